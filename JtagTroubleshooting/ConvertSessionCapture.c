@@ -0,0 +1,477 @@
+
+/* This tool converts a JtagDue session capture from its text form into binary files.
+
+   The session capture is only available if the firmware was configured with
+   switch --enable-session-capture . Console command "Capture dump" prints the capture
+   as text, and "Capture stream on" sends it continuously over the USB diagnostic port.
+   The input can contain other text, like the console prompt or the output of other commands,
+   only the lines between CAPTURE-BEGIN and CAPTURE-END are decoded. If the input contains
+   several captures, the last one wins. A stream does not need to end with CAPTURE-END.
+
+   The outputs are:
+   --capture <file>: The binary capture, the records back to back, see SessionCapture.h .
+   --host    <file>: All data the host sent, in order. You can replay a session by sending
+                      this file to the JtagDue, for example with:  cat host.bin >/dev/jtagdue1
+   --device  <file>: All data the JtagDue sent, in order. Compare it with the replies to a replay.
+   --list:           Print a line per record with a timestamp in microseconds since the first record.
+
+   Build it like this:
+     gcc -std=gnu99 -O2 -Wall -o ConvertSessionCapture ConvertSessionCapture.c
+
+   Usage examples:
+     ./ConvertSessionCapture --list <console-log.txt
+     ./ConvertSessionCapture --capture session.jdsc --host host.bin --device device.bin diag-port-log.txt
+
+   The timestamps wrap around every 2^32 clock cycles, so long gaps between records
+   are shown modulo that period.
+
+
+   Copyright (C) 2014 R. Diez
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the Affero GNU General Public License version 3
+   as published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Affero GNU General Public License version 3 for more details.
+
+   You should have received a copy of the Affero GNU General Public License version 3
+   along with this program. If not, see http://www.gnu.org/licenses/ .
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+
+// These values must match the firmware, see SessionCapture.h .
+#define RECORD_HEADER_LEN  7
+#define MAX_PAYLOAD_LEN    256
+#define FORMAT_VERSION     1
+
+enum
+{
+  scrCaptureHeader = 1,
+  scrConnectionOpened,
+  scrConnectionLost,
+  scrRxData,
+  scrTxData,
+  scrRecordsLost
+};
+
+// The firmware never generates this record type. It marks a place where the diagnostic port dropped
+// some output, so an unknown number of records is missing.
+#define RECORD_TYPE_STREAM_GAP  0xFF
+
+#define MAX_LINE_LEN  4096
+
+
+typedef struct
+{
+  uint8_t type;
+  uint32_t cycle_count;
+  uint16_t payload_len;
+  uint8_t payload[ MAX_PAYLOAD_LEN ];
+} capture_record;
+
+typedef struct
+{
+  capture_record * records;
+  size_t record_count;
+  size_t record_capacity;
+} capture;
+
+
+static void abort_with_error ( const char * const format, ... )
+{
+  va_list args;
+  va_start( args, format );
+  fprintf( stderr, "Error: " );
+  vfprintf( stderr, format, args );
+  fprintf( stderr, "\n" );
+  va_end( args );
+  exit( 1 );
+}
+
+
+static void clear_capture ( capture * const c )
+{
+  c->record_count = 0;
+}
+
+
+static capture_record * add_record ( capture * const c )
+{
+  if ( c->record_count == c->record_capacity )
+  {
+    c->record_capacity = c->record_capacity == 0 ? 1024 : c->record_capacity * 2;
+    c->records = realloc( c->records, c->record_capacity * sizeof( capture_record ) );
+
+    if ( c->records == NULL )
+      abort_with_error( "Out of memory." );
+  }
+
+  capture_record * const r = &c->records[ c->record_count ];
+  ++c->record_count;
+  memset( r, 0, sizeof( *r ) );
+  return r;
+}
+
+
+static int hex_digit_value ( const char c )
+{
+  if ( c >= '0' && c <= '9' )
+    return c - '0';
+
+  if ( c >= 'A' && c <= 'F' )
+    return c - 'A' + 10;
+
+  if ( c >= 'a' && c <= 'f' )
+    return c - 'a' + 10;
+
+  return -1;
+}
+
+
+static void parse_record_line ( const char * const hex, const unsigned line_number, capture * const c )
+{
+  uint8_t bytes[ RECORD_HEADER_LEN + MAX_PAYLOAD_LEN ];
+  size_t byte_count = 0;
+
+  for ( const char * p = hex; *p != 0 && !isspace( (unsigned char) *p ); p += 2 )
+  {
+    const int high = hex_digit_value( p[ 0 ] );
+    const int low  = high < 0 ? -1 : hex_digit_value( p[ 1 ] );
+
+    if ( low < 0 )
+      abort_with_error( "Line %u: Invalid hexadecimal data.", line_number );
+
+    if ( byte_count == sizeof( bytes ) )
+      abort_with_error( "Line %u: The record is too long.", line_number );
+
+    bytes[ byte_count ] = (uint8_t)( high * 16 + low );
+    ++byte_count;
+  }
+
+  if ( byte_count < RECORD_HEADER_LEN )
+    abort_with_error( "Line %u: The record is too short.", line_number );
+
+  const unsigned payload_len = bytes[ 5 ] | ( bytes[ 6 ] << 8 );
+
+  if ( payload_len != byte_count - RECORD_HEADER_LEN )
+    abort_with_error( "Line %u: The record length does not match its header.", line_number );
+
+  capture_record * const r = add_record( c );
+
+  r->type        = bytes[ 0 ];
+  r->cycle_count = (uint32_t) bytes[ 1 ]         |
+                   ( (uint32_t) bytes[ 2 ] << 8  ) |
+                   ( (uint32_t) bytes[ 3 ] << 16 ) |
+                   ( (uint32_t) bytes[ 4 ] << 24 );
+  r->payload_len = (uint16_t) payload_len;
+  memcpy( r->payload, bytes + RECORD_HEADER_LEN, payload_len );
+}
+
+
+// Returns the CPU clock found in the capture header.
+
+static uint32_t read_capture ( FILE * const input, capture * const c )
+{
+  char line[ MAX_LINE_LEN ];
+  unsigned line_number = 0;
+  bool is_inside_capture = false;
+  bool was_capture_found = false;
+
+  while ( fgets( line, sizeof( line ), input ) != NULL )
+  {
+    ++line_number;
+
+    if ( strchr( line, '\n' ) == NULL && !feof( input ) )
+      abort_with_error( "Line %u is too long.", line_number );
+
+    if ( strncmp( line, "CAPTURE-BEGIN", 13 ) == 0 )
+    {
+      clear_capture( c );
+      is_inside_capture = true;
+      was_capture_found = true;
+      continue;
+    }
+
+    if ( !is_inside_capture )
+      continue;
+
+    if ( strncmp( line, "CAPTURE-END", 11 ) == 0 )
+    {
+      is_inside_capture = false;
+      continue;
+    }
+
+    if ( strncmp( line, "CAPTURE-RECORD ", 15 ) == 0 )
+    {
+      parse_record_line( line + 15, line_number, c );
+      continue;
+    }
+
+    // See ReportDroppedData() in UsbDiagnosticPort.cpp .
+    if ( strstr( line, "bytes of diagnostic output lost]" ) != NULL )
+    {
+      fprintf( stderr, "Warning: Line %u: The diagnostic port dropped some output, some records are missing.\n", line_number );
+      add_record( c )->type = RECORD_TYPE_STREAM_GAP;
+    }
+  }
+
+  if ( ferror( input ) )
+    abort_with_error( "Cannot read the input: %s", strerror( errno ) );
+
+  if ( !was_capture_found )
+    abort_with_error( "The input contains no CAPTURE-BEGIN line." );
+
+  if ( c->record_count == 0 || c->records[ 0 ].type != scrCaptureHeader )
+    abort_with_error( "The capture does not start with a header record." );
+
+  const capture_record * const header = &c->records[ 0 ];
+
+  if ( header->payload_len != 9 || memcmp( header->payload, "JDSC", 4 ) != 0 )
+    abort_with_error( "The capture header record is invalid." );
+
+  if ( header->payload[ 4 ] != FORMAT_VERSION )
+    abort_with_error( "Unsupported capture format version %u.", header->payload[ 4 ] );
+
+  return (uint32_t) header->payload[ 5 ]         |
+         ( (uint32_t) header->payload[ 6 ] << 8  ) |
+         ( (uint32_t) header->payload[ 7 ] << 16 ) |
+         ( (uint32_t) header->payload[ 8 ] << 24 );
+}
+
+
+static FILE * open_output_file ( const char * const filename )
+{
+  FILE * const f = fopen( filename, "wb" );
+
+  if ( f == NULL )
+    abort_with_error( "Cannot create file \"%s\": %s", filename, strerror( errno ) );
+
+  return f;
+}
+
+
+static void write_data ( FILE * const f, const char * const filename, const void * const data, const size_t len )
+{
+  if ( len != 0 && fwrite( data, 1, len, f ) != len )
+    abort_with_error( "Cannot write to file \"%s\": %s", filename, strerror( errno ) );
+}
+
+
+static void close_output_file ( FILE * const f, const char * const filename )
+{
+  if ( fclose( f ) != 0 )
+    abort_with_error( "Cannot write to file \"%s\": %s", filename, strerror( errno ) );
+}
+
+
+static void write_capture_file ( const capture * const c, const char * const filename )
+{
+  FILE * const f = open_output_file( filename );
+
+  for ( size_t i = 0; i < c->record_count; ++i )
+  {
+    const capture_record * const r = &c->records[ i ];
+
+    // A scrRecordsLost record without payload stands for an unknown number of lost records.
+    const uint8_t type = r->type == RECORD_TYPE_STREAM_GAP ? scrRecordsLost : r->type;
+
+    const uint8_t header[ RECORD_HEADER_LEN ] = { type,
+                                                  (uint8_t) r->cycle_count,
+                                                  (uint8_t)( r->cycle_count >> 8  ),
+                                                  (uint8_t)( r->cycle_count >> 16 ),
+                                                  (uint8_t)( r->cycle_count >> 24 ),
+                                                  (uint8_t) r->payload_len,
+                                                  (uint8_t)( r->payload_len >> 8 ) };
+
+    write_data( f, filename, header, sizeof( header ) );
+    write_data( f, filename, r->payload, r->payload_len );
+  }
+
+  close_output_file( f, filename );
+}
+
+
+static void write_stream_file ( const capture * const c, const uint8_t record_type, const char * const filename )
+{
+  FILE * const f = open_output_file( filename );
+
+  for ( size_t i = 0; i < c->record_count; ++i )
+  {
+    const capture_record * const r = &c->records[ i ];
+
+    if ( r->type == record_type )
+      write_data( f, filename, r->payload, r->payload_len );
+  }
+
+  close_output_file( f, filename );
+}
+
+
+static const char * get_record_type_name ( const uint8_t type )
+{
+  switch ( type )
+  {
+  case scrCaptureHeader:       return "CaptureHeader";
+  case scrConnectionOpened:    return "ConnectionOpened";
+  case scrConnectionLost:      return "ConnectionLost";
+  case scrRxData:              return "HostToDevice";
+  case scrTxData:              return "DeviceToHost";
+  case scrRecordsLost:         return "RecordsLost";
+  case RECORD_TYPE_STREAM_GAP: return "StreamGap";
+  default:                     return "Unknown";
+  }
+}
+
+
+static void list_records ( const capture * const c, const uint32_t cpu_clock )
+{
+  // The capture header gets its timestamp when the capture is dumped or the stream starts,
+  // so it does not count for the elapsed time.
+
+  uint64_t elapsed_cycles = 0;
+  uint32_t prev_cycle_count = 0;
+  bool is_first = true;
+
+  for ( size_t i = 1; i < c->record_count; ++i )
+  {
+    const capture_record * const r = &c->records[ i ];
+
+    if ( r->type == RECORD_TYPE_STREAM_GAP )
+    {
+      printf( "(some records are missing here)\n" );
+      continue;
+    }
+
+    const uint32_t delta_cycles = is_first ? 0 : r->cycle_count - prev_cycle_count;
+    elapsed_cycles += delta_cycles;
+    prev_cycle_count = r->cycle_count;
+    is_first = false;
+
+    printf( "%12.3f us  (+%10.3f)  %s",
+            (double) elapsed_cycles * 1000000 / cpu_clock,
+            (double) delta_cycles   * 1000000 / cpu_clock,
+            get_record_type_name( r->type ) );
+
+    switch ( r->type )
+    {
+    case scrConnectionOpened:
+      if ( r->payload_len >= 1 )
+        printf( " channel=%u", r->payload[ 0 ] );
+      break;
+
+    case scrRecordsLost:
+      if ( r->payload_len >= 4 )
+        printf( " count=%u", (unsigned)( r->payload[ 0 ] | ( r->payload[ 1 ] << 8 ) | ( r->payload[ 2 ] << 16 ) | ( (uint32_t) r->payload[ 3 ] << 24 ) ) );
+      break;
+
+    case scrRxData:
+    case scrTxData:
+      {
+        printf( " len=%u data=", r->payload_len );
+
+        const unsigned MAX_SHOWN_BYTE_COUNT = 16;
+
+        for ( unsigned j = 0; j < r->payload_len && j < MAX_SHOWN_BYTE_COUNT; ++j )
+          printf( "%02X", r->payload[ j ] );
+
+        if ( r->payload_len > MAX_SHOWN_BYTE_COUNT )
+          printf( "..." );
+      }
+      break;
+
+    default:
+      break;
+    }
+
+    printf( "\n" );
+  }
+}
+
+
+static void print_usage ( void )
+{
+  fprintf( stderr, "Usage: ConvertSessionCapture [--capture <file>] [--host <file>] [--device <file>] [--list] [<input file>]\n" );
+  fprintf( stderr, "See this tool's source code for more information.\n" );
+}
+
+
+int main ( const int argc, char ** const argv )
+{
+  const char * capture_filename = NULL;
+  const char * host_filename    = NULL;
+  const char * device_filename  = NULL;
+  const char * input_filename   = NULL;
+  bool list = false;
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    const bool has_value = i + 1 < argc;
+
+    if ( strcmp( argv[ i ], "--capture" ) == 0 && has_value )
+      capture_filename = argv[ ++i ];
+    else if ( strcmp( argv[ i ], "--host" ) == 0 && has_value )
+      host_filename = argv[ ++i ];
+    else if ( strcmp( argv[ i ], "--device" ) == 0 && has_value )
+      device_filename = argv[ ++i ];
+    else if ( strcmp( argv[ i ], "--list" ) == 0 )
+      list = true;
+    else if ( argv[ i ][ 0 ] != '-' && input_filename == NULL )
+      input_filename = argv[ i ];
+    else
+    {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if ( capture_filename == NULL && host_filename == NULL && device_filename == NULL && !list )
+  {
+    print_usage();
+    return 1;
+  }
+
+  FILE * input = stdin;
+
+  if ( input_filename != NULL )
+  {
+    input = fopen( input_filename, "rb" );
+
+    if ( input == NULL )
+      abort_with_error( "Cannot open file \"%s\": %s", input_filename, strerror( errno ) );
+  }
+
+  capture c = { NULL, 0, 0 };
+
+  const uint32_t cpu_clock = read_capture( input, &c );
+
+  if ( input != stdin )
+    fclose( input );
+
+  if ( capture_filename != NULL )
+    write_capture_file( &c, capture_filename );
+
+  if ( host_filename != NULL )
+    write_stream_file( &c, scrRxData, host_filename );
+
+  if ( device_filename != NULL )
+    write_stream_file( &c, scrTxData, device_filename );
+
+  if ( list )
+    list_records( &c, cpu_clock );
+
+  free( c.records );
+
+  return 0;
+}
@@ -0,0 +1,490 @@
+
+/* This tool turns the tokenized log output of the JtagDue firmware back into text.
+
+   Tokenized logging is only available if the firmware was configured with
+   switch --enable-tokenized-log . The firmware then sends the address of each format string
+   in flash memory and the raw arguments, instead of the formatted text, see TokenizedLog.h .
+   This tool looks the format strings up in the firmware ELF file and formats the arguments
+   with the host's printf(). You must use the ELF file of the exact same build,
+   otherwise the output will be garbage.
+
+   Plain text in the input, like messages that were not tokenized, is passed through unchanged.
+   The input can be a file or a live serial port, the output is flushed after every line.
+
+   Build it like this:
+     gcc -std=gnu99 -O2 -Wall -o DecodeTokenizedLog DecodeTokenizedLog.c
+
+   Usage examples:
+     ./DecodeTokenizedLog jtagdue.elf serial-log.bin
+     stty -F /dev/ttyACM0 raw 115200 && ./DecodeTokenizedLog jtagdue.elf </dev/ttyACM0
+
+
+   Copyright (C) 2014 R. Diez
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the Affero GNU General Public License version 3
+   as published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Affero GNU General Public License version 3 for more details.
+
+   You should have received a copy of the Affero GNU General Public License version 3
+   along with this program. If not, see http://www.gnu.org/licenses/ .
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <elf.h>
+
+
+// These values must match the firmware, see TokenizedLog.h .
+#define FORMAT_MARKER  0xFE
+#define STRING_MARKER  0xFD
+
+#define MAX_SPEC_LEN  64
+
+
+typedef struct
+{
+  uint32_t address;
+  uint32_t size;
+  const uint8_t * data;
+} elf_section;
+
+typedef struct
+{
+  uint8_t * file_data;
+  elf_section * sections;
+  size_t section_count;
+} elf_image;
+
+
+static void abort_with_error ( const char * const format, ... )
+{
+  va_list args;
+  va_start( args, format );
+  fprintf( stderr, "Error: " );
+  vfprintf( stderr, format, args );
+  fprintf( stderr, "\n" );
+  va_end( args );
+  exit( 1 );
+}
+
+
+static void load_elf_file ( const char * const filename, elf_image * const image )
+{
+  FILE * const f = fopen( filename, "rb" );
+
+  if ( f == NULL )
+    abort_with_error( "Cannot open file \"%s\": %s", filename, strerror( errno ) );
+
+  if ( fseek( f, 0, SEEK_END ) != 0 )
+    abort_with_error( "Cannot seek in file \"%s\": %s", filename, strerror( errno ) );
+
+  const long file_size = ftell( f );
+  rewind( f );
+
+  image->file_data = malloc( file_size );
+
+  if ( image->file_data == NULL )
+    abort_with_error( "Out of memory." );
+
+  if ( fread( image->file_data, 1, file_size, f ) != (size_t) file_size )
+    abort_with_error( "Cannot read file \"%s\".", filename );
+
+  fclose( f );
+
+  // The JtagDue firmware is a 32-bit little-endian ARM ELF file, just like the hosts this tool normally runs on.
+  const Elf32_Ehdr * const header = (const Elf32_Ehdr *) image->file_data;
+
+  if ( file_size < (long) sizeof( Elf32_Ehdr ) ||
+       memcmp( header->e_ident, ELFMAG, SELFMAG ) != 0 ||
+       header->e_ident[ EI_CLASS ] != ELFCLASS32 ||
+       header->e_ident[ EI_DATA  ] != ELFDATA2LSB )
+  {
+    abort_with_error( "File \"%s\" is not a 32-bit little-endian ELF file.", filename );
+  }
+
+  if ( header->e_shoff + (uint64_t) header->e_shnum * sizeof( Elf32_Shdr ) > (uint64_t) file_size )
+    abort_with_error( "File \"%s\" has an invalid section header table.", filename );
+
+  const Elf32_Shdr * const section_headers = (const Elf32_Shdr *)( image->file_data + header->e_shoff );
+
+  image->sections = calloc( header->e_shnum, sizeof( elf_section ) );
+  image->section_count = 0;
+
+  if ( image->sections == NULL && header->e_shnum != 0 )
+    abort_with_error( "Out of memory." );
+
+  for ( unsigned i = 0; i < header->e_shnum; ++i )
+  {
+    const Elf32_Shdr * const sh = &section_headers[ i ];
+
+    if ( sh->sh_type != SHT_PROGBITS || ( sh->sh_flags & SHF_ALLOC ) == 0 )
+      continue;
+
+    if ( sh->sh_offset + (uint64_t) sh->sh_size > (uint64_t) file_size )
+      abort_with_error( "File \"%s\" has an invalid section.", filename );
+
+    elf_section * const s = &image->sections[ image->section_count ];
+    ++image->section_count;
+
+    s->address = sh->sh_addr;
+    s->size    = sh->sh_size;
+    s->data    = image->file_data + sh->sh_offset;
+  }
+}
+
+
+// Returns NULL if the address does not point to a null-terminated string in the ELF file.
+
+static const char * find_string ( const elf_image * const image, const uint32_t address )
+{
+  for ( size_t i = 0; i < image->section_count; ++i )
+  {
+    const elf_section * const s = &image->sections[ i ];
+
+    if ( address < s->address || address >= s->address + s->size )
+      continue;
+
+    const uint32_t offset = address - s->address;
+    const char * const str = (const char *)( s->data + offset );
+
+    if ( memchr( str, 0, s->size - offset ) == NULL )
+      return NULL;
+
+    return str;
+  }
+
+  return NULL;
+}
+
+
+static int read_byte ( FILE * const input )
+{
+  const int c = getc( input );
+
+  if ( c == EOF )
+  {
+    printf( "<truncated tokenized log record>\n" );
+    fflush( stdout );
+    exit( 0 );
+  }
+
+  return c;
+}
+
+
+static uint64_t read_leb128 ( FILE * const input )
+{
+  uint64_t value = 0;
+
+  for ( unsigned shift = 0; ; shift += 7 )
+  {
+    const int c = read_byte( input );
+
+    if ( shift < 64 )
+      value |= (uint64_t)( c & 0x7F ) << shift;
+
+    if ( ( c & 0x80 ) == 0 )
+      return value;
+  }
+}
+
+
+static double read_double ( FILE * const input )
+{
+  uint8_t bytes[ sizeof( double ) ];
+
+  for ( unsigned i = 0; i < sizeof( bytes ); ++i )
+    bytes[ i ] = (uint8_t) read_byte( input );
+
+  double value;
+  memcpy( &value, bytes, sizeof( value ) );
+  return value;
+}
+
+
+static void append_to_spec ( char * const spec, size_t * const spec_len, const char * const str, const size_t len )
+{
+  if ( *spec_len + len >= MAX_SPEC_LEN )
+    abort_with_error( "Format specification too long." );
+
+  memcpy( spec + *spec_len, str, len );
+  *spec_len += len;
+  spec[ *spec_len ] = 0;
+}
+
+
+// This parser must match the one in the firmware, see TokenizedLog_PrintV().
+// Each conversion is rebuilt as a separate host printf() format specification,
+// with the '*' arguments replaced by their values, and with length modifiers
+// that match the host's argument types.
+
+static void print_format_record ( const char * const format_str, FILE * const input )
+{
+  for ( const char * p = format_str; *p != 0; ++p )
+  {
+    if ( *p != '%' )
+    {
+      putchar( *p );
+      continue;
+    }
+
+    char spec[ MAX_SPEC_LEN ] = "%";
+    size_t spec_len = 1;
+
+    ++p;
+
+    const char * const flags_begin = p;
+
+    while ( *p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' )
+      ++p;
+
+    append_to_spec( spec, &spec_len, flags_begin, p - flags_begin );
+
+    char number[ 16 ];
+
+    if ( *p == '*' )
+    {
+      const int width = (int) (uint32_t) read_leb128( input );
+      append_to_spec( spec, &spec_len, number, snprintf( number, sizeof( number ), "%d", width ) );
+      ++p;
+    }
+    else
+    {
+      const char * const width_begin = p;
+
+      while ( *p >= '0' && *p <= '9' )
+        ++p;
+
+      append_to_spec( spec, &spec_len, width_begin, p - width_begin );
+    }
+
+    if ( *p == '.' )
+    {
+      ++p;
+
+      if ( *p == '*' )
+      {
+        // A negative precision means no precision at all.
+        const int precision = (int) (uint32_t) read_leb128( input );
+
+        if ( precision >= 0 )
+          append_to_spec( spec, &spec_len, number, snprintf( number, sizeof( number ), ".%d", precision ) );
+
+        ++p;
+      }
+      else
+      {
+        const char * const precision_begin = p;
+
+        while ( *p >= '0' && *p <= '9' )
+          ++p;
+
+        append_to_spec( spec, &spec_len, ".", 1 );
+        append_to_spec( spec, &spec_len, precision_begin, p - precision_begin );
+      }
+    }
+
+    unsigned long_count = 0;
+    unsigned short_count = 0;
+
+    for ( ; ; ++p )
+    {
+      if ( *p == 'z' || *p == 't' )
+        continue;
+
+      if ( *p == 'h' )
+      {
+        ++short_count;
+        continue;
+      }
+
+      if ( *p == 'l' )
+      {
+        ++long_count;
+        continue;
+      }
+
+      if ( *p == 'j' )
+      {
+        long_count = 2;
+        continue;
+      }
+
+      break;
+    }
+
+    const char conversion = *p;
+
+    switch ( conversion )
+    {
+    case '%':
+      putchar( '%' );
+      break;
+
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    case 'c':
+      {
+        const uint64_t value = read_leb128( input );
+
+        if ( long_count >= 2 )
+        {
+          append_to_spec( spec, &spec_len, "ll", 2 );
+          append_to_spec( spec, &spec_len, &conversion, 1 );
+          printf( spec, (long long) value );
+        }
+        else
+        {
+          // The "h" modifiers make printf() truncate the value as the firmware would.
+          append_to_spec( spec, &spec_len, "hh", short_count > 2 ? 2 : short_count );
+          append_to_spec( spec, &spec_len, &conversion, 1 );
+          printf( spec, (int) (uint32_t) value );
+        }
+      }
+      break;
+
+    case 'p':
+      // The host's "%p" would print a 64-bit pointer differently, so use the same format as newlib.
+      printf( "0x%x", (unsigned) read_leb128( input ) );
+      break;
+
+    case 's':
+      {
+        const uint64_t len = read_leb128( input );
+
+        char * const str = malloc( len + 1 );
+
+        if ( str == NULL )
+          abort_with_error( "Out of memory." );
+
+        for ( uint64_t i = 0; i < len; ++i )
+          str[ i ] = (char) read_byte( input );
+
+        str[ len ] = 0;
+
+        append_to_spec( spec, &spec_len, "s", 1 );
+        printf( spec, str );
+        free( str );
+      }
+      break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      append_to_spec( spec, &spec_len, &conversion, 1 );
+      printf( spec, read_double( input ) );
+      break;
+
+    default:
+      // The firmware never tokenizes such format strings, so the ELF file probably does not match.
+      printf( "<unsupported conversion in tokenized log record>\n" );
+      return;
+    }
+  }
+}
+
+
+static void decode_log ( FILE * const input, const elf_image * const image )
+{
+  for ( ; ; )
+  {
+    const int c = getc( input );
+
+    if ( c == EOF )
+      break;
+
+    if ( c != FORMAT_MARKER && c != STRING_MARKER )
+    {
+      putchar( c );
+
+      if ( c == '\n' )
+        fflush( stdout );
+
+      continue;
+    }
+
+    uint32_t address = 0;
+
+    for ( unsigned i = 0; i < 3; ++i )
+      address |= (uint32_t) read_byte( input ) << ( i * 8 );
+
+    const char * const str = find_string( image, address );
+
+    if ( str == NULL )
+    {
+      // The argument bytes that follow, if any, will be printed as garbage.
+      printf( "<unknown tokenized log string address 0x%06X>\n", (unsigned) address );
+    }
+    else if ( c == STRING_MARKER )
+    {
+      fputs( str, stdout );
+    }
+    else
+    {
+      print_format_record( str, input );
+    }
+
+    fflush( stdout );
+  }
+
+  fflush( stdout );
+}
+
+
+static void print_usage ( void )
+{
+  fprintf( stderr, "Usage: DecodeTokenizedLog <firmware ELF file> [<input file>]\n" );
+  fprintf( stderr, "See this tool's source code for more information.\n" );
+}
+
+
+int main ( const int argc, char ** const argv )
+{
+  if ( argc < 2 || argc > 3 )
+  {
+    print_usage();
+    return 1;
+  }
+
+  elf_image image;
+  load_elf_file( argv[ 1 ], &image );
+
+  FILE * input = stdin;
+
+  if ( argc == 3 )
+  {
+    input = fopen( argv[ 2 ], "rb" );
+
+    if ( input == NULL )
+      abort_with_error( "Cannot open file \"%s\": %s", argv[ 2 ], strerror( errno ) );
+  }
+
+  decode_log( input, &image );
+
+  if ( input != stdin )
+    fclose( input );
+
+  free( image.sections );
+  free( image.file_data );
+
+  return 0;
+}
@@ -0,0 +1,164 @@
+#!/bin/bash
+
+# This script decodes the trace ring dump that the JtagDue firmware prints with console command "Trace".
+#
+# Script arguments:  [<dump filename>]
+#
+# Without a filename, the dump is read from stdin. The input can contain other text, like
+# the console prompt or the output of other commands, only the lines between TRACE-BEGIN
+# and TRACE-END are decoded. The carriage return characters of the console output are ignored.
+#
+# Example:
+#   ./DecodeTraceDump.sh console-log.txt
+#
+# Each output line shows the time since the first record in microseconds, the time since
+# the previous record, the event name and its arguments. The timestamps in the dump wrap around
+# every 2^32 clock cycles, so long gaps between records are shown modulo that period.
+#
+#
+# Copyright (C) 2014 R. Diez
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the Affero GNU General Public License version 3
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# Affero GNU General Public License version 3 for more details.
+#
+# You should have received a copy of the Affero GNU General Public License version 3
+# along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+set -o errexit
+set -o pipefail
+set -o nounset
+set -o posix
+
+# set -x  # Enable tracing of this script.
+
+abort ()
+{
+    echo >&2 && echo "Error in script \"$0\": $*" >&2
+    exit 1
+}
+
+
+if (( $# > 1 )); then
+  abort "Invalid number of command-line arguments. See this script's source code for more information."
+fi
+
+INPUT_FILENAME="${1:--}"
+
+# Plain POSIX awk has no hexadecimal number parsing, hence routine hex_to_number().
+
+AWK_PROGRAM='
+
+function hex_to_number ( str,    result, i, digit )
+{
+  result = 0
+
+  for ( i = 1; i <= length( str ); ++i )
+  {
+    digit = index( "0123456789ABCDEF", toupper( substr( str, i, 1 ) ) )
+
+    if ( digit == 0 )
+    {
+      print "Invalid hexadecimal number \"" str "\"." > "/dev/stderr"
+      exit 1
+    }
+
+    result = result * 16 + digit - 1
+  }
+
+  return result
+}
+
+function format_arg ( name, hexValue )
+{
+  if ( name == "-" )
+    return ""
+
+  if ( name == "firstBytes" )
+    return " " name "=0x" hexValue
+
+  return " " name "=" hex_to_number( hexValue )
+}
+
+{
+  sub( /\r$/, "" )
+}
+
+$1 == "TRACE-BEGIN" {
+  isInsideDump = 1
+  cpuClock = 0
+  recordCount = 0
+  delete eventNames
+  delete arg1Names
+  delete arg2Names
+
+  for ( i = 2; i <= NF; ++i )
+  {
+    split( $i, keyAndValue, "=" )
+
+    if ( keyAndValue[ 1 ] == "cpu-clock" )
+      cpuClock = keyAndValue[ 2 ] + 0
+    else if ( keyAndValue[ 1 ] == "skipped" && keyAndValue[ 2 ] != "0" )
+      print "(" keyAndValue[ 2 ] " older records are not in the dump)"
+  }
+
+  if ( cpuClock == 0 )
+  {
+    print "The TRACE-BEGIN line has no CPU clock." > "/dev/stderr"
+    exit 1
+  }
+
+  next
+}
+
+! isInsideDump {
+  next
+}
+
+$1 == "TRACE-EVENT" {
+  eventNames[ $2 ] = $3
+  arg1Names [ $2 ] = $4
+  arg2Names [ $2 ] = $5
+  next
+}
+
+$1 == "TRACE-RECORD" {
+  cycleCount = hex_to_number( $2 )
+  eventId = $3
+
+  if ( recordCount == 0 )
+  {
+    elapsedCycles = 0
+    deltaCycles = 0
+  }
+  else
+  {
+    deltaCycles = ( cycleCount - prevCycleCount + 4294967296 ) % 4294967296
+    elapsedCycles += deltaCycles
+  }
+
+  prevCycleCount = cycleCount
+  ++recordCount
+
+  if ( eventId in eventNames )
+    text = eventNames[ eventId ] format_arg( arg1Names[ eventId ], $4 ) format_arg( arg2Names[ eventId ], $5 )
+  else
+    text = "UnknownEvent" eventId " arg1=0x" $4 " arg2=0x" $5
+
+  printf "%12.3f us  (+%10.3f)  %s\n", elapsedCycles * 1000000 / cpuClock, deltaCycles * 1000000 / cpuClock, text
+  next
+}
+
+$1 == "TRACE-END" {
+  isInsideDump = 0
+  next
+}
+'
+
+awk "$AWK_PROGRAM" "$INPUT_FILENAME"
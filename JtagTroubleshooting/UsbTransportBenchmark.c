@@ -0,0 +1,653 @@
+
+/* This tool measures the round-trip latency and the throughput of the JtagDue firmware
+   over the two USB transports it can offer: the CDC virtual serial port (through the host's
+   tty layer) and the optional vendor-specific bulk interface (through libusb).
+
+   The vendor-specific interface is only available if the firmware was configured with
+   switch --enable-usb-vendor-interface .
+
+   The test commands are regular Bus Pirate OpenOCD mode commands:
+   - Latency:    CMD_UART_SPEED, which only generates a 2-byte reply.
+   - Throughput: CMD_TAP_SHIFT with the maximum bit count of 0x2000.
+   The JTAG pins are left in high-impedance mode, so it is safe to run this test
+   with a target connected. The shifted data is meaningless.
+
+   Build it like this:
+     gcc -std=gnu99 -O2 -Wall -o UsbTransportBenchmark UsbTransportBenchmark.c $(pkg-config --cflags --libs libusb-1.0)
+
+   Usage examples:
+     ./UsbTransportBenchmark --cdc /dev/jtagdue1
+     ./UsbTransportBenchmark --vendor
+     ./UsbTransportBenchmark --vendor 2341:1237
+     ./UsbTransportBenchmark --cdc /dev/jtagdue1 --vendor --iterations 2000
+
+
+   Copyright (C) 2014 R. Diez
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the Affero GNU General Public License version 3
+   as published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   Affero GNU General Public License version 3 for more details.
+
+   You should have received a copy of the Affero GNU General Public License version 3
+   along with this program. If not, see http://www.gnu.org/licenses/ .
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include <libusb.h>
+
+
+// These values must match the firmware, see configure.ac . Each combination of optional USB interfaces
+// gets its own PID, and the interface and endpoint numbers differ too, see conf_usb.h .
+// Therefore, this tool looks for the vendor-specific interface in the USB descriptors.
+#define JTAGDUE_VENDOR_ID  0x2341
+
+static const uint16_t JTAGDUE_PRODUCT_IDS[] = { 0x1234, 0x1235, 0x1236, 0x1237 };
+
+#define BIN_MODE_CHAR   0x00
+#define OOCD_MODE_CHAR  0x06
+#define CMD_TAP_SHIFT   0x05
+#define CMD_UART_SPEED  0x07
+
+#define TAP_SHIFT_BIT_COUNT  0x2000
+#define TAP_SHIFT_BYTE_COUNT ( TAP_SHIFT_BIT_COUNT / 8 )
+
+static const int IO_TIMEOUT_MS = 2000;
+static const int STALE_DATA_TIMEOUT_MS = 100;
+
+
+static void abort_with_error ( const char * const format, ... )
+{
+  va_list args;
+  va_start( args, format );
+  fprintf( stderr, "Error: " );
+  vfprintf( stderr, format, args );
+  fprintf( stderr, "\n" );
+  va_end( args );
+  exit( 1 );
+}
+
+
+static double get_monotonic_time_us ( void )
+{
+  struct timespec ts;
+
+  if ( 0 != clock_gettime( CLOCK_MONOTONIC, &ts ) )
+    abort_with_error( "Cannot read the monotonic clock: %s", strerror( errno ) );
+
+  return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+// ------------------ Transport abstraction ------------------
+
+typedef struct transport
+{
+  const char * name;
+
+  void   ( * write_all ) ( struct transport * t, const uint8_t * data, size_t len );
+
+  // Returns the number of bytes read, which can be less than 'len' on time-out.
+  size_t ( * read_some ) ( struct transport * t, uint8_t * data, size_t len, int timeout_ms );
+
+  void   ( * close      ) ( struct transport * t );
+
+  int fd;
+
+  libusb_context       * usb_context;
+  libusb_device_handle * usb_handle;
+  int                    usb_interface_number;
+  uint8_t                usb_ep_bulk_in;
+  uint8_t                usb_ep_bulk_out;
+
+  // libusb needs read requests in multiples of the packet size, or it may report an overflow.
+  // Any data beyond what the caller asked for is kept here.
+  uint8_t usb_rx_buffer[ 16 * 1024 ];
+  size_t  usb_rx_pos;
+  size_t  usb_rx_len;
+
+} transport;
+
+
+static void read_exact ( transport * const t, uint8_t * const data, const size_t len )
+{
+  size_t pos = 0;
+
+  while ( pos < len )
+  {
+    const size_t read_count = t->read_some( t, data + pos, len - pos, IO_TIMEOUT_MS );
+
+    if ( read_count == 0 )
+      abort_with_error( "Time-out reading from the %s transport, got %zu bytes of %zu.", t->name, pos, len );
+
+    pos += read_count;
+  }
+}
+
+
+static void discard_stale_data ( transport * const t )
+{
+  uint8_t buffer[ 512 ];
+
+  while ( t->read_some( t, buffer, sizeof( buffer ), STALE_DATA_TIMEOUT_MS ) != 0 )
+  {
+  }
+}
+
+
+// ------------------ CDC transport ------------------
+
+static void cdc_write_all ( transport * const t, const uint8_t * const data, const size_t len )
+{
+  size_t pos = 0;
+
+  while ( pos < len )
+  {
+    const ssize_t written = write( t->fd, data + pos, len - pos );
+
+    if ( written < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+
+      abort_with_error( "Cannot write to the serial port: %s", strerror( errno ) );
+    }
+
+    pos += (size_t) written;
+  }
+}
+
+
+static size_t cdc_read_some ( transport * const t, uint8_t * const data, const size_t len, const int timeout_ms )
+{
+  struct pollfd pfd;
+  pfd.fd      = t->fd;
+  pfd.events  = POLLIN;
+  pfd.revents = 0;
+
+  const int poll_res = poll( &pfd, 1, timeout_ms );
+
+  if ( poll_res < 0 )
+    abort_with_error( "Error waiting for serial port data: %s", strerror( errno ) );
+
+  if ( poll_res == 0 )
+    return 0;
+
+  const ssize_t read_count = read( t->fd, data, len );
+
+  if ( read_count < 0 )
+    abort_with_error( "Cannot read from the serial port: %s", strerror( errno ) );
+
+  return (size_t) read_count;
+}
+
+
+static void cdc_close ( transport * const t )
+{
+  close( t->fd );
+  t->fd = -1;
+}
+
+
+static void cdc_open ( transport * const t, const char * const device_filename )
+{
+  memset( t, 0, sizeof( *t ) );
+  t->name      = "CDC";
+  t->write_all = cdc_write_all;
+  t->read_some = cdc_read_some;
+  t->close     = cdc_close;
+
+  // Opening the port sets DTR, which is what the firmware waits for.
+  t->fd = open( device_filename, O_RDWR | O_NOCTTY );
+
+  if ( t->fd == -1 )
+    abort_with_error( "Cannot open serial port \"%s\": %s", device_filename, strerror( errno ) );
+
+  struct termios tio;
+
+  if ( 0 != tcgetattr( t->fd, &tio ) )
+    abort_with_error( "Cannot read the serial port settings: %s", strerror( errno ) );
+
+  cfmakeraw( &tio );
+
+  if ( 0 != tcsetattr( t->fd, TCSANOW, &tio ) )
+    abort_with_error( "Cannot configure the serial port: %s", strerror( errno ) );
+
+  tcflush( t->fd, TCIOFLUSH );
+}
+
+
+// ------------------ Vendor-specific interface transport ------------------
+
+static void vendor_write_all ( transport * const t, const uint8_t * const data, const size_t len )
+{
+  int transferred;
+  const int res = libusb_bulk_transfer( t->usb_handle, t->usb_ep_bulk_out, (uint8_t *) data, (int) len, &transferred, IO_TIMEOUT_MS );
+
+  if ( res != 0 )
+    abort_with_error( "Cannot write to the vendor interface: %s", libusb_error_name( res ) );
+
+  if ( (size_t) transferred != len )
+    abort_with_error( "Short write to the vendor interface, %d bytes of %zu.", transferred, len );
+}
+
+
+static size_t vendor_read_some ( transport * const t, uint8_t * const data, const size_t len, const int timeout_ms )
+{
+  if ( t->usb_rx_pos == t->usb_rx_len )
+  {
+    int transferred;
+    const int res = libusb_bulk_transfer( t->usb_handle, t->usb_ep_bulk_in, t->usb_rx_buffer, sizeof( t->usb_rx_buffer ), &transferred, timeout_ms );
+
+    if ( res == LIBUSB_ERROR_TIMEOUT && transferred == 0 )
+      return 0;
+
+    if ( res != 0 && res != LIBUSB_ERROR_TIMEOUT )
+      abort_with_error( "Cannot read from the vendor interface: %s", libusb_error_name( res ) );
+
+    t->usb_rx_pos = 0;
+    t->usb_rx_len = (size_t) transferred;
+  }
+
+  const size_t available = t->usb_rx_len - t->usb_rx_pos;
+  const size_t count = len < available ? len : available;
+
+  memcpy( data, t->usb_rx_buffer + t->usb_rx_pos, count );
+  t->usb_rx_pos += count;
+
+  return count;
+}
+
+
+static void vendor_close ( transport * const t )
+{
+  // Selecting alternate setting 0 closes the channel on the firmware side.
+  libusb_set_interface_alt_setting( t->usb_handle, t->usb_interface_number, 0 );
+  libusb_release_interface( t->usb_handle, t->usb_interface_number );
+  libusb_close( t->usb_handle );
+  libusb_exit( t->usb_context );
+  t->usb_handle  = NULL;
+  t->usb_context = NULL;
+}
+
+
+// Looks for an interface with vendor-specific class that has a bulk IN and a bulk OUT endpoint
+// in its alternate setting 1. Alternate setting 0 has no endpoints, see the firmware's conf_usb.h .
+// Returns false if the device has no such interface.
+
+static bool find_vendor_interface ( transport * const t, libusb_device * const dev )
+{
+  struct libusb_config_descriptor * config;
+
+  if ( 0 != libusb_get_active_config_descriptor( dev, &config ) )
+    return false;
+
+  bool found = false;
+
+  for ( int i = 0; i < config->bNumInterfaces && !found; ++i )
+  {
+    const struct libusb_interface * const iface = &config->interface[ i ];
+
+    for ( int a = 0; a < iface->num_altsetting && !found; ++a )
+    {
+      const struct libusb_interface_descriptor * const alt = &iface->altsetting[ a ];
+
+      if ( alt->bInterfaceClass != LIBUSB_CLASS_VENDOR_SPEC || alt->bAlternateSetting != 1 )
+        continue;
+
+      int ep_in  = -1;
+      int ep_out = -1;
+
+      for ( int e = 0; e < alt->bNumEndpoints; ++e )
+      {
+        const struct libusb_endpoint_descriptor * const ep = &alt->endpoint[ e ];
+
+        if ( ( ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK ) != LIBUSB_TRANSFER_TYPE_BULK )
+          continue;
+
+        if ( ( ep->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK ) == LIBUSB_ENDPOINT_IN )
+          ep_in = ep->bEndpointAddress;
+        else
+          ep_out = ep->bEndpointAddress;
+      }
+
+      if ( ep_in != -1 && ep_out != -1 )
+      {
+        t->usb_interface_number = alt->bInterfaceNumber;
+        t->usb_ep_bulk_in       = (uint8_t) ep_in;
+        t->usb_ep_bulk_out      = (uint8_t) ep_out;
+        found = true;
+      }
+    }
+  }
+
+  libusb_free_config_descriptor( config );
+
+  return found;
+}
+
+
+static bool is_matching_device ( const struct libusb_device_descriptor * const desc,
+                                 const uint16_t vendor_id,
+                                 const uint16_t product_id )
+{
+  if ( desc->idVendor != vendor_id )
+    return false;
+
+  // A product ID of 0 means any of the JtagDue firmware's product IDs.
+  if ( product_id != 0 )
+    return desc->idProduct == product_id;
+
+  for ( size_t i = 0; i < sizeof( JTAGDUE_PRODUCT_IDS ) / sizeof( JTAGDUE_PRODUCT_IDS[ 0 ] ); ++i )
+  {
+    if ( desc->idProduct == JTAGDUE_PRODUCT_IDS[ i ] )
+      return true;
+  }
+
+  return false;
+}
+
+
+static void vendor_open ( transport * const t, const uint16_t vendor_id, const uint16_t product_id )
+{
+  memset( t, 0, sizeof( *t ) );
+  t->name      = "vendor";
+  t->write_all = vendor_write_all;
+  t->read_some = vendor_read_some;
+  t->close     = vendor_close;
+  t->fd        = -1;
+
+  int res = libusb_init( &t->usb_context );
+
+  if ( res != 0 )
+    abort_with_error( "Cannot initialise libusb: %s", libusb_error_name( res ) );
+
+  libusb_device ** dev_list;
+  const ssize_t dev_count = libusb_get_device_list( t->usb_context, &dev_list );
+
+  if ( dev_count < 0 )
+    abort_with_error( "Cannot list the USB devices: %s", libusb_error_name( (int) dev_count ) );
+
+  bool was_device_found = false;
+
+  for ( ssize_t i = 0; i < dev_count && t->usb_handle == NULL; ++i )
+  {
+    struct libusb_device_descriptor desc;
+
+    if ( 0 != libusb_get_device_descriptor( dev_list[ i ], &desc ) ||
+         !is_matching_device( &desc, vendor_id, product_id ) )
+    {
+      continue;
+    }
+
+    was_device_found = true;
+
+    if ( !find_vendor_interface( t, dev_list[ i ] ) )
+      continue;
+
+    res = libusb_open( dev_list[ i ], &t->usb_handle );
+
+    if ( res != 0 )
+      abort_with_error( "Cannot open USB device %04x:%04x: %s. Do you have permission to access it?",
+                        desc.idVendor, desc.idProduct, libusb_error_name( res ) );
+  }
+
+  libusb_free_device_list( dev_list, 1 );
+
+  if ( t->usb_handle == NULL )
+  {
+    if ( was_device_found )
+      abort_with_error( "The JtagDue USB device has no vendor-specific interface. Is the firmware built with switch --enable-usb-vendor-interface ?" );
+    else
+      abort_with_error( "Cannot find the JtagDue USB device." );
+  }
+
+  res = libusb_claim_interface( t->usb_handle, t->usb_interface_number );
+
+  if ( res != 0 )
+    abort_with_error( "Cannot claim the vendor interface: %s", libusb_error_name( res ) );
+
+  // Selecting alternate setting 1 opens the channel on the firmware side. Going through alternate setting 0
+  // first makes sure that any stale session from a previous client is closed.
+
+  res = libusb_set_interface_alt_setting( t->usb_handle, t->usb_interface_number, 0 );
+
+  if ( res == 0 )
+    res = libusb_set_interface_alt_setting( t->usb_handle, t->usb_interface_number, 1 );
+
+  if ( res != 0 )
+    abort_with_error( "Cannot select the vendor interface alternate setting: %s", libusb_error_name( res ) );
+}
+
+
+// ------------------ Benchmark ------------------
+
+static void expect_reply ( transport * const t, const char * const expected )
+{
+  const size_t len = strlen( expected );
+  uint8_t reply[ 16 ];
+
+  read_exact( t, reply, len );
+
+  if ( 0 != memcmp( reply, expected, len ) )
+    abort_with_error( "Unexpected reply from the %s transport, expected \"%s\".", t->name, expected );
+}
+
+
+static void enter_open_ocd_mode ( transport * const t )
+{
+  // The firmware takes a few milliseconds to consider the connection stable.
+  usleep( 200 * 1000 );
+
+  discard_stale_data( t );
+
+  uint8_t bin_mode_request[ 20 ];
+  memset( bin_mode_request, BIN_MODE_CHAR, sizeof( bin_mode_request ) );
+  t->write_all( t, bin_mode_request, sizeof( bin_mode_request ) );
+  expect_reply( t, "BBIO1" );
+
+  const uint8_t oocd_mode_request = OOCD_MODE_CHAR;
+  t->write_all( t, &oocd_mode_request, 1 );
+  expect_reply( t, "OCD1" );
+}
+
+
+static void leave_open_ocd_mode ( transport * const t )
+{
+  const uint8_t bin_mode_request = BIN_MODE_CHAR;
+  t->write_all( t, &bin_mode_request, 1 );
+  expect_reply( t, "BBIO1" );
+
+  const uint8_t console_mode_request = 0x0F;
+  t->write_all( t, &console_mode_request, 1 );
+
+  discard_stale_data( t );
+}
+
+
+static int compare_doubles ( const void * const a, const void * const b )
+{
+  const double da = *(const double *) a;
+  const double db = *(const double *) b;
+  return ( da > db ) - ( da < db );
+}
+
+
+static void measure_latency ( transport * const t, const unsigned iteration_count )
+{
+  double * const samples = malloc( iteration_count * sizeof( double ) );
+
+  if ( samples == NULL )
+    abort_with_error( "Out of memory." );
+
+  const uint8_t request[ 4 ] = { CMD_UART_SPEED, 0 /* SERIAL_NORMAL */, 0xAA, 0x55 };
+  uint8_t reply[ 2 ];
+
+  for ( unsigned i = 0; i < iteration_count; ++i )
+  {
+    const double start = get_monotonic_time_us();
+
+    t->write_all( t, request, sizeof( request ) );
+    read_exact( t, reply, sizeof( reply ) );
+
+    samples[ i ] = get_monotonic_time_us() - start;
+
+    if ( reply[ 0 ] != CMD_UART_SPEED )
+      abort_with_error( "Unexpected reply to CMD_UART_SPEED." );
+  }
+
+  qsort( samples, iteration_count, sizeof( double ), compare_doubles );
+
+  double sum = 0;
+  for ( unsigned i = 0; i < iteration_count; ++i )
+    sum += samples[ i ];
+
+  printf( "%-6s round-trip latency over %u commands: min %.0f us, median %.0f us, 99%% %.0f us, max %.0f us, average %.0f us\n",
+          t->name,
+          iteration_count,
+          samples[ 0 ],
+          samples[ iteration_count / 2 ],
+          samples[ ( iteration_count * 99 ) / 100 ],
+          samples[ iteration_count - 1 ],
+          sum / iteration_count );
+
+  free( samples );
+}
+
+
+static void measure_throughput ( transport * const t, const unsigned iteration_count )
+{
+  static uint8_t request[ 3 + TAP_SHIFT_BYTE_COUNT * 2 ];
+  static uint8_t reply  [ 3 + TAP_SHIFT_BYTE_COUNT ];
+
+  request[ 0 ] = CMD_TAP_SHIFT;
+  request[ 1 ] = TAP_SHIFT_BIT_COUNT >> 8;
+  request[ 2 ] = TAP_SHIFT_BIT_COUNT & 0xFF;
+
+  // TDI and TMS bytes are interleaved. Keep TMS low, so that a connected TAP would stay where it is.
+  for ( unsigned i = 0; i < TAP_SHIFT_BYTE_COUNT; ++i )
+  {
+    request[ 3 + i * 2 + 0 ] = (uint8_t) i;
+    request[ 3 + i * 2 + 1 ] = 0;
+  }
+
+  const double start = get_monotonic_time_us();
+
+  for ( unsigned i = 0; i < iteration_count; ++i )
+  {
+    t->write_all( t, request, sizeof( request ) );
+    read_exact( t, reply, sizeof( reply ) );
+
+    if ( reply[ 0 ] != CMD_TAP_SHIFT )
+      abort_with_error( "Unexpected reply to CMD_TAP_SHIFT." );
+  }
+
+  const double elapsed_s = ( get_monotonic_time_us() - start ) / 1000000.0;
+
+  const double usb_byte_count = (double) iteration_count * ( sizeof( request ) + sizeof( reply ) );
+  const double jtag_bit_count = (double) iteration_count * TAP_SHIFT_BIT_COUNT;
+
+  printf( "%-6s throughput over %u shift commands: %.1f KiB/s USB payload, %.1f Kbit/s JTAG data\n",
+          t->name,
+          iteration_count,
+          usb_byte_count / 1024 / elapsed_s,
+          jtag_bit_count / 1000 / elapsed_s );
+}
+
+
+static void run_benchmark ( transport * const t, const unsigned latency_iteration_count, const unsigned throughput_iteration_count )
+{
+  enter_open_ocd_mode( t );
+  measure_latency( t, latency_iteration_count );
+  measure_throughput( t, throughput_iteration_count );
+  leave_open_ocd_mode( t );
+}
+
+
+static void print_usage ( void )
+{
+  printf( "Usage: UsbTransportBenchmark [--cdc <serial port>] [--vendor [<vid>:<pid>]] [--iterations <count>]\n" );
+}
+
+
+int main ( const int argc, char ** const argv )
+{
+  const char * cdc_device = NULL;
+  bool use_vendor = false;
+  unsigned vendor_id  = JTAGDUE_VENDOR_ID;
+  unsigned product_id = 0;  // Any of the JtagDue firmware's product IDs.
+  unsigned iteration_count = 1000;
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    if ( 0 == strcmp( argv[ i ], "--cdc" ) && i + 1 < argc )
+    {
+      cdc_device = argv[ ++i ];
+    }
+    else if ( 0 == strcmp( argv[ i ], "--vendor" ) )
+    {
+      use_vendor = true;
+
+      if ( i + 1 < argc && argv[ i + 1 ][ 0 ] != '-' )
+      {
+        if ( 2 != sscanf( argv[ ++i ], "%x:%x", &vendor_id, &product_id ) )
+          abort_with_error( "Invalid USB device ID \"%s\".", argv[ i ] );
+      }
+    }
+    else if ( 0 == strcmp( argv[ i ], "--iterations" ) && i + 1 < argc )
+    {
+      iteration_count = (unsigned) strtoul( argv[ ++i ], NULL, 0 );
+
+      if ( iteration_count == 0 )
+        abort_with_error( "Invalid iteration count." );
+    }
+    else
+    {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if ( cdc_device == NULL && !use_vendor )
+  {
+    print_usage();
+    return 1;
+  }
+
+  // A shift command takes much longer than a latency test command.
+  const unsigned throughput_iteration_count = iteration_count / 10 + 1;
+
+  static transport t;
+
+  if ( cdc_device != NULL )
+  {
+    cdc_open( &t, cdc_device );
+    run_benchmark( &t, iteration_count, throughput_iteration_count );
+    t.close( &t );
+  }
+
+  if ( use_vendor )
+  {
+    vendor_open( &t, (uint16_t) vendor_id, (uint16_t) product_id );
+    run_benchmark( &t, iteration_count, throughput_iteration_count );
+    t.close( &t );
+  }
+
+  return 0;
+}
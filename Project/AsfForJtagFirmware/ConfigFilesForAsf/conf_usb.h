@@ -99,8 +99,13 @@
  * @{
  */
 
-// We just have 1 CDC interface on the USB connection.
-#define  UDI_CDC_PORT_NB 1
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+  // Port 0 carries the Bus Pirate protocol, port 1 is the diagnostic port, see UsbDiagnosticPort.h .
+  #define  UDI_CDC_PORT_NB 2
+#else
+  // We just have 1 CDC interface on the USB connection.
+  #define  UDI_CDC_PORT_NB 1
+#endif
 
 //! Interface callback definition
 #define  UDI_CDC_ENABLE_EXT(port)         MyUsbCallback_cdc_enable(port)
@@ -134,8 +139,196 @@
  */
 //@}
 
+#ifdef ENABLE_USB_VENDOR_INTERFACE
+
+/**
+ * Configuration of the vendor-specific interface
+ * @{
+ */
+
+// The vendor interface carries the same Bus Pirate protocol as the CDC interface,
+// but over plain bulk endpoints, so that the host can bypass its tty layer.
+// Selecting alternate setting 1 opens the channel, see MyUsbCallback_vendor_enable().
+
+#define  UDI_VENDOR_ENABLE_EXT()          MyUsbCallback_vendor_enable()
+#define  UDI_VENDOR_DISABLE_EXT()         MyUsbCallback_vendor_disable()
+#define  UDI_VENDOR_SETUP_OUT_RECEIVED()  false
+#define  UDI_VENDOR_SETUP_IN_RECEIVED()   false
+
+// We only need the bulk endpoints, a size of 0 leaves the other endpoint types out of the descriptors.
+#define  UDI_VENDOR_EPS_SIZE_INT_FS       0
+#define  UDI_VENDOR_EPS_SIZE_BULK_FS      64
+#define  UDI_VENDOR_EPS_SIZE_ISO_FS       0
+#define  UDI_VENDOR_EPS_SIZE_INT_HS       0
+#define  UDI_VENDOR_EPS_SIZE_BULK_HS      512
+#define  UDI_VENDOR_EPS_SIZE_ISO_HS       0
+//@}
+
+
+#endif  // #ifdef ENABLE_USB_VENDOR_INTERFACE
+
+
+#if defined( ENABLE_USB_VENDOR_INTERFACE ) || defined( ENABLE_USB_DIAGNOSTIC_PORT )
+
+#define  JTAGDUE_USB_COMPOSITE_DEVICE
+
+/**
+ * Description of the composite device
+ * @{
+ */
+
+// The Bus Pirate CDC interface always comes first, so that it keeps the "MI_00" suffix under Windows.
+
+#define  UDI_CDC_DATA_EP_IN_0             (1 | USB_EP_DIR_IN)
+#define  UDI_CDC_DATA_EP_OUT_0            (2 | USB_EP_DIR_OUT)
+#define  UDI_CDC_COMM_EP_0                (3 | USB_EP_DIR_IN)
+
+#define  UDI_CDC_COMM_IFACE_NUMBER_0      0
+#define  UDI_CDC_DATA_IFACE_NUMBER_0      1
+
+#define  USB_DEVICE_EP_CTRL_SIZE          64
+
+#if defined( ENABLE_USB_VENDOR_INTERFACE ) && !defined( ENABLE_USB_DIAGNOSTIC_PORT )
+
+  #define  UDI_VENDOR_EP_BULK_IN            (4 | USB_EP_DIR_IN)
+  #define  UDI_VENDOR_EP_BULK_OUT           (5 | USB_EP_DIR_OUT)
+
+  #define  UDI_VENDOR_IFACE_NUMBER          2
+
+  #define  USB_DEVICE_NB_INTERFACE          3
+  #define  USB_DEVICE_MAX_EP                5
+
+  #define  UDI_COMPOSITE_DESC_T \
+     usb_iad_desc_t       udi_cdc_iad; \
+     udi_cdc_comm_desc_t  udi_cdc_comm; \
+     udi_cdc_data_desc_t  udi_cdc_data; \
+     udi_vendor_desc_t    udi_vendor
+
+  #define  UDI_COMPOSITE_DESC_FS \
+     .udi_cdc_iad  = UDI_CDC_IAD_DESC_0, \
+     .udi_cdc_comm = UDI_CDC_COMM_DESC_0, \
+     .udi_cdc_data = UDI_CDC_DATA_DESC_0_FS, \
+     .udi_vendor   = UDI_VENDOR_DESC_FS
+
+  #define  UDI_COMPOSITE_DESC_HS \
+     .udi_cdc_iad  = UDI_CDC_IAD_DESC_0, \
+     .udi_cdc_comm = UDI_CDC_COMM_DESC_0, \
+     .udi_cdc_data = UDI_CDC_DATA_DESC_0_HS, \
+     .udi_vendor   = UDI_VENDOR_DESC_HS
+
+  #define  UDI_COMPOSITE_API \
+     &udi_api_cdc_comm, \
+     &udi_api_cdc_data, \
+     &udi_api_vendor
+
+#else
+
+  #define  UDI_CDC_DATA_EP_IN_1             (4 | USB_EP_DIR_IN)
+  #define  UDI_CDC_DATA_EP_OUT_1            (5 | USB_EP_DIR_OUT)
+  #define  UDI_CDC_COMM_EP_1                (6 | USB_EP_DIR_IN)
+
+  #define  UDI_CDC_COMM_IFACE_NUMBER_1      2
+  #define  UDI_CDC_DATA_IFACE_NUMBER_1      3
+
+  #ifdef ENABLE_USB_VENDOR_INTERFACE
+
+    #define  UDI_VENDOR_EP_BULK_IN            (7 | USB_EP_DIR_IN)
+    #define  UDI_VENDOR_EP_BULK_OUT           (8 | USB_EP_DIR_OUT)
+
+    #define  UDI_VENDOR_IFACE_NUMBER          4
+
+    #define  USB_DEVICE_NB_INTERFACE          5
+    #define  USB_DEVICE_MAX_EP                8
+
+    #define  UDI_COMPOSITE_DESC_T \
+       usb_iad_desc_t       udi_cdc_iad; \
+       udi_cdc_comm_desc_t  udi_cdc_comm; \
+       udi_cdc_data_desc_t  udi_cdc_data; \
+       usb_iad_desc_t       udi_diag_iad; \
+       udi_cdc_comm_desc_t  udi_diag_comm; \
+       udi_cdc_data_desc_t  udi_diag_data; \
+       udi_vendor_desc_t    udi_vendor
+
+    #define  UDI_COMPOSITE_DESC_FS \
+       .udi_cdc_iad   = UDI_CDC_IAD_DESC_0, \
+       .udi_cdc_comm  = UDI_CDC_COMM_DESC_0, \
+       .udi_cdc_data  = UDI_CDC_DATA_DESC_0_FS, \
+       .udi_diag_iad  = UDI_CDC_IAD_DESC_1, \
+       .udi_diag_comm = UDI_CDC_COMM_DESC_1, \
+       .udi_diag_data = UDI_CDC_DATA_DESC_1_FS, \
+       .udi_vendor    = UDI_VENDOR_DESC_FS
+
+    #define  UDI_COMPOSITE_DESC_HS \
+       .udi_cdc_iad   = UDI_CDC_IAD_DESC_0, \
+       .udi_cdc_comm  = UDI_CDC_COMM_DESC_0, \
+       .udi_cdc_data  = UDI_CDC_DATA_DESC_0_HS, \
+       .udi_diag_iad  = UDI_CDC_IAD_DESC_1, \
+       .udi_diag_comm = UDI_CDC_COMM_DESC_1, \
+       .udi_diag_data = UDI_CDC_DATA_DESC_1_HS, \
+       .udi_vendor    = UDI_VENDOR_DESC_HS
+
+    #define  UDI_COMPOSITE_API \
+       &udi_api_cdc_comm, \
+       &udi_api_cdc_data, \
+       &udi_api_cdc_comm, \
+       &udi_api_cdc_data, \
+       &udi_api_vendor
+
+  #else
+
+    #define  USB_DEVICE_NB_INTERFACE          4
+    #define  USB_DEVICE_MAX_EP                6
+
+    #define  UDI_COMPOSITE_DESC_T \
+       usb_iad_desc_t       udi_cdc_iad; \
+       udi_cdc_comm_desc_t  udi_cdc_comm; \
+       udi_cdc_data_desc_t  udi_cdc_data; \
+       usb_iad_desc_t       udi_diag_iad; \
+       udi_cdc_comm_desc_t  udi_diag_comm; \
+       udi_cdc_data_desc_t  udi_diag_data
+
+    #define  UDI_COMPOSITE_DESC_FS \
+       .udi_cdc_iad   = UDI_CDC_IAD_DESC_0, \
+       .udi_cdc_comm  = UDI_CDC_COMM_DESC_0, \
+       .udi_cdc_data  = UDI_CDC_DATA_DESC_0_FS, \
+       .udi_diag_iad  = UDI_CDC_IAD_DESC_1, \
+       .udi_diag_comm = UDI_CDC_COMM_DESC_1, \
+       .udi_diag_data = UDI_CDC_DATA_DESC_1_FS
+
+    #define  UDI_COMPOSITE_DESC_HS \
+       .udi_cdc_iad   = UDI_CDC_IAD_DESC_0, \
+       .udi_cdc_comm  = UDI_CDC_COMM_DESC_0, \
+       .udi_cdc_data  = UDI_CDC_DATA_DESC_0_HS, \
+       .udi_diag_iad  = UDI_CDC_IAD_DESC_1, \
+       .udi_diag_comm = UDI_CDC_COMM_DESC_1, \
+       .udi_diag_data = UDI_CDC_DATA_DESC_1_HS
+
+    #define  UDI_COMPOSITE_API \
+       &udi_api_cdc_comm, \
+       &udi_api_cdc_data, \
+       &udi_api_cdc_comm, \
+       &udi_api_cdc_data
+
+  #endif
+
+#endif
+//@}
+
+#endif  // #if defined( ENABLE_USB_VENDOR_INTERFACE ) || defined( ENABLE_USB_DIAGNOSTIC_PORT )
+
+
 //! The includes of classes and other headers must be done at the end of this file to avoid compile error
-#include "udi_cdc_conf.h"
+#ifdef JTAGDUE_USB_COMPOSITE_DEVICE
+  // The composite device defines its own endpoint and interface numbers above.
+  #include "udi_cdc.h"
+
+  #ifdef ENABLE_USB_VENDOR_INTERFACE
+    #include "udi_vendor.h"
+  #endif
+#else
+  #include "udi_cdc_conf.h"
+#endif
+
 #include "my_usb_callbacks.h"
 
 #endif // _CONF_USB_H_
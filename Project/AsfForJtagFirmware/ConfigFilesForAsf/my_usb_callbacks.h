@@ -24,6 +24,11 @@ void MyUsbCallback_cdc_set_dtr         ( uint8_t port, bool b_enable );
 void MyUsbCallback_cdc_rx_notify       ( uint8_t port );
 void MyUsbCallback_cdc_tx_empty_notify ( uint8_t port );
 
+#ifdef ENABLE_USB_VENDOR_INTERFACE
+  bool MyUsbCallback_vendor_enable  ( void );
+  void MyUsbCallback_vendor_disable ( void );
+#endif
+
 
 #ifdef __cplusplus
 }
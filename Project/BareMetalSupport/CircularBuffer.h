@@ -22,6 +22,9 @@
 #include <assert.h>
 #include <string.h>
 
+#include "AssertionUtils.h"
+#include "CircularBufferStats.h"
+
 
 // Fixed-size circular buffer.
 //
@@ -39,11 +42,20 @@
 //
 // If your processor supports virtual memory, you can map the buffer's memory
 // twice into consecutive memory locations and avoid handling wrap-arounds in many occasions.
+//
+// Our processor has no MMU, but MIRROR_ELEM_COUNT achieves a similar effect on a smaller scale.
+// The buffer gets that many extra elements after its end, and they always mirror
+// the first elements at the beginning of the buffer. As a result, GetReadPtr() and GetWritePtr()
+// always return at least MIRROR_ELEM_COUNT consecutive elements, or as many as available,
+// whichever is smaller, even across the wrap-around point. The price is the extra memory
+// and copying those elements once per wrap-around in CommitWrittenElements().
+// The default of 0 yields the classic circular buffer.
 
 
 template< typename TemplElemType,
           typename TemplSizeType,
-          TemplSizeType MAX_ELEM_COUNT >
+          TemplSizeType MAX_ELEM_COUNT,
+          TemplSizeType MIRROR_ELEM_COUNT = 0 >
 
 class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
 {
@@ -53,10 +65,12 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
   typedef TemplSizeType SizeType;
 
  private:
-  ElemType  m_buffer[ MAX_ELEM_COUNT ];
+  ElemType  m_buffer[ MAX_ELEM_COUNT + MIRROR_ELEM_COUNT ];
   SizeType  m_readPos;
   SizeType  m_elemCount;
 
+  CCircularBufferStatsTracker m_statsTracker;
+
 
   // Use our own min() routine, because Atmel Software Framework version 3.7.3.69
   // defines min and max macros, which conflict with STL's std::min and std::max.
@@ -71,6 +85,9 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
  public:
   CCircularBuffer ( void )
   {
+    // The mirrored elements must not overlap with each other.
+    STATIC_ASSERT( MIRROR_ELEM_COUNT <= MAX_ELEM_COUNT, "The mirror region is too big." );
+
     Reset();
   }
 
@@ -78,6 +95,7 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
   {
     m_readPos   = 0;
     m_elemCount = 0;
+    m_statsTracker.NoteReset();
   }
 
   SizeType GetElemCount ( void ) const { return m_elemCount; }
@@ -86,6 +104,19 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
   bool     IsFull       ( void ) const { return GetFreeCount() == 0; }
 
 
+  // Occupancy statistics, see CircularBufferStats.h . The user calls NoteOverflow()
+  // when it drops data because the buffer was full.
+
+  void GetStats ( CircularBufferStats * const stats ) const
+  {
+    m_statsTracker.GetStats( stats );
+    stats->bufferSize = MAX_ELEM_COUNT;
+  }
+
+  void ResetStats ( void ) { m_statsTracker.ResetStats( GetElemCount() ); }
+  void NoteOverflow ( const SizeType droppedElemCount ) { m_statsTracker.NoteOverflow( droppedElemCount ); }
+
+
   // Peeking does not consume the element, see ConsumeReadElements() below.
 
   const ElemType * PeekElement ( void ) const
@@ -127,15 +158,18 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
     elemCountLeft -= firstLoopCount;
 
 
-    // Do the second chunk, if any.
+    // Do the second chunk, if any. If the first chunk reached into the mirror region,
+    // the second one does not start at the beginning of the buffer.
 
     if ( elemCountLeft > 0 )
     {
       assert( elemCountLeft < MAX_ELEM_COUNT );
 
+      const SizeType secondChunkPos = ( m_readPos + firstLoopCount ) % MAX_ELEM_COUNT;
+
       for ( SizeType j = 0; j < elemCountLeft; ++j )
       {
-        *dest = m_buffer[ j ];
+        *dest = m_buffer[ secondChunkPos + j ];
         ++dest;
       }
     }
@@ -163,11 +197,24 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
 
   const ElemType * GetReadPtr ( SizeType * const elemCount ) const
   {
-    *elemCount = MinFrom( m_elemCount, MAX_ELEM_COUNT - m_readPos );
+    *elemCount = MinFrom( m_elemCount, MAX_ELEM_COUNT + MIRROR_ELEM_COUNT - m_readPos );
     assert( m_readPos < MAX_ELEM_COUNT );
     return &m_buffer[ m_readPos ];
   }
 
+  // Like GetReadPtr(), but for the elements that start at the given offset from the read position.
+  // This allows looking at data further ahead, like the data just written, without consuming anything.
+
+  const ElemType * GetReadPtrAt ( const SizeType offset, SizeType * const elemCount ) const
+  {
+    assert( offset < m_elemCount );
+
+    const SizeType pos = ( m_readPos + offset ) % MAX_ELEM_COUNT;
+
+    *elemCount = MinFrom( SizeType( m_elemCount - offset ), SizeType( MAX_ELEM_COUNT + MIRROR_ELEM_COUNT - pos ) );
+    return &m_buffer[ pos ];
+  }
+
   void ConsumeReadElements ( const SizeType elemCountToConsume )
   {
     assert( elemCountToConsume != 0 );
@@ -176,6 +223,8 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
     m_readPos += elemCountToConsume;
     m_readPos %= MAX_ELEM_COUNT;
     m_elemCount -= elemCountToConsume;
+
+    m_statsTracker.NoteRead( m_elemCount );
   }
 
 
@@ -185,7 +234,13 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
 
     const SizeType writePos = ( m_readPos + m_elemCount ) % MAX_ELEM_COUNT;
     m_buffer[ writePos ] = elemToWrite;
+
+    if ( writePos < MIRROR_ELEM_COUNT )
+      m_buffer[ MAX_ELEM_COUNT + writePos ] = elemToWrite;
+
     ++m_elemCount;
+
+    m_statsTracker.NoteWrite( m_elemCount, MAX_ELEM_COUNT );
   }
 
 
@@ -258,8 +313,8 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
 
     ElemType * const ptr = &m_buffer[ writePos ];
 
-    *elemCount = MinFrom( MAX_ELEM_COUNT - m_elemCount,  // Room left in the buffer ...
-                          MAX_ELEM_COUNT - writePos      // ... without wrapping around.
+    *elemCount = MinFrom( MAX_ELEM_COUNT - m_elemCount,                 // Room left in the buffer ...
+                          MAX_ELEM_COUNT + MIRROR_ELEM_COUNT - writePos  // ... without wrapping around.
                         );
     return ptr;
   }
@@ -268,7 +323,41 @@ class CCircularBuffer  // Also called Cyclic or Ring Buffer in the literature.
   {
     assert( elemCountToCommit != 0 );
     assert( elemCountToCommit <= GetFreeCount() );
+
+    if ( MIRROR_ELEM_COUNT > 0 )
+      UpdateMirror( ( m_readPos + m_elemCount ) % MAX_ELEM_COUNT, elemCountToCommit );
+
     m_elemCount += elemCountToCommit;
+
+    m_statsTracker.NoteWrite( m_elemCount, MAX_ELEM_COUNT );
+  }
+
+ private:
+
+  // The caller has written directly into the buffer at the given position. Copy the elements
+  // that landed in the first MIRROR_ELEM_COUNT positions to the mirror region, and the ones
+  // that landed in the mirror region back to the beginning of the buffer.
+
+  void UpdateMirror ( const SizeType writePos, const SizeType elemCount )
+  {
+    assert( writePos < MAX_ELEM_COUNT );
+    assert( writePos + elemCount <= MAX_ELEM_COUNT + MIRROR_ELEM_COUNT );
+
+    const SizeType writeEnd = writePos + elemCount;
+
+    if ( writePos < MIRROR_ELEM_COUNT )
+    {
+      const SizeType end = MinFrom( writeEnd, MIRROR_ELEM_COUNT );
+
+      for ( SizeType i = writePos; i < end; ++i )
+        m_buffer[ MAX_ELEM_COUNT + i ] = m_buffer[ i ];
+    }
+
+    if ( writeEnd > MAX_ELEM_COUNT )
+    {
+      for ( SizeType i = MAX_ELEM_COUNT; i < writeEnd; ++i )
+        m_buffer[ i - MAX_ELEM_COUNT ] = m_buffer[ i ];
+    }
   }
 };
 
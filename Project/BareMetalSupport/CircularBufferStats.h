@@ -0,0 +1,159 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef BMS_CIRCULAR_BUFFER_STATS_H_INCLUDED
+#define BMS_CIRCULAR_BUFFER_STATS_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+
+
+// The circular buffer classes can optionally keep occupancy statistics, which help size the buffers
+// for real workloads. Define ENABLE_CIRCULAR_BUFFER_STATS to turn them on, see --enable-circular-buffer-stats
+// in configure.ac . Otherwise, the tracker below is an empty class and all calls to it compile to nothing.
+//
+// The time spent full is measured with the DWT cycle counter. The counter is read directly,
+// because the serial port Tx Buffer is used before EnableDwtCycleCounter() gets called,
+// so any full periods that early are not measured correctly. A single full period longer than
+// the counter's wrap-around time of 51 seconds is also under-counted.
+//
+// Like the buffers themselves, the tracker has no interrupt protection. However, when used
+// by CSpscCircularBuffer, the producer only updates the high-water mark and the full counter,
+// and the consumer only updates the empty counter and the time spent full. The full period
+// is closed before the consumer releases the slots, so that the producer cannot start a new one
+// in the meantime.
+
+struct CircularBufferStats
+{
+  uint32_t bufferSize;         // Filled in by the buffer class, for convenience.
+  uint32_t maxElemCount;       // High-water mark.
+  uint32_t becameFullCount;
+  uint32_t becameEmptyCount;
+  uint32_t overflowCount;      // How many times the user dropped data because the buffer was full, see NoteOverflow().
+  uint32_t droppedElemCount;
+  uint64_t fullCycleCount;     // Cumulative time spent full, including the current full period.
+};
+
+
+#ifdef ENABLE_CIRCULAR_BUFFER_STATS
+
+#include <sam3xa.h>
+
+class CCircularBufferStatsTracker
+{
+ private:
+  CircularBufferStats m_stats;
+  volatile bool       m_isFull;
+  volatile uint32_t   m_fullSinceCycleCount;
+
+  static uint32_t GetCycleCount ( void )
+  {
+    return DWT->CYCCNT;
+  }
+
+ public:
+  CCircularBufferStatsTracker ( void )
+  {
+    memset( &m_stats, 0, sizeof( m_stats ) );
+    m_isFull = false;
+    m_fullSinceCycleCount = 0;
+  }
+
+  // Call this after adding elements to the buffer.
+  void NoteWrite ( const uint32_t elemCountAfter, const uint32_t maxElemCount )
+  {
+    if ( elemCountAfter > m_stats.maxElemCount )
+      m_stats.maxElemCount = elemCountAfter;
+
+    if ( elemCountAfter == maxElemCount && !m_isFull )
+    {
+      ++m_stats.becameFullCount;
+      m_fullSinceCycleCount = GetCycleCount();
+      m_isFull = true;
+    }
+  }
+
+  // Call this when removing elements from the buffer.
+  void NoteRead ( const uint32_t elemCountAfter )
+  {
+    if ( m_isFull )
+    {
+      m_stats.fullCycleCount += uint32_t( GetCycleCount() - m_fullSinceCycleCount );
+      m_isFull = false;
+    }
+
+    if ( elemCountAfter == 0 )
+      ++m_stats.becameEmptyCount;
+  }
+
+  // Discarding all elements ends the current full period, but does not count as becoming empty.
+  void NoteReset ( void )
+  {
+    if ( m_isFull )
+    {
+      m_stats.fullCycleCount += uint32_t( GetCycleCount() - m_fullSinceCycleCount );
+      m_isFull = false;
+    }
+  }
+
+  void NoteOverflow ( const uint32_t droppedElemCount )
+  {
+    ++m_stats.overflowCount;
+    m_stats.droppedElemCount += droppedElemCount;
+  }
+
+  void GetStats ( CircularBufferStats * const stats ) const
+  {
+    *stats = m_stats;
+
+    if ( m_isFull )
+      stats->fullCycleCount += uint32_t( GetCycleCount() - m_fullSinceCycleCount );
+  }
+
+  // The high-water mark restarts at the current occupancy.
+  void ResetStats ( const uint32_t currentElemCount )
+  {
+    memset( &m_stats, 0, sizeof( m_stats ) );
+    m_stats.maxElemCount = currentElemCount;
+
+    if ( m_isFull )
+      m_fullSinceCycleCount = GetCycleCount();
+  }
+};
+
+#else
+
+class CCircularBufferStatsTracker
+{
+ public:
+  void NoteWrite    ( uint32_t, uint32_t ) {}
+  void NoteRead     ( uint32_t ) {}
+  void NoteReset    ( void ) {}
+  void NoteOverflow ( uint32_t ) {}
+
+  void GetStats ( CircularBufferStats * const stats ) const
+  {
+    memset( stats, 0, sizeof( *stats ) );
+  }
+
+  void ResetStats ( uint32_t ) {}
+};
+
+#endif  // #ifdef ENABLE_CIRCULAR_BUFFER_STATS
+
+#endif  // Include this header file only once.
@@ -0,0 +1,73 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef BMS_DWT_UTILS_H_INCLUDED
+#define BMS_DWT_UTILS_H_INCLUDED
+
+#include <stdint.h>
+#include <assert.h>
+
+#include <sam3xa.h>
+
+
+// The Cortex-M3 Data Watchpoint and Trace unit (DWT) has a 32-bit cycle counter (CYCCNT)
+// that increments once per CPU clock. At 84 MHz, it wraps around every 51 seconds,
+// so it can only measure intervals shorter than that. Unlike the SysTick-based helpers,
+// it is not affected by the SysTick reload period.
+//
+// Note that a JTAG debugger attached to this board may also reconfigure the DWT.
+
+inline void EnableDwtCycleCounter ( void )
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
+inline bool IsDwtCycleCounterEnabled ( void )
+{
+  return 0 != ( CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk ) &&
+         0 != ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk );
+}
+
+
+inline uint32_t GetDwtCycleCount ( void )
+{
+  assert( IsDwtCycleCounterEnabled() );
+  return DWT->CYCCNT;
+}
+
+
+// The unsigned subtraction takes care of one eventual wrap-around.
+
+inline uint32_t GetDwtElapsedCycleCount ( const uint32_t referenceCountInThePast )
+{
+  return GetDwtCycleCount() - referenceCountInThePast;
+}
+
+
+inline uint32_t DwtCycleCountToUs ( const uint32_t cycleCount )
+{
+  // Otherwise you should adjust the logic below for better accuracy.
+  assert( 0 == ( CPU_CLOCK % 1000000 ) );
+
+  return cycleCount / ( CPU_CLOCK / 1000000 );
+}
+
+
+#endif  // Include this header file only once.
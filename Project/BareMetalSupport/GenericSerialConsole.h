@@ -27,10 +27,16 @@
 //  - Unicode support.
 //  - Handle more keys like these: home, end, del, Ctrl+arrow keys.
 
+// The build normally sets this size, see --with-console-history-size in configure.ac .
+#ifndef SERIAL_CONSOLE_HISTORY_SIZE
+  #define SERIAL_CONSOLE_HISTORY_SIZE 1024
+#endif
+
+
 class CGenericSerialConsole
 {
 private:
-  enum { BUF_LEN = 1024 };
+  enum { BUF_LEN = SERIAL_CONSOLE_HISTORY_SIZE };
   enum { MAX_SINGLE_CMD_LEN = 256 };  // Not including the NULL character terminator.
 
   enum StateEnum
@@ -70,6 +76,7 @@ private:
 public:
   CGenericSerialConsole ( void )
   {
+    STATIC_ASSERT( BUF_LEN >= 1024, "See --with-console-history-size in configure.ac ." );
     STATIC_ASSERT( MAX_SINGLE_CMD_LEN < BUF_LEN / 2, "Otherwise, the max single cmd len does not make much sense." );
     Reset();
   }
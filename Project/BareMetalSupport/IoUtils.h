@@ -27,6 +27,10 @@
 #include <pio.h>
 #include <pmc.h>
 
+#ifdef HOST_SIMULATOR
+  #include <SimulatedPio.h>
+#endif
+
 
 // Empirical tests show that using bit banding yields significantly lower performance.
 // Either the GCC 4.7.3 does not optimise it properly, or bit-banding carries a CPU performance penalty,
@@ -38,6 +42,9 @@
 // The corresponding PIO_OWER bit should be set to 1 then for the pins written.
 #define USE_PARALLEL_ACCESS false
 
+// In the host simulator, the pin writes below go to the simulated pin backend, which keeps
+// the PIO status registers up to date, so the pin reads need no changes. See HostSimulator/SimulatedPio.h .
+
 
 inline uint32_t BV ( const uint32_t v )
 {
@@ -176,7 +183,11 @@ inline void SetOutputDataDrivenOnPinToHigh ( Pio * const pioPtr,
   }
   else
   {
-    pioPtr->PIO_SODR = BV( pinNumber );
+    #ifdef HOST_SIMULATOR
+      SimulatedPio_SetOutputData( pioPtr, BV( pinNumber ), true );
+    #else
+      pioPtr->PIO_SODR = BV( pinNumber );
+    #endif
   }
 }
 
@@ -206,7 +217,11 @@ inline void SetOutputDataDrivenOnPinToLow ( Pio * const pioPtr,
   }
   else
   {
-    pioPtr->PIO_CODR = BV( pinNumber );
+    #ifdef HOST_SIMULATOR
+      SimulatedPio_SetOutputData( pioPtr, BV( pinNumber ), false );
+    #else
+      pioPtr->PIO_CODR = BV( pinNumber );
+    #endif
   }
 }
 
@@ -272,6 +287,35 @@ inline bool IsInputPinHigh ( const Pio * const pioPtr,
 }
 
 
+// Switches the pin direction without touching the rest of the pin configuration,
+// which is faster than calling pio_set_input() and pio_set_output().
+
+inline void SetPinOutputEnabled ( Pio * const pioPtr,
+                                  const uint8_t pinNumber,  // 0-31.
+                                  const bool isOutputEnabled
+                                )
+{
+  assert( IsKnownPioPtr( pioPtr ) );
+
+  #ifdef HOST_SIMULATOR
+    SimulatedPio_SetOutputEnabled( pioPtr, BV( pinNumber ), isOutputEnabled );
+  #else
+    if ( isOutputEnabled )
+      pioPtr->PIO_OER = BV( pinNumber );
+    else
+      pioPtr->PIO_ODR = BV( pinNumber );
+  #endif
+}
+
+
+inline bool IsPinOutputEnabled ( const Pio * const pioPtr,
+                                 const uint8_t pinNumber  // 0-31.
+                               )
+{
+  return ( pioPtr->PIO_OSR & BV(pinNumber) ) ? true : false;
+}
+
+
 uint8_t GetArduinoDuePinNumberFromPio ( const Pio * pioPtr, uint8_t pinNumber );
 
 
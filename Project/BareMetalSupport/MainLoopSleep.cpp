@@ -20,10 +20,9 @@
 
 #include <sam3xa.h>
 
-#include "SerialPrint.h"
 #include "AssertionUtils.h"
 #include "Miscellaneous.h"
-#include "IntegerPrintUtils.h"
+#include "DwtUtils.h"
 
 
 static volatile bool s_wasMainLoopEventTriggered = false;
@@ -54,18 +53,16 @@ static uint8_t s_lastLongPeriodIndex;
 static uint8_t s_lastShortPeriod[ CPU_LOAD_SHORT_PERIOD_SLOT_COUNT ];
 static uint8_t s_lastShortPeriodIndex;
 
-static uint64_t s_sleepLoopCount;
-
-// The value below was calibrated by hand, see ENABLE_CALIBRATION_MODE.
-// Tips for calibrating this value are:
-// - Leave any non-essential interfaces (like USB)  unconnected for a short time, as there is less CPU load then.
-// - Turn off the main loop wake-ups for time-out purposes.
-// - Run a release build (with compiler optimisations turned on).
-static const uint64_t CALIBRATED_MAX_LOOP_COUNT = 1049937;
-
-
-static bool ENABLE_CALIBRATION_MODE = false;
-static uint64_t s_maximumSleepLoopCountForCalibration;
+// The CPU load is measured with the DWT cycle counter: MainLoopSleep() adds up the cycles
+// it spends waiting, and UpdateCpuLoadStats() compares that with the cycles elapsed since its last call.
+// This works the same with and without ENABLE_CPU_SLEEP, because the DWT keeps counting
+// on the free-running clock while the core sleeps in WFE. There is no calibration step.
+//
+// The interrupt handlers that run while the main loop is waiting are counted as idle time,
+// because the cycle counter cannot tell them apart. Their time is normally small
+// compared to a CPU load slot.
+static uint32_t s_sleepCycleCount = 0;
+static uint32_t s_lastUpdateCycleCount = 0;
 
 
 static void ShiftSlot ( const uint8_t cpuLoad )
@@ -102,9 +99,6 @@ void UpdateCpuLoadStats ( void )
   static_assert( CPU_LOAD_LONG_PERIOD_SLOT_COUNT < 255, "Index data type too small." );
   static_assert( CPU_LOAD_LONG_PERIOD_SLOT_COUNT < 255, "Index data type too small." );
 
-  if ( ENABLE_CPU_SLEEP )
-    return;
-
   uint32_t capturedTickCount;
 
   { // Scope for interrupts disabled.
@@ -117,116 +111,36 @@ void UpdateCpuLoadStats ( void )
   if ( capturedTickCount == 0 )
     return;
 
-  if ( ENABLE_CALIBRATION_MODE )
-  {
-    if ( s_sleepLoopCount > s_maximumSleepLoopCountForCalibration )
-      s_maximumSleepLoopCountForCalibration = s_sleepLoopCount;
-  }
+  const uint32_t currentCycleCount = GetDwtCycleCount();
+  const uint32_t elapsedCycleCount = currentCycleCount - s_lastUpdateCycleCount;
+  const uint32_t sleepCycleCount   = MinFrom( s_sleepCycleCount, elapsedCycleCount );
 
+  s_lastUpdateCycleCount = currentCycleCount;
+  s_sleepCycleCount      = 0;
 
   const uint8_t MAX_CPU_LOAD = 255;
 
   uint8_t cpuLoad;
 
-  if ( s_sleepLoopCount > CALIBRATED_MAX_LOOP_COUNT )
+  if ( elapsedCycleCount == 0 )
   {
-    // If the manual calibration has been done correctly, this should never happen.
-    if ( !ENABLE_CALIBRATION_MODE )
-      assert( false );
-
     cpuLoad = 0;
   }
   else
   {
-    const uint64_t newVal = ( CALIBRATED_MAX_LOOP_COUNT - s_sleepLoopCount ) * 255 / CALIBRATED_MAX_LOOP_COUNT;
+    const uint64_t newVal = uint64_t( elapsedCycleCount - sleepCycleCount ) * MAX_CPU_LOAD / elapsedCycleCount;
     assert( newVal <= MAX_CPU_LOAD );
 
     cpuLoad = uint8_t( newVal );
   }
 
-  s_sleepLoopCount = 0;
-
-  ShiftSlot( cpuLoad );
-
-  capturedTickCount--;
+  // If the main loop was too busy to update the statistics on every tick,
+  // the measured load applies to all the slots it missed.
 
   for ( uint32_t i = 0; i < capturedTickCount; ++i )
   {
-    ShiftSlot( MAX_CPU_LOAD );
-  }
-}
-
-
-// This routine must be in assembly so that the number of iterations can be calibrated once
-// and does not change depending on compiler flags and version.
-
-// Note that there is a similar constant in the include file for assembly modules,
-// see that other definition for information about why alignment matters here too.
-#define INSTRUCTION_LOAD_ALIGNMENT 16
-
-static void CpuLoadAsmLoop ( volatile bool * wasMainLoopEventTriggered,
-                             uint64_t * sleepLoopCount ) __attribute__ (( naked ));
-
-static void CpuLoadAsmLoop ( volatile bool * const /* wasMainLoopEventTriggered */,
-                           uint64_t * const /* sleepLoopCount */ )
-{
-  /* This is the equivalent code in C++:
-  for ( ; ; )
-  {
-    if ( *wasMainLoopEventTriggered )
-    {
-      break;
-    }
-
-    ++*sleepLoopCount;
+    ShiftSlot( cpuLoad );
   }
-  */
-
-  // Possible improvements:
-  // 1) Do not use a 'naked' function.
-  // 2) Do not access the stack arguments by address, but use their names
-  //    from the function prototype.
-
-  asm volatile
-  (
-     "ldrb    r3, [r0, #0]"  "\n"
-     "push    {r4, r5, r6}"  "\n"
-     "cbnz    r3, AsmLoopExitLabel"  "\n"
-     "movs    r4, #1"  "\n"
-     "movs    r5, #0"  "\n"
-     "ldrd    r2, r3, [r1]"  "\n"
-
-     // The whole loop fits exactly in the 16-byte alignment and runs much faster.
-     // Speed is actually not so important here, but the runtime should not depend
-     // on some compilation randomness, therefore we must align here.
-     //
-     // I have not managed yet to use a named constant like INSTRUCTION_LOAD_ALIGNMENT
-     // instead of the hard-coded 16 below, the %[inst_align] syntax does not work.
-
-     ".balignw 16, 0xBF00"  "\n"  // A thumb 'nop' instruction has opcode 0xBF00.
-   "AsmLoopLoopLabel:"  "\n"
-
-      "ldrb    r6, [r0, #0]"  "\n"
-      "adds    r2, r2, r4"  "\n"
-      "adc.w   r3, r3, r5"  "\n"
-      "cmp r6, #0"  "\n"
-      "beq.n   AsmLoopLoopLabel"  "\n"
-      "strd    r2, r3, [r1]"  "\n"
-
-   "AsmLoopExitLabel:"  "\n"
-
-        "pop {r4, r5, r6}"  "\n"
-        "bx lr"  "\n"
-
-     // Output operand list
-     :
-
-     // Input operand list
-     : [inst_align] "I" ( INSTRUCTION_LOAD_ALIGNMENT )
-
-     // Clobber list
-     :
-  );
 }
 
 
@@ -243,16 +157,22 @@ void MainLoopSleep ( void )
   // the CPU manufacturer's library. For example, for Atmel chips, see the "Sleep Manager",
   // function sleepmgr_enter_sleep(), in the Atmel Software Framework documentation.
 
+  const uint32_t sleepStartCycleCount = GetDwtCycleCount();
+
   if ( ENABLE_CPU_SLEEP )
   {
     __WFE();
   }
   else
   {
-    CpuLoadAsmLoop( &s_wasMainLoopEventTriggered, &s_sleepLoopCount );
+    while ( !s_wasMainLoopEventTriggered )
+    {
+    }
 
     s_wasMainLoopEventTriggered = false;
   }
+
+  s_sleepCycleCount += GetDwtElapsedCycleCount( sleepStartCycleCount );
 }
 
 
@@ -260,16 +180,9 @@ void MainLoopSleep ( void )
 
 void CpuLoadStatsTick ( void ) throw()
 {
-  if ( ENABLE_CPU_SLEEP )
-  {
-    assert( false );
-  }
-  else
-  {
-    CAutoDisableInterrupts autoDisableInterrupts;
+  CAutoDisableInterrupts autoDisableInterrupts;
 
-    s_tickCount++;
-  }
+  s_tickCount++;
 }
 
 
@@ -281,22 +194,9 @@ void GetCpuLoadStats ( const uint8_t ** const lastLongPeriod,
                        const uint8_t ** const lastShortPeriod,
                        uint8_t  * const lastShortPeriodIndex )
 {
-  if ( ENABLE_CPU_SLEEP )
-  {
-    assert( false );
-  }
-  else
-  {
-    *lastLongPeriod      = s_lastLongPeriod;
-    *lastLongPeriodIndex = s_lastLongPeriodIndex;
-
-    *lastShortPeriod      = s_lastShortPeriod;
-    *lastShortPeriodIndex = s_lastShortPeriodIndex;
+  *lastLongPeriod      = s_lastLongPeriod;
+  *lastLongPeriodIndex = s_lastLongPeriodIndex;
 
-    if ( ENABLE_CALIBRATION_MODE )
-    {
-      char buffer[ CONVERT_TO_DEC_BUF_SIZE ];
-      SerialPrintf( "Max loop count found: %s\n", convert_unsigned_to_dec_th( s_maximumSleepLoopCountForCalibration, buffer, ',' ) );
-    }
-  }
+  *lastShortPeriod      = s_lastShortPeriod;
+  *lastShortPeriodIndex = s_lastShortPeriodIndex;
 }
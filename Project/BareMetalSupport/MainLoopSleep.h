@@ -20,10 +20,16 @@
 
 #include <stdint.h>
 
-// Note that CPU load statistics are only available if CPU sleep support is disabled below.
-// An alternative implementation using a timer would not have this limitation.
-// Also, if you enable the CPU sleep feature, you may not be able to connect with the JTAG debugger.
-#define ENABLE_CPU_SLEEP  false
+// The CPU load statistics are available with and without CPU sleep support, see UpdateCpuLoadStats().
+// They need the DWT cycle counter, see EnableDwtCycleCounter().
+// Note that, if you enable the CPU sleep feature, you may not be able to connect with the JTAG debugger.
+// The host simulator has no interrupts that could set a flag while the main loop is busy-waiting,
+// so it always sleeps with __WFE(), which waits on the host, see HostSimulator/SimulatedCpu.cpp .
+#ifdef HOST_SIMULATOR
+  #define ENABLE_CPU_SLEEP  true
+#else
+  #define ENABLE_CPU_SLEEP  false
+#endif
 
 
 void WakeFromMainLoopSleep ( void ) throw();
@@ -38,8 +44,8 @@ void UpdateCpuLoadStats ( void );
 #define CPU_LOAD_LONG_PERIOD_SLOT_COUNT 60  // Consumes one byte per slot.
 
 // A value of 10 here means that the main loop will run once every 100 ms.
-// You need to call UpdateCpuLoadStats() in approximately 100 ms intervals then,
-// or the CPU load statistics will be inaccurate.
+// You need to call CpuLoadStatsTick() in 100 ms intervals then, and UpdateCpuLoadStats()
+// from the main loop soon afterwards, or the CPU load statistics will be less detailed.
 #define CPU_LOAD_SHORT_PERIOD_SLOT_COUNT 10
 
 void GetCpuLoadStats ( const uint8_t ** lastLongPeriod,
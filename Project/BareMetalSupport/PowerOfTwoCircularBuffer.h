@@ -0,0 +1,203 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef BMS_POWER_OF_TWO_CIRCULAR_BUFFER_H_INCLUDED
+#define BMS_POWER_OF_TWO_CIRCULAR_BUFFER_H_INCLUDED
+
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+
+#include "AssertionUtils.h"
+#include "CircularBufferStats.h"
+
+
+// Fixed-size circular buffer with the same interface as CCircularBuffer,
+// but MAX_ELEM_COUNT must be a power of two.
+//
+// Instead of a read position and an element count, this class keeps free-running read
+// and write indices, which are only masked when accessing the array. The indices wrap around
+// naturally together with SizeType, so there are no modulo operations, and the element count
+// is just the difference between both indices.
+//
+// Because the producer only modifies the write index and the consumer only modifies the read index,
+// this scheme is also the basis for the lock-free variant in SpscCircularBuffer.h .
+//
+// Like CCircularBuffer, there is no error handling, only asserts, and no automatic
+// multithread or interrupt protection.
+
+template< typename TemplElemType,
+          typename TemplSizeType,
+          TemplSizeType MAX_ELEM_COUNT >
+
+class CPowerOfTwoCircularBuffer
+{
+ public:
+  typedef TemplElemType ElemType;
+  typedef TemplSizeType SizeType;
+
+ private:
+  static const SizeType INDEX_MASK = MAX_ELEM_COUNT - 1;
+
+  ElemType  m_buffer[ MAX_ELEM_COUNT ];
+  SizeType  m_readIndex;
+  SizeType  m_writeIndex;
+
+  CCircularBufferStatsTracker m_statsTracker;
+
+  template < typename IntegerType >
+  static
+  IntegerType MinFrom ( const IntegerType a, const IntegerType b )
+  {
+    return a < b ? a : b;
+  }
+
+ public:
+  CPowerOfTwoCircularBuffer ( void )
+  {
+    // MAX_ELEM_COUNT is a power of two of type SizeType, so it is at most half the range of SizeType.
+    // The difference between the free-running indices can therefore always tell a full buffer
+    // from an empty one, even after the indices have wrapped around.
+    STATIC_ASSERT( MAX_ELEM_COUNT > 0 && ( MAX_ELEM_COUNT & INDEX_MASK ) == 0, "The size must be a power of two." );
+    STATIC_ASSERT( SizeType( -1 ) > SizeType( 0 ), "The size type must be unsigned." );
+
+    Reset();
+  }
+
+  void Reset ( void )
+  {
+    m_readIndex  = 0;
+    m_writeIndex = 0;
+    m_statsTracker.NoteReset();
+  }
+
+  SizeType GetElemCount ( void ) const { return SizeType( m_writeIndex - m_readIndex ); }
+  SizeType GetFreeCount ( void ) const { return MAX_ELEM_COUNT - GetElemCount(); }
+  bool     IsEmpty      ( void ) const { return m_writeIndex == m_readIndex; }
+  bool     IsFull       ( void ) const { return GetElemCount() == MAX_ELEM_COUNT; }
+
+
+  // Occupancy statistics, see CircularBufferStats.h . The user calls NoteOverflow()
+  // when it drops data because the buffer was full.
+
+  void GetStats ( CircularBufferStats * const stats ) const
+  {
+    m_statsTracker.GetStats( stats );
+    stats->bufferSize = MAX_ELEM_COUNT;
+  }
+
+  void ResetStats ( void ) { m_statsTracker.ResetStats( GetElemCount() ); }
+  void NoteOverflow ( const SizeType droppedElemCount ) { m_statsTracker.NoteOverflow( droppedElemCount ); }
+
+
+  const ElemType * PeekElement ( void ) const
+  {
+    assert( !IsEmpty() );
+    return &m_buffer[ m_readIndex & INDEX_MASK ];
+  }
+
+
+  void PeekMultipleElements ( const SizeType elemCount,
+                              ElemType * const elemArray ) const
+  {
+    assert( elemCount > 0 );
+    assert( elemCount <= GetElemCount() );
+
+    for ( SizeType i = 0; i < elemCount; ++i )
+      elemArray[ i ] = m_buffer[ ( m_readIndex + i ) & INDEX_MASK ];
+  }
+
+
+  ElemType ReadElement ( void )
+  {
+    assert( !IsEmpty() );
+    const ElemType elem = m_buffer[ m_readIndex & INDEX_MASK ];
+    ++m_readIndex;
+    m_statsTracker.NoteRead( GetElemCount() );
+    return elem;
+  }
+
+
+  // See CCircularBuffer::GetReadPtr() for more information.
+
+  const ElemType * GetReadPtr ( SizeType * const elemCount ) const
+  {
+    const SizeType readPos = m_readIndex & INDEX_MASK;
+    *elemCount = MinFrom( GetElemCount(), SizeType( MAX_ELEM_COUNT - readPos ) );
+    return &m_buffer[ readPos ];
+  }
+
+  void ConsumeReadElements ( const SizeType elemCountToConsume )
+  {
+    assert( elemCountToConsume != 0 );
+    assert( elemCountToConsume <= GetElemCount() );
+
+    m_readIndex += elemCountToConsume;
+    m_statsTracker.NoteRead( GetElemCount() );
+  }
+
+
+  void WriteElem ( const ElemType elemToWrite )
+  {
+    assert( !IsFull() );
+
+    m_buffer[ m_writeIndex & INDEX_MASK ] = elemToWrite;
+    ++m_writeIndex;
+    m_statsTracker.NoteWrite( GetElemCount(), MAX_ELEM_COUNT );
+  }
+
+
+  void WriteElemArray ( const ElemType * const ptr, const SizeType elemCount )
+  {
+    assert( elemCount > 0 );
+    assert( elemCount <= GetFreeCount() );
+
+    for ( SizeType i = 0; i < elemCount; ++i )
+      m_buffer[ ( m_writeIndex + i ) & INDEX_MASK ] = ptr[ i ];
+
+    m_writeIndex += elemCount;
+    m_statsTracker.NoteWrite( GetElemCount(), MAX_ELEM_COUNT );
+  }
+
+
+  void WriteString ( const char * const str )
+  {
+    const size_t len = strlen( str );
+    if ( len > 0 )
+      WriteElemArray( (const ElemType *)str, len );
+  }
+
+
+  // See CCircularBuffer::GetWritePtr() for more information.
+
+  ElemType * GetWritePtr ( SizeType * const elemCount )
+  {
+    const SizeType writePos = m_writeIndex & INDEX_MASK;
+    *elemCount = MinFrom( GetFreeCount(), SizeType( MAX_ELEM_COUNT - writePos ) );
+    return &m_buffer[ writePos ];
+  }
+
+  void CommitWrittenElements ( const SizeType elemCountToCommit )
+  {
+    assert( elemCountToCommit != 0 );
+    assert( elemCountToCommit <= GetFreeCount() );
+    m_writeIndex += elemCountToCommit;
+    m_statsTracker.NoteWrite( GetElemCount(), MAX_ELEM_COUNT );
+  }
+};
+
+#endif  // Include this header file only once.
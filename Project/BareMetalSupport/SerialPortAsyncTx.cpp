@@ -21,7 +21,7 @@
 
 #include "AssertionUtils.h"
 #include "Miscellaneous.h"
-#include "CircularBuffer.h"
+#include "PowerOfTwoCircularBuffer.h"
 #include "SerialPortUtils.h"
 
 #include <sam3xa.h>
@@ -80,7 +80,10 @@ bool HasSerialPortDataBeenSentSinceLastCall ( void )
 }
 
 
-#define SERIAL_PORT_TX_BUFFER_SIZE 4096
+// The build normally sets this size, see --with-serial-tx-buffer-size in configure.ac .
+#ifndef SERIAL_PORT_TX_BUFFER_SIZE
+  #define SERIAL_PORT_TX_BUFFER_SIZE 4096
+#endif
 
 // If the buffer overflows, the user will get a warning message. Wait until the buffer is
 // half empty before restarting normal behaviour, otherwise the user may get many
@@ -88,7 +91,10 @@ bool HasSerialPortDataBeenSentSinceLastCall ( void )
 #define OVERFLOW_REARM_THRESHOLD ( SERIAL_PORT_TX_BUFFER_SIZE / 2 )
 
 
-typedef CCircularBuffer< char, uint32_t, SERIAL_PORT_TX_BUFFER_SIZE > CSerialPortTxBuffer;
+// The lock-free CSpscCircularBuffer does not help here, because SendSerialPortAsyncData() may be called
+// from several contexts (main loop and interrupt handlers), and it may also consume the first byte itself.
+// Therefore, we still need to disable interrupts, but at least the buffer needs no modulo operations.
+typedef CPowerOfTwoCircularBuffer< char, uint32_t, SERIAL_PORT_TX_BUFFER_SIZE > CSerialPortTxBuffer;
 
 // This instance should be "volatile", but then I get difficult compilation errors,
 // more investigation is needed. In the mean time, see AssumeMemoryHasChanged() below.
@@ -110,7 +116,7 @@ static bool IsTxReadyInterruptEnabled ( void )
 #endif
 
 
-void SendSerialPortAsyncData ( const char * data, const size_t dataLen )
+static void SendAsyncData ( const char * const data, const size_t dataLen, const bool isBlock )
 {
   // WARNING: This routine blocks interrupts for some time.
   // WARNING: This routine may be called in interrupt context.
@@ -137,7 +143,10 @@ void SendSerialPortAsyncData ( const char * data, const size_t dataLen )
     CAutoDisableInterrupts autoDisableInterrupts;
 
     if ( s_txBufferOverflowMode )
+    {
+      s_serialPortTxBuffer.NoteOverflow( dataLen );
       return;
+    }
 
     AssumeMemoryHasChanged();  // Because s_serialPortTxBuffer should be volatile.
 
@@ -150,9 +159,11 @@ void SendSerialPortAsyncData ( const char * data, const size_t dataLen )
     }
     else
     {
-      dataLenToUse = freeCount;
+      // A block is either sent in full or dropped, see SendSerialPortAsyncBlock().
+      dataLenToUse = isBlock ? 0 : freeCount;
 
       s_txBufferOverflowMode = true;
+      s_serialPortTxBuffer.NoteOverflow( dataLen - dataLenToUse );
 
       if ( dataLenToUse == 0 )
         return;
@@ -210,6 +221,18 @@ void SendSerialPortAsyncData ( const char * data, const size_t dataLen )
 }
 
 
+void SendSerialPortAsyncData ( const char * const data, const size_t dataLen )
+{
+  SendAsyncData( data, dataLen, false );
+}
+
+
+void SendSerialPortAsyncBlock ( const char * const data, const size_t dataLen )
+{
+  SendAsyncData( data, dataLen, true );
+}
+
+
 void SerialPortAsyncTxInterruptHandler ( void )
 {
   // WARNING: This routine is always called in interrupt context.
@@ -266,3 +289,17 @@ void SerialPortAsyncTxInterruptHandler ( void )
     s_txBufferOverflowMode = false;
   }
 }
+
+
+void GetSerialPortTxBufferStats ( CircularBufferStats * const stats )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+  s_serialPortTxBuffer.GetStats( stats );
+}
+
+
+void ResetSerialPortTxBufferStats ( void )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+  s_serialPortTxBuffer.ResetStats();
+}
@@ -18,6 +18,8 @@
 #include <stdint.h>
 #include <stddef.h>  // For size_t.
 
+#include "CircularBufferStats.h"
+
 
 void InitSerialPortAsyncTx ( const char * eol );
 
@@ -25,9 +27,17 @@ void SerialPortAsyncTxInterruptHandler ( void );
 
 void SendSerialPortAsyncData ( const char * data, size_t dataLen );
 
+// Like SendSerialPortAsyncData(), but if the data does not fit in the Tx Buffer, all of it gets dropped,
+// instead of sending the first part. Use it for binary records that would be useless if cut in half.
+void SendSerialPortAsyncBlock ( const char * data, size_t dataLen );
+
 const char * GetSerialPortEol ( void );
 
 bool HasSerialPortDataBeenSentSinceLastCall ( void );
 
+// The overflow counters include the data dropped while in overflow mode.
+void GetSerialPortTxBufferStats ( CircularBufferStats * stats );
+void ResetSerialPortTxBufferStats ( void );
+
 
 #endif  // Include this header file only once.
@@ -21,11 +21,50 @@
 #include <stdio.h>
 
 #include "SerialPortAsyncTx.h"
+#include "TokenizedLog.h"
+
+
+static volatile SerialPrintRedirectRoutine s_redirectRoutine = NULL;
+
+
+void SetSerialPrintRedirection ( const SerialPrintRedirectRoutine redirectRoutine )
+{
+  s_redirectRoutine = redirectRoutine;
+}
+
+
+static void SendData ( const char * const data, const size_t dataLen )
+{
+  const SerialPrintRedirectRoutine redirectRoutine = s_redirectRoutine;
+
+  if ( redirectRoutine != NULL && redirectRoutine( data, dataLen ) )
+    return;
+
+  SendSerialPortAsyncData( data, dataLen );
+}
+
+
+#ifdef ENABLE_TOKENIZED_LOG
+
+// The redirection target, like the USB diagnostic port, expects text,
+// so tokenized logging only applies when there is no redirection.
+
+static bool IsTokenizedLogActive ( void )
+{
+  return s_redirectRoutine == NULL;
+}
+
+#endif
 
 
 void SerialPrintStr ( const char * const msg )
 {
-  SendSerialPortAsyncData( msg, strlen(msg) );
+  #ifdef ENABLE_TOKENIZED_LOG
+    if ( IsTokenizedLogActive() && TokenizedLog_PrintStr( msg ) )
+      return;
+  #endif
+
+  SendData( msg, strlen(msg) );
 }
 
 
@@ -82,6 +121,22 @@ void SerialPrintV ( const char * const formatStr, va_list argList )
   // in the Tx Buffer. Or maybe there is a variant of vsnprintf() which does not take
   // a buffer to write to, but a call-back routine instead.
 
+  #ifdef ENABLE_TOKENIZED_LOG
+    if ( IsTokenizedLogActive() )
+    {
+      // If the format string cannot be tokenized, we need the arguments again for vsnprintf().
+      va_list argListCopy;
+      va_copy( argListCopy, argList );
+
+      const bool wasSent = TokenizedLog_PrintV( formatStr, argListCopy );
+
+      va_end( argListCopy );
+
+      if ( wasSent )
+        return;
+    }
+  #endif
+
   char buffer[ MAX_SERIAL_PRINT_LEN + 1 ];
 
   const int len = vsnprintf( buffer, MAX_SERIAL_PRINT_LEN + 1, formatStr, argList );
@@ -93,12 +148,12 @@ void SerialPrintV ( const char * const formatStr, va_list argList )
     // We don't actually need to assert on this, but I just want to be sure I know what happens in this case.
     assert( buffer[ MAX_SERIAL_PRINT_LEN ] == 0 );
 
-    SendSerialPortAsyncData( buffer, MAX_SERIAL_PRINT_LEN );
-    SendSerialPortAsyncData( TRUNCATION_SUFFIX, TRUNCATION_SUFFIX_LEN );
-    SendSerialPortAsyncData( GetSerialPortEol(), strlen( GetSerialPortEol() ) );
+    SendData( buffer, MAX_SERIAL_PRINT_LEN );
+    SendData( TRUNCATION_SUFFIX, TRUNCATION_SUFFIX_LEN );
+    SendData( GetSerialPortEol(), strlen( GetSerialPortEol() ) );
   }
   else
   {
-    SendSerialPortAsyncData( buffer, len );
+    SendData( buffer, len );
   }
 }
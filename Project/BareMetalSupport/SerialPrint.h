@@ -17,9 +17,18 @@ void SerialPrintHexDump ( const void * ptr, size_t byteCount, const char * endOf
 
 // Beware that these routines consumes quite a lot of stack space,
 // so use with care while in interrupt context.
+//
+// With ENABLE_TOKENIZED_LOG, these routines and SerialPrintStr() send the format strings that live
+// in flash memory as compact binary records instead of text, see TokenizedLog.h .
 #define MAX_SERIAL_PRINT_LEN 256
 void SerialPrintf ( const char * formatStr, ... ) __attribute__ ((format(printf, 1, 2)));
 void SerialPrintV ( const char * const formatStr, va_list argList );
 
+// The output can be redirected to some other, faster channel. The redirection routine
+// may be called in interrupt context. It returns 'false' if it did not take the data,
+// which then goes to the serial port as usual.
+typedef bool (* SerialPrintRedirectRoutine )( const char * data, size_t dataLen );
+void SetSerialPrintRedirection ( SerialPrintRedirectRoutine redirectRoutine );
+
 
 #endif  // Include this header file only once.
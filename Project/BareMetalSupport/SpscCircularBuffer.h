@@ -0,0 +1,222 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef BMS_SPSC_CIRCULAR_BUFFER_H_INCLUDED
+#define BMS_SPSC_CIRCULAR_BUFFER_H_INCLUDED
+
+#include <stdint.h>
+#include <assert.h>
+
+#include "AssertionUtils.h"
+#include "CircularBufferStats.h"
+
+
+// Single-producer, single-consumer circular buffer that needs no interrupt masking.
+// The typical usage is an interrupt handler that writes and the main loop that reads, or the other way round.
+//
+// Like CPowerOfTwoCircularBuffer, it uses free-running indices and MAX_ELEM_COUNT must be a power of two.
+// The producer only ever writes m_writeIndex, and the consumer only ever writes m_readIndex.
+// Each side publishes its index only after its data accesses are complete, with a memory barrier
+// in between, so the other side never sees an index that runs ahead of the data.
+//
+// The SizeType must be a type that the CPU can read and write atomically, like uint32_t on a Cortex-M3.
+//
+// The routines are split in producer-side and consumer-side ones. Calling a routine from the wrong side
+// breaks the lock-free guarantees. Reset() may only be called when neither side is active.
+
+inline void SpscMemoryBarrier ( void )
+{
+  #ifdef __arm__
+    // On the single-core Cortex-M3, a compiler barrier would suffice for interrupt handlers,
+    // but the DMB instruction makes this class also safe with a DMA or a second bus master.
+    asm volatile( "dmb" ::: "memory" );
+  #else
+    __sync_synchronize();
+  #endif
+}
+
+
+template< typename TemplElemType,
+          typename TemplSizeType,
+          TemplSizeType MAX_ELEM_COUNT >
+
+class CSpscCircularBuffer
+{
+ public:
+  typedef TemplElemType ElemType;
+  typedef TemplSizeType SizeType;
+
+ private:
+  static const SizeType INDEX_MASK = MAX_ELEM_COUNT - 1;
+
+  ElemType           m_buffer[ MAX_ELEM_COUNT ];
+  volatile SizeType  m_readIndex;
+  volatile SizeType  m_writeIndex;
+
+  CCircularBufferStatsTracker m_statsTracker;
+
+  template < typename IntegerType >
+  static
+  IntegerType MinFrom ( const IntegerType a, const IntegerType b )
+  {
+    return a < b ? a : b;
+  }
+
+ public:
+  CSpscCircularBuffer ( void )
+  {
+    // See CPowerOfTwoCircularBuffer for the reasoning behind these checks.
+    STATIC_ASSERT( MAX_ELEM_COUNT > 0 && ( MAX_ELEM_COUNT & INDEX_MASK ) == 0, "The size must be a power of two." );
+    STATIC_ASSERT( SizeType( -1 ) > SizeType( 0 ), "The size type must be unsigned." );
+
+    Reset();
+  }
+
+  void Reset ( void )
+  {
+    m_readIndex  = 0;
+    m_writeIndex = 0;
+    m_statsTracker.NoteReset();
+  }
+
+
+  // Occupancy statistics, see CircularBufferStats.h . The tracker updates are split between
+  // the producer and consumer sides like the rest of this class, but GetStats() and ResetStats()
+  // read and write fields from both sides, so the caller must make sure that neither side is active,
+  // for example by disabling interrupts. NoteOverflow() belongs to the producer side.
+
+  void GetStats ( CircularBufferStats * const stats ) const
+  {
+    m_statsTracker.GetStats( stats );
+    stats->bufferSize = MAX_ELEM_COUNT;
+  }
+
+  void ResetStats ( void ) { m_statsTracker.ResetStats( GetElemCount() ); }
+  void NoteOverflow ( const SizeType droppedElemCount ) { m_statsTracker.NoteOverflow( droppedElemCount ); }
+
+
+  // ------- Consumer side -------
+
+  SizeType GetElemCount ( void ) const
+  {
+    const SizeType writeIndex = m_writeIndex;
+    SpscMemoryBarrier();  // Read the index before the data it covers.
+    return SizeType( writeIndex - m_readIndex );
+  }
+
+  bool IsEmpty ( void ) const { return GetElemCount() == 0; }
+
+  ElemType ReadElement ( void )
+  {
+    assert( !IsEmpty() );
+
+    const SizeType readIndex = m_readIndex;
+    const ElemType elem = m_buffer[ readIndex & INDEX_MASK ];
+
+    SpscMemoryBarrier();  // Finish reading the element before releasing its slot.
+    m_statsTracker.NoteRead( SizeType( m_writeIndex - ( readIndex + 1 ) ) );
+    m_readIndex = readIndex + 1;
+
+    return elem;
+  }
+
+  // Returns false if the buffer is empty.
+  bool TryReadElement ( ElemType * const elem )
+  {
+    if ( IsEmpty() )
+      return false;
+
+    *elem = ReadElement();
+    return true;
+  }
+
+  // See CCircularBuffer::GetReadPtr() for more information. The producer may add more elements
+  // in the meantime, so the count returned is only a lower bound.
+
+  const ElemType * GetReadPtr ( SizeType * const elemCount ) const
+  {
+    const SizeType readPos = m_readIndex & INDEX_MASK;
+    *elemCount = MinFrom( GetElemCount(), SizeType( MAX_ELEM_COUNT - readPos ) );
+    return &m_buffer[ readPos ];
+  }
+
+  void ConsumeReadElements ( const SizeType elemCountToConsume )
+  {
+    assert( elemCountToConsume != 0 );
+    assert( elemCountToConsume <= GetElemCount() );
+
+    SpscMemoryBarrier();  // Finish reading the elements before releasing their slots.
+    m_statsTracker.NoteRead( SizeType( m_writeIndex - ( m_readIndex + elemCountToConsume ) ) );
+    m_readIndex = m_readIndex + elemCountToConsume;
+  }
+
+
+  // ------- Producer side -------
+
+  SizeType GetFreeCount ( void ) const
+  {
+    const SizeType readIndex = m_readIndex;
+    SpscMemoryBarrier();  // Do not overwrite a slot before the consumer has released it.
+    return MAX_ELEM_COUNT - SizeType( m_writeIndex - readIndex );
+  }
+
+  bool IsFull ( void ) const { return GetFreeCount() == 0; }
+
+  void WriteElem ( const ElemType elemToWrite )
+  {
+    assert( !IsFull() );
+
+    const SizeType writeIndex = m_writeIndex;
+    m_buffer[ writeIndex & INDEX_MASK ] = elemToWrite;
+
+    SpscMemoryBarrier();  // Write the element before publishing it.
+    m_statsTracker.NoteWrite( SizeType( writeIndex + 1 - m_readIndex ), MAX_ELEM_COUNT );
+    m_writeIndex = writeIndex + 1;
+  }
+
+  // Returns false if the buffer is full.
+  bool TryWriteElem ( const ElemType elemToWrite )
+  {
+    if ( IsFull() )
+      return false;
+
+    WriteElem( elemToWrite );
+    return true;
+  }
+
+  // See CCircularBuffer::GetWritePtr() for more information. The consumer may free more slots
+  // in the meantime, so the count returned is only a lower bound.
+
+  ElemType * GetWritePtr ( SizeType * const elemCount )
+  {
+    const SizeType writePos = m_writeIndex & INDEX_MASK;
+    *elemCount = MinFrom( GetFreeCount(), SizeType( MAX_ELEM_COUNT - writePos ) );
+    return &m_buffer[ writePos ];
+  }
+
+  void CommitWrittenElements ( const SizeType elemCountToCommit )
+  {
+    assert( elemCountToCommit != 0 );
+    assert( elemCountToCommit <= GetFreeCount() );
+
+    SpscMemoryBarrier();  // Write the elements before publishing them.
+    m_statsTracker.NoteWrite( SizeType( m_writeIndex + elemCountToCommit - m_readIndex ), MAX_ELEM_COUNT );
+    m_writeIndex = m_writeIndex + elemCountToCommit;
+  }
+};
+
+#endif  // Include this header file only once.
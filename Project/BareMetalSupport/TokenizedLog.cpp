@@ -0,0 +1,261 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "TokenizedLog.h"  // The include file for this module should come first.
+
+#ifdef ENABLE_TOKENIZED_LOG
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "SerialPortAsyncTx.h"
+#include "AssertionUtils.h"
+
+
+// See the linker script.
+extern "C" int _sfixed;
+extern "C" int _efixed;
+
+
+static bool IsInFlash ( const void * const ptr )
+{
+  const uintptr_t addr = uintptr_t( ptr );
+  return addr >= uintptr_t( &_sfixed ) && addr < uintptr_t( &_efixed );
+}
+
+
+// Building the record in a small buffer first keeps the interrupts enabled until the record is complete.
+
+class CRecordWriter
+{
+ private:
+  uint8_t  m_buffer[ TOKENIZED_LOG_MAX_RECORD_LEN ];
+  uint32_t m_len;
+  bool     m_hasOverflowed;
+
+ public:
+  CRecordWriter ( const uint8_t marker, const char * const str )
+    : m_len( 0 )
+    , m_hasOverflowed( false )
+  {
+    const uint32_t addr = uint32_t( uintptr_t( str ) );
+    assert( addr < ( 1 << 24 ) );
+
+    PutByte( marker );
+    PutByte( uint8_t( addr       ) );
+    PutByte( uint8_t( addr >>  8 ) );
+    PutByte( uint8_t( addr >> 16 ) );
+  }
+
+  void PutByte ( const uint8_t b )
+  {
+    if ( m_len < sizeof( m_buffer ) )
+      m_buffer[ m_len++ ] = b;
+    else
+      m_hasOverflowed = true;
+  }
+
+  void PutUint32 ( uint32_t value )
+  {
+    while ( value >= 0x80 )
+    {
+      PutByte( uint8_t( value | 0x80 ) );
+      value >>= 7;
+    }
+
+    PutByte( uint8_t( value ) );
+  }
+
+  void PutUint64 ( uint64_t value )
+  {
+    while ( value >= 0x80 )
+    {
+      PutByte( uint8_t( value | 0x80 ) );
+      value >>= 7;
+    }
+
+    PutByte( uint8_t( value ) );
+  }
+
+  void PutDouble ( const double value )
+  {
+    // The ARM EABI stores doubles in little-endian order, like the record format.
+    STATIC_ASSERT( sizeof( value ) == 8, "Unexpected double size." );
+
+    uint8_t bytes[ sizeof( value ) ];
+    memcpy( bytes, &value, sizeof( bytes ) );
+
+    for ( unsigned i = 0; i < sizeof( bytes ); ++i )
+      PutByte( bytes[ i ] );
+  }
+
+  void PutString ( const char * const str )
+  {
+    const size_t len = strlen( str );
+
+    PutUint32( uint32_t( len ) );
+
+    for ( size_t i = 0; i < len && !m_hasOverflowed; ++i )
+      PutByte( uint8_t( str[ i ] ) );
+  }
+
+  bool HasOverflowed ( void ) const { return m_hasOverflowed; }
+
+  void Send ( void ) const
+  {
+    assert( !m_hasOverflowed );
+    SendSerialPortAsyncBlock( reinterpret_cast< const char * >( m_buffer ), m_len );
+  }
+};
+
+
+bool TokenizedLog_PrintStr ( const char * const str )
+{
+  if ( !IsInFlash( str ) )
+    return false;
+
+  CRecordWriter writer( TOKENIZED_LOG_STRING_MARKER, str );
+  writer.Send();
+
+  return true;
+}
+
+
+// The format string parsing must match the decoder's.
+
+bool TokenizedLog_PrintV ( const char * const formatStr, va_list argList )
+{
+  if ( !IsInFlash( formatStr ) )
+    return false;
+
+  CRecordWriter writer( TOKENIZED_LOG_FORMAT_MARKER, formatStr );
+
+  for ( const char * p = formatStr; *p != 0; ++p )
+  {
+    if ( *p != '%' )
+      continue;
+
+    ++p;
+
+    while ( *p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' )
+      ++p;
+
+    if ( *p == '*' )
+    {
+      writer.PutUint32( uint32_t( va_arg( argList, int ) ) );
+      ++p;
+    }
+    else
+    {
+      while ( *p >= '0' && *p <= '9' )
+        ++p;
+    }
+
+    if ( *p == '.' )
+    {
+      ++p;
+
+      if ( *p == '*' )
+      {
+        writer.PutUint32( uint32_t( va_arg( argList, int ) ) );
+        ++p;
+      }
+      else
+      {
+        while ( *p >= '0' && *p <= '9' )
+          ++p;
+      }
+    }
+
+    // On this platform, only "ll" and "j" mean 64 bits. "long", "size_t" and "ptrdiff_t" are 32 bits wide.
+    unsigned longCount = 0;
+
+    for ( ; ; ++p )
+    {
+      if ( *p == 'h' || *p == 'z' || *p == 't' )
+        continue;
+
+      if ( *p == 'l' )
+      {
+        ++longCount;
+        continue;
+      }
+
+      if ( *p == 'j' )
+      {
+        longCount = 2;
+        continue;
+      }
+
+      break;
+    }
+
+    switch ( *p )
+    {
+    case '%':
+      break;
+
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    case 'c':
+      if ( longCount >= 2 )
+        writer.PutUint64( va_arg( argList, unsigned long long ) );
+      else
+        writer.PutUint32( va_arg( argList, unsigned ) );
+      break;
+
+    case 'p':
+      writer.PutUint32( uint32_t( uintptr_t( va_arg( argList, const void * ) ) ) );
+      break;
+
+    case 's':
+      {
+        const char * const str = va_arg( argList, const char * );
+        writer.PutString( str == NULL ? "(null)" : str );
+      }
+      break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      writer.PutDouble( va_arg( argList, double ) );
+      break;
+
+    default:
+      // This includes "%n", "long double" arguments and a '%' at the end of the format string.
+      return false;
+    }
+
+    if ( writer.HasOverflowed() )
+      return false;
+  }
+
+  writer.Send();
+
+  return true;
+}
+
+#endif  // #ifdef ENABLE_TOKENIZED_LOG
@@ -0,0 +1,59 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef BMS_TOKENIZED_LOG_H_INCLUDED
+#define BMS_TOKENIZED_LOG_H_INCLUDED
+
+#include <stdarg.h>
+
+// Tokenized logging sends the address of the format string in flash memory and the raw arguments
+// to the serial port, instead of the formatted text. This avoids calling vsnprintf() in SerialPrintf()
+// and makes the output several times shorter. It is only available if ENABLE_TOKENIZED_LOG is defined,
+// see --enable-tokenized-log in configure.ac .
+//
+// Host tool JtagTroubleshooting/DecodeTokenizedLog.c rebuilds the text, looking up the format strings
+// in the firmware ELF file. You must use the ELF file of the exact same build.
+//
+// Record format:
+//   1 byte : TOKENIZED_LOG_FORMAT_MARKER or TOKENIZED_LOG_STRING_MARKER.
+//   3 bytes: String address, little endian. The flash memory is well below 16 MiB.
+//   n bytes: Only for format strings, the arguments in the order they appear in the format string:
+//            - Integers up to 32 bits (including characters and pointers) and 64-bit integers
+//              as unsigned LEB128 numbers. Negative numbers are sent as their unsigned 32-bit
+//              or 64-bit equivalent.
+//            - Doubles as 8 raw bytes, little endian.
+//            - Strings as an unsigned LEB128 length followed by the characters, without null terminator.
+//            - Width or precision arguments ('*') like integers, before the argument they apply to.
+//
+// The marker bytes never appear in ASCII or UTF-8 text, so the records can be mixed with plain text.
+// A record is never cut in half: if it does not fit in the serial port Tx Buffer, the whole record gets dropped.
+//
+// Strings that do not live in flash memory, and format strings with unsupported conversions like "%n"
+// or whose record would exceed TOKENIZED_LOG_MAX_RECORD_LEN, are sent as plain text.
+
+#define TOKENIZED_LOG_FORMAT_MARKER  0xFE
+#define TOKENIZED_LOG_STRING_MARKER  0xFD
+
+#define TOKENIZED_LOG_MAX_RECORD_LEN  128
+
+// These routines return 'false' if they did not send anything, and the caller should print the text instead.
+// The argument list is consumed in any case.
+bool TokenizedLog_PrintV ( const char * formatStr, va_list argList );
+bool TokenizedLog_PrintStr ( const char * str );
+
+
+#endif  // Include this header file only once.
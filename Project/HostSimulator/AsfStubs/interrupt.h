@@ -0,0 +1,45 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef HOST_SIM_INTERRUPT_H_INCLUDED
+#define HOST_SIM_INTERRUPT_H_INCLUDED
+
+// Stand-in for the ASF interrupt management routines, see sam3xa.h in this directory.
+
+#include <sam3xa.h>
+
+typedef uint32_t irqflags_t;
+
+inline bool cpu_irq_is_enabled ( void ) { return g_simulatedPrimask == 0; }
+
+inline void cpu_irq_enable  ( void ) { __enable_irq();  }
+inline void cpu_irq_disable ( void ) { __disable_irq(); }
+
+inline irqflags_t cpu_irq_save ( void )
+{
+  const irqflags_t flags = __get_PRIMASK();
+  __disable_irq();
+  return flags;
+}
+
+inline void cpu_irq_restore ( const irqflags_t flags )
+{
+  if ( flags == 0 )
+    __enable_irq();
+}
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,38 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef HOST_SIM_PIO_H_INCLUDED
+#define HOST_SIM_PIO_H_INCLUDED
+
+// Stand-in for the ASF PIO driver, implemented in SimulatedPio.cpp .
+
+#include <sam3xa.h>
+
+#define LOW   0
+#define HIGH  1
+
+#define DISABLE  0
+#define ENABLE   1
+
+#define PIO_DEFAULT  ( 0 << 0 )
+#define PIO_PULLUP   ( 1 << 0 )
+
+void pio_set_input  ( Pio * pioPtr, uint32_t mask, uint32_t attribute );
+void pio_set_output ( Pio * pioPtr, uint32_t mask, uint32_t defaultLevel, uint32_t multiDriveEnable, uint32_t pullUpEnable );
+void pio_pull_up    ( Pio * pioPtr, uint32_t mask, uint32_t pullUpEnable );
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,28 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef HOST_SIM_PMC_H_INCLUDED
+#define HOST_SIM_PMC_H_INCLUDED
+
+// Stand-in for the ASF power management controller driver. All peripheral clocks are always enabled.
+
+#include <sam3xa.h>
+
+inline uint32_t pmc_enable_periph_clk     ( uint32_t ) { return 0; }
+inline uint32_t pmc_is_periph_clk_enabled ( uint32_t ) { return 1; }
+
+
+#endif  // Include this header file only once.
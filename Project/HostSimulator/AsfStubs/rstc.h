@@ -0,0 +1,33 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef HOST_SIM_RSTC_H_INCLUDED
+#define HOST_SIM_RSTC_H_INCLUDED
+
+// Stand-in for the ASF reset controller driver. The simulator always reports a power-on reset.
+
+#include <sam3xa.h>
+
+#define RSTC_GENERAL_RESET   ( 0 << 8 )
+#define RSTC_BACKUP_RESET    ( 1 << 8 )
+#define RSTC_WATCHDOG_RESET  ( 2 << 8 )
+#define RSTC_SOFTWARE_RESET  ( 3 << 8 )
+#define RSTC_USER_RESET      ( 4 << 8 )
+
+inline uint32_t rstc_get_reset_cause ( Rstc * ) { return RSTC_GENERAL_RESET; }
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,189 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef HOST_SIM_SAM3XA_H_INCLUDED
+#define HOST_SIM_SAM3XA_H_INCLUDED
+
+// Stand-in for the CMSIS device header when building the firmware for the host simulator,
+// see HostSimulator/Makefile.am . It only provides what the simulated modules use.
+//
+// The peripheral registers are plain variables. Code that must see the register accesses,
+// like the PIO pin routines in IoUtils.h, calls the simulator directly instead.
+
+#ifndef HOST_SIMULATOR
+  #error "This header file is only meant for the host simulator."
+#endif
+
+#include <stdint.h>
+
+#define __I   volatile const
+#define __O   volatile
+#define __IO  volatile
+
+
+// ---- PIO
+
+struct Pio
+{
+  __O  uint32_t PIO_PER;
+  __O  uint32_t PIO_PDR;
+  __I  uint32_t PIO_PSR;
+  __O  uint32_t PIO_OER;
+  __O  uint32_t PIO_ODR;
+  __I  uint32_t PIO_OSR;
+  __O  uint32_t PIO_SODR;
+  __O  uint32_t PIO_CODR;
+  __IO uint32_t PIO_ODSR;
+  __I  uint32_t PIO_PDSR;
+  __O  uint32_t PIO_PUDR;
+  __O  uint32_t PIO_PUER;
+  __I  uint32_t PIO_PUSR;
+  __O  uint32_t PIO_OWER;
+  __O  uint32_t PIO_OWDR;
+  __I  uint32_t PIO_OWSR;
+};
+
+extern Pio g_simulatedPio[ 4 ];
+
+#define PIOA  ( &g_simulatedPio[ 0 ] )
+#define PIOB  ( &g_simulatedPio[ 1 ] )
+#define PIOC  ( &g_simulatedPio[ 2 ] )
+#define PIOD  ( &g_simulatedPio[ 3 ] )
+
+#define PIO_DELTA  sizeof( Pio )
+
+#define ID_UART  8
+#define ID_PIOA  11
+#define ID_PIOB  12
+#define ID_PIOC  13
+#define ID_PIOD  14
+
+
+// ---- DWT cycle counter
+
+// The simulated cycle counter follows the host's monotonic clock, scaled to CPU_CLOCK,
+// so that the firmware time-outs and statistics still make sense.
+
+uint32_t GetSimulatedCycleCount ( void );
+
+class CSimulatedCycleCounter
+{
+  uint32_t m_offset;
+
+public:
+  operator uint32_t ( void ) const volatile
+  {
+    return GetSimulatedCycleCount() - m_offset;
+  }
+
+  void operator= ( const uint32_t value ) volatile
+  {
+    m_offset = GetSimulatedCycleCount() - value;
+  }
+};
+
+struct DWT_Type
+{
+  __IO uint32_t CTRL;
+  CSimulatedCycleCounter CYCCNT;
+};
+
+extern DWT_Type g_simulatedDwt;
+#define DWT  ( &g_simulatedDwt )
+
+#define DWT_CTRL_CYCCNTENA_Msk  ( 1UL << 0 )
+
+struct CoreDebug_Type
+{
+  __IO uint32_t DEMCR;
+};
+
+extern CoreDebug_Type g_simulatedCoreDebug;
+#define CoreDebug  ( &g_simulatedCoreDebug )
+
+#define CoreDebug_DEMCR_TRCENA_Msk  ( 1UL << 24 )
+
+
+// ---- SysTick
+
+// The host main loop advances the uptime directly, so the SysTick registers
+// only need to satisfy the sanity checks in SysTickUtils.h .
+
+struct SysTick_Type
+{
+  __IO uint32_t CTRL;
+  __IO uint32_t LOAD;
+  __IO uint32_t VAL;
+};
+
+extern SysTick_Type g_simulatedSysTick;
+#define SysTick  ( &g_simulatedSysTick )
+
+#define SysTick_CTRL_CLKSOURCE_Msk  ( 1UL << 2 )
+#define SysTick_LOAD_RELOAD_Msk     0xFFFFFFUL
+
+
+// ---- Reset controller and watchdog
+
+struct Rstc
+{
+  __IO uint32_t RSTC_SR;
+};
+
+extern Rstc g_simulatedRstc;
+#define RSTC  ( &g_simulatedRstc )
+
+struct Wdt
+{
+  __IO uint32_t WDT_MR;
+};
+
+extern Wdt g_simulatedWdt;
+#define WDT  ( &g_simulatedWdt )
+
+
+// ---- Core intrinsics, see SimulatedCpu.cpp .
+
+// There are no real interrupts in the simulator. Instead, pending simulated interrupts,
+// like the SysTick, run whenever the firmware enables the interrupts again.
+// The PRIMASK register is simulated too, because the firmware checks it with assertions.
+
+extern uint32_t g_simulatedPrimask;
+
+void DeliverPendingSimulatedInterrupts ( void );
+
+inline void __disable_irq ( void )
+{
+  g_simulatedPrimask = 1;
+}
+
+inline void __enable_irq ( void )
+{
+  g_simulatedPrimask = 0;
+  DeliverPendingSimulatedInterrupts();
+}
+
+inline uint32_t __get_PRIMASK ( void ) { return g_simulatedPrimask; }
+
+// __WFE() waits on the host until the next simulated interrupt or until data arrives.
+void __SEV ( void );
+void __WFE ( void );
+
+inline void __DSB ( void ) {}
+inline void __DMB ( void ) {}
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,35 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef HOST_SIM_UDI_CDC_H_INCLUDED
+#define HOST_SIM_UDI_CDC_H_INCLUDED
+
+// Stand-in for the ASF USB CDC device interface. The simulator implements these routines
+// on top of a pseudo-terminal, see PtyTransport.cpp .
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef size_t iram_size_t;  // Like on the target, where both are 32 bits wide.
+
+// These routines return how many bytes could NOT be transferred, like the ASF ones.
+iram_size_t udi_cdc_read_buf  ( void * buf, iram_size_t size );
+iram_size_t udi_cdc_write_buf ( const void * buf, iram_size_t size );
+
+iram_size_t udi_cdc_get_nb_received_data ( void );
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,27 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef HOST_SIM_WDT_H_INCLUDED
+#define HOST_SIM_WDT_H_INCLUDED
+
+// Stand-in for the ASF watchdog driver. There is no watchdog in the simulator.
+
+#include <sam3xa.h>
+
+inline void wdt_restart ( Wdt * ) {}
+
+
+#endif  // Include this header file only once.
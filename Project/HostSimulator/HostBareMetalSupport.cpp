@@ -0,0 +1,225 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Host versions of the Bare Metal Support routines that talk to the hardware.
+// The rest of the Bare Metal Support library is compiled unchanged, see Makefile.am .
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <BareMetalSupport/AssertionUtils.h>
+#include <BareMetalSupport/Miscellaneous.h>
+#include <BareMetalSupport/StackCheck.h>
+#include <BareMetalSupport/BusyWait.h>
+#include <BareMetalSupport/SerialPortUtils.h>
+#include <BareMetalSupport/SerialPortAsyncTx.h>
+#include <BareMetalSupport/DwtUtils.h>
+
+#include "PtyTransport.h"
+
+
+// ---- Miscellaneous.h
+
+void BreakpointPlaceholder ( void )
+{
+}
+
+
+void ForeverHang ( bool ) throw()
+{
+  fflush( stdout );
+  abort();
+}
+
+
+// There is no board to reset, so the simulator just quits.
+
+void ResetBoard ( bool )
+{
+  fflush( stdout );
+  TerminatePtyTransport();
+  exit( EXIT_SUCCESS );
+}
+
+
+// ---- AssertionUtils.h
+
+static UserPanicMsgFunction s_UserPanicMsgFunction = NULL;
+
+void SetUserPanicMsgFunction ( const UserPanicMsgFunction functionPointer )
+{
+  s_UserPanicMsgFunction = functionPointer;
+}
+
+
+void Panic ( const char * const msg )
+{
+  if ( s_UserPanicMsgFunction )
+    s_UserPanicMsgFunction( msg );
+
+  ForeverHangAfterPanic();
+}
+
+
+void ForeverHangAfterPanic ( void )
+{
+  fflush( stdout );
+  abort();
+}
+
+
+// ---- StackCheck.h
+
+// The host has no fixed memory partitions. The malloc heap is reported as it is,
+// so that the "MemoryUsage" console command still adds up.
+
+extern "C" int _end;
+
+uintptr_t GetStackStartAddr ( void ) throw()
+{
+  return GetHeapEndAddr();
+}
+
+void SetStackSize ( size_t ) throw()
+{
+}
+
+uintptr_t GetHeapEndAddr ( void ) throw()
+{
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+  return uintptr_t( &_end ) + unsigned( mallinfo().arena );
+  #pragma GCC diagnostic pop
+}
+
+void SetHeapEndAddr ( uintptr_t ) throw()
+{
+}
+
+void FillStackCanary ( void ) throw()
+{
+}
+
+bool CheckStackCanary ( size_t ) throw()
+{
+  return true;
+}
+
+size_t GetStackSizeUsageEstimate ( void ) throw()
+{
+  return 0;
+}
+
+size_t GetCurrentStackDepth ( void ) throw()
+{
+  return 0;
+}
+
+
+// ---- BusyWait.h
+
+// The real loop takes 3 clock cycles per iteration.
+
+void BusyWaitAsmLoop ( const uint32_t iterationCount )
+{
+  const uint32_t startCycleCount = GetDwtCycleCount();
+
+  while ( GetDwtElapsedCycleCount( startCycleCount ) < iterationCount * 3 )
+  {
+  }
+}
+
+bool IsBusyWaitAsmLoopAligned ( void )
+{
+  return true;
+}
+
+
+// ---- SerialPortUtils.h and SerialPortAsyncTx.h
+
+// The serial port is the simulator's standard output. Writing to it may block, so nothing gets lost.
+
+static const char * s_serialPortEol = NULL;
+static bool s_wasSerialPortDataSent = false;
+
+void InitSerialPort ( bool )
+{
+}
+
+bool WasSerialPortInitialised ( void )
+{
+  return true;
+}
+
+void SerialSyncWriteStr ( const char * const msg )
+{
+  fputs( msg, stdout );
+  fflush( stdout );
+}
+
+void SerialSyncWriteUint32Hex ( const uint32_t val )
+{
+  printf( "0x%08X", unsigned( val ) );
+  fflush( stdout );
+}
+
+void SerialWaitForDataSent ( void )
+{
+  fflush( stdout );
+}
+
+void InitSerialPortAsyncTx ( const char * const eol )
+{
+  s_serialPortEol = eol;
+}
+
+const char * GetSerialPortEol ( void )
+{
+  return s_serialPortEol;
+}
+
+void SerialPortAsyncTxInterruptHandler ( void )
+{
+}
+
+void SendSerialPortAsyncData ( const char * const data, const size_t dataLen )
+{
+  fwrite( data, 1, dataLen, stdout );
+  fflush( stdout );
+  s_wasSerialPortDataSent = true;
+}
+
+void SendSerialPortAsyncBlock ( const char * const data, const size_t dataLen )
+{
+  SendSerialPortAsyncData( data, dataLen );
+}
+
+bool HasSerialPortDataBeenSentSinceLastCall ( void )
+{
+  const bool ret = s_wasSerialPortDataSent;
+  s_wasSerialPortDataSent = false;
+  return ret;
+}
+
+void GetSerialPortTxBufferStats ( CircularBufferStats * const stats )
+{
+  memset( stats, 0, sizeof( *stats ) );
+}
+
+void ResetSerialPortTxBufferStats ( void )
+{
+}
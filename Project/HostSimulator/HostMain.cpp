@@ -0,0 +1,227 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Entry point of the host-native simulator build. It mirrors JtagFirmware/Main.cpp ,
+// but without the serial port console and the USB diagnostic port. The serial port
+// is the standard output, and the native USB port is a pseudo-terminal.
+
+#include <stdexcept>
+#include <vector>
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <BareMetalSupport/Miscellaneous.h>
+#include <BareMetalSupport/AssertionUtils.h>
+#include <BareMetalSupport/BusyWait.h>
+#include <BareMetalSupport/StackCheck.h>
+#include <BareMetalSupport/Uptime.h>
+#include <BareMetalSupport/SerialPortUtils.h>
+#include <BareMetalSupport/SerialPortAsyncTx.h>
+#include <BareMetalSupport/SerialPrint.h>
+#include <BareMetalSupport/MainLoopSleep.h>
+#include <BareMetalSupport/DwtUtils.h>
+
+#include <JtagFirmware/Globals.h>
+#include <JtagFirmware/UsbConnection.h>
+#include <JtagFirmware/BusPirateOpenOcdMode.h>
+#include <JtagFirmware/WorkBudget.h>
+#include <JtagFirmware/MainLoopStats.h>
+
+#include <pmc.h>
+
+#include "SimulatedPio.h"
+#include "SimulatedCpu.h"
+#include "PtyTransport.h"
+#include "VirtualJtagTarget.h"
+
+
+static volatile sig_atomic_t s_wasQuitRequested = 0;
+
+static void QuitSignalHandler ( int )
+{
+  s_wasQuitRequested = 1;
+}
+
+
+static void PrintPanicMsg ( const char * const msg )
+{
+  fflush( stdout );
+  fprintf( stderr, "PANIC: %s\n", msg );
+}
+
+
+static uint32_t s_mainLoopWakeUpCounterTimeouts = 0;
+static uint32_t s_mainLoopWakeUpCounterCpuLoad  = 0;
+
+// Same as SysTick_Handler() in JtagFirmware/Main.cpp .
+
+static void SimulatedSysTickHandler ( void )
+{
+  IncrementUptime( SYSTEM_TICK_PERIOD_MS );
+
+  const uint32_t MAINLOOP_WAKE_UP_TIMEOUTS_TICK_COUNT = 250 / SYSTEM_TICK_PERIOD_MS;
+
+  if ( ++s_mainLoopWakeUpCounterTimeouts == MAINLOOP_WAKE_UP_TIMEOUTS_TICK_COUNT )
+  {
+    s_mainLoopWakeUpCounterTimeouts = 0;
+    WakeFromMainLoopSleep();
+  }
+
+  const uint32_t MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT = 1000 / CPU_LOAD_SHORT_PERIOD_SLOT_COUNT / SYSTEM_TICK_PERIOD_MS;
+
+  if ( ++s_mainLoopWakeUpCounterCpuLoad == MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT )
+  {
+    s_mainLoopWakeUpCounterCpuLoad = 0;
+    CpuLoadStatsTick();
+    WakeFromMainLoopSleep();
+  }
+}
+
+
+static void Configure ( const char * const linkPath )
+{
+  InitSerialPortAsyncTx( EOL );
+
+  SerialPrintf( "--- JtagDue %s host simulator ---" EOL, PACKAGE_VERSION );
+
+  SetUserPanicMsgFunction( &PrintPanicMsg );
+
+  EnableDwtCycleCounter();
+
+  InitSimulatedPio();
+
+  InitSimulatedCpu( &SimulatedSysTickHandler, SYSTEM_TICK_PERIOD_MS );
+
+  SetStackSize( STACK_SIZE );
+
+  VERIFY( 0 == pmc_enable_periph_clk( ID_PIOA ) );
+  VERIFY( 0 == pmc_enable_periph_clk( ID_PIOB ) );
+  VERIFY( 0 == pmc_enable_periph_clk( ID_PIOC ) );
+  VERIFY( 0 == pmc_enable_periph_clk( ID_PIOD ) );
+
+  InitJtagPins();
+
+  InitVirtualJtagTarget();
+
+  InitPtyTransport( linkPath );
+}
+
+
+static void MainLoop ( void )
+{
+  SerialPrintStr( "Entering the main loop." EOL );
+
+  while ( !s_wasQuitRequested )
+  {
+    const uint64_t currentTime = GetUptime();
+
+    const uint32_t iterationStartCycleCount = GetDwtCycleCount();
+    uint32_t phaseStartCycleCount = iterationStartCycleCount;
+
+    WorkBudget_BeginPass();
+
+    WorkBudget_BeginService( wbsUsbConnection );
+    ServiceUsbConnection( currentTime );
+    WorkBudget_EndService();
+    phaseStartCycleCount = MainLoopStats_EndPhase( mlpUsbConnection, phaseStartCycleCount );
+
+    assert( AreInterruptsEnabled() );
+
+    UpdateCpuLoadStats();
+    MainLoopStats_EndPhase( mlpCpuLoadStats, phaseStartCycleCount );
+
+    const uint32_t sleepStartCycleCount = MainLoopStats_EndPhase( mlpBusy, iterationStartCycleCount );
+
+    MainLoopSleep();
+
+    MainLoopStats_EndPhase( mlpSleep, sleepStartCycleCount );
+  }
+
+  SerialPrintStr( "Leaving the main loop." EOL );
+
+  VirtualJtagTarget_PrintStats();
+}
+
+
+static void PrintUsage ( void )
+{
+  printf( "Usage: jtagdue-sim [--link <path>] [--tap <spec>]...\n"
+          "\n"
+          "Runs the JtagDue firmware on the host. The native USB port is a pseudo-terminal.\n"
+          "Option --link creates a symbolic link to it, like /tmp/jtagdue, for OpenOCD's\n"
+          "\"buspirate_port\" setting. The link is removed on exit.\n"
+          "\n"
+          "Each --tap option adds a TAP model to the virtual JTAG target, starting with the TAP\n"
+          "nearest to TDO. The TAP specification syntax is:\n"
+          "  arm-dp[:idcode=<n>,ram-base=<n>,ram-size=<n>,ap-wait=<n>]\n"
+          "  generic[:idcode=<n>,ir-length=<n>]\n"
+          "For example, an STM32F1 chain is: --tap arm-dp --tap generic\n" );
+}
+
+
+int main ( const int argc, char ** const argv )
+{
+  const char * linkPath = NULL;
+  std::vector< const char * > tapSpecs;
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    if ( 0 == strcmp( argv[ i ], "--link" ) && i + 1 < argc )
+    {
+      linkPath = argv[ ++i ];
+    }
+    else if ( 0 == strcmp( argv[ i ], "--tap" ) && i + 1 < argc )
+    {
+      tapSpecs.push_back( argv[ ++i ] );
+    }
+    else if ( 0 == strcmp( argv[ i ], "--help" ) )
+    {
+      PrintUsage();
+      return EXIT_SUCCESS;
+    }
+    else
+    {
+      fprintf( stderr, "Invalid command-line argument \"%s\".\n", argv[ i ] );
+      PrintUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  signal( SIGINT,  &QuitSignalHandler );
+  signal( SIGTERM, &QuitSignalHandler );
+  signal( SIGPIPE, SIG_IGN );
+
+  try
+  {
+    for ( size_t i = 0; i < tapSpecs.size(); ++i )
+      VirtualJtagTarget_AddTap( tapSpecs[ i ] );
+
+    Configure( linkPath );
+    MainLoop();
+  }
+  catch ( const std::exception & e )
+  {
+    fflush( stdout );
+    fprintf( stderr, "Error: %s\n", e.what() );
+    TerminatePtyTransport();
+    return EXIT_FAILURE;
+  }
+
+  TerminatePtyTransport();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Host version of UsbSupport.cpp . The native USB port is a pseudo-terminal,
+// see PtyTransport.cpp , which offers no vendor interface.
+
+#include <assert.h>
+#include <string.h>
+
+#include <BareMetalSupport/AssertionUtils.h>
+
+#include <JtagFirmware/UsbSupport.h>
+
+#include <udi_cdc.h>
+
+#include "PtyTransport.h"
+
+
+void InitUsb ( void )
+{
+}
+
+
+// Simulate a high-speed USB connection.
+
+uint32_t GetUsbDataPacketSize ( void )
+{
+  return 512;
+}
+
+
+bool IsUsbConnectionOpen ( void )
+{
+  return IsPtyClientConnected();
+}
+
+
+void UsbWriteData ( const void * const data, const size_t dataLen )
+{
+  const uint8_t * currPos = (const uint8_t *) data;
+  size_t byteCountLeft = dataLen;
+
+  while ( byteCountLeft > 0 )
+  {
+    const size_t remainingCount = udi_cdc_write_buf( currPos, byteCountLeft );
+
+    assert( remainingCount <= byteCountLeft );
+
+    const size_t writtenCount = byteCountLeft - remainingCount;
+
+    byteCountLeft -= writtenCount;
+    currPos += writtenCount;
+  }
+}
+
+
+void UsbWriteStr ( const char * const str )
+{
+  UsbWriteData( str, strlen( str ) );
+}
+
+
+void DiscardAllUsbData ( void )
+{
+  uint8_t buffer[ 64 ];
+
+  while ( udi_cdc_get_nb_received_data() != 0 )
+  {
+    udi_cdc_read_buf( buffer, sizeof( buffer ) );
+  }
+}
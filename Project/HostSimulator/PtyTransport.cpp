@@ -0,0 +1,230 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+#include "PtyTransport.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <stdexcept>
+#include <string>
+
+#include <BareMetalSupport/SerialPrint.h>
+#include <BareMetalSupport/AssertionUtils.h>
+#include <BareMetalSupport/Miscellaneous.h>
+
+#include <JtagFirmware/Globals.h>
+#include <JtagFirmware/UsbConnection.h>
+
+#include <udi_cdc.h>
+
+#include "SimulatedCpu.h"
+
+
+static int s_masterFd = -1;
+
+static std::string s_linkPath;
+
+// Like the packet buffers inside the ASF CDC layer, this buffer holds the data read from
+// the pseudo-terminal until the firmware collects it.
+static uint8_t  s_rxPacket[ 512 ];
+static uint32_t s_rxPacketBegin = 0;
+static uint32_t s_rxPacketEnd   = 0;
+
+static bool s_isTxBlocked = false;
+
+
+static void ThrowErrno ( const char * const operation )
+{
+  throw std::runtime_error( std::string( operation ) + ": " + strerror( errno ) );
+}
+
+
+static void UpdateWakeUpEvents ( void )
+{
+  short events = 0;
+
+  // While the firmware has not collected the last packet, any new data can wait.
+  if ( s_rxPacketBegin == s_rxPacketEnd )
+    events |= POLLIN;
+
+  if ( s_isTxBlocked )
+    events |= POLLOUT;
+
+  SimulatedCpu_SetWakeUpFd( s_masterFd, events );
+}
+
+
+void InitPtyTransport ( const char * const linkPath )
+{
+  assert( s_masterFd == -1 );
+
+  s_masterFd = posix_openpt( O_RDWR | O_NOCTTY | O_NONBLOCK );
+
+  if ( s_masterFd == -1 )
+    ThrowErrno( "Cannot open a pseudo-terminal" );
+
+  if ( 0 != grantpt( s_masterFd ) || 0 != unlockpt( s_masterFd ) )
+    ThrowErrno( "Cannot unlock the pseudo-terminal" );
+
+  const char * const slaveName = ptsname( s_masterFd );
+
+  if ( slaveName == NULL )
+    ThrowErrno( "Cannot get the pseudo-terminal name" );
+
+  // The Bus Pirate protocol is binary, so turn off all line editing. This affects the slave side too.
+  termios settings;
+
+  if ( 0 != tcgetattr( s_masterFd, &settings ) )
+    ThrowErrno( "Cannot get the pseudo-terminal settings" );
+
+  cfmakeraw( &settings );
+
+  if ( 0 != tcsetattr( s_masterFd, TCSANOW, &settings ) )
+    ThrowErrno( "Cannot set the pseudo-terminal settings" );
+
+  // poll() only starts reporting POLLHUP after the slave side has been closed for the first time,
+  // see IsPtyClientConnected().
+  const int slaveFd = open( slaveName, O_RDWR | O_NOCTTY );
+
+  if ( slaveFd == -1 )
+    ThrowErrno( "Cannot open the pseudo-terminal slave" );
+
+  close( slaveFd );
+
+  if ( linkPath != NULL )
+  {
+    struct stat linkStat;
+
+    if ( 0 == lstat( linkPath, &linkStat ) && S_ISLNK( linkStat.st_mode ) )
+      unlink( linkPath );
+
+    if ( 0 != symlink( slaveName, linkPath ) )
+      ThrowErrno( "Cannot create the pseudo-terminal link" );
+
+    s_linkPath = linkPath;
+  }
+
+  SerialPrintf( "Simulated native USB port: %s%s%s" EOL,
+                slaveName,
+                linkPath == NULL ? "" : ", link: ",
+                linkPath == NULL ? "" : linkPath );
+
+  UpdateWakeUpEvents();
+}
+
+
+void TerminatePtyTransport ( void )
+{
+  if ( !s_linkPath.empty() )
+  {
+    unlink( s_linkPath.c_str() );
+    s_linkPath.clear();
+  }
+
+  if ( s_masterFd != -1 )
+  {
+    SimulatedCpu_SetWakeUpFd( -1, 0 );
+    close( s_masterFd );
+    s_masterFd = -1;
+  }
+}
+
+
+bool IsPtyClientConnected ( void )
+{
+  pollfd fds;
+  fds.fd      = s_masterFd;
+  fds.events  = 0;
+  fds.revents = 0;
+
+  VERIFY( poll( &fds, 1, 0 ) != -1 || errno == EINTR );
+
+  return 0 == ( fds.revents & POLLHUP );
+}
+
+
+// ---- ASF CDC stand-ins, see udi_cdc.h .
+
+iram_size_t udi_cdc_get_nb_received_data ( void )
+{
+  if ( s_rxPacketBegin == s_rxPacketEnd )
+  {
+    s_rxPacketBegin = 0;
+    s_rxPacketEnd   = 0;
+
+    const ssize_t readCount = read( s_masterFd, s_rxPacket, sizeof( s_rxPacket ) );
+
+    // EAGAIN means that there is no data, and EIO that no client is connected.
+    if ( readCount > 0 )
+      s_rxPacketEnd = uint32_t( readCount );
+
+    UpdateWakeUpEvents();
+  }
+
+  return s_rxPacketEnd - s_rxPacketBegin;
+}
+
+
+iram_size_t udi_cdc_read_buf ( void * const buf, const iram_size_t size )
+{
+  const uint32_t count = MinFrom( size, udi_cdc_get_nb_received_data() );
+
+  memcpy( buf, &s_rxPacket[ s_rxPacketBegin ], count );
+  s_rxPacketBegin += count;
+
+  if ( s_rxPacketBegin == s_rxPacketEnd )
+    UpdateWakeUpEvents();
+
+  return size - count;
+}
+
+
+iram_size_t udi_cdc_write_buf ( const void * const buf, const iram_size_t size )
+{
+  const ssize_t writtenCount = write( s_masterFd, buf, size );
+
+  uint32_t remainingCount;
+
+  if ( writtenCount >= 0 )
+  {
+    remainingCount = size - uint32_t( writtenCount );
+
+    // There are no USB packets here, so each write takes the place of a USB transfer.
+    if ( writtenCount > 0 )
+      NoteUsbTxTransferComplete();
+  }
+  else if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+  {
+    remainingCount = size;
+  }
+  else
+  {
+    // The client has gone. Discard the data, the connection will be closed shortly.
+    remainingCount = 0;
+  }
+
+  s_isTxBlocked = remainingCount != 0;
+  UpdateWakeUpEvents();
+
+  return remainingCount;
+}
@@ -0,0 +1,32 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef PTY_TRANSPORT_H_INCLUDED
+#define PTY_TRANSPORT_H_INCLUDED
+
+// The host simulator offers its native USB port as a pseudo-terminal. The udi_cdc_xxx() routines
+// in AsfStubs/udi_cdc.h read from and write to it. A client like OpenOCD or a terminal emulator
+// connects by opening the pseudo-terminal's slave device, whose name changes every time.
+// The optional link path gives it a fixed name, like a udev rule does for /dev/jtagdue1 .
+
+void InitPtyTransport ( const char * linkPath );
+void TerminatePtyTransport ( void );
+
+// Whether a client has the pseudo-terminal open, which is the equivalent of an open CDC connection.
+bool IsPtyClientConnected ( void );
+
+
+#endif  // Include this header file only once.
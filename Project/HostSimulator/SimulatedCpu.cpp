@@ -0,0 +1,145 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+#include "SimulatedCpu.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stddef.h>
+#include <time.h>
+#include <poll.h>
+
+#include <sam3xa.h>
+
+
+DWT_Type       g_simulatedDwt;
+CoreDebug_Type g_simulatedCoreDebug;
+SysTick_Type   g_simulatedSysTick;
+Rstc           g_simulatedRstc;
+Wdt            g_simulatedWdt;
+
+uint32_t g_simulatedPrimask = 0;
+
+static SimulatedInterruptHandler s_sysTickHandler = NULL;
+static uint64_t s_sysTickPeriodNs;
+static uint64_t s_nextSysTickNs;
+
+static bool s_isInInterrupt = false;
+static bool s_isEventPending = false;
+
+static int   s_wakeUpFd = -1;
+static short s_wakeUpPollEvents = 0;
+static bool  s_wasHangUpReported = false;
+
+
+static uint64_t GetHostTimeNs ( void )
+{
+  timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return uint64_t( ts.tv_sec ) * 1000000000 + uint64_t( ts.tv_nsec );
+}
+
+
+uint32_t GetSimulatedCycleCount ( void )
+{
+  // The cycle counter wraps around like the real one.
+  return uint32_t( GetHostTimeNs() * ( CPU_CLOCK / 1000000 ) / 1000 );
+}
+
+
+void InitSimulatedCpu ( const SimulatedInterruptHandler sysTickHandler, const uint32_t sysTickPeriodMs )
+{
+  assert( sysTickPeriodMs > 0 );
+
+  // The SysTick counts the CPU clock, just like the firmware configures it.
+  g_simulatedSysTick.CTRL = SysTick_CTRL_CLKSOURCE_Msk;
+  g_simulatedSysTick.LOAD = CPU_CLOCK / 1000 * sysTickPeriodMs - 1;
+
+  s_sysTickHandler  = sysTickHandler;
+  s_sysTickPeriodNs = uint64_t( sysTickPeriodMs ) * 1000000;
+  s_nextSysTickNs   = GetHostTimeNs() + s_sysTickPeriodNs;
+}
+
+
+void SimulatedCpu_SetWakeUpFd ( const int fd, const short pollEvents )
+{
+  s_wakeUpFd         = fd;
+  s_wakeUpPollEvents = pollEvents;
+}
+
+
+void DeliverPendingSimulatedInterrupts ( void )
+{
+  if ( s_isInInterrupt || g_simulatedPrimask != 0 || s_sysTickHandler == NULL )
+    return;
+
+  s_isInInterrupt = true;
+
+  // If the host process was stopped for a while, for example in a debugger,
+  // all missed ticks run now, so that the uptime stays in step with the host clock.
+
+  while ( GetHostTimeNs() >= s_nextSysTickNs )
+  {
+    s_sysTickHandler();
+    s_nextSysTickNs += s_sysTickPeriodNs;
+  }
+
+  s_isInInterrupt = false;
+}
+
+
+void __SEV ( void )
+{
+  s_isEventPending = true;
+}
+
+
+void __WFE ( void )
+{
+  DeliverPendingSimulatedInterrupts();
+
+  if ( !s_isEventPending )
+  {
+    const uint64_t now = GetHostTimeNs();
+    const int timeoutMs = s_nextSysTickNs > now ? int( ( s_nextSysTickNs - now + 999999 ) / 1000000 ) : 0;
+
+    pollfd fds;
+    fds.fd      = s_wakeUpFd;
+    fds.events  = s_wakeUpPollEvents;
+    fds.revents = 0;
+
+    const int fdCount = s_wakeUpFd == -1 ? 0 : 1;
+
+    if ( poll( &fds, fdCount, timeoutMs ) == 1 )
+    {
+      const bool isHangUp = 0 != ( fds.revents & POLLHUP );
+
+      // poll() keeps reporting POLLHUP on a pseudo-terminal that nobody has open.
+      // Only the first report wakes the firmware up, so that it notices the lost connection
+      // straight away. Afterwards, just wait for the next tick.
+      if ( isHangUp && s_wasHangUpReported && ( fds.revents & s_wakeUpPollEvents ) == 0 )
+        poll( NULL, 0, timeoutMs );
+
+      s_wasHangUpReported = isHangUp;
+    }
+    else
+    {
+      s_wasHangUpReported = false;
+    }
+
+    DeliverPendingSimulatedInterrupts();
+  }
+
+  s_isEventPending = false;
+}
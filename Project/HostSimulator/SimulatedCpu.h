@@ -0,0 +1,37 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef SIMULATED_CPU_H_INCLUDED
+#define SIMULATED_CPU_H_INCLUDED
+
+#include <stdint.h>
+
+// The simulated CPU core for the host simulator: the DWT cycle counter, the SysTick interrupt
+// and the __WFE() sleep instruction, see AsfStubs/sam3xa.h .
+//
+// The simulated SysTick interrupt runs whenever the firmware enables the interrupts again and
+// at least one tick period has elapsed on the host clock. Interrupts never nest.
+
+typedef void (* SimulatedInterruptHandler )( void );
+
+void InitSimulatedCpu ( SimulatedInterruptHandler sysTickHandler, uint32_t sysTickPeriodMs );
+
+// __WFE() also returns when any of the given poll() events happen on this file descriptor.
+// The events are normally POLLIN, plus POLLOUT while some data is waiting to be sent.
+void SimulatedCpu_SetWakeUpFd ( int fd, short pollEvents );
+
+
+#endif  // Include this header file only once.
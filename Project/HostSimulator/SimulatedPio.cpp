@@ -0,0 +1,205 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+#include "SimulatedPio.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <pio.h>
+
+
+Pio g_simulatedPio[ 4 ] = {};
+
+struct ExternalDrive
+{
+  uint32_t drivenMask;
+  uint32_t levels;
+};
+
+static ExternalDrive s_externalDrive[ 4 ];
+
+static SimulatedPioChangeRoutine s_changeRoutine = NULL;
+
+static bool s_isInsideChangeRoutine = false;
+
+
+static uint32_t GetPioIndex ( const Pio * const pioPtr )
+{
+  const uint32_t index = uint32_t( pioPtr - g_simulatedPio );
+  assert( index < 4 );
+  return index;
+}
+
+
+// The status registers are read-only for the firmware, but the simulator is the hardware.
+
+static uint32_t & Reg ( const volatile uint32_t & reg )
+{
+  return const_cast< uint32_t & >( reg );
+}
+
+
+static void UpdateInputData ( Pio * const pioPtr )
+{
+  const ExternalDrive & ext = s_externalDrive[ GetPioIndex( pioPtr ) ];
+
+  const uint32_t outputMask = pioPtr->PIO_OSR;
+  const uint32_t pullUpMask = ~pioPtr->PIO_PUSR;  // A 0 bit in PIO_PUSR means that the pull-up is enabled.
+
+  const uint32_t inputLevels = ( ext.levels & ext.drivenMask ) | ( pullUpMask & ~ext.drivenMask );
+
+  Reg( pioPtr->PIO_PDSR ) = ( pioPtr->PIO_ODSR & outputMask ) | ( inputLevels & ~outputMask );
+}
+
+
+static void NotifyChange ( Pio * const pioPtr )
+{
+  UpdateInputData( pioPtr );
+
+  // The change routine may drive some pins itself, which must not trigger it again.
+  if ( s_changeRoutine != NULL && !s_isInsideChangeRoutine )
+  {
+    s_isInsideChangeRoutine = true;
+    s_changeRoutine();
+    s_isInsideChangeRoutine = false;
+  }
+}
+
+
+// Like after a reset, all pins are inputs controlled by the PIO, with the pull-ups enabled.
+
+void InitSimulatedPio ( void )
+{
+  for ( uint32_t i = 0; i < 4; ++i )
+  {
+    Pio * const pioPtr = &g_simulatedPio[ i ];
+
+    Reg( pioPtr->PIO_PSR  ) = 0xFFFFFFFF;
+    Reg( pioPtr->PIO_OSR  ) = 0;
+    Reg( pioPtr->PIO_PUSR ) = 0;
+
+    UpdateInputData( pioPtr );
+  }
+}
+
+
+void SimulatedPio_SetOutputData ( Pio * const pioPtr, const uint32_t mask, const bool isHigh )
+{
+  if ( isHigh )
+    Reg( pioPtr->PIO_ODSR ) |= mask;
+  else
+    Reg( pioPtr->PIO_ODSR ) &= ~mask;
+
+  NotifyChange( pioPtr );
+}
+
+
+void SimulatedPio_SetOutputEnabled ( Pio * const pioPtr, const uint32_t mask, const bool isOutputEnabled )
+{
+  if ( isOutputEnabled )
+    Reg( pioPtr->PIO_OSR ) |= mask;
+  else
+    Reg( pioPtr->PIO_OSR ) &= ~mask;
+
+  NotifyChange( pioPtr );
+}
+
+
+void SimulatedPio_SetPullUp ( Pio * const pioPtr, const uint32_t mask, const bool isPullUpEnabled )
+{
+  if ( isPullUpEnabled )
+    Reg( pioPtr->PIO_PUSR ) &= ~mask;
+  else
+    Reg( pioPtr->PIO_PUSR ) |= mask;
+
+  NotifyChange( pioPtr );
+}
+
+
+void SimulatedPio_SetPioControlled ( Pio * const pioPtr, const uint32_t mask )
+{
+  Reg( pioPtr->PIO_PSR ) |= mask;
+}
+
+
+bool SimulatedPio_GetPinLevel ( const Pio * const pioPtr, const uint8_t pinNumber )
+{
+  assert( pinNumber < 32 );
+  return 0 != ( pioPtr->PIO_PDSR & ( 1 << pinNumber ) );
+}
+
+
+void SimulatedPio_DriveExternally ( Pio * const pioPtr, const uint8_t pinNumber, const bool isHigh )
+{
+  assert( pinNumber < 32 );
+
+  ExternalDrive & ext = s_externalDrive[ GetPioIndex( pioPtr ) ];
+  const uint32_t mask = 1 << pinNumber;
+
+  ext.drivenMask |= mask;
+
+  if ( isHigh )
+    ext.levels |= mask;
+  else
+    ext.levels &= ~mask;
+
+  UpdateInputData( pioPtr );
+}
+
+
+void SimulatedPio_ReleaseExternalDrive ( Pio * const pioPtr, const uint8_t pinNumber )
+{
+  assert( pinNumber < 32 );
+
+  s_externalDrive[ GetPioIndex( pioPtr ) ].drivenMask &= ~( 1 << pinNumber );
+
+  UpdateInputData( pioPtr );
+}
+
+
+void SimulatedPio_SetChangeRoutine ( const SimulatedPioChangeRoutine changeRoutine )
+{
+  s_changeRoutine = changeRoutine;
+}
+
+
+// ---- ASF PIO driver stand-ins, see pio.h .
+
+void pio_set_input ( Pio * const pioPtr, const uint32_t mask, const uint32_t attribute )
+{
+  SimulatedPio_SetPioControlled( pioPtr, mask );
+  SimulatedPio_SetPullUp( pioPtr, mask, 0 != ( attribute & PIO_PULLUP ) );
+  SimulatedPio_SetOutputEnabled( pioPtr, mask, false );
+}
+
+
+void pio_set_output ( Pio * const pioPtr,
+                      const uint32_t mask,
+                      const uint32_t defaultLevel,
+                      uint32_t,  // Multi-drive (open drain) is not simulated.
+                      const uint32_t pullUpEnable )
+{
+  SimulatedPio_SetPioControlled( pioPtr, mask );
+  SimulatedPio_SetPullUp( pioPtr, mask, pullUpEnable != 0 );
+  SimulatedPio_SetOutputData( pioPtr, mask, defaultLevel != 0 );
+  SimulatedPio_SetOutputEnabled( pioPtr, mask, true );
+}
+
+
+void pio_pull_up ( Pio * const pioPtr, const uint32_t mask, const uint32_t pullUpEnable )
+{
+  SimulatedPio_SetPullUp( pioPtr, mask, pullUpEnable != 0 );
+}
@@ -0,0 +1,54 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef SIMULATED_PIO_H_INCLUDED
+#define SIMULATED_PIO_H_INCLUDED
+
+#include <stdint.h>
+
+#include <sam3xa.h>
+
+// Simulated pin backend for the host simulator. The PIO pin routines in IoUtils.h and the ASF
+// stand-ins in pio.h route all pin changes through here. This module keeps the status registers
+// (PIO_ODSR, PIO_OSR, PIO_PSR, PIO_PUSR and PIO_PDSR) up to date, so that reading them works
+// like on the real hardware.
+//
+// The level on each pin is the output level if the pin is an output. Otherwise, it is the level
+// that something outside drives, if anything, or the level given by the pull-up resistor.
+// Open-drain outputs are simulated as normal outputs.
+//
+// Whatever is connected to the pins, like a simulated JTAG target, registers a change routine.
+// It gets called after every output change and can then drive the input pins accordingly.
+
+// All pins start as inputs with the pull-up resistor enabled, like after a reset.
+void InitSimulatedPio ( void );
+
+void SimulatedPio_SetOutputData    ( Pio * pioPtr, uint32_t mask, bool isHigh );
+void SimulatedPio_SetOutputEnabled ( Pio * pioPtr, uint32_t mask, bool isOutputEnabled );
+void SimulatedPio_SetPullUp        ( Pio * pioPtr, uint32_t mask, bool isPullUpEnabled );
+void SimulatedPio_SetPioControlled ( Pio * pioPtr, uint32_t mask );
+
+bool SimulatedPio_GetPinLevel ( const Pio * pioPtr, uint8_t pinNumber );
+
+// Drives a pin from the outside. An output pin ignores this level until it becomes an input.
+void SimulatedPio_DriveExternally ( Pio * pioPtr, uint8_t pinNumber, bool isHigh );
+void SimulatedPio_ReleaseExternalDrive ( Pio * pioPtr, uint8_t pinNumber );
+
+typedef void (* SimulatedPioChangeRoutine )( void );
+void SimulatedPio_SetChangeRoutine ( SimulatedPioChangeRoutine changeRoutine );
+
+
+#endif  // Include this header file only once.
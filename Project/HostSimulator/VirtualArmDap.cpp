@@ -0,0 +1,534 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+#include "VirtualArmDap.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <BareMetalSupport/SerialPrint.h>
+#include <BareMetalSupport/Miscellaneous.h>
+
+#include <JtagFirmware/Globals.h>
+#include <JtagFirmware/DapRegisters.h>
+
+
+// JTAG-DP instructions, like in JtagFirmware/JtagDap.cpp .
+#define JTAG_DP_IR_LEN      4
+#define JTAG_DP_IR_ABORT    0x8
+#define JTAG_DP_IR_DPACC    0xA
+#define JTAG_DP_IR_APACC    0xB
+#define JTAG_DP_IR_IDCODE   0xE
+
+#define JTAG_DP_ACC_LEN     35
+
+#define JTAG_DP_ACK_OK_FAULT  0x2
+#define JTAG_DP_ACK_WAIT      0x1
+
+// More MEM-AP registers.
+#define AP_BD0  0x10
+#define AP_CFG  0xF4
+#define AP_BASE 0xF8
+#define AP_IDR  0xFC
+
+#define AP_CSW_SIZE_MASK       0x07
+#define AP_CSW_ADDRINC_MASK    0x30
+#define AP_CSW_DEVICEEN        ( 1UL << 6 )
+#define AP_CSW_TRINPROG        ( 1UL << 7 )
+
+// An AHB-AP, as found on the Cortex-M3, and a ROM table base address with the "present" bit.
+#define AHB_AP_IDR          0x24770011
+#define AHB_AP_BASE         0xE00FF003
+
+// More Cortex-M registers.
+#define ARMV7M_CPUID        0xE000ED00
+#define ARMV7M_AIRCR        0xE000ED0C
+#define ARMV7M_DCRSR        0xE000EDF4
+#define ARMV7M_DCRDR        0xE000EDF8
+
+#define CORTEX_M3_CPUID     0x412FC230  // Cortex-M3 r2p0
+
+#define PPB_BEGIN           0xE0000000
+#define PPB_END             0xE0100000
+
+#define AIRCR_VECTKEY       0x05FA0000
+#define AIRCR_VECTKEYSTAT   0xFA050000
+#define AIRCR_VECTRESET     ( 1UL << 0 )
+#define AIRCR_SYSRESETREQ   ( 1UL << 2 )
+
+#define DHCSR_C_HALT        ( 1UL << 1  )
+#define DHCSR_CONTROL_MASK  0x2F  // C_DEBUGEN, C_HALT, C_STEP, C_MASKINTS and C_SNAPSTALL.
+#define DHCSR_S_REGRDY      ( 1UL << 16 )
+#define DHCSR_S_RESET_ST    ( 1UL << 25 )
+
+#define DCRSR_REGWNR        ( 1UL << 16 )
+#define DCRSR_REGSEL_MASK   0x7F
+
+#define XPSR_REG_INDEX      16
+#define XPSR_T_BIT          ( 1UL << 24 )
+
+
+void GetDefaultVirtualArmDapConfig ( VirtualArmDapConfig * const config )
+{
+  config->idCode          = 0x4BA00477;  // Cortex-M3 JTAG-DP
+  config->ramBase         = 0x20000000;
+  config->ramSize         = 64 * 1024;
+  config->apBusyScanCount = 0;
+}
+
+
+CVirtualArmDap::CVirtualArmDap ( const VirtualArmDapConfig & config )
+  : CVirtualTap( JTAG_DP_IR_LEN, config.idCode, JTAG_DP_IR_IDCODE )
+  , m_config( config )
+  , m_ram( config.ramSize, 0 )
+  , m_ctrlStat( 0 )
+  , m_select( 0 )
+  , m_readResult( 0 )
+  , m_apBusyScansLeft( 0 )
+  , m_isCurrentScanWait( false )
+  , m_csw( AP_CSW_DEVICEEN )
+  , m_tar( 0 )
+  , m_isCoreInReset( false )
+  , m_isCoreHalted( false )
+  , m_wasCoreReset( false )
+  , m_dhcsrControl( 0 )
+  , m_demcr( 0 )
+  , m_dcrdr( 0 )
+  , m_dpAccessCount( 0 )
+  , m_apAccessCount( 0 )
+  , m_waitCount( 0 )
+  , m_busErrorCount( 0 )
+{
+  ResetCore();
+}
+
+
+uint8_t CVirtualArmDap::GetDrLength ( const uint32_t instruction ) const
+{
+  switch ( instruction )
+  {
+  case JTAG_DP_IR_ABORT:
+  case JTAG_DP_IR_DPACC:
+  case JTAG_DP_IR_APACC:
+    return JTAG_DP_ACC_LEN;
+
+  default:
+    return CVirtualTap::GetDrLength( instruction );
+  }
+}
+
+
+// The ACK field tells whether the previous AP access has completed. If it has not (WAIT),
+// the data captured is meaningless and the access requested in this scan is ignored.
+
+uint64_t CVirtualArmDap::CaptureDr ( const uint32_t instruction )
+{
+  switch ( instruction )
+  {
+  case JTAG_DP_IR_DPACC:
+  case JTAG_DP_IR_APACC:
+    m_isCurrentScanWait = m_apBusyScansLeft != 0;
+
+    if ( m_isCurrentScanWait )
+    {
+      --m_apBusyScansLeft;
+      ++m_waitCount;
+      return JTAG_DP_ACK_WAIT;
+    }
+
+    return ( uint64_t( m_readResult ) << 3 ) | JTAG_DP_ACK_OK_FAULT;
+
+  case JTAG_DP_IR_ABORT:
+    return 0;
+
+  default:
+    return CVirtualTap::CaptureDr( instruction );
+  }
+}
+
+
+void CVirtualArmDap::UpdateDr ( const uint32_t instruction, const uint64_t value )
+{
+  const bool     isRead  = 0 != ( value & 1 );
+  const uint8_t  regAddr = uint8_t( ( value >> 1 ) & 0x3 ) << 2;
+  const uint32_t data    = uint32_t( value >> 3 );
+
+  switch ( instruction )
+  {
+  case JTAG_DP_IR_ABORT:
+    if ( 0 != ( data & DP_ABORT_DAPABORT ) )
+      m_apBusyScansLeft = 0;
+    break;
+
+  case JTAG_DP_IR_DPACC:
+    if ( m_isCurrentScanWait )
+      break;
+
+    ++m_dpAccessCount;
+
+    if ( isRead )
+      m_readResult = ReadDpReg( regAddr );
+    else
+      WriteDpReg( regAddr, data );
+    break;
+
+  case JTAG_DP_IR_APACC:
+    {
+      if ( m_isCurrentScanWait )
+        break;
+
+      ++m_apAccessCount;
+
+      const uint8_t apRegAddr = uint8_t( m_select & 0xF0 ) | regAddr;
+      const bool isAp0 = ( m_select >> 24 ) == 0;
+
+      if ( isRead )
+        m_readResult = isAp0 ? ReadApReg( apRegAddr ) : 0;
+      else if ( isAp0 )
+        WriteApReg( apRegAddr, data );
+
+      m_apBusyScansLeft = m_config.apBusyScanCount;
+    }
+    break;
+
+  default:
+    CVirtualTap::UpdateDr( instruction, value );
+    break;
+  }
+}
+
+
+uint32_t CVirtualArmDap::ReadDpReg ( const uint8_t regAddr )
+{
+  switch ( regAddr )
+  {
+  case DP_CTRL_STAT:
+    return m_ctrlStat;
+
+  case DP_SELECT:
+    return m_select;
+
+  default:
+    // DP_RDBUFF reads as zero on a JTAG-DP. The data of the last AP read comes
+    // in the capture of this very scan.
+    return 0;
+  }
+}
+
+
+void CVirtualArmDap::WriteDpReg ( const uint8_t regAddr, const uint32_t value )
+{
+  switch ( regAddr )
+  {
+  case DP_CTRL_STAT:
+    {
+      const uint32_t stickyMask = DP_CTRL_STAT_STICKYORUN |
+                                  DP_CTRL_STAT_STICKYCMP  |
+                                  DP_CTRL_STAT_STICKYERR;
+
+      // On a JTAG-DP, the sticky flags are cleared by writing 1 to them.
+      uint32_t newValue = ( m_ctrlStat & stickyMask & ~value ) | ( value & ~stickyMask );
+
+      // The power domains come up straight away.
+      newValue &= ~( DP_CTRL_STAT_CDBGPWRUPACK | DP_CTRL_STAT_CSYSPWRUPACK );
+
+      if ( 0 != ( value & DP_CTRL_STAT_CDBGPWRUPREQ ) )
+        newValue |= DP_CTRL_STAT_CDBGPWRUPACK;
+
+      if ( 0 != ( value & DP_CTRL_STAT_CSYSPWRUPREQ ) )
+        newValue |= DP_CTRL_STAT_CSYSPWRUPACK;
+
+      m_ctrlStat = newValue;
+    }
+    break;
+
+  case DP_SELECT:
+    m_select = value;
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+uint32_t CVirtualArmDap::ReadApReg ( const uint8_t regAddr )
+{
+  switch ( regAddr )
+  {
+  case AP_CSW:  return m_csw;
+  case AP_TAR:  return m_tar;
+  case AP_DRW:  return AccessMemory( m_tar, true, 0 );
+  case AP_CFG:  return 0;  // Little endian.
+  case AP_BASE: return AHB_AP_BASE;
+  case AP_IDR:  return AHB_AP_IDR;
+
+  default:
+    if ( regAddr >= AP_BD0 && regAddr < AP_BD0 + 0x10 )
+      return AccessMemory( ( m_tar & ~0xFUL ) | ( regAddr & 0xC ), true, 0 );
+
+    return 0;
+  }
+}
+
+
+void CVirtualArmDap::WriteApReg ( const uint8_t regAddr, const uint32_t value )
+{
+  switch ( regAddr )
+  {
+  case AP_CSW:
+    m_csw = ( value & ~AP_CSW_TRINPROG ) | AP_CSW_DEVICEEN;
+    break;
+
+  case AP_TAR:
+    m_tar = value;
+    break;
+
+  case AP_DRW:
+    AccessMemory( m_tar, false, value );
+    break;
+
+  default:
+    if ( regAddr >= AP_BD0 && regAddr < AP_BD0 + 0x10 )
+      AccessMemory( ( m_tar & ~0xFUL ) | ( regAddr & 0xC ), false, value );
+    break;
+  }
+}
+
+
+// Like on a real MEM-AP, byte and halfword data travels on the byte lanes given by the address.
+
+uint32_t CVirtualArmDap::AccessMemory ( const uint32_t addr, const bool isRead, const uint32_t value )
+{
+  const uint32_t size = m_csw & AP_CSW_SIZE_MASK;
+
+  uint32_t byteMask;
+
+  switch ( size )
+  {
+  case 0:  byteMask = 0x1 << ( addr & 3 ); break;
+  case 1:  byteMask = 0x3 << ( addr & 2 ); break;
+  default: byteMask = 0xF;                 break;
+  }
+
+  const uint32_t wordAddr = addr & ~3UL;
+
+  uint32_t result = 0;
+  bool isOk;
+
+  if ( isRead )
+    isOk = ReadBusWord( wordAddr, &result );
+  else
+    isOk = WriteBusWord( wordAddr, value, byteMask );
+
+  if ( !isOk )
+  {
+    ++m_busErrorCount;
+    m_ctrlStat |= DP_CTRL_STAT_STICKYERR;
+    result = 0;
+  }
+
+  // The address is incremented even after an error, which does not matter,
+  // as the debugger should give up and rewrite TAR anyway.
+  IncrementTar();
+
+  return result;
+}
+
+
+// The auto-increment only operates on the 10 least-significant bits, like most MEM-AP implementations do.
+// OpenOCD knows about it, and rewrites TAR at each 1 KiB boundary.
+
+void CVirtualArmDap::IncrementTar ( void )
+{
+  if ( ( m_csw & AP_CSW_ADDRINC_MASK ) == 0 )
+    return;
+
+  const uint32_t increment = 1 << MinFrom( m_csw & AP_CSW_SIZE_MASK, uint32_t( 2 ) );
+
+  m_tar = ( m_tar & ~0x3FFUL ) | ( ( m_tar + increment ) & 0x3FF );
+}
+
+
+bool CVirtualArmDap::ReadBusWord ( const uint32_t addr, uint32_t * const value )
+{
+  if ( addr >= m_config.ramBase && addr - m_config.ramBase < m_config.ramSize )
+  {
+    memcpy( value, &m_ram[ addr - m_config.ramBase ], sizeof( *value ) );  // The host is little endian too.
+    return true;
+  }
+
+  if ( addr < PPB_BEGIN || addr >= PPB_END )
+    return false;
+
+  switch ( addr )
+  {
+  case ARMV7M_CPUID: *value = CORTEX_M3_CPUID;   break;
+  case ARMV7M_AIRCR: *value = AIRCR_VECTKEYSTAT; break;
+  case ARMV7M_DHCSR: *value = ReadDhcsr();       break;
+  case ARMV7M_DCRDR: *value = m_dcrdr;           break;
+  case ARMV7M_DEMCR: *value = m_demcr;           break;
+  default:           *value = 0;                 break;
+  }
+
+  return true;
+}
+
+
+bool CVirtualArmDap::WriteBusWord ( const uint32_t addr, const uint32_t value, const uint32_t byteMask )
+{
+  if ( addr >= m_config.ramBase && addr - m_config.ramBase < m_config.ramSize )
+  {
+    for ( unsigned i = 0; i < 4; ++i )
+    {
+      if ( 0 != ( byteMask & ( 1 << i ) ) )
+        m_ram[ addr - m_config.ramBase + i ] = uint8_t( value >> ( i * 8 ) );
+    }
+
+    return true;
+  }
+
+  if ( addr < PPB_BEGIN || addr >= PPB_END )
+    return false;
+
+  // The debug registers are only written as whole words, which is what OpenOCD does.
+  if ( byteMask != 0xF )
+    return true;
+
+  switch ( addr )
+  {
+  case ARMV7M_AIRCR:
+    if ( ( value & 0xFFFF0000 ) == AIRCR_VECTKEY &&
+         0 != ( value & ( AIRCR_SYSRESETREQ | AIRCR_VECTRESET ) ) )
+    {
+      SetSystemReset( true  );
+      SetSystemReset( false );
+    }
+    break;
+
+  case ARMV7M_DHCSR:
+    WriteDhcsr( value );
+    break;
+
+  case ARMV7M_DCRSR:
+    {
+      const uint32_t regIndex = value & DCRSR_REGSEL_MASK;
+
+      // The core registers are only accessible while the core is halted.
+      if ( !m_isCoreHalted || regIndex >= sizeof( m_coreRegs ) / sizeof( m_coreRegs[ 0 ] ) )
+        break;
+
+      if ( 0 != ( value & DCRSR_REGWNR ) )
+        m_coreRegs[ regIndex ] = m_dcrdr;
+      else
+        m_dcrdr = m_coreRegs[ regIndex ];
+    }
+    break;
+
+  case ARMV7M_DCRDR:
+    m_dcrdr = value;
+    break;
+
+  case ARMV7M_DEMCR:
+    m_demcr = value;
+    break;
+
+  default:
+    break;
+  }
+
+  return true;
+}
+
+
+uint32_t CVirtualArmDap::ReadDhcsr ( void )
+{
+  uint32_t value = m_dhcsrControl | DHCSR_S_REGRDY;
+
+  if ( m_isCoreHalted )
+    value |= DHCSR_S_HALT;
+
+  // S_RESET_ST is cleared on read.
+  if ( m_wasCoreReset )
+  {
+    value |= DHCSR_S_RESET_ST;
+    m_wasCoreReset = false;
+  }
+
+  return value;
+}
+
+
+void CVirtualArmDap::WriteDhcsr ( const uint32_t value )
+{
+  if ( ( value & 0xFFFF0000 ) != DHCSR_DBGKEY )
+    return;
+
+  m_dhcsrControl = value & DHCSR_CONTROL_MASK;
+
+  if ( m_isCoreInReset )
+    return;
+
+  const uint32_t haltMask = DHCSR_C_DEBUGEN | DHCSR_C_HALT;
+
+  m_isCoreHalted = ( m_dhcsrControl & haltMask ) == haltMask;
+}
+
+
+// A system reset does not affect the debug logic, only the core.
+
+void CVirtualArmDap::ResetCore ( void )
+{
+  memset( m_coreRegs, 0, sizeof( m_coreRegs ) );
+  m_coreRegs[ XPSR_REG_INDEX ] = XPSR_T_BIT;
+
+  m_wasCoreReset = true;
+}
+
+
+void CVirtualArmDap::SetSystemReset ( const bool isAsserted )
+{
+  if ( isAsserted == m_isCoreInReset )
+    return;
+
+  m_isCoreInReset = isAsserted;
+
+  if ( isAsserted )
+  {
+    m_isCoreHalted = false;
+    ResetCore();
+    return;
+  }
+
+  const bool isVectorCatchEnabled = 0 != ( m_dhcsrControl & DHCSR_C_DEBUGEN ) &&
+                                    0 != ( m_demcr & DEMCR_VC_CORERESET );
+
+  const bool isHaltRequested = ( m_dhcsrControl & ( DHCSR_C_DEBUGEN | DHCSR_C_HALT ) ) == ( DHCSR_C_DEBUGEN | DHCSR_C_HALT );
+
+  m_isCoreHalted = isVectorCatchEnabled || isHaltRequested;
+}
+
+
+void CVirtualArmDap::PrintStats ( void ) const
+{
+  SerialPrintf( "ARM JTAG-DP 0x%08X: %" PRIu64 " DP accesses, %" PRIu64 " AP accesses, "
+                "%" PRIu64 " WAIT responses, %" PRIu64 " bus errors." EOL,
+                unsigned( m_config.idCode ),
+                m_dpAccessCount,
+                m_apAccessCount,
+                m_waitCount,
+                m_busErrorCount );
+}
@@ -0,0 +1,112 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef VIRTUAL_ARM_DAP_H_INCLUDED
+#define VIRTUAL_ARM_DAP_H_INCLUDED
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "VirtualTap.h"
+
+// Model of an ARM JTAG-DP with a single MEM-AP, see the ARM Debug Interface v5 Architecture Specification.
+// Behind the MEM-AP there is a RAM block and the Cortex-M debug registers that OpenOCD needs
+// to examine, halt and reset a core (CPUID, AIRCR, DHCSR, DCRSR, DCRDR and DEMCR).
+// The rest of the Private Peripheral Bus reads as zero, and any other address causes a bus error,
+// which sets STICKYERR in CTRL/STAT.
+//
+// Every AP access can keep the AP busy for a number of the following DPACC and APACC scans,
+// which then get a WAIT response, like a slow memory system would.
+//
+// Not modelled: overrun detection (ORUNDETECT), pushed compare and verify, packed transfers,
+// and any AP other than AP 0.
+
+struct VirtualArmDapConfig
+{
+  uint32_t idCode;
+  uint32_t ramBase;
+  uint32_t ramSize;
+  uint32_t apBusyScanCount;  // How many scans get a WAIT response after each AP access.
+};
+
+void GetDefaultVirtualArmDapConfig ( VirtualArmDapConfig * config );
+
+
+class CVirtualArmDap : public CVirtualTap
+{
+ public:
+  explicit CVirtualArmDap ( const VirtualArmDapConfig & config );
+
+  virtual void SetSystemReset ( bool isAsserted );
+
+  void PrintStats ( void ) const;
+
+ protected:
+  virtual uint8_t  GetDrLength ( uint32_t instruction ) const;
+  virtual uint64_t CaptureDr   ( uint32_t instruction );
+  virtual void     UpdateDr    ( uint32_t instruction, uint64_t value );
+
+ private:
+  const VirtualArmDapConfig m_config;
+
+  std::vector< uint8_t > m_ram;
+
+  // Debug port.
+  uint32_t m_ctrlStat;
+  uint32_t m_select;
+  uint32_t m_readResult;
+  uint32_t m_apBusyScansLeft;
+  bool     m_isCurrentScanWait;
+
+  // MEM-AP.
+  uint32_t m_csw;
+  uint32_t m_tar;
+
+  // Cortex-M core and debug registers.
+  bool     m_isCoreInReset;
+  bool     m_isCoreHalted;
+  bool     m_wasCoreReset;  // DHCSR.S_RESET_ST
+  uint32_t m_dhcsrControl;
+  uint32_t m_demcr;
+  uint32_t m_dcrdr;
+  uint32_t m_coreRegs[ 32 ];
+
+  // Statistics.
+  uint64_t m_dpAccessCount;
+  uint64_t m_apAccessCount;
+  uint64_t m_waitCount;
+  uint64_t m_busErrorCount;
+
+  uint32_t ReadDpReg ( uint8_t regAddr );
+  void WriteDpReg ( uint8_t regAddr, uint32_t value );
+
+  uint32_t ReadApReg ( uint8_t regAddr );
+  void WriteApReg ( uint8_t regAddr, uint32_t value );
+
+  uint32_t AccessMemory ( uint32_t addr, bool isRead, uint32_t value );
+  void IncrementTar ( void );
+
+  bool ReadBusWord  ( uint32_t addr, uint32_t * value );
+  bool WriteBusWord ( uint32_t addr, uint32_t value, uint32_t byteMask );
+
+  uint32_t ReadDhcsr ( void );
+  void WriteDhcsr ( uint32_t value );
+  void ResetCore ( void );
+};
+
+
+#endif  // Include this header file only once.
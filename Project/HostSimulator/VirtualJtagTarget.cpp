@@ -0,0 +1,231 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+#include "VirtualJtagTarget.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <BareMetalSupport/SerialPrint.h>
+
+#include <JtagFirmware/Globals.h>
+#include <JtagFirmware/JtagPins.h>
+
+#include "SimulatedPio.h"
+#include "VirtualTap.h"
+#include "VirtualArmDap.h"
+
+
+// Position 0 is the TAP nearest to TDO.
+static std::vector< CVirtualTap * > s_taps;
+
+// The same TAPs, for the statistics.
+static std::vector< CVirtualArmDap * > s_armDaps;
+
+static bool s_lastTck  = false;
+static bool s_lastSrst = false;
+
+static uint64_t s_tckCycleCount = 0;
+
+
+static uint32_t ParseNumber ( const std::string & str, const std::string & spec )
+{
+  char * end;
+  errno = 0;
+  const unsigned long value = strtoul( str.c_str(), &end, 0 );
+
+  if ( str.empty() || *end != 0 || errno != 0 || value > UINT32_MAX )
+    throw std::runtime_error( "Invalid number \"" + str + "\" in TAP specification \"" + spec + "\"." );
+
+  return uint32_t( value );
+}
+
+
+void VirtualJtagTarget_AddTap ( const char * const spec )
+{
+  const std::string specStr( spec );
+
+  const size_t colonPos = specStr.find( ':' );
+  const std::string kind = specStr.substr( 0, colonPos );
+
+  const bool isArmDp = kind == "arm-dp";
+
+  if ( !isArmDp && kind != "generic" )
+    throw std::runtime_error( "Unknown TAP type \"" + kind + "\", it should be \"arm-dp\" or \"generic\"." );
+
+  VirtualArmDapConfig armDapConfig;
+  GetDefaultVirtualArmDapConfig( &armDapConfig );
+
+  // The defaults of the generic TAP match the boundary scan TAP of an STM32F1,
+  // which sits next to a Cortex-M3 JTAG-DP on the same chain.
+  uint32_t genericIdCode   = 0x06414041;
+  uint32_t genericIrLength = 5;
+
+  size_t pos = colonPos;
+
+  while ( pos != std::string::npos )
+  {
+    const size_t optionBegin = pos + 1;
+    pos = specStr.find( ',', optionBegin );
+
+    const std::string option = specStr.substr( optionBegin, pos == std::string::npos ? std::string::npos : pos - optionBegin );
+
+    const size_t equalPos = option.find( '=' );
+
+    if ( equalPos == std::string::npos )
+      throw std::runtime_error( "Invalid option \"" + option + "\" in TAP specification \"" + specStr + "\"." );
+
+    const std::string name = option.substr( 0, equalPos );
+    const uint32_t value = ParseNumber( option.substr( equalPos + 1 ), specStr );
+
+    if ( name == "idcode" )
+    {
+      armDapConfig.idCode = value;
+      genericIdCode = value;
+    }
+    else if ( isArmDp && name == "ram-base" )
+      armDapConfig.ramBase = value;
+    else if ( isArmDp && name == "ram-size" )
+      armDapConfig.ramSize = value;
+    else if ( isArmDp && name == "ap-wait" )
+      armDapConfig.apBusyScanCount = value;
+    else if ( !isArmDp && name == "ir-length" )
+      genericIrLength = value;
+    else
+      throw std::runtime_error( "Unknown option \"" + name + "\" in TAP specification \"" + specStr + "\"." );
+  }
+
+  if ( isArmDp )
+  {
+    if ( ( armDapConfig.idCode & 1 ) == 0 )
+      throw std::runtime_error( "Bit 0 of an IDCODE must be 1." );
+
+    if ( armDapConfig.ramSize % 4 != 0 || armDapConfig.ramBase % 4 != 0 ||
+         uint64_t( armDapConfig.ramBase ) + armDapConfig.ramSize > 0xE0000000 )
+      throw std::runtime_error( "The RAM must be word aligned and lie below the Private Peripheral Bus at 0xE0000000." );
+
+    CVirtualArmDap * const dap = new CVirtualArmDap( armDapConfig );
+    s_taps.push_back( dap );
+    s_armDaps.push_back( dap );
+  }
+  else
+  {
+    if ( genericIdCode != 0 && ( genericIdCode & 1 ) == 0 )
+      throw std::runtime_error( "Bit 0 of an IDCODE must be 1." );
+
+    if ( genericIrLength < 2 || genericIrLength > 32 )
+      throw std::runtime_error( "The IR length must be between 2 and 32 bits." );
+
+    // The IDCODE instruction is implementation defined. Use 1, which is a common choice.
+    s_taps.push_back( new CVirtualTap( uint8_t( genericIrLength ), genericIdCode, 1 ) );
+  }
+}
+
+
+// Called after every change on the simulated pins.
+
+static void PinChangeRoutine ( void )
+{
+  // TRST is active low. While it is asserted, the TAPs ignore TCK.
+  if ( !SimulatedPio_GetPinLevel( JTAG_TRST_PIO, JTAG_TRST_PIN ) )
+  {
+    for ( size_t i = 0; i < s_taps.size(); ++i )
+      s_taps[ i ]->Reset();
+  }
+
+  const bool srst = !SimulatedPio_GetPinLevel( JTAG_SRST_PIO, JTAG_SRST_PIN );
+
+  if ( srst != s_lastSrst )
+  {
+    s_lastSrst = srst;
+
+    for ( size_t i = 0; i < s_taps.size(); ++i )
+      s_taps[ i ]->SetSystemReset( srst );
+  }
+
+  const bool tck = SimulatedPio_GetPinLevel( JTAG_TCK_PIO, JTAG_TCK_PIN );
+
+  if ( tck == s_lastTck )
+    return;
+
+  s_lastTck = tck;
+
+  if ( tck )
+  {
+    ++s_tckCycleCount;
+
+    const bool tms = SimulatedPio_GetPinLevel( JTAG_TMS_PIO, JTAG_TMS_PIN );
+
+    // Each TAP samples the TDO level that its neighbour nearer to TDI set up on the last falling edge,
+    // so the order does not matter. A TAP that is not driving TDO leaves a high level behind (pull-up).
+    bool tdi = SimulatedPio_GetPinLevel( JTAG_TDI_PIO, JTAG_TDI_PIN );
+
+    for ( size_t i = s_taps.size(); i-- > 0; )
+    {
+      CVirtualTap * const tap = s_taps[ i ];
+
+      const bool nextTdi = tap->IsTdoDriven() ? tap->GetTdo() : true;
+
+      tap->ClockRisingEdge( tms, tdi );
+
+      tdi = nextTdi;
+    }
+  }
+  else
+  {
+    for ( size_t i = 0; i < s_taps.size(); ++i )
+      s_taps[ i ]->ClockFallingEdge();
+
+    CVirtualTap * const nearestToTdo = s_taps[ 0 ];
+
+    if ( nearestToTdo->IsTdoDriven() )
+      SimulatedPio_DriveExternally( JTAG_TDO_PIO, JTAG_TDO_PIN, nearestToTdo->GetTdo() );
+    else
+      SimulatedPio_ReleaseExternalDrive( JTAG_TDO_PIO, JTAG_TDO_PIN );
+  }
+}
+
+
+void InitVirtualJtagTarget ( void )
+{
+  if ( s_taps.empty() )
+    return;
+
+  s_lastTck  = SimulatedPio_GetPinLevel( JTAG_TCK_PIO, JTAG_TCK_PIN );
+  s_lastSrst = !SimulatedPio_GetPinLevel( JTAG_SRST_PIO, JTAG_SRST_PIN );
+
+  SimulatedPio_SetChangeRoutine( &PinChangeRoutine );
+
+  SerialPrintf( "Virtual JTAG target with %u TAP(s) connected." EOL, unsigned( s_taps.size() ) );
+}
+
+
+void VirtualJtagTarget_PrintStats ( void )
+{
+  if ( s_taps.empty() )
+    return;
+
+  SerialPrintf( "Virtual JTAG target: %" PRIu64 " TCK cycles." EOL, s_tckCycleCount );
+
+  for ( size_t i = 0; i < s_armDaps.size(); ++i )
+    s_armDaps[ i ]->PrintStats();
+}
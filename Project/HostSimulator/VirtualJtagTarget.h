@@ -0,0 +1,40 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef VIRTUAL_JTAG_TARGET_H_INCLUDED
+#define VIRTUAL_JTAG_TARGET_H_INCLUDED
+
+// The virtual JTAG target is a chain of TAP models connected to the simulated JTAG pins,
+// so that the host simulator can run whole OpenOCD sessions, see HostMain.cpp .
+// It watches TCK, TMS, TDI, TRST and SRST through the simulated PIO, and drives TDO.
+// When no TAP is driving TDO, the pin floats, so it reads as high if the pull-up is enabled.
+//
+// TAP specification syntax, as in command-line option --tap:
+//   arm-dp[:idcode=<n>,ram-base=<n>,ram-size=<n>,ap-wait=<n>]  See VirtualArmDap.h .
+//   generic[:idcode=<n>,ir-length=<n>]                         IDCODE and BYPASS only. An IDCODE of 0 means none.
+// The numbers can be decimal or hexadecimal with a "0x" prefix.
+
+// Add the TAPs in chain order, starting with the one nearest to TDO, like in OpenOCD.
+// Throws an exception if the specification is invalid.
+void VirtualJtagTarget_AddTap ( const char * spec );
+
+// Call after InitSimulatedPio(). Does nothing if there are no TAPs.
+void InitVirtualJtagTarget ( void );
+
+void VirtualJtagTarget_PrintStats ( void );
+
+
+#endif  // Include this header file only once.
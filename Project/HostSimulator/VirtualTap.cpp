@@ -0,0 +1,157 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+#include "VirtualTap.h"  // The include file for this module should come first.
+
+#include <assert.h>
+
+
+CVirtualTap::CVirtualTap ( const uint8_t irLength, const uint32_t idCode, const uint32_t idCodeInstruction )
+  : m_irLength( irLength )
+  , m_idCode( idCode )
+  , m_idCodeInstruction( idCodeInstruction )
+  , m_bypassInstruction( uint32_t( ( uint64_t( 1 ) << irLength ) - 1 ) )  // All ones.
+{
+  assert( irLength >= 2 && irLength <= 32 );
+
+  // Bit 0 of an IDCODE is always 1, that is how it is told apart from BYPASS during chain discovery.
+  assert( idCode == 0 || ( idCode & 1 ) != 0 );
+
+  Reset();
+}
+
+
+void CVirtualTap::Reset ( void )
+{
+  m_state          = tsTestLogicReset;
+  m_instruction    = m_idCode != 0 ? m_idCodeInstruction : m_bypassInstruction;
+  m_shiftReg       = 0;
+  m_shiftRegLength = 0;
+  m_isTdoDriven    = false;
+  m_tdo            = false;
+}
+
+
+void CVirtualTap::SetSystemReset ( bool )
+{
+}
+
+
+TapStateEnum CVirtualTap::GetNextState ( const TapStateEnum state, const bool tms )
+{
+  switch ( state )
+  {
+  case tsTestLogicReset: return tms ? tsTestLogicReset : tsRunTestIdle;
+  case tsRunTestIdle:    return tms ? tsSelectDrScan   : tsRunTestIdle;
+  case tsSelectDrScan:   return tms ? tsSelectIrScan   : tsCaptureDr;
+  case tsCaptureDr:      return tms ? tsExit1Dr        : tsShiftDr;
+  case tsShiftDr:        return tms ? tsExit1Dr        : tsShiftDr;
+  case tsExit1Dr:        return tms ? tsUpdateDr       : tsPauseDr;
+  case tsPauseDr:        return tms ? tsExit2Dr        : tsPauseDr;
+  case tsExit2Dr:        return tms ? tsUpdateDr       : tsShiftDr;
+  case tsUpdateDr:       return tms ? tsSelectDrScan   : tsRunTestIdle;
+  case tsSelectIrScan:   return tms ? tsTestLogicReset : tsCaptureIr;
+  case tsCaptureIr:      return tms ? tsExit1Ir        : tsShiftIr;
+  case tsShiftIr:        return tms ? tsExit1Ir        : tsShiftIr;
+  case tsExit1Ir:        return tms ? tsUpdateIr       : tsPauseIr;
+  case tsPauseIr:        return tms ? tsExit2Ir        : tsPauseIr;
+  case tsExit2Ir:        return tms ? tsUpdateIr       : tsShiftIr;
+  case tsUpdateIr:       return tms ? tsSelectDrScan   : tsRunTestIdle;
+  }
+
+  assert( false );
+  return tsTestLogicReset;
+}
+
+
+// The action of the current state takes place on the rising edge, before the state changes.
+
+void CVirtualTap::ClockRisingEdge ( const bool tms, const bool tdi )
+{
+  switch ( m_state )
+  {
+  case tsCaptureIr:
+    // The 2 least-significant bits must capture 01, the rest is implementation defined.
+    m_shiftReg       = 1;
+    m_shiftRegLength = m_irLength;
+    break;
+
+  case tsCaptureDr:
+    m_shiftRegLength = GetDrLength( m_instruction );
+    assert( m_shiftRegLength >= 1 && m_shiftRegLength <= 64 );
+    m_shiftReg = CaptureDr( m_instruction );
+    break;
+
+  case tsShiftIr:
+  case tsShiftDr:
+    m_shiftReg >>= 1;
+
+    if ( tdi )
+      m_shiftReg |= uint64_t( 1 ) << ( m_shiftRegLength - 1 );
+    break;
+
+  case tsUpdateIr:
+    m_instruction = uint32_t( m_shiftReg );
+    break;
+
+  case tsUpdateDr:
+    UpdateDr( m_instruction, m_shiftReg );
+    break;
+
+  default:
+    break;
+  }
+
+  m_state = GetNextState( m_state, tms );
+
+  if ( m_state == tsTestLogicReset )
+  {
+    m_instruction = m_idCode != 0 ? m_idCodeInstruction : m_bypassInstruction;
+  }
+}
+
+
+void CVirtualTap::ClockFallingEdge ( void )
+{
+  m_isTdoDriven = m_state == tsShiftIr || m_state == tsShiftDr;
+
+  if ( m_isTdoDriven )
+    m_tdo = 0 != ( m_shiftReg & 1 );
+}
+
+
+uint8_t CVirtualTap::GetDrLength ( const uint32_t instruction ) const
+{
+  if ( instruction == m_idCodeInstruction && m_idCode != 0 )
+    return 32;
+
+  // BYPASS, and all instructions this model does not know.
+  return 1;
+}
+
+
+uint64_t CVirtualTap::CaptureDr ( const uint32_t instruction )
+{
+  if ( instruction == m_idCodeInstruction && m_idCode != 0 )
+    return m_idCode;
+
+  // The bypass register captures a 0.
+  return 0;
+}
+
+
+void CVirtualTap::UpdateDr ( uint32_t, uint64_t )
+{
+}
@@ -0,0 +1,98 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Include this header file only once.
+#ifndef VIRTUAL_TAP_H_INCLUDED
+#define VIRTUAL_TAP_H_INCLUDED
+
+#include <stdint.h>
+
+// Software model of an IEEE 1149.1 TAP controller, clocked by the simulated JTAG pins,
+// see VirtualJtagTarget.h . It implements the TAP state machine, the instruction register,
+// and the IDCODE and BYPASS data registers. Subclasses add further data registers.
+
+enum TapStateEnum
+{
+  tsTestLogicReset,
+  tsRunTestIdle,
+  tsSelectDrScan,
+  tsCaptureDr,
+  tsShiftDr,
+  tsExit1Dr,
+  tsPauseDr,
+  tsExit2Dr,
+  tsUpdateDr,
+  tsSelectIrScan,
+  tsCaptureIr,
+  tsShiftIr,
+  tsExit1Ir,
+  tsPauseIr,
+  tsExit2Ir,
+  tsUpdateIr
+};
+
+
+class CVirtualTap
+{
+ public:
+  // An idCode of 0 means that the TAP has no IDCODE register, so BYPASS is selected after a reset.
+  CVirtualTap ( uint8_t irLength, uint32_t idCode, uint32_t idCodeInstruction );
+  virtual ~CVirtualTap ( void ) {}
+
+  // TRST or power-up reset.
+  void Reset ( void );
+
+  // TMS and TDI are sampled on the rising edge, and TDO changes on the falling edge.
+  void ClockRisingEdge ( bool tms, bool tdi );
+  void ClockFallingEdge ( void );
+
+  // TDO is only driven in the Shift-IR and Shift-DR states, otherwise it is in high impedance.
+  bool IsTdoDriven ( void ) const { return m_isTdoDriven; }
+  bool GetTdo      ( void ) const { return m_tdo; }
+
+  TapStateEnum GetState ( void ) const { return m_state; }
+  uint8_t GetIrLength ( void ) const { return m_irLength; }
+
+  // The system reset line (SRST) does not reset the TAP, but it may reset the rest of the device.
+  virtual void SetSystemReset ( bool isAsserted );
+
+ protected:
+  uint32_t GetInstruction ( void ) const { return m_instruction; }
+
+  // The data register selected by the current instruction, up to 64 bits long.
+  virtual uint8_t  GetDrLength ( uint32_t instruction ) const;
+  virtual uint64_t CaptureDr   ( uint32_t instruction );
+  virtual void     UpdateDr    ( uint32_t instruction, uint64_t value );
+
+ private:
+  const uint8_t  m_irLength;
+  const uint32_t m_idCode;
+  const uint32_t m_idCodeInstruction;
+  const uint32_t m_bypassInstruction;
+
+  TapStateEnum m_state;
+  uint32_t m_instruction;
+
+  uint64_t m_shiftReg;
+  uint8_t  m_shiftRegLength;
+
+  bool m_isTdoDriven;
+  bool m_tdo;
+
+  static TapStateEnum GetNextState ( TapStateEnum state, bool tms );
+};
+
+
+#endif  // Include this header file only once.
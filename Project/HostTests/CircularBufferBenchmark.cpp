@@ -0,0 +1,170 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Host-side microbenchmark for the circular buffer classes in BareMetalSupport.
+// It is built with "make host-tests", but not run automatically, as the figures depend on the host.
+//
+// The figures only give a rough idea of the relative costs. The Cortex-M3 has no data cache
+// and no branch predictor to speak of, so the differences on the target may be larger or smaller.
+// In particular, CSpscCircularBuffer uses a full memory barrier on the host, which is much more expensive
+// than the DMB instruction on the Cortex-M3.
+
+#include <chrono>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <BareMetalSupport/AssertionUtils.h>
+#include <BareMetalSupport/CircularBuffer.h>
+#include <BareMetalSupport/PowerOfTwoCircularBuffer.h>
+#include <BareMetalSupport/SpscCircularBuffer.h>
+
+
+static const uint32_t BUFFER_SIZE = 4096;
+
+// Elements transferred per test.
+static const uint64_t TOTAL_ELEM_COUNT = 100 * 1000 * 1000;
+
+// The block test moves data in chunks of this size, roughly like a USB packet.
+static const uint32_t BLOCK_SIZE = 300;
+
+// The element test writes this many elements before reading them back, roughly like a short OpenOCD command.
+static const uint32_t ELEM_BATCH_SIZE = 64;
+
+
+static double GetElapsedNs ( const std::chrono::steady_clock::time_point startTime )
+{
+  return std::chrono::duration< double, std::nano >( std::chrono::steady_clock::now() - startTime ).count();
+}
+
+
+// One element at a time, with WriteElem() and ReadElement().
+
+template < typename BufferType >
+static uint32_t BenchmarkElements ( BufferType * const buffer, double * const nsPerElem )
+{
+  typedef typename BufferType::ElemType ElemType;
+
+  uint32_t checksum = 0;
+
+  const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+  for ( uint64_t transferred = 0; transferred < TOTAL_ELEM_COUNT; transferred += ELEM_BATCH_SIZE )
+  {
+    for ( uint32_t i = 0; i < ELEM_BATCH_SIZE; ++i )
+      buffer->WriteElem( ElemType( i ) );
+
+    for ( uint32_t i = 0; i < ELEM_BATCH_SIZE; ++i )
+      checksum += buffer->ReadElement();
+  }
+
+  *nsPerElem = GetElapsedNs( startTime ) / TOTAL_ELEM_COUNT;
+
+  return checksum;
+}
+
+
+// In blocks, with GetWritePtr() / CommitWrittenElements() and GetReadPtr() / ConsumeReadElements().
+
+template < typename BufferType >
+static uint32_t BenchmarkBlocks ( BufferType * const buffer, double * const nsPerElem )
+{
+  typedef typename BufferType::ElemType ElemType;
+  typedef typename BufferType::SizeType SizeType;
+
+  uint32_t checksum = 0;
+  uint64_t transferred = 0;
+
+  const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+  while ( transferred < TOTAL_ELEM_COUNT )
+  {
+    for ( uint32_t remaining = BLOCK_SIZE; remaining > 0; )
+    {
+      SizeType count;
+      ElemType * const writePtr = buffer->GetWritePtr( &count );
+
+      if ( count > remaining )
+        count = SizeType( remaining );
+
+      memset( writePtr, int( transferred ), count * sizeof( ElemType ) );
+      buffer->CommitWrittenElements( count );
+      remaining -= count;
+    }
+
+    for ( uint32_t remaining = BLOCK_SIZE; remaining > 0; )
+    {
+      SizeType count;
+      const ElemType * const readPtr = buffer->GetReadPtr( &count );
+
+      if ( count > remaining )
+        count = SizeType( remaining );
+
+      for ( SizeType i = 0; i < count; ++i )
+        checksum += readPtr[ i ];
+
+      buffer->ConsumeReadElements( count );
+      remaining -= count;
+    }
+
+    transferred += BLOCK_SIZE;
+  }
+
+  *nsPerElem = GetElapsedNs( startTime ) / transferred;
+
+  return checksum;
+}
+
+
+template < typename BufferType >
+static void RunBenchmark ( const char * const name )
+{
+  // The buffers are too big for some default stack sizes.
+  static BufferType buffer;
+
+  double elemNs;
+  double blockNs;
+
+  uint32_t checksum = BenchmarkElements( &buffer, &elemNs );
+  checksum += BenchmarkBlocks( &buffer, &blockNs );
+
+  if ( !buffer.IsEmpty() )
+    throw std::runtime_error( "The buffer should be empty after the benchmark." );
+
+  // Printing the checksum prevents the compiler from optimising the loops away.
+  printf( "%-34s %8.3f ns %8.3f ns  (checksum 0x%08X)\n", name, elemNs, blockNs, unsigned( checksum ) );
+}
+
+
+int main ( void )
+{
+  try
+  {
+    printf( "Time per element, %u-byte buffers:   single       blocks\n", unsigned( BUFFER_SIZE ) );
+
+    RunBenchmark< CCircularBuffer< uint8_t, uint32_t, BUFFER_SIZE > >( "CCircularBuffer" );
+    RunBenchmark< CCircularBuffer< uint8_t, uint32_t, BUFFER_SIZE, 512 > >( "CCircularBuffer with 512 mirrored" );
+    RunBenchmark< CPowerOfTwoCircularBuffer< uint8_t, uint32_t, BUFFER_SIZE > >( "CPowerOfTwoCircularBuffer" );
+    RunBenchmark< CSpscCircularBuffer< uint8_t, uint32_t, BUFFER_SIZE > >( "CSpscCircularBuffer" );
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf( stderr, "Error: %s\n", e.what() );
+    return 1;
+  }
+
+  return 0;
+}
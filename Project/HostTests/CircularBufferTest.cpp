@@ -0,0 +1,477 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Host-side unit tests for the circular buffer classes in BareMetalSupport.
+// They run with "make host-tests", see Makefile.am .
+//
+// The same tests run against CCircularBuffer, CPowerOfTwoCircularBuffer and CSpscCircularBuffer,
+// using only the routines that all of them have. Small size types like uint8_t make
+// the free-running indices of the power-of-two variants wrap around many times.
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <BareMetalSupport/AssertionUtils.h>
+#include <BareMetalSupport/CircularBuffer.h>
+#include <BareMetalSupport/PowerOfTwoCircularBuffer.h>
+#include <BareMetalSupport/SpscCircularBuffer.h>
+
+
+static unsigned s_testCount = 0;
+
+
+#define CHECK(cond) \
+  do { if ( !(cond) ) ThrowCheckFailed( #cond, __FILE__, __LINE__ ); } while ( false )
+
+static void ThrowCheckFailed ( const char * const condition, const char * const filename, const int line )
+{
+  char buffer[ 512 ];
+  snprintf( buffer, sizeof( buffer ), "%s:%d: Check failed: %s", filename, line, condition );
+  throw std::runtime_error( buffer );
+}
+
+
+// The element values are a running sequence number, truncated to the element type.
+
+template < typename BufferType >
+static void WriteSequence ( BufferType * const buffer, uint32_t * const nextValue, const uint32_t count )
+{
+  for ( uint32_t i = 0; i < count; ++i )
+  {
+    buffer->WriteElem( typename BufferType::ElemType( *nextValue ) );
+    ++*nextValue;
+  }
+}
+
+template < typename BufferType >
+static void ReadSequence ( BufferType * const buffer, uint32_t * const nextValue, const uint32_t count )
+{
+  for ( uint32_t i = 0; i < count; ++i )
+  {
+    CHECK( buffer->ReadElement() == typename BufferType::ElemType( *nextValue ) );
+    ++*nextValue;
+  }
+}
+
+
+template < typename BufferType >
+static void TestFullAndEmpty ( const uint32_t maxElemCount )
+{
+  BufferType buffer;
+  uint32_t nextWrite = 0;
+  uint32_t nextRead  = 0;
+
+  CHECK( buffer.IsEmpty() );
+  CHECK( !buffer.IsFull() );
+  CHECK( buffer.GetElemCount() == 0 );
+  CHECK( buffer.GetFreeCount() == maxElemCount );
+
+  typename BufferType::SizeType count;
+  buffer.GetReadPtr( &count );
+  CHECK( count == 0 );
+
+  WriteSequence( &buffer, &nextWrite, maxElemCount - 1 );
+  CHECK( !buffer.IsEmpty() );
+  CHECK( !buffer.IsFull() );
+  CHECK( buffer.GetFreeCount() == 1 );
+
+  WriteSequence( &buffer, &nextWrite, 1 );
+  CHECK( buffer.IsFull() );
+  CHECK( buffer.GetElemCount() == maxElemCount );
+  CHECK( buffer.GetFreeCount() == 0 );
+
+  buffer.GetWritePtr( &count );
+  CHECK( count == 0 );
+
+  ReadSequence( &buffer, &nextRead, maxElemCount );
+  CHECK( buffer.IsEmpty() );
+  CHECK( buffer.GetFreeCount() == maxElemCount );
+
+  // Fill it up again from a position other than the beginning.
+  WriteSequence( &buffer, &nextWrite, maxElemCount / 2 + 1 );
+  ReadSequence( &buffer, &nextRead, maxElemCount / 2 + 1 );
+  WriteSequence( &buffer, &nextWrite, maxElemCount );
+  CHECK( buffer.IsFull() );
+  ReadSequence( &buffer, &nextRead, maxElemCount );
+  CHECK( buffer.IsEmpty() );
+
+  WriteSequence( &buffer, &nextWrite, 3 );
+  buffer.Reset();
+  CHECK( buffer.IsEmpty() );
+  CHECK( buffer.GetFreeCount() == maxElemCount );
+
+  ++s_testCount;
+}
+
+
+// Writes and reads through the pointer routines across the wrap-around point.
+
+template < typename BufferType >
+static void TestWrapAround ( const uint32_t maxElemCount )
+{
+  typedef typename BufferType::ElemType ElemType;
+  typedef typename BufferType::SizeType SizeType;
+
+  BufferType buffer;
+  uint32_t nextWrite = 0;
+  uint32_t nextRead  = 0;
+
+  const uint32_t tailCount = 3;
+
+  WriteSequence( &buffer, &nextWrite, maxElemCount - tailCount );
+  ReadSequence( &buffer, &nextRead, maxElemCount - tailCount );
+
+  uint32_t remaining = maxElemCount;
+  unsigned chunkCount = 0;
+
+  while ( remaining > 0 )
+  {
+    SizeType contiguousCount;
+    ElemType * const writePtr = buffer.GetWritePtr( &contiguousCount );
+
+    CHECK( contiguousCount > 0 );
+    CHECK( contiguousCount <= buffer.GetFreeCount() );
+
+    const uint32_t toWrite = contiguousCount < remaining ? contiguousCount : remaining;
+
+    for ( uint32_t i = 0; i < toWrite; ++i )
+      writePtr[ i ] = ElemType( nextWrite++ );
+
+    buffer.CommitWrittenElements( SizeType( toWrite ) );
+    remaining -= toWrite;
+    ++chunkCount;
+  }
+
+  CHECK( buffer.IsFull() );
+  CHECK( chunkCount <= 2 );
+
+  remaining = maxElemCount;
+
+  while ( remaining > 0 )
+  {
+    SizeType contiguousCount;
+    const ElemType * const readPtr = buffer.GetReadPtr( &contiguousCount );
+
+    CHECK( contiguousCount > 0 );
+    CHECK( contiguousCount <= buffer.GetElemCount() );
+
+    for ( uint32_t i = 0; i < contiguousCount; ++i )
+      CHECK( readPtr[ i ] == ElemType( nextRead++ ) );
+
+    buffer.ConsumeReadElements( contiguousCount );
+    remaining -= contiguousCount;
+  }
+
+  CHECK( buffer.IsEmpty() );
+
+  ++s_testCount;
+}
+
+
+// The power-of-two variants must split the transfers exactly at the end of the array.
+
+template < typename BufferType >
+static void TestPowerOfTwoChunks ( const uint32_t maxElemCount )
+{
+  typedef typename BufferType::SizeType SizeType;
+
+  BufferType buffer;
+  uint32_t nextWrite = 0;
+  uint32_t nextRead  = 0;
+
+  WriteSequence( &buffer, &nextWrite, maxElemCount - 3 );
+  ReadSequence( &buffer, &nextRead, maxElemCount - 3 );
+
+  SizeType count;
+  buffer.GetWritePtr( &count );
+  CHECK( count == 3 );
+
+  WriteSequence( &buffer, &nextWrite, 5 );
+
+  buffer.GetReadPtr( &count );
+  CHECK( count == 3 );
+  buffer.ConsumeReadElements( count );
+  nextRead += count;
+
+  buffer.GetReadPtr( &count );
+  CHECK( count == 2 );
+
+  buffer.GetWritePtr( &count );
+  CHECK( count == maxElemCount - 2 );
+
+  ++s_testCount;
+}
+
+
+// Pushes many times the range of SizeType through the buffer in irregular batches,
+// so that the free-running indices overflow several times in all possible positions.
+
+template < typename BufferType >
+static void TestIndexOverflow ( const uint32_t maxElemCount, const uint32_t totalElemCount )
+{
+  BufferType buffer;
+  uint32_t nextWrite = 0;
+  uint32_t nextRead  = 0;
+  uint32_t pseudoRandom = 12345;
+
+  while ( nextRead < totalElemCount )
+  {
+    pseudoRandom = pseudoRandom * 1103515245 + 12345;
+
+    const uint32_t writeCount = ( pseudoRandom >> 16 ) % ( buffer.GetFreeCount() + 1 );
+    WriteSequence( &buffer, &nextWrite, writeCount );
+
+    CHECK( buffer.GetElemCount() == nextWrite - nextRead );
+    CHECK( buffer.GetElemCount() + buffer.GetFreeCount() == maxElemCount );
+    CHECK( buffer.IsFull() == ( nextWrite - nextRead == maxElemCount ) );
+
+    pseudoRandom = pseudoRandom * 1103515245 + 12345;
+
+    const uint32_t readCount = ( pseudoRandom >> 16 ) % ( buffer.GetElemCount() + 1 );
+    ReadSequence( &buffer, &nextRead, readCount );
+
+    CHECK( buffer.IsEmpty() == ( nextWrite == nextRead ) );
+  }
+
+  ++s_testCount;
+}
+
+
+template < typename BufferType >
+static void RunCommonTests ( const uint32_t maxElemCount, const uint32_t overflowElemCount )
+{
+  TestFullAndEmpty < BufferType >( maxElemCount );
+  TestWrapAround   < BufferType >( maxElemCount );
+  TestIndexOverflow< BufferType >( maxElemCount, overflowElemCount );
+}
+
+
+// Only CCircularBuffer has a mirror region after the end of the array. Start at every possible
+// read position, fill the buffer with both write methods, and then check that the pointer routines
+// deliver at least mirrorElemCount consecutive elements with the right contents, including
+// the ones that live in the mirror region.
+
+template < typename BufferType >
+static void TestMirrorRead ( const uint32_t maxElemCount, const uint32_t mirrorElemCount, const bool useWriteElemArray )
+{
+  typedef typename BufferType::ElemType ElemType;
+  typedef typename BufferType::SizeType SizeType;
+
+  std::vector< ElemType > values( maxElemCount );
+  std::vector< ElemType > peeked( maxElemCount );
+
+  for ( uint32_t startPos = 0; startPos < maxElemCount; ++startPos )
+  {
+    BufferType buffer;
+    uint32_t nextWrite = 0;
+    uint32_t nextRead  = 0;
+
+    if ( startPos > 0 )
+    {
+      WriteSequence( &buffer, &nextWrite, startPos );
+      ReadSequence( &buffer, &nextRead, startPos );
+    }
+
+    // The buffer gets filled across the wrap-around point, so that the elements written
+    // at the beginning of the array must also land in the mirror region.
+
+    if ( useWriteElemArray )
+    {
+      for ( uint32_t i = 0; i < maxElemCount; ++i )
+        values[ i ] = ElemType( nextWrite++ );
+
+      buffer.WriteElemArray( &values[ 0 ], SizeType( maxElemCount ) );
+    }
+    else
+      WriteSequence( &buffer, &nextWrite, maxElemCount );
+
+    CHECK( buffer.IsFull() );
+
+    while ( !buffer.IsEmpty() )
+    {
+      const uint32_t elemCount = buffer.GetElemCount();
+
+      SizeType contiguousCount;
+      const ElemType * const readPtr = buffer.GetReadPtr( &contiguousCount );
+
+      CHECK( contiguousCount <= elemCount );
+      CHECK( contiguousCount >= ( mirrorElemCount < elemCount ? mirrorElemCount : elemCount ) );
+
+      for ( uint32_t i = 0; i < contiguousCount; ++i )
+        CHECK( readPtr[ i ] == ElemType( nextRead + i ) );
+
+      // When the read position is near the end, the first chunk reaches into the mirror region
+      // and the second one must continue right after it.
+
+      buffer.PeekMultipleElements( SizeType( elemCount ), &peeked[ 0 ] );
+
+      for ( uint32_t i = 0; i < elemCount; ++i )
+        CHECK( peeked[ i ] == ElemType( nextRead + i ) );
+
+      ReadSequence( &buffer, &nextRead, 1 );
+    }
+  }
+
+  ++s_testCount;
+}
+
+
+// Writes through GetWritePtr() at every possible write position and fill level. Whatever lands
+// in the mirror region must show up at the beginning of the buffer, where ReadElement() looks.
+
+template < typename BufferType >
+static void TestMirrorWrite ( const uint32_t maxElemCount, const uint32_t mirrorElemCount )
+{
+  typedef typename BufferType::ElemType ElemType;
+  typedef typename BufferType::SizeType SizeType;
+
+  for ( uint32_t startPos = 0; startPos < maxElemCount; ++startPos )
+  {
+    for ( uint32_t fillCount = 0; fillCount < maxElemCount; ++fillCount )
+    {
+      BufferType buffer;
+      uint32_t nextWrite = 0;
+      uint32_t nextRead  = 0;
+
+      if ( startPos > 0 )
+      {
+        WriteSequence( &buffer, &nextWrite, startPos );
+        ReadSequence( &buffer, &nextRead, startPos );
+      }
+
+      WriteSequence( &buffer, &nextWrite, fillCount );
+
+      const uint32_t freeCount = buffer.GetFreeCount();
+
+      SizeType contiguousCount;
+      ElemType * const writePtr = buffer.GetWritePtr( &contiguousCount );
+
+      CHECK( contiguousCount <= freeCount );
+      CHECK( contiguousCount >= ( mirrorElemCount < freeCount ? mirrorElemCount : freeCount ) );
+
+      for ( uint32_t i = 0; i < contiguousCount; ++i )
+        writePtr[ i ] = ElemType( nextWrite++ );
+
+      buffer.CommitWrittenElements( contiguousCount );
+
+      ReadSequence( &buffer, &nextRead, buffer.GetElemCount() );
+      CHECK( nextRead == nextWrite );
+    }
+  }
+
+  ++s_testCount;
+}
+
+
+template < typename BufferType >
+static void RunMirrorTests ( const uint32_t maxElemCount, const uint32_t mirrorElemCount, const uint32_t overflowElemCount )
+{
+  RunCommonTests < BufferType >( maxElemCount, overflowElemCount );
+  TestMirrorRead < BufferType >( maxElemCount, mirrorElemCount, false );
+  TestMirrorRead < BufferType >( maxElemCount, mirrorElemCount, true  );
+  TestMirrorWrite< BufferType >( maxElemCount, mirrorElemCount );
+}
+
+
+template < typename BufferType >
+static void RunPowerOfTwoTests ( const uint32_t maxElemCount, const uint32_t overflowElemCount )
+{
+  RunCommonTests< BufferType >( maxElemCount, overflowElemCount );
+  TestPowerOfTwoChunks< BufferType >( maxElemCount );
+}
+
+
+// A producer and a consumer thread hammer the lock-free buffer. On a strongly-ordered CPU like x86
+// this does not prove much about the memory barriers, but it does check the index handling
+// under real concurrency.
+
+template < typename BufferType >
+static void TestSpscThreads ( const uint32_t totalElemCount )
+{
+  typedef typename BufferType::ElemType ElemType;
+
+  BufferType buffer;
+  bool wasSequenceOk = true;
+
+  std::thread consumer( [ &buffer, &wasSequenceOk, totalElemCount ] ()
+  {
+    for ( uint32_t nextRead = 0; nextRead < totalElemCount; )
+    {
+      ElemType elem;
+
+      if ( !buffer.TryReadElement( &elem ) )
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      if ( elem != ElemType( nextRead ) )
+        wasSequenceOk = false;
+
+      ++nextRead;
+    }
+  } );
+
+  for ( uint32_t nextWrite = 0; nextWrite < totalElemCount; )
+  {
+    if ( buffer.TryWriteElem( ElemType( nextWrite ) ) )
+      ++nextWrite;
+    else
+      std::this_thread::yield();
+  }
+
+  consumer.join();
+
+  CHECK( wasSequenceOk );
+  CHECK( buffer.IsEmpty() );
+
+  ++s_testCount;
+}
+
+
+int main ( void )
+{
+  try
+  {
+    RunCommonTests< CCircularBuffer< uint8_t , uint32_t, 100 > >( 100, 10000 );
+    RunMirrorTests< CCircularBuffer< uint32_t, uint32_t, 64, 16  > >( 64, 16 , 10000 );
+    RunMirrorTests< CCircularBuffer< uint8_t , uint32_t, 10, 10  > >( 10, 10 , 10000 );
+    RunMirrorTests< CCircularBuffer< uint8_t , uint32_t, 37, 1   > >( 37, 1  , 10000 );
+
+    RunPowerOfTwoTests< CPowerOfTwoCircularBuffer< uint8_t , uint8_t , 128  > >( 128 , 10 * 256 );
+    RunPowerOfTwoTests< CPowerOfTwoCircularBuffer< uint32_t, uint8_t , 16   > >( 16  , 10 * 256 );
+    RunPowerOfTwoTests< CPowerOfTwoCircularBuffer< uint8_t , uint16_t, 64   > >( 64  , 3 * 65536 );
+    RunPowerOfTwoTests< CPowerOfTwoCircularBuffer< uint8_t , uint32_t, 4096 > >( 4096, 100000 );
+
+    RunPowerOfTwoTests< CSpscCircularBuffer< uint8_t , uint8_t , 128  > >( 128 , 10 * 256 );
+    RunPowerOfTwoTests< CSpscCircularBuffer< uint32_t, uint8_t , 16   > >( 16  , 10 * 256 );
+    RunPowerOfTwoTests< CSpscCircularBuffer< uint8_t , uint16_t, 64   > >( 64  , 3 * 65536 );
+    RunPowerOfTwoTests< CSpscCircularBuffer< uint8_t , uint32_t, 4096 > >( 4096, 100000 );
+
+    TestSpscThreads< CSpscCircularBuffer< uint32_t, uint8_t , 8    > >( 1000000 );
+    TestSpscThreads< CSpscCircularBuffer< uint32_t, uint32_t, 1024 > >( 1000000 );
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf( stderr, "Error: %s\n", e.what() );
+    return 1;
+  }
+
+  printf( "All %u circular buffer tests passed.\n", s_testCount );
+  return 0;
+}
@@ -0,0 +1,338 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+// Host-side protocol tests that run the host simulator, see HostSimulator/Makefile.am ,
+// and talk to it over its pseudo-terminal like OpenOCD would.
+// They run with "make host-tests", see Makefile.am .
+//
+// The simulator gets the same JTAG chain as an STM32F1: an ARM JTAG-DP with a 4-bit IR at position 0,
+// and a generic TAP with a 5-bit IR.
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <JtagFirmware/UsbBuffers.h>
+
+
+// These values must match the firmware, see BusPirateOpenOcdMode.cpp .
+static const uint8_t BIN_MODE_CHAR              = 0x00;
+static const uint8_t OOCD_MODE_CHAR             = 0x06;
+static const uint8_t CMD_PORT_MODE              = 0x01;
+static const uint8_t CMD_JTAGDUE_DISCOVER_CHAIN = 0x22;
+static const uint8_t CMD_JTAGDUE_SELECT_TAP     = 0x23;
+static const uint8_t CMD_JTAGDUE_TAP_SCAN       = 0x24;
+
+static const uint32_t TAP_SCAN_CMD_HEADER_LEN   = 4;
+static const uint32_t TAP_SCAN_REPLY_HEADER_LEN = 5;
+
+// The longest scan that CMD_JTAGDUE_TAP_SCAN accepts, see MAX_TAP_SCAN_BIT_COUNT.
+static const uint32_t MAX_TAP_SCAN_BYTE_COUNT = USB_RX_BUFFER_SIZE - USB_RX_PACKET_MARGIN - TAP_SCAN_CMD_HEADER_LEN < USB_TX_BUFFER_SIZE - TAP_SCAN_REPLY_HEADER_LEN
+                                                  ? USB_RX_BUFFER_SIZE - USB_RX_PACKET_MARGIN - TAP_SCAN_CMD_HEADER_LEN
+                                                  : USB_TX_BUFFER_SIZE - TAP_SCAN_REPLY_HEADER_LEN;
+static const uint32_t MAX_TAP_SCAN_BIT_COUNT  = MAX_TAP_SCAN_BYTE_COUNT * 8 < UINT16_MAX ? MAX_TAP_SCAN_BYTE_COUNT * 8 : UINT16_MAX;
+
+static const int REPLY_TIMEOUT_MS = 5000;
+
+static unsigned s_testCount = 0;
+
+
+#define CHECK(cond) \
+  do { if ( !(cond) ) ThrowCheckFailed( #cond, __FILE__, __LINE__ ); } while ( false )
+
+static void ThrowCheckFailed ( const char * const condition, const char * const filename, const int line )
+{
+  char buffer[ 512 ];
+  snprintf( buffer, sizeof( buffer ), "%s:%d: Check failed: %s", filename, line, condition );
+  throw std::runtime_error( buffer );
+}
+
+
+class CSimulatorConnection
+{
+  pid_t m_simPid;
+  int   m_fd;
+  std::string m_linkPath;
+
+public:
+
+  explicit CSimulatorConnection ( const char * const simFilename )
+    : m_simPid( -1 )
+    , m_fd( -1 )
+  {
+    char linkPath[] = "/tmp/jtagdue-host-test-XXXXXX";
+
+    if ( mkdtemp( linkPath ) == NULL )
+      throw std::runtime_error( std::string( "Cannot create a temporary directory: " ) + strerror( errno ) );
+
+    m_linkPath = std::string( linkPath ) + "/link";
+
+    m_simPid = fork();
+
+    if ( m_simPid == -1 )
+      throw std::runtime_error( std::string( "Cannot fork: " ) + strerror( errno ) );
+
+    if ( m_simPid == 0 )
+    {
+      // The simulator's log is just noise here. Any errors still go to stderr.
+      const int nullFd = open( "/dev/null", O_WRONLY );
+      dup2( nullFd, STDOUT_FILENO );
+
+      execl( simFilename, simFilename, "--link", m_linkPath.c_str(), "--tap", "arm-dp", "--tap", "generic", (char *) NULL );
+      fprintf( stderr, "Cannot run the simulator \"%s\": %s\n", simFilename, strerror( errno ) );
+      _exit( 1 );
+    }
+
+    for ( int i = 0; ; ++i )
+    {
+      m_fd = open( m_linkPath.c_str(), O_RDWR | O_NOCTTY );
+
+      if ( m_fd != -1 )
+        break;
+
+      if ( i == 50 )
+        throw std::runtime_error( "The simulator did not create its pseudo-terminal." );
+
+      usleep( 100 * 1000 );
+    }
+
+    termios tio;
+    CHECK( 0 == tcgetattr( m_fd, &tio ) );
+    cfmakeraw( &tio );
+    CHECK( 0 == tcsetattr( m_fd, TCSANOW, &tio ) );
+  }
+
+  ~CSimulatorConnection ()
+  {
+    if ( m_fd != -1 )
+      close( m_fd );
+
+    if ( m_simPid > 0 )
+    {
+      kill( m_simPid, SIGTERM );
+      waitpid( m_simPid, NULL, 0 );
+    }
+
+    unlink( m_linkPath.c_str() );
+    rmdir( m_linkPath.substr( 0, m_linkPath.rfind( '/' ) ).c_str() );
+  }
+
+  void Write ( const std::vector< uint8_t > & data )
+  {
+    size_t pos = 0;
+
+    while ( pos < data.size() )
+    {
+      const ssize_t written = write( m_fd, &data[ pos ], data.size() - pos );
+
+      if ( written < 0 )
+      {
+        if ( errno == EINTR )
+          continue;
+
+        throw std::runtime_error( std::string( "Cannot write to the simulator: " ) + strerror( errno ) );
+      }
+
+      pos += size_t( written );
+    }
+  }
+
+  std::vector< uint8_t > Read ( const size_t len )
+  {
+    std::vector< uint8_t > data( len );
+    size_t pos = 0;
+
+    while ( pos < len )
+    {
+      pollfd pfd;
+      pfd.fd      = m_fd;
+      pfd.events  = POLLIN;
+      pfd.revents = 0;
+
+      const int pollRes = poll( &pfd, 1, REPLY_TIMEOUT_MS );
+
+      if ( pollRes == 0 )
+      {
+        char buffer[ 200 ];
+        snprintf( buffer, sizeof( buffer ), "Time-out waiting for the simulator's reply, got %zu bytes of %zu.", pos, len );
+        throw std::runtime_error( buffer );
+      }
+
+      if ( pollRes < 0 && errno != EINTR )
+        throw std::runtime_error( std::string( "Error waiting for the simulator: " ) + strerror( errno ) );
+
+      const ssize_t readCount = read( m_fd, &data[ pos ], len - pos );
+
+      if ( readCount < 0 && errno != EAGAIN && errno != EINTR )
+        throw std::runtime_error( std::string( "Cannot read from the simulator: " ) + strerror( errno ) );
+
+      if ( readCount > 0 )
+        pos += size_t( readCount );
+    }
+
+    return data;
+  }
+
+  std::vector< uint8_t > Transfer ( const std::vector< uint8_t > & request, const size_t replyLen )
+  {
+    Write( request );
+    return Read( replyLen );
+  }
+};
+
+
+static void EnterOpenOcdMode ( CSimulatorConnection * const conn )
+{
+  const std::vector< uint8_t > binMode = conn->Transfer( std::vector< uint8_t >( 20, BIN_MODE_CHAR ), 5 );
+  CHECK( 0 == memcmp( &binMode[ 0 ], "BBIO1", 5 ) );
+
+  const std::vector< uint8_t > oocdMode = conn->Transfer( std::vector< uint8_t >( 1, OOCD_MODE_CHAR ), 4 );
+  CHECK( 0 == memcmp( &oocdMode[ 0 ], "OCD1", 4 ) );
+
+  // Drive the JTAG pins. This command has no reply.
+  conn->Write( std::vector< uint8_t >{ CMD_PORT_MODE, 1 } );
+}
+
+
+static std::vector< uint8_t > TapScan ( CSimulatorConnection * const conn,
+                                        const bool isIr,
+                                        const uint32_t bitCount,
+                                        const std::vector< uint8_t > & tdi )
+{
+  const uint32_t byteCount = ( bitCount + 7 ) / 8;
+  CHECK( tdi.size() == byteCount );
+
+  std::vector< uint8_t > request{ CMD_JTAGDUE_TAP_SCAN, uint8_t( isIr ? 1 : 0 ), uint8_t( bitCount >> 8 ), uint8_t( bitCount ) };
+  request.insert( request.end(), tdi.begin(), tdi.end() );
+
+  const std::vector< uint8_t > reply = conn->Transfer( request, TAP_SCAN_REPLY_HEADER_LEN + byteCount );
+
+  CHECK( reply[ 0 ] == CMD_JTAGDUE_TAP_SCAN );
+  CHECK( reply[ 1 ] == 0 );  // Status.
+  CHECK( reply[ 2 ] == request[ 1 ] );
+  CHECK( reply[ 3 ] == request[ 2 ] );
+  CHECK( reply[ 4 ] == request[ 3 ] );
+
+  return std::vector< uint8_t >( reply.begin() + TAP_SCAN_REPLY_HEADER_LEN, reply.end() );
+}
+
+
+static bool GetBit ( const std::vector< uint8_t > & data, const uint32_t bitIndex )
+{
+  return 0 != ( data[ bitIndex / 8 ] & ( 1 << ( bitIndex % 8 ) ) );
+}
+
+
+// With both TAPs in BYPASS, a scan longer than the selected TAP's BYPASS register goes on into
+// the other TAP's one, so the TDO bits are the TDI bits delayed by 2 clock cycles,
+// and the first 2 bits are always zero.
+
+static void TestBypassScan ( CSimulatorConnection * const conn, const uint32_t bitCount )
+{
+  std::vector< uint8_t > tdi( ( bitCount + 7 ) / 8 );
+
+  for ( size_t i = 0; i < tdi.size(); ++i )
+    tdi[ i ] = uint8_t( i * 37 + 11 );
+
+  // Clear the unused bits in the last byte.
+  if ( bitCount % 8 != 0 )
+    tdi.back() &= uint8_t( ( 1 << ( bitCount % 8 ) ) - 1 );
+
+  const std::vector< uint8_t > tdo = TapScan( conn, false, bitCount, tdi );
+
+  const uint32_t BYPASS_BIT_COUNT = 2;
+
+  for ( uint32_t i = 0; i < bitCount; ++i )
+    CHECK( GetBit( tdo, i ) == ( i < BYPASS_BIT_COUNT ? false : GetBit( tdi, i - BYPASS_BIT_COUNT ) ) );
+
+  ++s_testCount;
+}
+
+
+static void TestTapScanLimits ( const char * const simFilename )
+{
+  CSimulatorConnection conn( simFilename );
+
+  EnterOpenOcdMode( &conn );
+
+  const std::vector< uint8_t > discoverReply = conn.Transfer( std::vector< uint8_t >( 1, CMD_JTAGDUE_DISCOVER_CHAIN ), 5 );
+  CHECK( discoverReply == std::vector< uint8_t >( { CMD_JTAGDUE_DISCOVER_CHAIN, 0, 2, 4, 5 } ) );
+
+  const std::vector< uint8_t > selectReply = conn.Transfer( std::vector< uint8_t >{ CMD_JTAGDUE_SELECT_TAP, 0 }, 2 );
+  CHECK( selectReply == std::vector< uint8_t >( { CMD_JTAGDUE_SELECT_TAP, 0 } ) );
+
+  // Put the JTAG-DP in BYPASS. The other TAP gets the BYPASS instruction automatically.
+  TapScan( &conn, true, 4, std::vector< uint8_t >( 1, 0x0F ) );
+
+  TestBypassScan( &conn, 1 );
+  TestBypassScan( &conn, 100 );
+
+  // The longest scan must fit in both the Rx and the Tx Buffers, or the connection hangs.
+  TestBypassScan( &conn, MAX_TAP_SCAN_BIT_COUNT - 7 );
+  TestBypassScan( &conn, MAX_TAP_SCAN_BIT_COUNT );
+
+  // The connection must still work afterwards.
+  TestBypassScan( &conn, 32 );
+
+  // A longer scan must be rejected straight away, which resets the connection.
+  // If the firmware waited for the rest of the command instead, it would hang, and it would
+  // not answer the request to enter binary mode below.
+  const uint32_t tooLongBitCount = MAX_TAP_SCAN_BIT_COUNT + 1;
+  conn.Write( std::vector< uint8_t >{ CMD_JTAGDUE_TAP_SCAN, 0, uint8_t( tooLongBitCount >> 8 ), uint8_t( tooLongBitCount ) } );
+
+  // Give the firmware time to reset the connection, or it may discard the next request too.
+  usleep( 200 * 1000 );
+
+  const std::vector< uint8_t > binMode = conn.Transfer( std::vector< uint8_t >( 20, BIN_MODE_CHAR ), 5 );
+  CHECK( 0 == memcmp( &binMode[ 0 ], "BBIO1", 5 ) );
+
+  ++s_testCount;
+}
+
+
+int main ( const int argc, char ** const argv )
+{
+  if ( argc != 2 )
+  {
+    fprintf( stderr, "Usage: simulator-protocol-test <path to jtagdue-sim>\n" );
+    return 1;
+  }
+
+  try
+  {
+    TestTapScanLimits( argv[ 1 ] );
+  }
+  catch ( const std::exception & e )
+  {
+    fprintf( stderr, "Error: %s\n", e.what() );
+    return 1;
+  }
+
+  printf( "All %u simulator protocol tests passed.\n", s_testCount );
+  return 0;
+}
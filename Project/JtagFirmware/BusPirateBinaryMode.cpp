@@ -25,6 +25,7 @@
 #include <BareMetalSupport/IoUtils.h>
 
 #include "BusPirateConnection.h"
+#include "ProtocolStats.h"
 
 
 #ifndef NDEBUG
@@ -42,14 +43,22 @@ void BusPirateBinaryMode_ProcessData ( CUsbRxBuffer * const rxBuffer, CUsbTxBuff
 {
   assert( s_wasInitialised );
 
-  // Speed is not important here (yet), so we favor simplicity. We only process one byte at a time,
-  // otherwise we would have to worry about whether there is enough space in the tx buffer
-  // for the next command reply.
+  // Speed is not important here (yet), so we favor simplicity. We only process one byte at a time.
+  // The welcome message does not need an empty Tx Buffer, because the printing routines
+  // can wait for room in the Tx Buffer, but changing modes does.
 
-  if ( rxBuffer->IsEmpty() || !txBuffer->IsEmpty() )
+  if ( rxBuffer->IsEmpty() )
     return;
-    
-  const uint8_t byte = rxBuffer->ReadElement();
+
+  const uint8_t byte = *rxBuffer->PeekElement();
+
+  if ( byte != BIN_MODE_CHAR && !txBuffer->IsEmpty() )
+  {
+    ProtocolStats_CountStall( psrTxNotEmptyForModeChange );
+    return;
+  }
+
+  rxBuffer->ConsumeReadElements( 1 );
 
   switch ( byte )
   {
@@ -61,6 +70,10 @@ void BusPirateBinaryMode_ProcessData ( CUsbRxBuffer * const rxBuffer, CUsbTxBuff
     ChangeBusPirateMode( bpOpenOcdMode, txBuffer );
     break;
 
+  case SWD_MODE_CHAR:
+    ChangeBusPirateMode( bpSwdMode, txBuffer );
+    break;
+
   case 0x0F:
     ChangeBusPirateMode( bpConsoleMode, txBuffer );
     break;
@@ -7,6 +7,9 @@
 #define BIN_MODE_CHAR  (uint8_t( 0x00 ))
 #define OOCD_MODE_CHAR (uint8_t( 0x06 ))
 
+// JtagDue extension, the Bus Pirate does not have it.
+#define SWD_MODE_CHAR  (uint8_t( 0x20 ))
+
 void BusPirateBinaryMode_Init ( CUsbTxBuffer * txBuffer );
 void BusPirateBinaryMode_Terminate ( void );
 void BusPirateBinaryMode_ProcessData ( CUsbRxBuffer * rxBuffer, CUsbTxBuffer * txBuffer );
@@ -22,6 +22,7 @@
 #include "BusPirateConsole.h"
 #include "BusPirateBinaryMode.h"
 #include "BusPirateOpenOcdMode.h"
+#include "SwdMode.h"
 #include "Globals.h"
 
 
@@ -38,6 +39,7 @@ static const char * GetModeName ( const BusPirateModeEnum mode )
   case bpConsoleMode:  return "bpConsoleMode";
   case bpBinMode:      return "bpBinMode";
   case bpOpenOcdMode:  return "bpOpenOcdMode";
+  case bpSwdMode:      return "bpSwdMode";
 
   default:
     assert( false );
@@ -88,6 +90,7 @@ void ChangeBusPirateMode ( const BusPirateModeEnum newMode,
   case bpConsoleMode:  BusPirateConsole_Terminate();     break;
   case bpBinMode:      BusPirateBinaryMode_Terminate();  break;
   case bpOpenOcdMode:  BusPirateOpenOcdMode_Terminate(); break;
+  case bpSwdMode:      SwdMode_Terminate();              break;
 
   case bpInvalid:
       break;
@@ -111,6 +114,7 @@ void ChangeBusPirateMode ( const BusPirateModeEnum newMode,
   case bpConsoleMode:  BusPirateConsole_Init    ( txBufferForWelcomeMsg ); break;
   case bpBinMode:      BusPirateBinaryMode_Init ( txBufferForWelcomeMsg ); break;
   case bpOpenOcdMode:  BusPirateOpenOcdMode_Init( txBufferForWelcomeMsg ); break;
+  case bpSwdMode:      SwdMode_Init             ( txBufferForWelcomeMsg ); break;
 
   case bpInvalid:
     break;
@@ -146,6 +150,10 @@ void BusPirateConnection_ProcessData ( CUsbRxBuffer * const rxBuffer,
     BusPirateOpenOcdMode_ProcessData( rxBuffer, txBuffer );
     break;
 
+  case bpSwdMode:
+    SwdMode_ProcessData( rxBuffer, txBuffer );
+    break;
+
   default:
     assert( false );
     break;
@@ -14,7 +14,8 @@ enum BusPirateModeEnum
   bpInvalid = 0,
   bpConsoleMode,
   bpBinMode,
-  bpOpenOcdMode
+  bpOpenOcdMode,
+  bpSwdMode
 };
 
 void ChangeBusPirateMode ( BusPirateModeEnum newMode, CUsbTxBuffer * txBufferForWelcomeMsg );
@@ -28,12 +28,17 @@
 #include "BusPirateBinaryMode.h"
 #include "UsbConnection.h"
 #include "CommandProcessor.h"
+#include "WorkBudget.h"
+#include "ProtocolStats.h"
 
 #include <udi_cdc.h>
 
 
 static unsigned s_binaryModeCount;
 
+// How many BIN_MODE_CHAR bytes in a row switch to binary mode.
+static const unsigned BIN_MODE_ENTRY_CHAR_COUNT = 20;
+
 
 class CUsbSerialConsole : public CGenericSerialConsole
 {
@@ -249,15 +254,27 @@ void BusPirateConsole_ProcessData ( CUsbRxBuffer * const rxBuffer,
 
 
   // Speed is not important here, so we favor simplicity. We only process one command at a time.
-  // There is also a limit on the number of bytes consumed, so that the main loop does not get
+  // We also stop when this pass' work budget is spent, so that the main loop does not get
   // blocked for a long time if we keep getting garbage.
+  //
+  // The printing routines wait for room in the Tx Buffer if necessary, so we do not need
+  // to wait here for the previous output to be sent. The only exception is changing modes,
+  // see ChangeBusPirateMode().
 
-  for ( uint32_t i = 0; i < 100; ++i )
+  for ( ; ; )
   {
-    if ( rxBuffer->IsEmpty() || ! txBuffer->IsEmpty() )
+    if ( rxBuffer->IsEmpty() )
+      break;
+
+    const uint8_t byte = *rxBuffer->PeekElement();
+
+    if ( byte == BIN_MODE_CHAR && s_binaryModeCount == BIN_MODE_ENTRY_CHAR_COUNT - 1 && !txBuffer->IsEmpty() )
+    {
+      ProtocolStats_CountStall( psrTxNotEmptyForModeChange );
       break;
+    }
 
-    const uint8_t byte = rxBuffer->ReadElement();
+    rxBuffer->ConsumeReadElements( 1 );
     bool endLoop = false;
 
     if ( byte == BIN_MODE_CHAR )
@@ -266,7 +283,7 @@ void BusPirateConsole_ProcessData ( CUsbRxBuffer * const rxBuffer,
       //   http://dangerousprototypes.com/2009/10/09/bus-pirate-raw-bitbang-mode/
       ++s_binaryModeCount;
 
-       if ( s_binaryModeCount == 20 )
+       if ( s_binaryModeCount == BIN_MODE_ENTRY_CHAR_COUNT )
        {
          ChangeBusPirateMode( bpBinMode, txBuffer );
          endLoop = true;
@@ -293,7 +310,7 @@ void BusPirateConsole_ProcessData ( CUsbRxBuffer * const rxBuffer,
       }
     }
 
-    if ( endLoop )
+    if ( endLoop || WorkBudget_IsSpent() )
       break;
   }
 }
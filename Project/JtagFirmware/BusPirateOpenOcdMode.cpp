@@ -28,6 +28,14 @@
 #include "BusPirateBinaryMode.h"
 #include "Globals.h"
 #include "JtagPins.h"
+#include "JtagDap.h"
+#include "JtagTap.h"
+#include "WorkBudget.h"
+#include "Profiler.h"
+#include "CommandLatency.h"
+#include "TraceRing.h"
+#include "ProtocolStats.h"
+#include "TckTiming.h"
 
 
 #define OPEN_OCD_CMD_CODE_LEN         1
@@ -73,6 +81,8 @@ static const bool SHIFT_USE_BLOCKS = true;
 // This variable could be unsigned, but then you get a compilation warning when it's 0.
 static const int32_t TDO_STABILITY_TEST_LOOP_COUNT = 0;
 
+// The beginning and the end of each JTAG shift always go to the trace ring, see TraceRing.h .
+// This switch adds a trace record for each shifted byte, which quickly fills the trace ring.
 static const bool TRACE_JTAG_SHIFTING = false;
 
 
@@ -88,6 +98,24 @@ static const bool TRACE_JTAG_SHIFTING = false;
 #define CMD_UART_SPEED    0x07
 #define CMD_JTAG_SPEED    0x08
 
+// The following commands are JtagDue extensions, they are not part of the Bus Pirate protocol.
+// Codes 0x20 - 0x2F are reserved for such extensions.
+#define CMD_JTAGDUE_RESET_AND_HALT     0x20
+#define CMD_JTAGDUE_SET_CHAIN          0x21
+#define CMD_JTAGDUE_DISCOVER_CHAIN     0x22
+#define CMD_JTAGDUE_SELECT_TAP         0x23
+#define CMD_JTAGDUE_TAP_SCAN           0x24
+
+#define TAP_SCAN_CMD_HEADER_LEN       ( uint32_t( OPEN_OCD_CMD_CODE_LEN + 3 ) )
+#define TAP_SCAN_REPLY_HEADER_LEN     ( TAP_SCAN_CMD_HEADER_LEN + 1 )
+
+// The whole command must fit in the Rx Buffer, with room for one more USB packet, and the whole reply
+// must fit in the Tx Buffer. Otherwise, the command would never run and the connection would hang.
+#define TAP_SCAN_MAX_RX_DATA_LEN      ( uint32_t( USB_RX_BUFFER_SIZE - USB_RX_PACKET_MARGIN - TAP_SCAN_CMD_HEADER_LEN ) )
+#define TAP_SCAN_MAX_TX_DATA_LEN      ( uint32_t( USB_TX_BUFFER_SIZE - TAP_SCAN_REPLY_HEADER_LEN ) )
+#define TAP_SCAN_MAX_DATA_LEN         ( TAP_SCAN_MAX_RX_DATA_LEN < TAP_SCAN_MAX_TX_DATA_LEN ? TAP_SCAN_MAX_RX_DATA_LEN : TAP_SCAN_MAX_TX_DATA_LEN )
+#define MAX_TAP_SCAN_BIT_COUNT        ( TAP_SCAN_MAX_DATA_LEN * 8 < UINT16_MAX ? TAP_SCAN_MAX_DATA_LEN * 8 : uint32_t( UINT16_MAX ) )
+
 enum
 {
     SERIAL_NORMAL = 0,
@@ -326,7 +354,10 @@ static void SendOpenOcdModeWelcome ( CUsbTxBuffer * const txBuffer )
 static bool PeekCmdData ( CUsbRxBuffer * const rxBuffer, uint8_t * cmdData, const uint32_t cmdDataSize )
 {
   if ( rxBuffer->GetElemCount() < cmdDataSize )
+  {
+    ProtocolStats_CountStall( psrIncompleteCommand );
     return false;
+  }
 
   rxBuffer->PeekMultipleElements( cmdDataSize, cmdData );
 
@@ -334,6 +365,18 @@ static bool PeekCmdData ( CUsbRxBuffer * const rxBuffer, uint8_t * cmdData, cons
 }
 
 
+static bool HasTxRoom ( const CUsbTxBuffer * const txBuffer, const uint32_t byteCount )
+{
+  if ( txBuffer->GetFreeCount() < byteCount )
+  {
+    ProtocolStats_CountStall( psrTxBufferFull );
+    return false;
+  }
+
+  return true;
+}
+
+
 static bool ShiftSingleBit ( const bool tdiBit, const bool tmsBit )
 {
   // I have measured TCK once with the oscilloscope and, with GCC 4.7.3 and optimisation level "-O3",
@@ -351,11 +394,13 @@ static bool ShiftSingleBit ( const bool tdiBit, const bool tmsBit )
 
   assert( GetOutputDataDrivenOnPin( JTAG_TCK_PIO, JTAG_TCK_PIN ) );
   SetOutputDataDrivenOnPinToLow( JTAG_TCK_PIO, JTAG_TCK_PIN );
+  TckTiming_RecordEdge();
 
   SetOutputDataDrivenOnPin( JTAG_TDI_PIO, JTAG_TDI_PIN, tdiBit );
   SetOutputDataDrivenOnPin( JTAG_TMS_PIO, JTAG_TMS_PIN, tmsBit );
 
   SetOutputDataDrivenOnPinToHigh( JTAG_TCK_PIO, JTAG_TCK_PIN );
+  TckTiming_RecordEdge();
 
   // The new TDO value appears on the line after TCK's falling edge. Therefore, at this point
   // we are reading the TDO value left behind by the last shift operation, that is,
@@ -380,6 +425,12 @@ static bool ShiftSingleBit ( const bool tdiBit, const bool tmsBit )
 }
 
 
+bool ShiftSingleJtagBit ( const bool tdiBit, const bool tmsBit )
+{
+  return ShiftSingleBit( tdiBit, tmsBit );
+}
+
+
 static uint8_t ShiftSeveralBits ( const uint8_t tdi8,
                                   const uint8_t tms8,
                                   const uint8_t bitCount )
@@ -406,7 +457,7 @@ static uint8_t ShiftSeveralBits ( const uint8_t tdi8,
   }
 
   if ( TRACE_JTAG_SHIFTING )
-    SerialPrintf( "TDI8: 0x%02X, TMS8: 0x%02X, TDO8: 0x%02X" EOL, tdi8, tms8, tdo8 );
+    TraceRing_Record( teJtagShiftBits, ( uint32_t( tms8 ) << 8 ) | tdi8, tdo8 );
 
 
   // Note that OpenOCD 0.8.0's Bus Pirate driver does not bother clearing the last buffer
@@ -614,6 +665,21 @@ static uint8_t ShiftFullByte ( const uint8_t tdi8,
 }
 
 
+uint8_t ShiftJtagBits ( const uint8_t tdi8, const uint8_t tms8, const uint8_t bitCount )
+{
+  assert( bitCount > 0 && bitCount <= 8 );
+
+  if ( FULL_BYTE_IMPLEMENTATION && bitCount == 8 )
+    return ShiftFullByte( tdi8, tms8 );
+
+  // ShiftSeveralBits() expects the unused upper bits to be zero,
+  // and it leaves the TDO bits in the upper part of the result.
+  const uint8_t mask = uint8_t( 0xFF >> ( 8 - bitCount ) );
+
+  return uint8_t( ShiftSeveralBits( tdi8 & mask, tms8 & mask, bitCount ) >> ( 8 - bitCount ) );
+}
+
+
 static void ShiftJtagData_OneBufferByteAtATime ( CUsbRxBuffer * const rxBuffer,
                                                  CUsbTxBuffer * const txBuffer,
                                                  const uint16_t fullDataByteCount )
@@ -656,6 +722,54 @@ static void ShiftMemBlock ( const uint8_t * const __restrict__ readPtr,
 }
 
 
+const char * GetJtagShiftKernelName ( const JtagShiftKernelEnum kernel )
+{
+  switch ( kernel )
+  {
+  case jskSeveralBits: return "bits";
+  case jskFullByte:    return "fullbyte";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+// Like ShiftMemBlock(), but with a kernel chosen at run time. The choice is made
+// outside the loops, so that the time between the bytes is the same as in ShiftMemBlock().
+
+void RunJtagShiftKernel ( const JtagShiftKernelEnum kernel,
+                          const uint8_t * const tdiTms,
+                          uint8_t * const tdo,
+                          const uint32_t byteCount )
+{
+  switch ( kernel )
+  {
+  case jskSeveralBits:
+    for ( uint32_t i = 0; i < byteCount; ++i )
+      tdo[i] = ShiftSeveralBits( tdiTms[ i*2 ], tdiTms[ i*2 + 1 ], 8 );
+    break;
+
+  case jskFullByte:
+    for ( uint32_t i = 0; i < byteCount; ++i )
+      tdo[i] = ShiftFullByte( tdiTms[ i*2 ], tdiTms[ i*2 + 1 ] );
+    break;
+
+  default:
+    throw std::runtime_error( "Unknown JTAG shift kernel." );
+  }
+}
+
+
+static uint32_t s_shiftByteAtATimeFallbackCount = 0;
+
+uint32_t GetShiftJtagDataFallbackCount ( void )
+{
+  return s_shiftByteAtATimeFallbackCount;
+}
+
+
 static void ShiftJtagData_InBufferBlocks ( CUsbRxBuffer * const rxBuffer,
                                            CUsbTxBuffer * const txBuffer,
                                            const uint16_t fullDataByteCount )
@@ -682,8 +796,11 @@ static void ShiftJtagData_InBufferBlocks ( CUsbRxBuffer * const rxBuffer,
 
     if ( maxIterationCount == 0 )
     {
+      // A TDI/TMS byte pair straddles the wrap-around point. This cannot happen
+      // if the Rx Buffer has a mirrored region, see USB_BUFFER_MIRROR_SIZE.
       assert( maxReadCount == 1 );
 
+      ++s_shiftByteAtATimeFallbackCount;
       ShiftJtagData_OneBufferByteAtATime( rxBuffer, txBuffer, 1 );
       --remainingBytes;
 
@@ -704,8 +821,9 @@ void ShiftJtagData ( CUsbRxBuffer * const rxBuffer,
                      CUsbTxBuffer * const txBuffer,
                      const uint16_t dataBitCount )
 {
-  if ( TRACE_JTAG_SHIFTING )
-    SerialPrintf( "--- Begin of JTAG shifting for %u bits ---" EOL, dataBitCount );
+  TraceRing_Record( teJtagShiftBegin, dataBitCount, 0 );
+
+  JtagTap_ForgetBypassState();
 
   const uint16_t fullDataByteCount = dataBitCount / 8;
   const uint8_t  restBitCount      = uint8_t( dataBitCount % 8 );
@@ -741,26 +859,123 @@ void ShiftJtagData ( CUsbRxBuffer * const rxBuffer,
     txBuffer->WriteElem( tdo8 );
   }
 
-  if ( TRACE_JTAG_SHIFTING )
-    SerialPrintStr( "--- End of JTAG shifting ---" EOL );
+  TraceRing_Record( teJtagShiftEnd, 0, 0 );
+}
+
+
+// Command CMD_TAP_SHIFT streams its reply. Once the header has been received, the data gets shifted
+// in blocks as it arrives, as long as there is room in the Tx Buffer for the TDO data.
+// This way, the first part of the reply can already be sent while the rest of the command
+// is still being received, and a full Tx Buffer does not hold up the whole command.
+// The state below tracks a shift operation in progress between calls.
+
+static bool     s_isShiftInProgress           = false;
+static uint16_t s_shiftRemainingFullByteCount = 0;
+static uint8_t  s_shiftRestBitCount           = 0;
+
+static CommandLatencyCategoryEnum s_shiftLatencyCategory;
+static CommandLatencyStart s_shiftLatencyStart;
+
+
+static bool ContinueShiftCommand ( CUsbRxBuffer * const rxBuffer,
+                                   CUsbTxBuffer * const txBuffer )
+{
+  assert( s_isShiftInProgress );
+
+  bool madeProgress = false;
+
+  if ( s_shiftRemainingFullByteCount > 0 )
+  {
+    // We need to read 2 bytes for each byte we write, because we output 2 bits (TDI and TMS)
+    // for each TDO bit we sample in.
+    const uint32_t byteCount = MinFrom( MinFrom( rxBuffer->GetElemCount() / 2, txBuffer->GetFreeCount() ),
+                                        uint32_t( s_shiftRemainingFullByteCount ) );
+    if ( byteCount == 0 )
+    {
+      ProtocolStats_CountStall( rxBuffer->GetElemCount() < 2 ? psrShiftWaitingForRxData : psrShiftWaitingForTxRoom );
+      return false;
+    }
+
+    {
+      // Only profile the calls that actually shift some data, and not the ones that stall.
+      PROFILE_ZONE( pzShiftJtagData );
+
+      if ( SHIFT_USE_BLOCKS )
+        ShiftJtagData_InBufferBlocks( rxBuffer, txBuffer, uint16_t( byteCount ) );
+      else
+        ShiftJtagData_OneBufferByteAtATime( rxBuffer, txBuffer, uint16_t( byteCount ) );
+    }
+
+    s_shiftRemainingFullByteCount -= uint16_t( byteCount );
+    madeProgress = true;
+
+    if ( s_shiftRemainingFullByteCount > 0 )
+      return madeProgress;
+  }
+
+  if ( s_shiftRestBitCount > 0 )
+  {
+    if ( rxBuffer->GetElemCount() < 2 || txBuffer->GetFreeCount() < 1 )
+    {
+      ProtocolStats_CountStall( rxBuffer->GetElemCount() < 2 ? psrShiftWaitingForRxData : psrShiftWaitingForTxRoom );
+      return madeProgress;
+    }
+
+    const uint8_t tdi8 = rxBuffer->ReadElement();
+    const uint8_t tms8 = rxBuffer->ReadElement();
+
+    txBuffer->WriteElem( ShiftSeveralBits( tdi8, tms8, s_shiftRestBitCount ) );
+
+    s_shiftRestBitCount = 0;
+  }
+
+  TraceRing_Record( teJtagShiftEnd, 0, 0 );
+
+  s_isShiftInProgress = false;
+
+  return true;
+}
+
+
+static CommandLatencyCategoryEnum GetTapShiftLatencyCategory ( const uint16_t dataBitCount )
+{
+  if ( dataBitCount <= 8 )
+    return clcTapShiftUpTo8Bits;
+
+  if ( dataBitCount <= 64 )
+    return clcTapShiftUpTo64Bits;
+
+  if ( dataBitCount <= 512 )
+    return clcTapShiftUpTo512Bits;
+
+  if ( dataBitCount <= 4096 )
+    return clcTapShiftUpTo4096Bits;
+
+  return clcTapShiftLonger;
 }
 
 
 static bool ShiftCommand ( CUsbRxBuffer * const rxBuffer,
                            CUsbTxBuffer * const txBuffer )
 {
+  assert( !s_isShiftInProgress );
+
   uint8_t cmdHeader[ TAP_SHIFT_CMD_HEADER_LEN ];
 
-  if ( !PeekCmdData( rxBuffer, cmdHeader, sizeof(cmdHeader) ) )
+  if ( !HasTxRoom( txBuffer, TAP_SHIFT_CMD_HEADER_LEN ) ||
+       !PeekCmdData( rxBuffer, cmdHeader, sizeof(cmdHeader) ) )
+  {
     return false;
+  }
 
   const uint8_t len1 = cmdHeader[ FIRST_PARAM_POS + 0 ];
   const uint8_t len2 = cmdHeader[ FIRST_PARAM_POS + 1 ];
 
   const uint16_t dataBitCount = (len1 << 8) | len2;
 
-  // A command with more data bits than MAX_JTAG_TAP_SHIFT_BIT_COUNT will never fit
-  // in the Rx Buffer, so we would be waiting forever for the command to be complete.
+  // Thanks to the streaming, the command does not need to fit in the Rx Buffer anymore.
+  // But OpenOCD never sends so many bits at once, so a bigger count means that
+  // we are out of sync with the host.
 
   if ( dataBitCount > MAX_JTAG_TAP_SHIFT_BIT_COUNT )
   {
@@ -770,38 +985,395 @@ static bool ShiftCommand ( CUsbRxBuffer * const rxBuffer,
     throw std::runtime_error( "CMD_TAP_SHIFT data len too big." );
   }
 
+  rxBuffer->ConsumeReadElements( TAP_SHIFT_CMD_HEADER_LEN );
 
-  const unsigned dataByteCount = ( dataBitCount + 7 ) / 8;
-  const uint32_t cmdLen   = TAP_SHIFT_CMD_HEADER_LEN + dataByteCount * 2;
-  const uint32_t replyLen = TAP_SHIFT_CMD_HEADER_LEN + dataByteCount;
+  // SerialPrint( "CMD_TAP_SHIFT: %u bits." EOL, dataBitCount );
 
-  if ( rxBuffer->GetElemCount() < cmdLen   ||
-       txBuffer->GetFreeCount() < replyLen )
+  STATIC_ASSERT( TAP_SHIFT_CMD_HEADER_LEN == 3, "Header size mismatch" );
+  txBuffer->WriteElem( CMD_TAP_SHIFT );
+  txBuffer->WriteElem( len1 );
+  txBuffer->WriteElem( len2 );
+
+  TraceRing_Record( teJtagShiftBegin, dataBitCount, 0 );
+
+  JtagTap_ForgetBypassState();
+
+  g_protocolStats.shiftedBitCount += dataBitCount;
+
+  s_isShiftInProgress           = true;
+  s_shiftRemainingFullByteCount = dataBitCount / 8;
+  s_shiftRestBitCount           = uint8_t( dataBitCount % 8 );
+  s_shiftLatencyCategory        = GetTapShiftLatencyCategory( dataBitCount );
+
+  ContinueShiftCommand( rxBuffer, txBuffer );
+
+  // The header has been consumed, so this counts as progress.
+  return true;
+}
+
+
+// Command CMD_JTAGDUE_RESET_AND_HALT runs the whole reset-and-halt sequence on this device,
+// see JtagDap_ResetAndHalt() for details. The host would otherwise need several USB round trips
+// between releasing SRST and halting the CPU, and the target would have run some code by then.
+//
+// Request: command code, SRST pulse width in us (16 bits, big endian),
+//          halt timeout in ms (16 bits, big endian).
+// Reply:   command code, status (0 = success, 1 = error),
+//          halt latency in us after releasing SRST (32 bits, big endian).
+
+static bool ResetAndHaltCommand ( CUsbRxBuffer * const rxBuffer,
+                                  CUsbTxBuffer * const txBuffer )
+{
+  uint8_t cmdData[ OPEN_OCD_CMD_CODE_LEN + 4 ];
+  const uint32_t RESPONSE_SIZE = 6;
+
+  if ( !HasTxRoom( txBuffer, RESPONSE_SIZE ) ||
+       !PeekCmdData( rxBuffer, cmdData, sizeof(cmdData) ) )
   {
     return false;
   }
 
-  rxBuffer->ConsumeReadElements( TAP_SHIFT_CMD_HEADER_LEN );
+  rxBuffer->ConsumeReadElements( sizeof( cmdData ) );
 
-  // SerialPrint( "CMD_TAP_SHIFT: %u bits." EOL, dataBitCount );
+  const uint32_t srstPulseWidthUs = ( cmdData[ FIRST_PARAM_POS + 0 ] << 8 ) | cmdData[ FIRST_PARAM_POS + 1 ];
+  const uint32_t haltTimeoutMs    = ( cmdData[ FIRST_PARAM_POS + 2 ] << 8 ) | cmdData[ FIRST_PARAM_POS + 3 ];
 
-  STATIC_ASSERT( TAP_SHIFT_CMD_HEADER_LEN == 3, "Header size mismatch" );
-  txBuffer->WriteElem( CMD_TAP_SHIFT );
+  uint8_t  status = 0;
+  uint32_t latencyUs = 0;
+
+  // An error here is a problem with the target, and not with the protocol,
+  // so report it to the host instead of resetting the connection.
+  try
+  {
+    latencyUs = JtagDap_ResetAndHalt( srstPulseWidthUs, haltTimeoutMs * 1000 );
+  }
+  catch ( const std::exception & e )
+  {
+    SerialPrintf( "Error in CMD_JTAGDUE_RESET_AND_HALT: %s" EOL, e.what() );
+    status = 1;
+  }
+
+  STATIC_ASSERT( RESPONSE_SIZE == 6, "Internal error" );
+  txBuffer->WriteElem( CMD_JTAGDUE_RESET_AND_HALT );
+  txBuffer->WriteElem( status );
+  txBuffer->WriteElem( uint8_t( latencyUs >> 24 ) );
+  txBuffer->WriteElem( uint8_t( latencyUs >> 16 ) );
+  txBuffer->WriteElem( uint8_t( latencyUs >>  8 ) );
+  txBuffer->WriteElem( uint8_t( latencyUs       ) );
+
+  return true;
+}
+
+
+static void WriteStatusReply ( CUsbTxBuffer * const txBuffer, const uint8_t cmdCode, const bool success )
+{
+  txBuffer->WriteElem( cmdCode );
+  txBuffer->WriteElem( success ? 0 : 1 );
+}
+
+
+// Command CMD_JTAGDUE_SET_CHAIN describes the JTAG chain, so that the scans with CMD_JTAGDUE_TAP_SCAN
+// can be padded on this device.
+//
+// Request: command code, device count, selected TAP index, and one IR length per device.
+//          The TAP at position 0 is the nearest to TDO, like in OpenOCD.
+// Reply:   command code, status (0 = success, 1 = error).
+
+static bool SetChainCommand ( CUsbRxBuffer * const rxBuffer,
+                              CUsbTxBuffer * const txBuffer )
+{
+  const uint32_t CMD_HEADER_LEN = OPEN_OCD_CMD_CODE_LEN + 2;
+  const uint32_t RESPONSE_SIZE = 2;
+
+  uint8_t cmdData[ CMD_HEADER_LEN + JTAG_TAP_MAX_CHAIN_DEVICE_COUNT ];
+
+  if ( !HasTxRoom( txBuffer, RESPONSE_SIZE ) ||
+       !PeekCmdData( rxBuffer, cmdData, CMD_HEADER_LEN ) )
+  {
+    return false;
+  }
+
+  const uint8_t deviceCount = cmdData[ FIRST_PARAM_POS + 0 ];
+  const uint8_t selectedTap = cmdData[ FIRST_PARAM_POS + 1 ];
+
+  if ( deviceCount > JTAG_TAP_MAX_CHAIN_DEVICE_COUNT )
+    throw std::runtime_error( "Too many devices in CMD_JTAGDUE_SET_CHAIN." );
+
+  if ( !PeekCmdData( rxBuffer, cmdData, CMD_HEADER_LEN + deviceCount ) )
+    return false;
+
+  rxBuffer->ConsumeReadElements( CMD_HEADER_LEN + deviceCount );
+
+  bool success = true;
+
+  try
+  {
+    JtagTap_SetChain( deviceCount, &cmdData[ CMD_HEADER_LEN ], selectedTap );
+  }
+  catch ( const std::exception & e )
+  {
+    SerialPrintf( "Error in CMD_JTAGDUE_SET_CHAIN: %s" EOL, e.what() );
+    success = false;
+  }
+
+  WriteStatusReply( txBuffer, CMD_JTAGDUE_SET_CHAIN, success );
+
+  return true;
+}
+
+
+// Command CMD_JTAGDUE_DISCOVER_CHAIN tries to find out the JTAG chain description by itself.
+// Afterwards, the TAP at position 0 is selected.
+//
+// Request: command code.
+// Reply:   command code, status (0 = success, 1 = error), device count,
+//          and one IR length per device.
+
+static bool DiscoverChainCommand ( CUsbRxBuffer * const rxBuffer,
+                                   CUsbTxBuffer * const txBuffer )
+{
+  const uint32_t MAX_RESPONSE_SIZE = 3 + JTAG_TAP_MAX_CHAIN_DEVICE_COUNT;
+
+  if ( !HasTxRoom( txBuffer, MAX_RESPONSE_SIZE ) )
+    return false;
+
+  rxBuffer->ConsumeReadElements( OPEN_OCD_CMD_CODE_LEN );
+
+  bool success = true;
+
+  try
+  {
+    JtagTap_DiscoverChain();
+  }
+  catch ( const std::exception & e )
+  {
+    SerialPrintf( "Error in CMD_JTAGDUE_DISCOVER_CHAIN: %s" EOL, e.what() );
+    success = false;
+  }
+
+  WriteStatusReply( txBuffer, CMD_JTAGDUE_DISCOVER_CHAIN, success );
+
+  const uint8_t deviceCount = success ? JtagTap_GetChainDeviceCount() : 0;
+
+  txBuffer->WriteElem( deviceCount );
+
+  for ( uint8_t i = 0; i < deviceCount; ++i )
+    txBuffer->WriteElem( JtagTap_GetChainIrLength( i ) );
+
+  return true;
+}
+
+
+// Command CMD_JTAGDUE_SELECT_TAP selects the TAP that CMD_JTAGDUE_TAP_SCAN addresses.
+//
+// Request: command code, TAP index.
+// Reply:   command code, status (0 = success, 1 = error).
+
+static bool SelectTapCommand ( CUsbRxBuffer * const rxBuffer,
+                               CUsbTxBuffer * const txBuffer )
+{
+  uint8_t cmdData[ OPEN_OCD_CMD_CODE_LEN + 1 ];
+  const uint32_t RESPONSE_SIZE = 2;
+
+  if ( !HasTxRoom( txBuffer, RESPONSE_SIZE ) ||
+       !PeekCmdData( rxBuffer, cmdData, sizeof(cmdData) ) )
+  {
+    return false;
+  }
+
+  rxBuffer->ConsumeReadElements( sizeof( cmdData ) );
+
+  bool success = true;
+
+  try
+  {
+    JtagTap_SelectTap( cmdData[ FIRST_PARAM_POS ] );
+  }
+  catch ( const std::exception & e )
+  {
+    SerialPrintf( "Error in CMD_JTAGDUE_SELECT_TAP: %s" EOL, e.what() );
+    success = false;
+  }
+
+  WriteStatusReply( txBuffer, CMD_JTAGDUE_SELECT_TAP, success );
+
+  return true;
+}
+
+
+// Command CMD_JTAGDUE_TAP_SCAN performs a complete IR or DR scan on the selected TAP,
+// starting and ending in the Run-Test/Idle state. This device generates the TMS sequence
+// and the BYPASS padding for the other TAPs, so the host only sends the TDI bits for the selected TAP.
+// Before the first DR scan after a TAP reset, a chain change or a CMD_TAP_SHIFT, you need an IR scan,
+// so that the other TAPs get the BYPASS instruction.
+//
+// Request: command code, scan type (0 = DR, 1 = IR), bit count (16 bits, big endian), TDI bytes.
+// Reply:   command code, status (0 = success, 1 = error), scan type, bit count (16 bits, big endian),
+//          TDO bytes. If the scan was not possible, nothing was shifted and the TDO bytes are all zero.
+
+static bool TapScanCommand ( CUsbRxBuffer * const rxBuffer,
+                             CUsbTxBuffer * const txBuffer )
+{
+  uint8_t cmdHeader[ TAP_SCAN_CMD_HEADER_LEN ];
+
+  if ( !PeekCmdData( rxBuffer, cmdHeader, sizeof(cmdHeader) ) )
+    return false;
+
+  const uint8_t scanType = cmdHeader[ FIRST_PARAM_POS + 0 ];
+  const uint8_t len1     = cmdHeader[ FIRST_PARAM_POS + 1 ];
+  const uint8_t len2     = cmdHeader[ FIRST_PARAM_POS + 2 ];
+
+  const uint16_t dataBitCount = (len1 << 8) | len2;
+
+  if ( scanType > 1 )
+    throw std::runtime_error( "Invalid scan type in CMD_JTAGDUE_TAP_SCAN." );
+
+  STATIC_ASSERT( TAP_SCAN_CMD_HEADER_LEN + ( MAX_TAP_SCAN_BIT_COUNT + 7 ) / 8 + USB_RX_PACKET_MARGIN <= USB_RX_BUFFER_SIZE,
+                 "The longest command would never arrive completely." );
+  STATIC_ASSERT( TAP_SCAN_REPLY_HEADER_LEN + ( MAX_TAP_SCAN_BIT_COUNT + 7 ) / 8 <= USB_TX_BUFFER_SIZE,
+                 "The longest reply would never fit in the Tx Buffer." );
+
+  if ( dataBitCount == 0 || dataBitCount > MAX_TAP_SCAN_BIT_COUNT )
+    throw std::runtime_error( "Invalid CMD_JTAGDUE_TAP_SCAN data len." );
+
+  const uint32_t dataByteCount = ( dataBitCount + 7 ) / 8;
+
+  if ( rxBuffer->GetElemCount() < TAP_SCAN_CMD_HEADER_LEN + dataByteCount )
+  {
+    ProtocolStats_CountStall( psrIncompleteCommand );
+    return false;
+  }
+
+  if ( !HasTxRoom( txBuffer, TAP_SCAN_REPLY_HEADER_LEN + dataByteCount ) )
+    return false;
+
+
+  // An error here is a problem with the chain state, and not with the protocol,
+  // so report it to the host instead of resetting the connection.
+  // JtagTap_BeginScan() checks everything before it starts shifting.
+
+  bool success = true;
+
+  try
+  {
+    JtagTap_BeginScan( scanType == 1, dataBitCount );
+  }
+  catch ( const std::exception & e )
+  {
+    SerialPrintf( "Error in CMD_JTAGDUE_TAP_SCAN: %s" EOL, e.what() );
+    success = false;
+  }
+
+  rxBuffer->ConsumeReadElements( TAP_SCAN_CMD_HEADER_LEN );
+
+  STATIC_ASSERT( TAP_SCAN_REPLY_HEADER_LEN == 5, "Header size mismatch" );
+  WriteStatusReply( txBuffer, CMD_JTAGDUE_TAP_SCAN, success );
+  txBuffer->WriteElem( scanType );
   txBuffer->WriteElem( len1 );
   txBuffer->WriteElem( len2 );
 
-  ShiftJtagData( rxBuffer, txBuffer, dataBitCount );
+  if ( !success )
+  {
+    rxBuffer->ConsumeReadElements( dataByteCount );
+
+    for ( uint32_t i = 0; i < dataByteCount; ++i )
+      txBuffer->WriteElem( 0 );
+
+    return true;
+  }
+
+  g_protocolStats.shiftedBitCount += dataBitCount;
+
+  // Shift the data in blocks directly from the Rx Buffer into the Tx Buffer.
+
+  uint32_t remainingBitCount = dataBitCount;
+
+  while ( remainingBitCount > 0 )
+  {
+    uint32_t maxReadCount;
+    uint32_t maxWriteCount;
+
+    const uint8_t * const readPtr  = rxBuffer->GetReadPtr ( &maxReadCount );
+          uint8_t * const writePtr = txBuffer->GetWritePtr( &maxWriteCount );
+
+    const uint32_t byteCount = MinFrom( MinFrom( maxReadCount, maxWriteCount ), ( remainingBitCount + 7 ) / 8 );
+    assert( byteCount > 0 );
+
+    const uint32_t bitCount = MinFrom( byteCount * 8, remainingBitCount );
+
+    JtagTap_ScanBits( readPtr, writePtr, uint16_t( bitCount ) );
+
+    rxBuffer->ConsumeReadElements( byteCount );
+    txBuffer->CommitWrittenElements( byteCount );
+
+    remainingBitCount -= bitCount;
+  }
+
+  JtagTap_EndScan();
 
   return true;
 }
 
 
+static uint32_t s_commandCount = 0;
+
+uint32_t GetOpenOcdCommandCount ( void )
+{
+  return s_commandCount;
+}
+
+void ResetOpenOcdCommandCount ( void )
+{
+  s_commandCount = 0;
+}
+
+
+static CommandLatencyCategoryEnum GetLatencyCategory ( const uint8_t cmdCode )
+{
+  switch ( cmdCode )
+  {
+  case CMD_TAP_SHIFT:   return s_shiftLatencyCategory;
+  case CMD_PORT_MODE:   return clcPortMode;
+  case CMD_FEATURE:     return clcFeature;
+  case CMD_UART_SPEED:  return clcUartSpeed;
+  case OOCD_MODE_CHAR:  return clcWelcome;
+
+  case CMD_JTAGDUE_RESET_AND_HALT:
+  case CMD_JTAGDUE_SET_CHAIN:
+  case CMD_JTAGDUE_DISCOVER_CHAIN:
+  case CMD_JTAGDUE_SELECT_TAP:
+  case CMD_JTAGDUE_TAP_SCAN:
+    return clcJtagDueExtension;
+
+  default:
+    return clcOther;
+  }
+}
+
+
 static bool ProcessReceivedData ( CUsbRxBuffer * const rxBuffer,
                                   CUsbTxBuffer * const txBuffer )
 {
+  PROFILE_ZONE( pzOpenOcdProcessReceivedData );
+
+  if ( s_isShiftInProgress )
+  {
+    const bool madeProgress = ContinueShiftCommand( rxBuffer, txBuffer );
+
+    if ( !s_isShiftInProgress )
+      CommandLatency_EndCommand( &s_shiftLatencyStart, s_shiftLatencyCategory, txBuffer->GetElemCount() );
+
+    return madeProgress;
+  }
+
   if ( rxBuffer->IsEmpty() )
     return false;
 
+  // If the command is not complete yet, we will get here again, and the execution starts
+  // with the last attempt. Waiting for the rest of the command counts then as queueing time.
+  CommandLatencyStart latencyStart;
+  CommandLatency_BeginCommand( &latencyStart, rxBuffer->GetElemCount() );
+
   bool callMeAgain = false;
 
   const uint8_t cmdCode = *rxBuffer->PeekElement();
@@ -815,6 +1387,10 @@ static bool ProcessReceivedData ( CUsbRxBuffer * const rxBuffer,
       ChangeBusPirateMode( bpBinMode, txBuffer );
       assert( !callMeAgain );
     }
+    else
+    {
+      ProtocolStats_CountStall( psrTxNotEmptyForModeChange );
+    }
     break;
 
   case OOCD_MODE_CHAR:
@@ -825,6 +1401,10 @@ static bool ProcessReceivedData ( CUsbRxBuffer * const rxBuffer,
       SendOpenOcdModeWelcome( txBuffer );
       callMeAgain = true;
     }
+    else
+    {
+      ProtocolStats_CountStall( psrTxNotEmptyForModeChange );
+    }
     break;
 
   case CMD_READ_ADCS:
@@ -869,7 +1449,7 @@ static bool ProcessReceivedData ( CUsbRxBuffer * const rxBuffer,
       uint8_t cmdData[OPEN_OCD_CMD_CODE_LEN+3];
       const uint32_t RESPONSE_SIZE = 2;
 
-      if ( txBuffer->GetFreeCount() >= RESPONSE_SIZE &&
+      if ( HasTxRoom( txBuffer, RESPONSE_SIZE ) &&
            PeekCmdData( rxBuffer, cmdData, sizeof(cmdData) ) )
       {
         // SerialPrintStr( "CMD_UART_SPEED." EOL );
@@ -896,8 +1476,28 @@ static bool ProcessReceivedData ( CUsbRxBuffer * const rxBuffer,
     callMeAgain = ShiftCommand( rxBuffer, txBuffer );
     break;
 
+  case CMD_JTAGDUE_RESET_AND_HALT:
+    callMeAgain = ResetAndHaltCommand( rxBuffer, txBuffer );
+    break;
+
+  case CMD_JTAGDUE_SET_CHAIN:
+    callMeAgain = SetChainCommand( rxBuffer, txBuffer );
+    break;
+
+  case CMD_JTAGDUE_DISCOVER_CHAIN:
+    callMeAgain = DiscoverChainCommand( rxBuffer, txBuffer );
+    break;
+
+  case CMD_JTAGDUE_SELECT_TAP:
+    callMeAgain = SelectTapCommand( rxBuffer, txBuffer );
+    break;
+
+  case CMD_JTAGDUE_TAP_SCAN:
+    callMeAgain = TapScanCommand( rxBuffer, txBuffer );
+    break;
+
   default:
-    if ( txBuffer->GetFreeCount() >= 1 )
+    if ( HasTxRoom( txBuffer, 1 ) )
     {
       SerialPrintf( "Unknown OpenOCD command with code %u (0x%02X).", cmdCode, cmdCode );
       assert( false );  // This should actually never happen if the client is written correctly.
@@ -917,6 +1517,19 @@ static bool ProcessReceivedData ( CUsbRxBuffer * const rxBuffer,
     break;
   }
 
+  // A command that has not been processed yet does not consume any data and returns 'false'.
+  // A CMD_TAP_SHIFT only counts here once, continuing it does not get this far.
+  if ( callMeAgain )
+  {
+    ++s_commandCount;
+    ProtocolStats_CountOpenOcdCommand( cmdCode );
+
+    if ( s_isShiftInProgress )
+      s_shiftLatencyStart = latencyStart;
+    else
+      CommandLatency_EndCommand( &latencyStart, GetLatencyCategory( cmdCode ), txBuffer->GetElemCount() );
+  }
+
   return callMeAgain;
 }
 
@@ -926,17 +1539,13 @@ void BusPirateOpenOcdMode_ProcessData ( CUsbRxBuffer * const rxBuffer, CUsbTxBuf
   assert( s_wasInitialised );
 
   // Speed is important here, and the receive buffer is not so big, so process all we can here.
-  // In order to prevent starving the main loop, there is a limit on the number of commands
-  // that can be executed at once.
-
-  // We should allow in debug builds at least one main loop iteration every MAINLOOP_WAKE_UP_CPU_LOAD_MS.
-  const unsigned MAX_CMD_COUNT = 20;
+  // In order to prevent starving the main loop, we stop when this pass' work budget is spent.
 
-  for ( unsigned i = 0; i < MAX_CMD_COUNT; ++i )
+  for ( ; ; )
   {
     const bool repeatIteration = ProcessReceivedData( rxBuffer, txBuffer );
 
-    if ( !repeatIteration )
+    if ( !repeatIteration || WorkBudget_IsSpent() )
       break;
   }
 }
@@ -952,6 +1561,8 @@ void BusPirateOpenOcdMode_Init ( CUsbTxBuffer * const txBuffer )
 
   // Note that routine InitJtagPins() has already been called at start-up time.
 
+  s_isShiftInProgress = false;
+
   // There is an error-handling path that might get us here with a non-empty Tx Buffer.
   SendOpenOcdModeWelcome( txBuffer );
 }
@@ -960,6 +1571,9 @@ void BusPirateOpenOcdMode_Terminate ( void )
 {
   assert( s_wasInitialised );
 
+  // If the connection gets closed in the middle of a CMD_TAP_SHIFT, just forget about it.
+  s_isShiftInProgress = false;
+
   InitJtagPins();
 
   #ifndef NDEBUG
@@ -20,6 +20,37 @@ void ShiftJtagData ( CUsbRxBuffer * rxBuffer,
                      CUsbTxBuffer * txBuffer,
                      uint16_t dataBitCount );
 
+// How many times ShiftJtagData() had to fall back to its byte-at-a-time path.
+uint32_t GetShiftJtagDataFallbackCount ( void );
+
+// How many OpenOCD commands have been processed. Used to calculate the USB packets per command.
+uint32_t GetOpenOcdCommandCount ( void );
+void ResetOpenOcdCommandCount ( void );
+
+// These routines are used by the modules that drive the TAP state machine on the device itself.
+// ShiftJtagBits() shifts up to 8 bits with the same kernel as CMD_TAP_SHIFT, LSB first.
+// The TDO bits come back LSB first too, and the unused upper bits are zero.
+bool ShiftSingleJtagBit ( bool tdiBit, bool tmsBit );
+uint8_t ShiftJtagBits ( uint8_t tdi8, uint8_t tms8, uint8_t bitCount );
+
+// The shift kernels that ShiftJtagData() can use, see FULL_BYTE_IMPLEMENTATION.
+// The TCK timing measurement runs each one of them, see TckTiming.h .
+enum JtagShiftKernelEnum
+{
+  jskSeveralBits = 0,
+  jskFullByte,
+
+  JTAG_SHIFT_KERNEL_COUNT
+};
+
+const char * GetJtagShiftKernelName ( JtagShiftKernelEnum kernel );
+
+// Each byte to shift takes a TDI byte and a TMS byte from tdiTms, like in the Rx Buffer.
+void RunJtagShiftKernel ( JtagShiftKernelEnum kernel,
+                          const uint8_t * tdiTms,
+                          uint8_t * tdo,
+                          uint32_t byteCount );
+
 enum JtagPinModeEnum
 {
     // These values are specified in the Bus Pirate <-> OpenOCD protocol.
@@ -0,0 +1,278 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+#include "CommandLatency.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+
+#include <BareMetalSupport/PowerOfTwoCircularBuffer.h>
+#include <BareMetalSupport/DwtUtils.h>
+#include <BareMetalSupport/Miscellaneous.h>
+
+
+#ifndef ENABLE_PROFILER
+  #error "This module should only be compiled if the profiler is enabled."
+#endif
+
+
+// The byte offsets below count all bytes since the connection started. They are allowed to wrap around,
+// so always compare them with a subtraction.
+
+static uint32_t s_rxByteTotal;
+static uint32_t s_txSentByteTotal;
+
+
+// Each call to CommandLatency_DataReceived() adds a record here. If the host sends lots of small packets
+// that are not processed straight away, the oldest records get dropped, and the queueing times
+// for the corresponding commands will then be too short.
+
+struct ArrivalRecord
+{
+  uint32_t rxEndOffset;  // The offset after the last byte received.
+  uint32_t cycleCount;
+};
+
+static CPowerOfTwoCircularBuffer< ArrivalRecord, uint32_t, 16 > s_arrivals;
+
+
+// The commands whose reply has not been completely handed over to the USB stack yet.
+// If there are too many of them, the measurements are lost, see CommandLatency_GetLostCount().
+
+struct PendingReply
+{
+  CommandLatencyCategoryEnum category;
+  uint32_t arrivalCycleCount;
+  uint32_t executionStartCycleCount;
+  uint32_t executionEndCycleCount;
+  uint32_t replyEndOffset;
+};
+
+static CPowerOfTwoCircularBuffer< PendingReply, uint32_t, 32 > s_pendingReplies;
+
+static uint32_t s_lostCount = 0;
+
+static uint32_t s_commandCounts[ COMMAND_LATENCY_CATEGORY_COUNT ];
+static CommandLatencyHistogram s_histograms[ COMMAND_LATENCY_CATEGORY_COUNT ][ COMMAND_LATENCY_STAGE_COUNT ];
+
+
+static void AddToHistogram ( CommandLatencyHistogram * const histogram, const uint32_t cycleCount )
+{
+  const uint32_t us = DwtCycleCountToUs( cycleCount );
+
+  unsigned binIndex = 0;
+
+  while ( binIndex < COMMAND_LATENCY_BIN_COUNT - 1 && ( us >> binIndex ) != 0 )
+    ++binIndex;
+
+  ++histogram->binCounts[ binIndex ];
+  histogram->totalUs += us;
+}
+
+
+static void RecordCommand ( const PendingReply * const cmd, const uint32_t replySentCycleCount )
+{
+  assert( cmd->category < COMMAND_LATENCY_CATEGORY_COUNT );
+
+  CommandLatencyHistogram * const histograms = s_histograms[ cmd->category ];
+
+  AddToHistogram( &histograms[ clsQueueing     ], cmd->executionStartCycleCount - cmd->arrivalCycleCount       );
+  AddToHistogram( &histograms[ clsExecution    ], cmd->executionEndCycleCount   - cmd->executionStartCycleCount );
+  AddToHistogram( &histograms[ clsTransmission ], replySentCycleCount           - cmd->executionEndCycleCount   );
+  AddToHistogram( &histograms[ clsTotal        ], replySentCycleCount           - cmd->arrivalCycleCount       );
+
+  ++s_commandCounts[ cmd->category ];
+}
+
+
+void CommandLatency_ConnectionStarted ( const uint32_t rxBufferElemCount )
+{
+  s_rxByteTotal = 0;
+  s_txSentByteTotal = 0;
+  s_arrivals.Reset();
+  s_pendingReplies.Reset();
+
+  // Some data may have already landed in the Rx Buffer when the connection was set up.
+  if ( rxBufferElemCount != 0 )
+    CommandLatency_DataReceived( rxBufferElemCount );
+}
+
+
+void CommandLatency_DataReceived ( const uint32_t byteCount )
+{
+  if ( byteCount == 0 )
+    return;
+
+  s_rxByteTotal += byteCount;
+
+  if ( s_arrivals.IsFull() )
+    s_arrivals.ConsumeReadElements( 1 );
+
+  ArrivalRecord record;
+  record.rxEndOffset = s_rxByteTotal;
+  record.cycleCount  = GetDwtCycleCount();
+
+  s_arrivals.WriteElem( record );
+}
+
+
+void CommandLatency_DataSent ( const uint32_t byteCount )
+{
+  if ( byteCount == 0 )
+    return;
+
+  s_txSentByteTotal += byteCount;
+
+  const uint32_t currentCycleCount = GetDwtCycleCount();
+
+  while ( !s_pendingReplies.IsEmpty() )
+  {
+    const PendingReply * const oldest = s_pendingReplies.PeekElement();
+
+    if ( int32_t( s_txSentByteTotal - oldest->replyEndOffset ) < 0 )
+      break;
+
+    RecordCommand( oldest, currentCycleCount );
+    s_pendingReplies.ConsumeReadElements( 1 );
+  }
+}
+
+
+void CommandLatency_BeginCommand ( CommandLatencyStart * const start, const uint32_t rxBufferElemCount )
+{
+  const uint32_t firstByteOffset = s_rxByteTotal - rxBufferElemCount;
+
+  // Forget the arrival records that only contain bytes of earlier commands.
+  while ( !s_arrivals.IsEmpty() &&
+          int32_t( s_arrivals.PeekElement()->rxEndOffset - firstByteOffset ) <= 0 )
+  {
+    s_arrivals.ConsumeReadElements( 1 );
+  }
+
+  start->executionStartCycleCount = GetDwtCycleCount();
+
+  if ( s_arrivals.IsEmpty() )
+  {
+    assert( false );  // The byte must have arrived somehow.
+    start->arrivalCycleCount = start->executionStartCycleCount;
+  }
+  else
+  {
+    start->arrivalCycleCount = s_arrivals.PeekElement()->cycleCount;
+  }
+}
+
+
+void CommandLatency_EndCommand ( const CommandLatencyStart * const start,
+                                 const CommandLatencyCategoryEnum category,
+                                 const uint32_t txBufferElemCount )
+{
+  PendingReply cmd;
+
+  cmd.category                 = category;
+  cmd.arrivalCycleCount        = start->arrivalCycleCount;
+  cmd.executionStartCycleCount = start->executionStartCycleCount;
+  cmd.executionEndCycleCount   = GetDwtCycleCount();
+  cmd.replyEndOffset           = s_txSentByteTotal + txBufferElemCount;
+
+  // If nothing is waiting to be sent, there is no transmission time.
+  // This is normally the case for commands without a reply.
+
+  if ( txBufferElemCount == 0 && s_pendingReplies.IsEmpty() )
+  {
+    RecordCommand( &cmd, cmd.executionEndCycleCount );
+    return;
+  }
+
+  if ( s_pendingReplies.IsFull() )
+  {
+    ++s_lostCount;
+    return;
+  }
+
+  s_pendingReplies.WriteElem( cmd );
+}
+
+
+const char * CommandLatency_GetCategoryName ( const CommandLatencyCategoryEnum category )
+{
+  switch ( category )
+  {
+  case clcTapShiftUpTo8Bits:    return "CMD_TAP_SHIFT <= 8 bits";
+  case clcTapShiftUpTo64Bits:   return "CMD_TAP_SHIFT <= 64 bits";
+  case clcTapShiftUpTo512Bits:  return "CMD_TAP_SHIFT <= 512 bits";
+  case clcTapShiftUpTo4096Bits: return "CMD_TAP_SHIFT <= 4096 bits";
+  case clcTapShiftLonger:       return "CMD_TAP_SHIFT > 4096 bits";
+  case clcPortMode:             return "CMD_PORT_MODE";
+  case clcFeature:              return "CMD_FEATURE";
+  case clcUartSpeed:            return "CMD_UART_SPEED";
+  case clcWelcome:              return "OpenOCD mode welcome";
+  case clcJtagDueExtension:     return "JtagDue extensions";
+  case clcOther:                return "Other";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+const char * CommandLatency_GetStageName ( const CommandLatencyStageEnum stage )
+{
+  switch ( stage )
+  {
+  case clsQueueing:     return "Queueing";
+  case clsExecution:    return "Execution";
+  case clsTransmission: return "Transmission";
+  case clsTotal:        return "Total";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+uint32_t CommandLatency_GetCommandCount ( const CommandLatencyCategoryEnum category )
+{
+  assert( category < COMMAND_LATENCY_CATEGORY_COUNT );
+  return s_commandCounts[ category ];
+}
+
+
+const CommandLatencyHistogram * CommandLatency_GetHistogram ( const CommandLatencyCategoryEnum category,
+                                                              const CommandLatencyStageEnum stage )
+{
+  assert( category < COMMAND_LATENCY_CATEGORY_COUNT );
+  assert( stage < COMMAND_LATENCY_STAGE_COUNT );
+  return &s_histograms[ category ][ stage ];
+}
+
+
+uint32_t CommandLatency_GetLostCount ( void )
+{
+  return s_lostCount;
+}
+
+
+void CommandLatency_Reset ( void )
+{
+  // The commands still pending will be recorded later on, which is harmless.
+  memset( s_commandCounts, 0, sizeof( s_commandCounts ) );
+  memset( s_histograms, 0, sizeof( s_histograms ) );
+  s_lostCount = 0;
+}
@@ -0,0 +1,117 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef COMMAND_LATENCY_H_INCLUDED
+#define COMMAND_LATENCY_H_INCLUDED
+
+#include <stdint.h>
+
+// These routines measure the turnaround latency of the OpenOCD commands in 3 stages:
+//
+// 1) Queueing: from the moment the command's first byte enters the USB Rx Buffer
+//    until the command starts executing.
+// 2) Execution: until the command has finished. A streamed CMD_TAP_SHIFT also counts the time
+//    spent waiting for the rest of its data here.
+// 3) Transmission: until the last byte of the reply has been handed over to the USB stack.
+//
+// The time of arrival is the time when the main loop moved the data into the USB Rx Buffer,
+// which can be somewhat later than the time when the data arrived over USB.
+//
+// The results are kept in log-scale histograms per command category,
+// see console command "Latency". The routines are only available with the profiler
+// (see configure option --enable-profiler), otherwise they compile to nothing.
+
+enum CommandLatencyCategoryEnum
+{
+  clcTapShiftUpTo8Bits = 0,
+  clcTapShiftUpTo64Bits,
+  clcTapShiftUpTo512Bits,
+  clcTapShiftUpTo4096Bits,
+  clcTapShiftLonger,
+  clcPortMode,
+  clcFeature,
+  clcUartSpeed,
+  clcWelcome,
+  clcJtagDueExtension,
+  clcOther,
+
+  COMMAND_LATENCY_CATEGORY_COUNT
+};
+
+enum CommandLatencyStageEnum
+{
+  clsQueueing = 0,
+  clsExecution,
+  clsTransmission,
+  clsTotal,
+
+  COMMAND_LATENCY_STAGE_COUNT
+};
+
+// Bin 0 counts the latencies under 1 us, bin n counts those under 2^n us,
+// and the last bin counts all longer latencies.
+#define COMMAND_LATENCY_BIN_COUNT  16
+
+
+#ifdef ENABLE_PROFILER
+
+  struct CommandLatencyStart
+  {
+    uint32_t arrivalCycleCount;
+    uint32_t executionStartCycleCount;
+  };
+
+  struct CommandLatencyHistogram
+  {
+    uint32_t binCounts[ COMMAND_LATENCY_BIN_COUNT ];
+    uint64_t totalUs;
+  };
+
+  void CommandLatency_ConnectionStarted ( uint32_t rxBufferElemCount );
+  void CommandLatency_DataReceived ( uint32_t byteCount );
+  void CommandLatency_DataSent ( uint32_t byteCount );
+
+  void CommandLatency_BeginCommand ( CommandLatencyStart * start, uint32_t rxBufferElemCount );
+  void CommandLatency_EndCommand ( const CommandLatencyStart * start,
+                                   CommandLatencyCategoryEnum category,
+                                   uint32_t txBufferElemCount );
+
+  const char * CommandLatency_GetCategoryName ( CommandLatencyCategoryEnum category );
+  const char * CommandLatency_GetStageName ( CommandLatencyStageEnum stage );
+  uint32_t CommandLatency_GetCommandCount ( CommandLatencyCategoryEnum category );
+  const CommandLatencyHistogram * CommandLatency_GetHistogram ( CommandLatencyCategoryEnum category,
+                                                                CommandLatencyStageEnum stage );
+  uint32_t CommandLatency_GetLostCount ( void );
+  void CommandLatency_Reset ( void );
+
+#else
+
+  struct CommandLatencyStart
+  {
+  };
+
+  inline void CommandLatency_ConnectionStarted ( uint32_t ) {}
+  inline void CommandLatency_DataReceived ( uint32_t ) {}
+  inline void CommandLatency_DataSent ( uint32_t ) {}
+  inline void CommandLatency_BeginCommand ( CommandLatencyStart *, uint32_t ) {}
+  inline void CommandLatency_EndCommand ( const CommandLatencyStart *, CommandLatencyCategoryEnum, uint32_t ) {}
+
+#endif
+
+
+#endif  // Include this header file only once.
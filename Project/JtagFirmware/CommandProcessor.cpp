@@ -16,10 +16,28 @@
 #include <BareMetalSupport/BusyWait.h>
 #include <BareMetalSupport/SerialPortUtils.h>
 #include <BareMetalSupport/IntegerPrintUtils.h>
+#include <BareMetalSupport/DwtUtils.h>
+#include <BareMetalSupport/Miscellaneous.h>
+#include <BareMetalSupport/SerialPortAsyncTx.h>
 
 #include "Globals.h"
 #include "BusPirateOpenOcdMode.h"
+#include "UsbConnection.h"
+#include "UsbDiagnosticPort.h"
+#include "SerialPortConsole.h"
 #include "JtagPins.h"
+#include "JtagDap.h"
+#include "JtagTap.h"
+#include "SwdDap.h"
+#include "DapRegisters.h"
+#include "WorkBudget.h"
+#include "MainLoopStats.h"
+#include "TraceRing.h"
+#include "ProtocolStats.h"
+#include "Profiler.h"
+#include "CommandLatency.h"
+#include "TckTiming.h"
+#include "SessionCapture.h"
 
 #include <rstc.h>
 
@@ -179,7 +197,12 @@ static unsigned int ParseUnsignedIntArg ( const char * const begin )
     throw std::runtime_error( ERR_MSG );
   }
 
-  STATIC_ASSERT( sizeof(unsigned int) == sizeof(unsigned long), "You may want to rethink this routine's data types." );
+  // 'long' is wider than 'int' in the host simulator build.
+  if ( (unsigned long) (unsigned int) val != val )
+  {
+    throw std::runtime_error( ERR_MSG );
+  }
+
   return (unsigned int) val;
 }
 
@@ -219,7 +242,7 @@ void CCommandProcessor::PrintMemory ( const char * const paramBegin )
     return;
   }
 
-  HexDump( (const void *) addr, size_t( count ), EOL );
+  HexDump( (const void *) uintptr_t( addr ), size_t( count ), EOL );
 }
 
 
@@ -311,9 +334,9 @@ void CCommandProcessor::ProcessUsbSpeedTestCmd ( const char * const paramBegin,
   }
 
   if ( extraParamsFound )
-    Printf( "No parameters are allowed after test type \"%.*s\"." EOL, paramEnd - paramBegin, paramBegin );
+    Printf( "No parameters are allowed after test type \"%.*s\"." EOL, int( paramEnd - paramBegin ), paramBegin );
   else
-    Printf( "Unknown test type \"%.*s\"." EOL, paramEnd - paramBegin, paramBegin );
+    Printf( "Unknown test type \"%.*s\"." EOL, int( paramEnd - paramBegin ), paramBegin );
 }
 
 
@@ -451,219 +474,1321 @@ void CCommandProcessor::SimulateError ( const char * const paramBegin )
     return;
   }
 
-  Printf( "Unknown error type \"%.*s\"." EOL, paramEnd - paramBegin, paramBegin );
+  Printf( "Unknown error type \"%.*s\"." EOL, int( paramEnd - paramBegin ), paramBegin );
 }
 
 
-static const char * const CMDNAME_QUESTION_MARK = "?";
-static const char * const CMDNAME_HELP = "help";
-static const char * const CMDNAME_I = "i";
-static const char * const CMDNAME_USBSPEEDTEST = "UsbSpeedTest";
-static const char * const CMDNAME_JTAGPINS = "JtagPins";
-static const char * const CMDNAME_JTAGSHIFTSPEEDTEST = "JtagShiftSpeedTest";
-static const char * const CMDNAME_MALLOCTEST = "MallocTest";
-static const char * const CMDNAME_CPP_EXCEPTION_TEST = "ExceptionTest";
-static const char * const CMDNAME_MEMORY_USAGE = "MemoryUsage";
-static const char * const CMDNAME_SIMULATE_ERROR = "SimulateError";
-static const char * const CMDNAME_RESET = "Reset";
-static const char * const CMDNAME_CPU_LOAD = "CpuLoad";
-static const char * const CMDNAME_RESET_CAUSE = "ResetCause";
-static const char * const CMDNAME_PRINT_MEMORY = "PrintMemory";
-static const char * const CMDNAME_BUSY_WAIT = "BusyWait";
-static const char * const CMDNAME_UPTIME = "Uptime";
+void CCommandProcessor::ResetAndHalt ( const char * const paramBegin )
+{
+  const char * const widthEnd      = SkipCharsNotInSet( paramBegin,   SPACE_AND_TAB );
+  const char * const timeoutBegin  = SkipCharsInSet   ( widthEnd,     SPACE_AND_TAB );
+  const char * const timeoutEnd    = SkipCharsNotInSet( timeoutBegin, SPACE_AND_TAB );
+  const char * const extraArgBegin = SkipCharsInSet   ( timeoutEnd,   SPACE_AND_TAB );
 
+  if ( *extraArgBegin != 0 )
+  {
+    PrintStr( "Invalid arguments." EOL );
+    return;
+  }
 
-void CCommandProcessor::ParseCommand ( const char * const cmdBegin,
-                                       const uint64_t currentTime )
-{
-  const char * const cmdEnd = SkipCharsNotInSet( cmdBegin, SPACE_AND_TAB );
-  assert( cmdBegin != cmdEnd );
+  const unsigned srstPulseWidthUs = ( *paramBegin   == 0 ) ? 1000 : ParseUnsignedIntArg( paramBegin   );
+  const unsigned haltTimeoutMs    = ( *timeoutBegin == 0 ) ?  100 : ParseUnsignedIntArg( timeoutBegin );
 
-  const char * const paramBegin = SkipCharsInSet( cmdEnd, SPACE_AND_TAB );
+  if ( srstPulseWidthUs > JTAG_DAP_MAX_SRST_PULSE_WIDTH_US ||
+       haltTimeoutMs > JTAG_DAP_MAX_HALT_TIMEOUT_US / 1000 )
+  {
+    Printf( "Because of the watchdog, the SRST pulse width is limited to %u us and the timeout to %u ms." EOL,
+            unsigned( JTAG_DAP_MAX_SRST_PULSE_WIDTH_US ),
+            unsigned( JTAG_DAP_MAX_HALT_TIMEOUT_US / 1000 ) );
+    return;
+  }
 
-  bool extraParamsFound = false;
+  // The JTAG pins are normally in high-impedance mode when OpenOCD is not connected.
+  const JtagPinModeEnum oldMode = GetJtagPinMode();
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_QUESTION_MARK, true, false, &extraParamsFound ) ||
-       IsCmd( cmdBegin, cmdEnd, CMDNAME_HELP, false, false, &extraParamsFound ) )
+  if ( oldMode == MODE_HIZ )
+    SetJtagPinMode( MODE_JTAG );
+
+  uint32_t latencyUs;
+  uint32_t idCode;
+
+  try
   {
-    PrintStr( "This console is similar to the Bus Pirate console." EOL );
-    PrintStr( "Commands longer than 1 character are case insensitive." EOL );
-    PrintStr( "WARNING: If a command takes too long to run, the watchdog may reset the board." EOL );
-    PrintStr( "Commands are:" EOL );
+    latencyUs = JtagDap_ResetAndHalt( srstPulseWidthUs, haltTimeoutMs * 1000 );
+    idCode = JtagDap_ReadIdCode();
+  }
+  catch ( ... )
+  {
+    SetJtagPinMode( oldMode );
+    throw;
+  }
 
-    Printf( "  %s, %s: Show this help text." EOL, CMDNAME_QUESTION_MARK, CMDNAME_HELP );
-    Printf( "  %s: Show version information." EOL, CMDNAME_I );
-    Printf( "  %s: Test USB transfer speed." EOL, CMDNAME_USBSPEEDTEST );
-    Printf( "  %s: Show JTAG pin status (read as inputs)." EOL, CMDNAME_JTAGPINS );
-    Printf( "  %s: Test JTAG shift speed. WARNING: Do NOT connect any JTAG device." EOL, CMDNAME_JTAGSHIFTSPEEDTEST );
-    Printf( "  %s: Exercises malloc()." EOL, CMDNAME_MALLOCTEST );
-    Printf( "  %s: Exercises C++ exceptions." EOL, CMDNAME_CPP_EXCEPTION_TEST );
-    Printf( "  %s: Shows memory usage." EOL, CMDNAME_MEMORY_USAGE );
-    Printf( "  %s" EOL, CMDNAME_CPU_LOAD );
-    Printf( "  %s" EOL, CMDNAME_UPTIME );
-    Printf( "  %s" EOL, CMDNAME_RESET );
-    Printf( "  %s" EOL, CMDNAME_RESET_CAUSE );
-    Printf( "  %s <addr> <byte count>" EOL, CMDNAME_PRINT_MEMORY );
-    Printf( "  %s <milliseconds>" EOL, CMDNAME_BUSY_WAIT );
-    Printf( "  %s <command|protocol>" EOL, CMDNAME_SIMULATE_ERROR );
+  SetJtagPinMode( oldMode );
+
+  Printf( "Target with IDCODE 0x%08X halted %u us after releasing SRST." EOL,
+          unsigned( idCode ), unsigned( latencyUs ) );
+}
+
+
+void CCommandProcessor::JtagChain ( const char * const paramBegin )
+{
+  const char * const paramEnd      = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+  const char * const extraArgBegin = SkipCharsInSet   ( paramEnd,   SPACE_AND_TAB );
 
+  if ( *extraArgBegin != 0 )
+  {
+    PrintStr( "Invalid arguments." EOL );
     return;
   }
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_I, true, false, &extraParamsFound ) )
+  if ( *paramBegin != 0 )
   {
-    #ifndef NDEBUG
-      const char buildType[] = "Debug build";
-    #else
-      const char buildType[] = "Release build";
-    #endif
+    if ( !DoesStrMatch( paramBegin, paramEnd, "discover", false ) )
+    {
+      Printf( "Unknown argument \"%.*s\"." EOL, int( paramEnd - paramBegin ), paramBegin );
+      return;
+    }
 
-    Printf( "JtagDue %s" EOL, PACKAGE_VERSION );
-    Printf( "%s, compiler version %s" EOL, buildType, __VERSION__ );
-    Printf( "Watchdog %s" EOL, ENABLE_WDT ? "enabled" : "disabled" );
+    const JtagPinModeEnum oldMode = GetJtagPinMode();
+
+    if ( oldMode == MODE_HIZ )
+      SetJtagPinMode( MODE_JTAG );
+
+    try
+    {
+      JtagTap_DiscoverChain();
+    }
+    catch ( ... )
+    {
+      SetJtagPinMode( oldMode );
+      throw;
+    }
+
+    SetJtagPinMode( oldMode );
+  }
 
+  const uint8_t deviceCount = JtagTap_GetChainDeviceCount();
+
+  Printf( "JTAG chain with %u device(s), selected TAP: %u." EOL,
+          unsigned( deviceCount ), unsigned( JtagTap_GetSelectedTap() ) );
+
+  if ( deviceCount > 1 )
+  {
+    for ( uint8_t i = 0; i < deviceCount; ++i )
+      Printf( "  TAP %u: IR length %u" EOL, unsigned( i ), unsigned( JtagTap_GetChainIrLength( i ) ) );
+  }
+}
+
+
+// Compares the memory read speed over the JTAG-DP and the SW-DP. You need a Cortex-M target
+// that supports both, like a second Arduino Due.
+
+void CCommandProcessor::DapSpeedTest ( const char * const paramBegin )
+{
+  const char * const typeEnd       = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+  const char * const addrBegin     = SkipCharsInSet   ( typeEnd,    SPACE_AND_TAB );
+  const char * const addrEnd       = SkipCharsNotInSet( addrBegin,  SPACE_AND_TAB );
+  const char * const extraArgBegin = SkipCharsInSet   ( addrEnd,    SPACE_AND_TAB );
+
+  if ( *paramBegin == 0 || *extraArgBegin != 0 )
+  {
+    PrintStr( "Invalid arguments." EOL );
     return;
   }
 
+  bool isSwd;
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_RESET, false, false, &extraParamsFound ) )
+  if ( DoesStrMatch( paramBegin, typeEnd, "jtag", false ) )
+    isSwd = false;
+  else if ( DoesStrMatch( paramBegin, typeEnd, "swd", false ) )
+    isSwd = true;
+  else
   {
-    // This message does not reach the other side, we would need to add some delay.
-    //   UsbPrint( txBuffer, "Resetting the board..." EOL );
-    __disable_irq();
-    // Note that this message always goes to the serial port console,
-    // even if the user is connected over USB. It might be possible to send
-    // it over USB and then wait for the outgoing buffer to be empty.
-    SerialSyncWriteStr( "Resetting the board..." EOL );
-    SerialWaitForDataSent();
-    ResetBoard( ENABLE_WDT );
-    assert( false );  // We should never reach this point.
+    Printf( "Unknown debug port type \"%.*s\"." EOL, int( typeEnd - paramBegin ), paramBegin );
     return;
   }
 
+  // By default, read a register that every Cortex-M core has.
+  const uint32_t addr = ( *addrBegin == 0 ) ? ARMV7M_DHCSR : ParseUnsignedIntArg( addrBegin );
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_CPU_LOAD, false, false, &extraParamsFound ) )
+  // Keep the test well below the watchdog period.
+  const uint32_t READ_COUNT = 1000;
+
+  const JtagPinModeEnum oldMode = GetJtagPinMode();
+
+  if ( oldMode == MODE_HIZ )
+    SetJtagPinMode( MODE_JTAG );
+
+  uint32_t elapsedCycleCount;
+
+  try
   {
-    if ( ENABLE_CPU_SLEEP )
-      PrintStr( "CPU load statistics not available." EOL );
+    if ( isSwd )
+      SwdDap_Connect();
     else
-      DisplayCpuLoad();
+      JtagDap_Connect();
 
-    return;
+    const uint32_t startTime = GetDwtCycleCount();
+
+    for ( uint32_t i = 0; i < READ_COUNT; ++i )
+    {
+      if ( isSwd )
+        SwdDap_ReadMem32( addr );
+      else
+        JtagDap_ReadMem32( addr );
+    }
+
+    elapsedCycleCount = GetDwtElapsedCycleCount( startTime );
+  }
+  catch ( ... )
+  {
+    SetJtagPinMode( oldMode );
+    throw;
   }
 
+  SetJtagPinMode( oldMode );
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_UPTIME, false, false, &extraParamsFound ) )
+  const uint32_t elapsedUs = MaxFrom( DwtCycleCountToUs( elapsedCycleCount ), uint32_t( 1 ) );
+
+  Printf( "%u memory reads over %s took %u us, %u reads/s." EOL,
+          unsigned( READ_COUNT ),
+          isSwd ? "SWD" : "JTAG",
+          unsigned( elapsedUs ),
+          unsigned( uint64_t( READ_COUNT ) * 1000000 / elapsedUs ) );
+}
+
+
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+
+void CCommandProcessor::LiveStats ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin == 0 || *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
   {
-    char buffer[ CONVERT_TO_DEC_BUF_SIZE ];
-    Printf( "Uptime: %s seconds." EOL, convert_unsigned_to_dec_th( GetUptime() / 1000, buffer, ',' ) );
+    PrintStr( "Invalid arguments." EOL );
     return;
   }
 
-
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_RESET_CAUSE, false, false, &extraParamsFound ) )
+  if ( DoesStrMatch( paramBegin, paramEnd, "off", false ) )
   {
-    DisplayResetCause();
+    UsbDiagnosticPort_SetLiveStatsPeriod( 0 );
     return;
   }
 
+  const uint32_t periodMs = ParseUnsignedIntArg( paramBegin );
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_PRINT_MEMORY, false, true, &extraParamsFound ) )
+  if ( periodMs == 0 )
   {
-    PrintMemory( paramBegin );
+    PrintStr( "Invalid period." EOL );
     return;
   }
 
+  UsbDiagnosticPort_SetLiveStatsPeriod( periodMs );
+}
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_BUSY_WAIT, false, true, &extraParamsFound ) )
+#endif
+
+
+#ifdef ENABLE_PROFILER
+
+// The times are inclusive, see Profiler.h .
+
+void CCommandProcessor::Profile ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  bool reset = false;
+
+  if ( *paramBegin != 0 )
   {
-    BusyWait( paramBegin );
-    return;
+    if ( !DoesStrMatch( paramBegin, paramEnd, "reset", false ) ||
+         *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    reset = true;
   }
 
+  PrintStr( "Zone                         Calls   Total us    Avg cyc    Min cyc    Max cyc" EOL );
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_USBSPEEDTEST, false, true, &extraParamsFound ) )
+  for ( unsigned i = 0; i < PROFILE_ZONE_COUNT; ++i )
   {
-    ProcessUsbSpeedTestCmd( paramBegin, currentTime );
-    return;
+    const ProfileZoneEnum zone = ProfileZoneEnum( i );
+
+    ProfileZoneStats stats;
+    Profiler_GetZoneStats( zone, &stats );
+
+    if ( stats.callCount == 0 )
+      continue;
+
+    Printf( "%-27s %7u %10u %10u %10u %10u" EOL,
+            Profiler_GetZoneName( zone ),
+            unsigned( stats.callCount ),
+            unsigned( stats.totalCycleCount / ( CPU_CLOCK / 1000000 ) ),
+            unsigned( stats.totalCycleCount / stats.callCount ),
+            unsigned( stats.minCycleCount ),
+            unsigned( stats.maxCycleCount ) );
+  }
+
+  if ( reset )
+  {
+    Profiler_Reset();
+    PrintStr( "The profiler statistics have been reset." EOL );
   }
+}
 
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_JTAGPINS, false, false, &extraParamsFound ) )
+// Only the non-empty histogram bins are printed. A bin like "<64" counts the latencies
+// between 32 and 63 us, see COMMAND_LATENCY_BIN_COUNT.
+
+void CCommandProcessor::Latency ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin != 0 )
   {
-    PrintJtagPinStatus();
+    if ( !DoesStrMatch( paramBegin, paramEnd, "reset", false ) ||
+         *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    CommandLatency_Reset();
+    PrintStr( "The command latency statistics have been reset." EOL );
     return;
   }
 
-  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_JTAGSHIFTSPEEDTEST, false, false, &extraParamsFound ) )
+  for ( unsigned c = 0; c < COMMAND_LATENCY_CATEGORY_COUNT; ++c )
   {
-    if ( !IsNativeUsbPort() )
-      throw std::runtime_error( "This command is only available on the 'Native' USB port." );
+    const CommandLatencyCategoryEnum category = CommandLatencyCategoryEnum( c );
 
+    const uint32_t cmdCount = CommandLatency_GetCommandCount( category );
 
-    // Fill the Rx buffer with some test data.
-    assert( m_rxBuffer != NULL );
+    if ( cmdCount == 0 )
+      continue;
 
-    m_rxBuffer->Reset();
-    for ( uint32_t i = 0; !m_rxBuffer->IsFull(); ++i )
+    Printf( "%s: %u commands" EOL, CommandLatency_GetCategoryName( category ), unsigned( cmdCount ) );
+
+    for ( unsigned s = 0; s < COMMAND_LATENCY_STAGE_COUNT; ++s )
     {
-      m_rxBuffer->WriteElem( CUsbRxBuffer::ElemType( i ) );
+      const CommandLatencyStageEnum stage = CommandLatencyStageEnum( s );
+      const CommandLatencyHistogram * const histogram = CommandLatency_GetHistogram( category, stage );
+
+      Printf( "  %-12s avg %6u us:", CommandLatency_GetStageName( stage ), unsigned( histogram->totalUs / cmdCount ) );
+
+      for ( unsigned b = 0; b < COMMAND_LATENCY_BIN_COUNT; ++b )
+      {
+        const uint32_t binCount = histogram->binCounts[ b ];
+
+        if ( binCount == 0 )
+          continue;
+
+        if ( b == COMMAND_LATENCY_BIN_COUNT - 1 )
+          Printf( " >=%u:%u", 1u << ( b - 1 ), unsigned( binCount ) );
+        else
+          Printf( " <%u:%u", 1u << b, unsigned( binCount ) );
+      }
+
+      PrintStr( EOL );
     }
+  }
 
+  Printf( "Measurements lost: %u" EOL, unsigned( CommandLatency_GetLostCount() ) );
+}
 
-    // If the mode is set to MODE_HIZ, you cannot see the generated signal with the oscilloscope.
-    // Note also that the built-in pull-ups on the Atmel ATSAM3X8 are too weak (between 50 and 100 KOhm,
-    // yields too slow a rising time) to be of any use.
+#endif
 
-    const bool oldPullUps = GetJtagPullups();
-    SetJtagPullups( false );
 
-    const JtagPinModeEnum oldMode = GetJtagPinMode();
-    SetJtagPinMode ( MODE_JTAG );
+#ifdef ENABLE_TCK_TIMING
 
+// Run this command after changing the shift kernels or the compiler settings, and compare
+// the figures with the previous build's, see TckTiming.h .
 
-    // Each JTAG transfer needs 2 bits in the Rx buffer, TMS and TDI,
-    // but produces only 1 bit, TDO.
-    const uint32_t jtagByteCount = m_rxBuffer->GetElemCount() / 2;
+void CCommandProcessor::TckTiming ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
 
-    const uint16_t bitCount = jtagByteCount * 8;
+  unsigned firstKernel = 0;
+  unsigned lastKernel  = JTAG_SHIFT_KERNEL_COUNT - 1;
 
-    // Shift all JTAG data through several times.
+  if ( *paramBegin != 0 )
+  {
+    if ( *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
 
-    const uint64_t startTime = GetUptime();
-    const uint32_t iterCount = 50;
+    unsigned k = 0;
 
-    for ( uint32_t i = 0; i < iterCount; ++i )
+    for ( ; k < JTAG_SHIFT_KERNEL_COUNT; ++k )
     {
-      // We hope that this will not clear the buffer contents.
-      assert( m_rxBuffer != NULL );
-      assert( m_txBuffer != NULL );
+      if ( DoesStrMatch( paramBegin, paramEnd, GetJtagShiftKernelName( JtagShiftKernelEnum( k ) ), false ) )
+        break;
+    }
 
-      m_rxBuffer->Reset();
-      m_rxBuffer->CommitWrittenElements( jtagByteCount * 2 );
+    if ( k == JTAG_SHIFT_KERNEL_COUNT )
+    {
+      Printf( "Unknown shift kernel \"%.*s\"." EOL, int( paramEnd - paramBegin ), paramBegin );
+      return;
+    }
 
-      m_txBuffer->Reset();
+    firstKernel = k;
+    lastKernel  = k;
+  }
 
-      ShiftJtagData( m_rxBuffer,
-                     m_txBuffer,
-                     bitCount );
+  // Like in the JTAG shift speed test, the pins must be driven for the shift kernels to work.
 
-      assert( m_txBuffer->GetElemCount() == jtagByteCount );
-    }
+  const bool oldPullUps = GetJtagPullups();
+  SetJtagPullups( false );
 
-    const uint64_t finishTime = GetUptime();
-    const uint32_t elapsedTime = uint32_t( finishTime - startTime );
+  const JtagPinModeEnum oldMode = GetJtagPinMode();
+  SetJtagPinMode( MODE_JTAG );
 
-    m_rxBuffer->Reset();
-    m_txBuffer->Reset();
-    const unsigned kBitsPerSec = unsigned( uint64_t(bitCount) * iterCount * 1000 / elapsedTime / 1024 );
+  for ( unsigned k = firstKernel; k <= lastKernel; ++k )
+    PrintTckTiming( JtagShiftKernelEnum( k ) );
 
-    SetJtagPinMode( oldMode );
-    SetJtagPullups( oldPullUps );
+  SetJtagPinMode( oldMode );
+  SetJtagPullups( oldPullUps );
+}
 
-    // I am getting 221 KiB/s with GCC 4.7.3 and optimisation level "-O3".
-    Printf( EOL "Finished JTAG shift speed test, throughput %u Kbits/s (%u KiB/s)." EOL,
-               kBitsPerSec, kBitsPerSec / 8 );
+
+// Only the non-empty histogram bins are printed. A bin like "+4:" counts the samples
+// between 4 and 5 cycles above the minimum, see TCK_TIMING_BIN_WIDTH.
+
+void CCommandProcessor::PrintTckTiming ( const JtagShiftKernelEnum kernel )
+{
+  TckTimingMetric metrics[ TCK_TIMING_METRIC_COUNT ];
+
+  TckTiming_Measure( kernel, metrics );
+
+  Printf( "Shift kernel \"%s\", times in CPU cycles at %u MHz:" EOL, GetJtagShiftKernelName( kernel ), unsigned( CPU_CLOCK / 1000000 ) );
+
+  for ( unsigned m = 0; m < TCK_TIMING_METRIC_COUNT; ++m )
+  {
+    const TckTimingMetricEnum metric = TckTimingMetricEnum( m );
+    const TckTimingMetric * const stats = &metrics[ m ];
+
+    if ( stats->sampleCount == 0 )
+      continue;
+
+    Printf( "  %-10s min %4u, mean %4u, max %4u, samples %u" EOL,
+            TckTiming_GetMetricName( metric ),
+            unsigned( stats->minCycleCount ),
+            unsigned( stats->totalCycleCount / stats->sampleCount ),
+            unsigned( stats->maxCycleCount ),
+            unsigned( stats->sampleCount ) );
+
+    PrintStr( "   " );
+
+    for ( unsigned b = 0; b < TCK_TIMING_BIN_COUNT; ++b )
+    {
+      if ( stats->binCounts[ b ] == 0 )
+        continue;
+
+      Printf( " %s+%u:%u",
+              b == TCK_TIMING_BIN_COUNT - 1 ? ">=" : "",
+              b * TCK_TIMING_BIN_WIDTH,
+              unsigned( stats->binCounts[ b ] ) );
+    }
+
+    PrintStr( EOL );
+  }
+
+  const TckTimingMetric * const period = &metrics[ ttmPeriod ];
+
+  if ( period->sampleCount != 0 && period->totalCycleCount != 0 )
+  {
+    Printf( "  Average TCK frequency inside a byte: %u kHz" EOL,
+            unsigned( uint64_t( CPU_CLOCK / 1000 ) * period->sampleCount / period->totalCycleCount ) );
+  }
+}
+
+#endif
+
+
+#ifdef ENABLE_CIRCULAR_BUFFER_STATS
+
+// Use these figures to size the buffers, see --with-usb-buffer-size and --with-serial-tx-buffer-size in configure.ac .
+// Printing this report fills the console's own Tx Buffer, so all statistics are collected beforehand.
+
+void CCommandProcessor::BufferStats ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin != 0 )
+  {
+    if ( !DoesStrMatch( paramBegin, paramEnd, "reset", false ) ||
+         *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    ResetUsbBufferStats();
+    ResetSerialPortRxBufferStats();
+    ResetSerialPortTxBufferStats();
+    PrintStr( "The buffer statistics have been reset." EOL );
+    return;
+  }
+
+  CircularBufferStats usbRxStats;
+  CircularBufferStats usbTxStats;
+  CircularBufferStats serialRxStats;
+  CircularBufferStats serialTxStats;
+
+  GetUsbBufferStats( &usbRxStats, &usbTxStats );
+  GetSerialPortRxBufferStats( &serialRxStats );
+  GetSerialPortTxBufferStats( &serialTxStats );
+
+  PrintStr( "Buffer        Size    Max used  Became full  Became empty  Full ms  Overflows  Dropped" EOL );
+
+  PrintBufferStats( "USB Rx", &usbRxStats );
+  PrintBufferStats( "USB Tx", &usbTxStats );
+  PrintBufferStats( "Serial Rx", &serialRxStats );
+  PrintBufferStats( "Serial Tx", &serialTxStats );
+}
+
+
+void CCommandProcessor::PrintBufferStats ( const char * const name, const CircularBufferStats * const stats )
+{
+  Printf( "%-10s %7u %7u %3u%% %12u %13u %8u %10u %8u" EOL,
+          name,
+          unsigned( stats->bufferSize ),
+          unsigned( stats->maxElemCount ),
+          unsigned( uint64_t( stats->maxElemCount ) * 100 / stats->bufferSize ),
+          unsigned( stats->becameFullCount ),
+          unsigned( stats->becameEmptyCount ),
+          unsigned( stats->fullCycleCount / ( CPU_CLOCK / 1000 ) ),
+          unsigned( stats->overflowCount ),
+          unsigned( stats->droppedElemCount ) );
+}
+
+#endif
+
+
+#ifdef ENABLE_SESSION_CAPTURE
+
+// The dump and the stream are meant to be converted with tool JtagTroubleshooting/ConvertSessionCapture.c .
+// The serial port console drops output if it gets too long, so dump over USB if you can.
+
+void CCommandProcessor::Capture ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin == 0 )
+  {
+    Printf( "Session capture: %s, %u records, %u of %u bytes used, %u records overwritten." EOL,
+            SessionCapture_IsActive() ? "on" : "off",
+            unsigned( SessionCapture_GetRecordCount() ),
+            unsigned( SessionCapture_GetByteCount() ),
+            unsigned( SESSION_CAPTURE_BUFFER_SIZE ),
+            unsigned( SessionCapture_GetOverwrittenCount() ) );
+
+    #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+      Printf( "Streaming to the USB diagnostic port: %s" EOL, SessionCapture_IsStreaming() ? "on" : "off" );
+    #endif
+
+    return;
+  }
+
+  const char * const secondParamBegin = SkipCharsInSet( paramEnd, SPACE_AND_TAB );
+
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+
+    if ( DoesStrMatch( paramBegin, paramEnd, "stream", false ) )
+    {
+      const char * const secondParamEnd = SkipCharsNotInSet( secondParamBegin, SPACE_AND_TAB );
+
+      if ( *SkipCharsInSet( secondParamEnd, SPACE_AND_TAB ) == 0 )
+      {
+        if ( DoesStrMatch( secondParamBegin, secondParamEnd, "on", false ) )
+        {
+          SessionCapture_SetStreaming( true );
+          return;
+        }
+
+        if ( DoesStrMatch( secondParamBegin, secondParamEnd, "off", false ) )
+        {
+          SessionCapture_SetStreaming( false );
+          return;
+        }
+      }
+
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+  #endif
+
+  if ( *secondParamBegin != 0 )
+  {
+    PrintStr( "Invalid arguments." EOL );
+    return;
+  }
+
+  if ( DoesStrMatch( paramBegin, paramEnd, "on", false ) )
+  {
+    SessionCapture_SetActive( true );
+    return;
+  }
+
+  if ( DoesStrMatch( paramBegin, paramEnd, "off", false ) )
+  {
+    SessionCapture_SetActive( false );
+    return;
+  }
+
+  if ( DoesStrMatch( paramBegin, paramEnd, "clear", false ) )
+  {
+    SessionCapture_Clear();
+    return;
+  }
+
+  if ( !DoesStrMatch( paramBegin, paramEnd, "dump", false ) )
+  {
+    PrintStr( "Invalid arguments." EOL );
+    return;
+  }
+
+  // If this console runs on the native USB port, the dump would otherwise capture itself.
+  CAutoDisableSessionCapture autoDisableSessionCapture;
+
+  Printf( "CAPTURE-BEGIN cpu-clock=%u records=%u overwritten=%u" EOL,
+          unsigned( CPU_CLOCK ),
+          unsigned( SessionCapture_GetRecordCount() ),
+          unsigned( SessionCapture_GetOverwrittenCount() ) );
+
+  uint8_t record[ SESSION_CAPTURE_MAX_RECORD_LEN ];
+  char line[ SESSION_CAPTURE_LINE_BUFFER_SIZE ];
+
+  SessionCapture_FormatRecordLine( record, SessionCapture_MakeHeaderRecord( record ), line );
+  PrintStr( line );
+
+  SessionCaptureCursor cursor;
+  SessionCapture_GetOldestCursor( &cursor );
+
+  for ( ; ; )
+  {
+    const uint32_t recordLen = SessionCapture_ReadRecord( &cursor, record );
+
+    if ( recordLen == 0 )
+      break;
+
+    SessionCapture_FormatRecordLine( record, recordLen, line );
+    PrintStr( line );
+  }
+
+  PrintStr( "CAPTURE-END" EOL );
+}
+
+#endif
+
+
+// Use the "coalesce" argument to compare the number of USB transfers per OpenOCD command
+// with and without reply coalescing, see ENABLE_REPLY_COALESCING.
+
+void CCommandProcessor::UsbTxStatsCmd ( const char * const paramBegin )
+{
+  const char * const paramEnd   = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+  const char * const valueBegin = SkipCharsInSet   ( paramEnd,   SPACE_AND_TAB );
+  const char * const valueEnd   = SkipCharsNotInSet( valueBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin != 0 )
+  {
+    if ( DoesStrMatch( paramBegin, paramEnd, "reset", false ) && *valueBegin == 0 )
+    {
+      ResetUsbTxStats();
+      ResetOpenOcdCommandCount();
+      PrintStr( "The USB transmit statistics have been reset." EOL );
+      return;
+    }
+
+    if ( !DoesStrMatch( paramBegin, paramEnd, "coalesce", false ) ||
+         *valueBegin == 0 ||
+         *SkipCharsInSet( valueEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    if ( DoesStrMatch( valueBegin, valueEnd, "on", false ) )
+      SetUsbReplyCoalescing( true );
+    else if ( DoesStrMatch( valueBegin, valueEnd, "off", false ) )
+      SetUsbReplyCoalescing( false );
+    else
+    {
+      Printf( "Unknown argument \"%.*s\"." EOL, int( valueEnd - valueBegin ), valueBegin );
+      return;
+    }
+  }
+
+  UsbTxStats stats;
+  GetUsbTxStats( &stats );
+
+  const uint32_t cmdCount = GetOpenOcdCommandCount();
+
+  Printf( "Reply coalescing: %s" EOL, IsUsbReplyCoalescingEnabled() ? "on" : "off" );
+  Printf( "OpenOCD commands: %u" EOL, unsigned( cmdCount ) );
+  Printf( "USB writes: %u, USB transfers: %u, %u bytes in total." EOL,
+          unsigned( stats.flushCount ), unsigned( stats.transferCount ), unsigned( stats.byteCount ) );
+
+  if ( cmdCount != 0 )
+    Printf( "USB transfers per 100 commands: %u" EOL, unsigned( uint64_t( stats.transferCount ) * 100 / cmdCount ) );
+
+  if ( stats.transferCount != 0 )
+    Printf( "Average bytes per USB transfer: %u" EOL, unsigned( stats.byteCount / stats.transferCount ) );
+}
+
+
+// Use this command to see which service uses up the main loop's time, and whether
+// the work budget is too small for the current load, see WorkBudget.h .
+
+void CCommandProcessor::WorkBudgetCmd ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin != 0 )
+  {
+    if ( *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    if ( DoesStrMatch( paramBegin, paramEnd, "reset", false ) )
+    {
+      WorkBudget_ResetStats();
+      PrintStr( "The work budget statistics have been reset." EOL );
+      return;
+    }
+
+    WorkBudget_SetPassBudgetUs( ParseUnsignedIntArg( paramBegin ) );
+  }
+
+  Printf( "Work budget per main loop pass: %u us." EOL, unsigned( WorkBudget_GetPassBudgetUs() ) );
+  Printf( "Main loop passes: %u" EOL, unsigned( WorkBudget_GetPassCount() ) );
+
+  for ( unsigned i = 0; i < WORK_BUDGET_SERVICE_COUNT; ++i )
+  {
+    const WorkBudgetServiceEnum service = WorkBudgetServiceEnum( i );
+
+    WorkBudgetServiceStats stats;
+    WorkBudget_GetServiceStats( service, &stats );
+
+    if ( stats.passCount == 0 )
+      continue;
+
+    Printf( "%s: average %u us, max %u us, budget spent %u times." EOL,
+            WorkBudget_GetServiceName( service ),
+            unsigned( DwtCycleCountToUs( uint32_t( stats.totalCycleCount / stats.passCount ) ) ),
+            unsigned( DwtCycleCountToUs( stats.maxCycleCount ) ),
+            unsigned( stats.spentCount ) );
+  }
+}
+
+
+// The dump is meant to be decoded with script JtagTroubleshooting/DecodeTraceDump.sh .
+// The serial port console drops output if it gets too long, so limit the number of records there.
+
+void CCommandProcessor::Trace ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  uint32_t maxRecordCount = TRACE_RING_RECORD_COUNT;
+
+  if ( *paramBegin != 0 )
+  {
+    if ( *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    if ( DoesStrMatch( paramBegin, paramEnd, "on", false ) )
+    {
+      TraceRing_SetEnabled( true );
+      return;
+    }
+
+    if ( DoesStrMatch( paramBegin, paramEnd, "off", false ) )
+    {
+      TraceRing_SetEnabled( false );
+      return;
+    }
+
+    if ( DoesStrMatch( paramBegin, paramEnd, "clear", false ) )
+    {
+      TraceRing_Clear();
+      return;
+    }
+
+    maxRecordCount = ParseUnsignedIntArg( paramBegin );
+  }
+
+  CAutoDisableTraceRing autoDisableTraceRing;
+
+  const uint32_t recordCount = TraceRing_GetRecordCount();
+  const uint32_t firstIndex  = recordCount - MinFrom( recordCount, maxRecordCount );
+
+  Printf( "TRACE-BEGIN cpu-clock=%u records=%u skipped=%u" EOL,
+          unsigned( CPU_CLOCK ),
+          unsigned( recordCount - firstIndex ),
+          unsigned( TraceRing_GetOverwrittenCount() + firstIndex ) );
+
+  for ( uint32_t eventId = 1; eventId < TRACE_EVENT_COUNT; ++eventId )
+  {
+    const char * arg1Name;
+    const char * arg2Name;
+    TraceRing_GetEventArgNames( eventId, &arg1Name, &arg2Name );
+
+    Printf( "TRACE-EVENT %u %s %s %s" EOL,
+            unsigned( eventId ),
+            TraceRing_GetEventName( eventId ),
+            *arg1Name == 0 ? "-" : arg1Name,
+            *arg2Name == 0 ? "-" : arg2Name );
+  }
+
+  for ( uint32_t i = firstIndex; i < recordCount; ++i )
+  {
+    TraceRecord record;
+    TraceRing_GetRecord( i, &record );
+
+    Printf( "TRACE-RECORD %08X %u %08X %08X" EOL,
+            unsigned( record.cycleCount ),
+            unsigned( record.eventId ),
+            unsigned( record.arg1 ),
+            unsigned( record.arg2 ) );
+  }
+
+  PrintStr( "TRACE-END" EOL );
+}
+
+
+// Use this command to find out whether a slow session is waiting for the host,
+// for the Tx Buffer or for the JTAG shifting, see ProtocolStats.h .
+
+void CCommandProcessor::StatsCmd ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin != 0 )
+  {
+    if ( !DoesStrMatch( paramBegin, paramEnd, "reset", false ) ||
+         *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    ProtocolStats_Reset();
+    PrintStr( "The protocol statistics have been reset." EOL );
+    return;
+  }
+
+  // Take a copy, so that the values printed are consistent with each other.
+  const ProtocolStats stats = g_protocolStats;
+
+  char buffer[ CONVERT_TO_DEC_BUF_SIZE ];
+
+  Printf( "USB bytes received: %s" EOL, convert_unsigned_to_dec_th( stats.usbReceivedByteCount, buffer, ',' ) );
+  Printf( "USB bytes sent: %s" EOL, convert_unsigned_to_dec_th( stats.usbSentByteCount, buffer, ',' ) );
+  Printf( "JTAG bits shifted: %s" EOL, convert_unsigned_to_dec_th( stats.shiftedBitCount, buffer, ',' ) );
+  Printf( "SWD commands: %u" EOL, unsigned( stats.swdCommandCount ) );
+
+  PrintStr( "OpenOCD commands by code:" EOL );
+
+  for ( unsigned i = 0; i < PROTOCOL_STATS_CMD_CODE_COUNT; ++i )
+  {
+    if ( stats.openOcdCommandCounts[ i ] == 0 )
+      continue;
+
+    if ( i == PROTOCOL_STATS_CMD_CODE_COUNT - 1 )
+      Printf( "  others: %u" EOL, unsigned( stats.openOcdCommandCounts[ i ] ) );
+    else
+      Printf( "  0x%02X: %u" EOL, i, unsigned( stats.openOcdCommandCounts[ i ] ) );
+  }
+
+  PrintStr( "Stalls by reason:" EOL );
+
+  for ( unsigned i = 0; i < PROTOCOL_STALL_REASON_COUNT; ++i )
+  {
+    const ProtocolStallReasonEnum reason = ProtocolStallReasonEnum( i );
+
+    Printf( "  %s: %u" EOL, ProtocolStats_GetStallReasonName( reason ), unsigned( stats.stallCounts[ i ] ) );
+  }
+}
+
+
+// Only the non-empty histogram bins are printed. A bin like "<4096" counts the iterations
+// between 2048 and 4095 CPU cycles, see MAIN_LOOP_BIN_COUNT. The time spent printing this report
+// shows up in the current iteration, which gets recorded afterwards.
+
+void CCommandProcessor::MainLoopStatsCmd ( const char * const paramBegin )
+{
+  const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+
+  if ( *paramBegin != 0 )
+  {
+    if ( !DoesStrMatch( paramBegin, paramEnd, "reset", false ) ||
+         *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 )
+    {
+      PrintStr( "Invalid arguments." EOL );
+      return;
+    }
+
+    MainLoopStats_Reset();
+    PrintStr( "The main loop statistics have been reset." EOL );
+    return;
+  }
+
+  for ( unsigned p = 0; p < MAIN_LOOP_PHASE_COUNT; ++p )
+  {
+    const MainLoopPhaseEnum phase = MainLoopPhaseEnum( p );
+    const MainLoopHistogram * const histogram = MainLoopStats_GetHistogram( phase );
+
+    if ( histogram->sampleCount == 0 )
+      continue;
+
+    Printf( "%s: %u samples, avg %u cycles, max %u cycles (%u us)" EOL,
+            MainLoopStats_GetPhaseName( phase ),
+            unsigned( histogram->sampleCount ),
+            unsigned( histogram->totalCycleCount / histogram->sampleCount ),
+            unsigned( histogram->maxCycleCount ),
+            unsigned( DwtCycleCountToUs( histogram->maxCycleCount ) ) );
+
+    PrintStr( " " );
+
+    for ( unsigned b = 0; b < MAIN_LOOP_BIN_COUNT; ++b )
+    {
+      const uint32_t binCount = histogram->binCounts[ b ];
+
+      if ( binCount == 0 )
+        continue;
+
+      if ( b == MAIN_LOOP_BIN_COUNT - 1 )
+        Printf( " >=%u:%u", 1u << ( b - 1 + MAIN_LOOP_FIRST_BIN_SHIFT ), unsigned( binCount ) );
+      else
+        Printf( " <%u:%u", 1u << ( b + MAIN_LOOP_FIRST_BIN_SHIFT ), unsigned( binCount ) );
+    }
+
+    PrintStr( EOL );
+  }
+
+  if ( ENABLE_WDT )
+  {
+    const uint32_t longestBusyUs = DwtCycleCountToUs( MainLoopStats_GetHistogram( mlpBusy )->maxCycleCount );
+
+    Printf( "The longest busy iteration took %u %% of the watchdog period." EOL,
+            unsigned( uint64_t( longestBusyUs ) * 100 / ( WATCHDOG_PERIOD_MS * 1000 ) ) );
+  }
+}
+
+
+static const char * const CMDNAME_QUESTION_MARK = "?";
+static const char * const CMDNAME_HELP = "help";
+static const char * const CMDNAME_I = "i";
+static const char * const CMDNAME_USBSPEEDTEST = "UsbSpeedTest";
+static const char * const CMDNAME_JTAGPINS = "JtagPins";
+static const char * const CMDNAME_JTAGSHIFTSPEEDTEST = "JtagShiftSpeedTest";
+static const char * const CMDNAME_MALLOCTEST = "MallocTest";
+static const char * const CMDNAME_CPP_EXCEPTION_TEST = "ExceptionTest";
+static const char * const CMDNAME_MEMORY_USAGE = "MemoryUsage";
+static const char * const CMDNAME_SIMULATE_ERROR = "SimulateError";
+static const char * const CMDNAME_RESET = "Reset";
+static const char * const CMDNAME_CPU_LOAD = "CpuLoad";
+static const char * const CMDNAME_RESET_CAUSE = "ResetCause";
+static const char * const CMDNAME_PRINT_MEMORY = "PrintMemory";
+static const char * const CMDNAME_BUSY_WAIT = "BusyWait";
+static const char * const CMDNAME_UPTIME = "Uptime";
+static const char * const CMDNAME_RESET_AND_HALT = "ResetAndHalt";
+static const char * const CMDNAME_JTAG_CHAIN = "JtagChain";
+static const char * const CMDNAME_DAP_SPEED_TEST = "DapSpeedTest";
+static const char * const CMDNAME_USB_TX_STATS = "UsbTxStats";
+static const char * const CMDNAME_LIVE_STATS = "LiveStats";
+static const char * const CMDNAME_WORK_BUDGET = "WorkBudget";
+static const char * const CMDNAME_TRACE = "Trace";
+static const char * const CMDNAME_STATS = "Stats";
+static const char * const CMDNAME_MAIN_LOOP_STATS = "MainLoopStats";
+static const char * const CMDNAME_PROFILE = "Profile";
+static const char * const CMDNAME_LATENCY = "Latency";
+static const char * const CMDNAME_BUFFER_STATS = "BufferStats";
+static const char * const CMDNAME_TCK_TIMING = "TckTiming";
+static const char * const CMDNAME_CAPTURE = "Capture";
+
+
+void CCommandProcessor::ParseCommand ( const char * const cmdBegin,
+                                       const uint64_t currentTime )
+{
+  const char * const cmdEnd = SkipCharsNotInSet( cmdBegin, SPACE_AND_TAB );
+  assert( cmdBegin != cmdEnd );
+
+  const char * const paramBegin = SkipCharsInSet( cmdEnd, SPACE_AND_TAB );
+
+  bool extraParamsFound = false;
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_QUESTION_MARK, true, false, &extraParamsFound ) ||
+       IsCmd( cmdBegin, cmdEnd, CMDNAME_HELP, false, false, &extraParamsFound ) )
+  {
+    PrintStr( "This console is similar to the Bus Pirate console." EOL );
+    PrintStr( "Commands longer than 1 character are case insensitive." EOL );
+    PrintStr( "WARNING: If a command takes too long to run, the watchdog may reset the board." EOL );
+    PrintStr( "Commands are:" EOL );
+
+    Printf( "  %s, %s: Show this help text." EOL, CMDNAME_QUESTION_MARK, CMDNAME_HELP );
+    Printf( "  %s: Show version information." EOL, CMDNAME_I );
+    Printf( "  %s: Test USB transfer speed." EOL, CMDNAME_USBSPEEDTEST );
+    Printf( "  %s: Show JTAG pin status (read as inputs)." EOL, CMDNAME_JTAGPINS );
+    Printf( "  %s [wrap]: Test JTAG shift speed. WARNING: Do NOT connect any JTAG device." EOL, CMDNAME_JTAGSHIFTSPEEDTEST );
+    Printf( "  %s: Exercises malloc()." EOL, CMDNAME_MALLOCTEST );
+    Printf( "  %s: Exercises C++ exceptions." EOL, CMDNAME_CPP_EXCEPTION_TEST );
+    Printf( "  %s: Shows memory usage." EOL, CMDNAME_MEMORY_USAGE );
+    Printf( "  %s" EOL, CMDNAME_CPU_LOAD );
+    Printf( "  %s" EOL, CMDNAME_UPTIME );
+    Printf( "  %s" EOL, CMDNAME_RESET );
+    Printf( "  %s" EOL, CMDNAME_RESET_CAUSE );
+    Printf( "  %s <addr> <byte count>" EOL, CMDNAME_PRINT_MEMORY );
+    Printf( "  %s <milliseconds>" EOL, CMDNAME_BUSY_WAIT );
+    Printf( "  %s <command|protocol>" EOL, CMDNAME_SIMULATE_ERROR );
+    Printf( "  %s [<SRST pulse width in us> [<timeout in ms>]]: Reset the JTAG target and halt it at the reset vector." EOL, CMDNAME_RESET_AND_HALT );
+    Printf( "  %s [discover]: Show or discover the JTAG chain description." EOL, CMDNAME_JTAG_CHAIN );
+    Printf( "  %s <jtag|swd> [<addr>]: Test the target memory read speed." EOL, CMDNAME_DAP_SPEED_TEST );
+    Printf( "  %s [reset | coalesce <on|off>]: Show the native USB port's transmit statistics." EOL, CMDNAME_USB_TX_STATS );
+    Printf( "  %s [reset | <us per main loop pass>]: Show the time used by each service." EOL, CMDNAME_WORK_BUDGET );
+    Printf( "  %s [<max record count> | on | off | clear]: Dump or control the trace ring." EOL, CMDNAME_TRACE );
+    Printf( "  %s [reset]: Show the protocol counters and the stall reasons." EOL, CMDNAME_STATS );
+    Printf( "  %s [reset]: Show the main loop iteration time histograms." EOL, CMDNAME_MAIN_LOOP_STATS );
+
+    #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+      Printf( "  %s <period in ms | off>: Print statistics periodically on the USB diagnostic port." EOL, CMDNAME_LIVE_STATS );
+    #endif
+
+    #ifdef ENABLE_PROFILER
+      Printf( "  %s [reset]: Show the profiling zone statistics, and optionally reset them afterwards." EOL, CMDNAME_PROFILE );
+      Printf( "  %s [reset]: Show or reset the OpenOCD command latency histograms." EOL, CMDNAME_LATENCY );
+    #endif
+
+    #ifdef ENABLE_CIRCULAR_BUFFER_STATS
+      Printf( "  %s [reset]: Show or reset the buffer occupancy statistics." EOL, CMDNAME_BUFFER_STATS );
+    #endif
+
+    #ifdef ENABLE_TCK_TIMING
+      Printf( "  %s [bits | fullbyte]: Measure the TCK waveform. WARNING: Do NOT connect any JTAG device." EOL, CMDNAME_TCK_TIMING );
+    #endif
+
+    #ifdef ENABLE_SESSION_CAPTURE
+      #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+        Printf( "  %s [on | off | clear | dump | stream <on|off>]: Control or dump the session capture." EOL, CMDNAME_CAPTURE );
+      #else
+        Printf( "  %s [on | off | clear | dump]: Control or dump the session capture." EOL, CMDNAME_CAPTURE );
+      #endif
+    #endif
+
+    return;
+  }
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_I, true, false, &extraParamsFound ) )
+  {
+    #ifndef NDEBUG
+      const char buildType[] = "Debug build";
+    #else
+      const char buildType[] = "Release build";
+    #endif
+
+    Printf( "JtagDue %s" EOL, PACKAGE_VERSION );
+    Printf( "%s, compiler version %s" EOL, buildType, __VERSION__ );
+    Printf( "Watchdog %s" EOL, ENABLE_WDT ? "enabled" : "disabled" );
+
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_RESET, false, false, &extraParamsFound ) )
+  {
+    // This message does not reach the other side, we would need to add some delay.
+    //   UsbPrint( txBuffer, "Resetting the board..." EOL );
+    __disable_irq();
+    // Note that this message always goes to the serial port console,
+    // even if the user is connected over USB. It might be possible to send
+    // it over USB and then wait for the outgoing buffer to be empty.
+    SerialSyncWriteStr( "Resetting the board..." EOL );
+    SerialWaitForDataSent();
+    ResetBoard( ENABLE_WDT );
+    assert( false );  // We should never reach this point.
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_CPU_LOAD, false, false, &extraParamsFound ) )
+  {
+    DisplayCpuLoad();
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_UPTIME, false, false, &extraParamsFound ) )
+  {
+    char buffer[ CONVERT_TO_DEC_BUF_SIZE ];
+    Printf( "Uptime: %s seconds." EOL, convert_unsigned_to_dec_th( GetUptime() / 1000, buffer, ',' ) );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_RESET_CAUSE, false, false, &extraParamsFound ) )
+  {
+    DisplayResetCause();
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_PRINT_MEMORY, false, true, &extraParamsFound ) )
+  {
+    PrintMemory( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_BUSY_WAIT, false, true, &extraParamsFound ) )
+  {
+    BusyWait( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_RESET_AND_HALT, false, true, &extraParamsFound ) )
+  {
+    ResetAndHalt( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_JTAG_CHAIN, false, true, &extraParamsFound ) )
+  {
+    JtagChain( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_DAP_SPEED_TEST, false, true, &extraParamsFound ) )
+  {
+    DapSpeedTest( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_USB_TX_STATS, false, true, &extraParamsFound ) )
+  {
+    UsbTxStatsCmd( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_WORK_BUDGET, false, true, &extraParamsFound ) )
+  {
+    WorkBudgetCmd( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_TRACE, false, true, &extraParamsFound ) )
+  {
+    Trace( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_STATS, false, true, &extraParamsFound ) )
+  {
+    StatsCmd( paramBegin );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_MAIN_LOOP_STATS, false, true, &extraParamsFound ) )
+  {
+    MainLoopStatsCmd( paramBegin );
+    return;
+  }
+
+
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_LIVE_STATS, false, true, &extraParamsFound ) )
+  {
+    LiveStats( paramBegin );
+    return;
+  }
+#endif
+
+
+#ifdef ENABLE_PROFILER
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_PROFILE, false, true, &extraParamsFound ) )
+  {
+    Profile( paramBegin );
+    return;
+  }
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_LATENCY, false, true, &extraParamsFound ) )
+  {
+    Latency( paramBegin );
+    return;
+  }
+#endif
+
+
+#ifdef ENABLE_CIRCULAR_BUFFER_STATS
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_BUFFER_STATS, false, true, &extraParamsFound ) )
+  {
+    BufferStats( paramBegin );
+    return;
+  }
+#endif
+
+
+#ifdef ENABLE_TCK_TIMING
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_TCK_TIMING, false, true, &extraParamsFound ) )
+  {
+    TckTiming( paramBegin );
+    return;
+  }
+#endif
+
+
+#ifdef ENABLE_SESSION_CAPTURE
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_CAPTURE, false, true, &extraParamsFound ) )
+  {
+    Capture( paramBegin );
+    return;
+  }
+#endif
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_USBSPEEDTEST, false, true, &extraParamsFound ) )
+  {
+    ProcessUsbSpeedTestCmd( paramBegin, currentTime );
+    return;
+  }
+
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_JTAGPINS, false, false, &extraParamsFound ) )
+  {
+    PrintJtagPinStatus();
+    return;
+  }
+
+  if ( IsCmd( cmdBegin, cmdEnd, CMDNAME_JTAGSHIFTSPEEDTEST, false, true, &extraParamsFound ) )
+  {
+    if ( !IsNativeUsbPort() )
+      throw std::runtime_error( "This command is only available on the 'Native' USB port." );
+
+    // With the "wrap" argument, the data starts at an odd position just before the end of the buffers,
+    // so that the first TDI/TMS byte pair straddles the wrap-around point.
+    const char * const paramEnd = SkipCharsNotInSet( paramBegin, SPACE_AND_TAB );
+    bool wrapAround = false;
+
+    if ( *paramBegin != 0 )
+    {
+      if ( *SkipCharsInSet( paramEnd, SPACE_AND_TAB ) != 0 ||
+           !DoesStrMatch( paramBegin, paramEnd, "wrap", false ) )
+      {
+        PrintStr( "Invalid arguments." EOL );
+        return;
+      }
+
+      wrapAround = true;
+    }
+
+
+    // Fill the Rx buffer with some test data.
+    assert( m_rxBuffer != NULL );
+
+    m_rxBuffer->Reset();
+    for ( uint32_t i = 0; !m_rxBuffer->IsFull(); ++i )
+    {
+      m_rxBuffer->WriteElem( CUsbRxBuffer::ElemType( i ) );
+    }
+
+
+    // If the mode is set to MODE_HIZ, you cannot see the generated signal with the oscilloscope.
+    // Note also that the built-in pull-ups on the Atmel ATSAM3X8 are too weak (between 50 and 100 KOhm,
+    // yields too slow a rising time) to be of any use.
+
+    const bool oldPullUps = GetJtagPullups();
+    SetJtagPullups( false );
+
+    const JtagPinModeEnum oldMode = GetJtagPinMode();
+    SetJtagPinMode ( MODE_JTAG );
+
+
+    // Each JTAG transfer needs 2 bits in the Rx buffer, TMS and TDI,
+    // but produces only 1 bit, TDO.
+    const uint32_t jtagByteCount = m_rxBuffer->GetElemCount() / 2;
+
+    const uint16_t bitCount = jtagByteCount * 8;
+
+    // Shift all JTAG data through several times.
+
+    const uint32_t oldFallbackCount = GetShiftJtagDataFallbackCount();
+
+    const uint64_t startTime = GetUptime();
+    const uint32_t iterCount = 50;
+
+    for ( uint32_t i = 0; i < iterCount; ++i )
+    {
+      // We hope that this will not clear the buffer contents.
+      assert( m_rxBuffer != NULL );
+      assert( m_txBuffer != NULL );
+
+      m_rxBuffer->Reset();
+      m_txBuffer->Reset();
+
+      if ( wrapAround )
+      {
+        const uint32_t rxOffset = USB_RX_BUFFER_SIZE - 1;
+        const uint32_t txOffset = USB_TX_BUFFER_SIZE - 1;
+
+        m_rxBuffer->CommitWrittenElements( rxOffset );
+        m_rxBuffer->ConsumeReadElements  ( rxOffset );
+        m_txBuffer->CommitWrittenElements( txOffset );
+        m_txBuffer->ConsumeReadElements  ( txOffset );
+      }
+
+      m_rxBuffer->CommitWrittenElements( jtagByteCount * 2 );
+
+      ShiftJtagData( m_rxBuffer,
+                     m_txBuffer,
+                     bitCount );
+
+      assert( m_txBuffer->GetElemCount() == jtagByteCount );
+    }
+
+    const uint64_t finishTime = GetUptime();
+    const uint32_t elapsedTime = uint32_t( finishTime - startTime );
+
+    m_rxBuffer->Reset();
+    m_txBuffer->Reset();
+
+    SetJtagPinMode( oldMode );
+    SetJtagPullups( oldPullUps );
+
+    // The uptime has a coarse resolution, and the host simulator runs much faster than the real board.
+    if ( elapsedTime == 0 )
+    {
+      PrintStr( EOL "The JTAG shift speed test finished too quickly to measure its throughput." EOL );
+      return;
+    }
+
+    const unsigned kBitsPerSec = unsigned( uint64_t(bitCount) * iterCount * 1000 / elapsedTime / 1024 );
+
+    // I am getting 221 KiB/s with GCC 4.7.3 and optimisation level "-O3".
+    Printf( EOL "Finished JTAG shift speed test, throughput %u Kbits/s (%u KiB/s)." EOL,
+               kBitsPerSec, kBitsPerSec / 8 );
+
+    Printf( "Byte pairs shifted one at a time because of a buffer wrap-around: %u" EOL,
+            unsigned( GetShiftJtagDataFallbackCount() - oldFallbackCount ) );
 
     return;
   }
@@ -718,7 +1843,7 @@ void CCommandProcessor::ParseCommand ( const char * const cmdBegin,
 
     Printf( "Partitions: malloc heap: %u bytes, free: %u bytes, stack: %u bytes." EOL,
                heapSize,
-               GetStackStartAddr() - GetHeapEndAddr(),
+               unsigned( GetStackStartAddr() - GetHeapEndAddr() ),
                STACK_SIZE );
 
     Printf( "Used stack (estimated): %u from %u bytes." EOL,
@@ -739,9 +1864,9 @@ void CCommandProcessor::ParseCommand ( const char * const cmdBegin,
   }
 
   if ( extraParamsFound )
-    Printf( "Command \"%.*s\" does not take any parameters." EOL, cmdEnd - cmdBegin, cmdBegin );
+    Printf( "Command \"%.*s\" does not take any parameters." EOL, int( cmdEnd - cmdBegin ), cmdBegin );
   else
-    Printf( "Unknown command \"%.*s\"." EOL, cmdEnd - cmdBegin, cmdBegin );
+    Printf( "Unknown command \"%.*s\"." EOL, int( cmdEnd - cmdBegin ), cmdBegin );
 }
 
 
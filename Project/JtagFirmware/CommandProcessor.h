@@ -3,6 +3,7 @@
 #define COMMAND_PROCESSOR_H_INCLUDED
 
 #include "UsbBuffers.h"
+#include "BusPirateOpenOcdMode.h"
 
 #include <BareMetalSupport/IoUtils.h>
 
@@ -37,6 +38,37 @@ private:
   void DisplayResetCause ( void );
   void DisplayCpuLoad ( void );
   void SimulateError ( const char * paramBegin );
+  void ResetAndHalt ( const char * paramBegin );
+  void JtagChain ( const char * paramBegin );
+  void DapSpeedTest ( const char * paramBegin );
+  void UsbTxStatsCmd ( const char * paramBegin );
+  void WorkBudgetCmd ( const char * paramBegin );
+  void Trace ( const char * paramBegin );
+  void StatsCmd ( const char * paramBegin );
+  void MainLoopStatsCmd ( const char * paramBegin );
+
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    void LiveStats ( const char * paramBegin );
+  #endif
+
+  #ifdef ENABLE_PROFILER
+    void Profile ( const char * paramBegin );
+    void Latency ( const char * paramBegin );
+  #endif
+
+  #ifdef ENABLE_TCK_TIMING
+    void TckTiming ( const char * paramBegin );
+    void PrintTckTiming ( JtagShiftKernelEnum kernel );
+  #endif
+
+  #ifdef ENABLE_CIRCULAR_BUFFER_STATS
+    void BufferStats ( const char * paramBegin );
+    void PrintBufferStats ( const char * name, const CircularBufferStats * stats );
+  #endif
+
+  #ifdef ENABLE_SESSION_CAPTURE
+    void Capture ( const char * paramBegin );
+  #endif
   void PrintJtagPinStatus ( void );
   void PrintPinStatus ( const char * const pinName,
                         const Pio * const pioPtr,
@@ -0,0 +1,64 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef DAP_REGISTERS_H_INCLUDED
+#define DAP_REGISTERS_H_INCLUDED
+
+// Register definitions shared by the JTAG-DP and the SW-DP implementations,
+// see the ARM Debug Interface v5 Architecture Specification.
+
+// DP registers.
+#define DP_ABORT      0x0  // Write only. Reading address 0x0 yields DPIDR over SWD.
+#define DP_IDCODE     0x0
+#define DP_CTRL_STAT  0x4
+#define DP_SELECT     0x8
+#define DP_RDBUFF     0xC
+
+#define DP_ABORT_DAPABORT    ( 1UL << 0 )
+#define DP_ABORT_STKCMPCLR   ( 1UL << 1 )
+#define DP_ABORT_STKERRCLR   ( 1UL << 2 )
+#define DP_ABORT_WDERRCLR    ( 1UL << 3 )
+#define DP_ABORT_ORUNERRCLR  ( 1UL << 4 )
+
+#define DP_CTRL_STAT_STICKYORUN     ( 1UL << 1  )
+#define DP_CTRL_STAT_STICKYCMP      ( 1UL << 4  )
+#define DP_CTRL_STAT_STICKYERR      ( 1UL << 5  )
+#define DP_CTRL_STAT_WDATAERR       ( 1UL << 7  )
+#define DP_CTRL_STAT_CDBGPWRUPREQ   ( 1UL << 28 )
+#define DP_CTRL_STAT_CDBGPWRUPACK   ( 1UL << 29 )
+#define DP_CTRL_STAT_CSYSPWRUPREQ   ( 1UL << 30 )
+#define DP_CTRL_STAT_CSYSPWRUPACK   ( 1UL << 31 )
+
+// MEM-AP registers.
+#define AP_CSW  0x00
+#define AP_TAR  0x04
+#define AP_DRW  0x0C
+
+// 32-bit accesses, no auto-increment, privileged data access, as OpenOCD does it.
+#define AP_CSW_VALUE  0xA2000002
+
+// Cortex-M3 debug registers.
+#define ARMV7M_DHCSR  0xE000EDF0
+#define ARMV7M_DEMCR  0xE000EDFC
+
+#define DHCSR_DBGKEY       0xA05F0000
+#define DHCSR_C_DEBUGEN    ( 1UL << 0  )
+#define DHCSR_S_HALT       ( 1UL << 17 )
+#define DEMCR_VC_CORERESET ( 1UL << 0  )
+
+
+#endif  // Include this header file only once.
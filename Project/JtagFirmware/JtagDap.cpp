@@ -0,0 +1,314 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "JtagDap.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stdexcept>
+
+#include <BareMetalSupport/IoUtils.h>
+#include <BareMetalSupport/DwtUtils.h>
+#include <BareMetalSupport/SysTickUtils.h>
+
+#include "JtagTap.h"
+#include "DapRegisters.h"
+#include "JtagPins.h"
+#include "BusPirateOpenOcdMode.h"
+
+
+// JTAG-DP instructions, see the ARM Debug Interface v5 Architecture Specification.
+#define JTAG_DP_IR_LEN      4
+#define JTAG_DP_IR_ABORT    0x8
+#define JTAG_DP_IR_DPACC    0xA
+#define JTAG_DP_IR_APACC    0xB
+#define JTAG_DP_IR_IDCODE   0xE
+#define JTAG_DP_IR_BYPASS   0xF
+
+// DPACC and APACC scan chains: 1 bit RnW, 2 bits address A[3:2], 32 bits data.
+#define JTAG_DP_ACC_LEN     35
+
+#define JTAG_DP_ACK_OK_FAULT  0x2
+#define JTAG_DP_ACK_WAIT      0x1
+
+static const unsigned MAX_WAIT_RETRY_COUNT = 100;
+static const unsigned MAX_POWER_UP_POLL_COUNT = 100;
+
+
+// The JTAG-DP instruction register is only 4 bits long.
+static const uint8_t INVALID_IR = 0xFF;
+
+static uint8_t  s_currentIr = INVALID_IR;
+static uint32_t s_currentSelect;
+
+
+static void SetIr ( const uint8_t ir )
+{
+  if ( ir == s_currentIr )
+    return;
+
+  JtagTap_ShiftIr( &ir, NULL, JTAG_DP_IR_LEN );
+  s_currentIr = ir;
+}
+
+
+// Performs a DPACC or APACC scan. Because reads are posted, the value returned
+// is the result of the previous read access.
+
+static uint32_t ScanDpAcc ( const uint8_t ir,
+                            const uint8_t regAddr,
+                            const bool isRead,
+                            const uint32_t data )
+{
+  assert( ( regAddr & ~0xC ) == 0 );
+
+  SetIr( ir );
+
+  const uint64_t tdi = ( uint64_t( data ) << 3 ) |
+                       ( ( regAddr >> 2 ) << 1 ) |
+                       ( isRead ? 1 : 0 );
+
+  for ( unsigned i = 0; i < MAX_WAIT_RETRY_COUNT; ++i )
+  {
+    const uint64_t tdo = JtagTap_ShiftDr64( tdi, JTAG_DP_ACC_LEN );
+
+    const unsigned ack = unsigned( tdo & 0x7 );
+
+    if ( ack == JTAG_DP_ACK_OK_FAULT )
+      return uint32_t( tdo >> 3 );
+
+    if ( ack != JTAG_DP_ACK_WAIT )
+      throw std::runtime_error( "Invalid JTAG-DP acknowledge." );
+  }
+
+  throw std::runtime_error( "Too many JTAG-DP WAIT responses." );
+}
+
+
+static uint32_t ReadDpReg ( const uint8_t regAddr )
+{
+  ScanDpAcc( JTAG_DP_IR_DPACC, regAddr, true, 0 );
+  return ScanDpAcc( JTAG_DP_IR_DPACC, DP_RDBUFF, true, 0 );
+}
+
+
+static void WriteDpReg ( const uint8_t regAddr, const uint32_t data )
+{
+  ScanDpAcc( JTAG_DP_IR_DPACC, regAddr, false, data );
+}
+
+
+static void SelectApBank ( const uint8_t apRegAddr )
+{
+  // Always AP number 0.
+  const uint32_t select = apRegAddr & 0xF0;
+
+  if ( select == s_currentSelect )
+    return;
+
+  WriteDpReg( DP_SELECT, select );
+  s_currentSelect = select;
+}
+
+
+static uint32_t ReadApReg ( const uint8_t regAddr )
+{
+  SelectApBank( regAddr );
+  ScanDpAcc( JTAG_DP_IR_APACC, regAddr & 0xC, true, 0 );
+  return ScanDpAcc( JTAG_DP_IR_DPACC, DP_RDBUFF, true, 0 );
+}
+
+
+static void WriteApReg ( const uint8_t regAddr, const uint32_t data )
+{
+  SelectApBank( regAddr );
+  ScanDpAcc( JTAG_DP_IR_APACC, regAddr & 0xC, false, data );
+}
+
+
+// A FAULT response is not reported in the ACK of a JTAG-DP, but in the sticky flags.
+
+static void CheckStickyErrors ( void )
+{
+  const uint32_t stickyMask = DP_CTRL_STAT_STICKYORUN |
+                              DP_CTRL_STAT_STICKYCMP  |
+                              DP_CTRL_STAT_STICKYERR;
+
+  const uint32_t ctrlStat = ReadDpReg( DP_CTRL_STAT );
+
+  if ( 0 != ( ctrlStat & stickyMask ) )
+  {
+    // On a JTAG-DP, the sticky flags are cleared by writing 1 to them.
+    WriteDpReg( DP_CTRL_STAT, ctrlStat );
+    throw std::runtime_error( "JTAG-DP sticky error flag set." );
+  }
+}
+
+
+uint32_t JtagDap_ReadIdCode ( void )
+{
+  SetIr( JTAG_DP_IR_IDCODE );
+  return uint32_t( JtagTap_ShiftDr64( 0, 32 ) );
+}
+
+
+// A SWJ-DP may have been left in SWD mode, see SwdDap.cpp . This sequence switches it back to JTAG,
+// and the TAP reset afterwards takes care of any TAP state changes it may have caused
+// on devices that do not understand it.
+
+static void SwitchFromSwdToJtag ( void )
+{
+  const uint16_t SWD_TO_JTAG_SEQUENCE = 0xE73C;  // Sent LSB first.
+
+  for ( unsigned i = 0; i < 56; ++i )
+    ShiftSingleJtagBit( false, true );
+
+  for ( unsigned i = 0; i < 16; ++i )
+    ShiftSingleJtagBit( false, 0 != ( SWD_TO_JTAG_SEQUENCE & ( 1 << i ) ) );
+}
+
+
+void JtagDap_Connect ( void )
+{
+  SwitchFromSwdToJtag();
+
+  JtagTap_ResetToIdle();
+
+  // After a TAP reset, the IDCODE instruction is active. However, the other TAPs
+  // on the chain need an IR scan to get into BYPASS, so force the next IR scan.
+  s_currentIr = INVALID_IR;
+
+  // We do not know what the SELECT register contains, so force the next access to write it.
+  s_currentSelect = UINT32_MAX;
+
+  const uint32_t idCode = JtagDap_ReadIdCode();
+
+  // Bit 0 of all IDCODEs is always 1. All zeros or all ones mean that nothing is connected.
+  if ( 0 == ( idCode & 1 ) || idCode == UINT32_MAX )
+    throw std::runtime_error( "No JTAG-DP found." );
+
+  const uint32_t stickyMask = DP_CTRL_STAT_STICKYORUN |
+                              DP_CTRL_STAT_STICKYCMP  |
+                              DP_CTRL_STAT_STICKYERR;
+
+  WriteDpReg( DP_CTRL_STAT, DP_CTRL_STAT_CDBGPWRUPREQ | DP_CTRL_STAT_CSYSPWRUPREQ | stickyMask );
+
+  const uint32_t ackMask = DP_CTRL_STAT_CDBGPWRUPACK | DP_CTRL_STAT_CSYSPWRUPACK;
+
+  for ( unsigned i = 0; ; ++i )
+  {
+    if ( ( ReadDpReg( DP_CTRL_STAT ) & ackMask ) == ackMask )
+      break;
+
+    if ( i == MAX_POWER_UP_POLL_COUNT )
+      throw std::runtime_error( "The debug port did not power up." );
+  }
+
+  WriteApReg( AP_CSW, AP_CSW_VALUE );
+}
+
+
+uint32_t JtagDap_ReadMem32 ( const uint32_t addr )
+{
+  WriteApReg( AP_TAR, addr );
+  const uint32_t data = ReadApReg( AP_DRW );
+  CheckStickyErrors();
+  return data;
+}
+
+
+void JtagDap_WriteMem32 ( const uint32_t addr, const uint32_t data )
+{
+  WriteApReg( AP_TAR, addr );
+  WriteApReg( AP_DRW, data );
+  CheckStickyErrors();
+}
+
+
+static void BusyWaitUs ( const uint32_t timeInUs )
+{
+  const uint32_t start = GetDwtCycleCount();
+  const uint32_t tickCount = UsToCpuClockTickCount( timeInUs );
+
+  while ( GetDwtElapsedCycleCount( start ) < tickCount )
+  {
+  }
+}
+
+
+uint32_t JtagDap_ResetAndHalt ( const uint32_t srstPulseWidthUs, const uint32_t haltTimeoutUs )
+{
+  // These limits keep the main loop iteration well below the watchdog period.
+  if ( srstPulseWidthUs > JTAG_DAP_MAX_SRST_PULSE_WIDTH_US )
+    throw std::runtime_error( "The SRST pulse width is too long." );
+
+  if ( haltTimeoutUs > JTAG_DAP_MAX_HALT_TIMEOUT_US )
+    throw std::runtime_error( "The halt timeout is too long." );
+
+  if ( GetJtagPinMode() == MODE_HIZ )
+    throw std::runtime_error( "The JTAG pins are in high-impedance mode." );
+
+  JtagDap_Connect();
+
+  JtagDap_WriteMem32( ARMV7M_DHCSR, DHCSR_DBGKEY | DHCSR_C_DEBUGEN );
+
+  const uint32_t prevDemcr = JtagDap_ReadMem32( ARMV7M_DEMCR );
+  JtagDap_WriteMem32( ARMV7M_DEMCR, prevDemcr | DEMCR_VC_CORERESET );
+
+  SetOutputDataDrivenOnPin( JTAG_SRST_PIO, JTAG_SRST_PIN, false );
+  BusyWaitUs( srstPulseWidthUs );
+  SetOutputDataDrivenOnPin( JTAG_SRST_PIO, JTAG_SRST_PIN, true );
+
+  const uint32_t releaseTime = GetDwtCycleCount();
+  const uint32_t timeoutTickCount = UsToCpuClockTickCount( haltTimeoutUs );
+
+  uint32_t latencyTickCount;
+
+  // The debug port may not respond while the target is coming out of reset,
+  // so keep trying until the timeout expires.
+  for ( ; ; )
+  {
+    bool isHalted = false;
+
+    try
+    {
+      isHalted = 0 != ( JtagDap_ReadMem32( ARMV7M_DHCSR ) & DHCSR_S_HALT );
+    }
+    catch ( const std::exception & )
+    {
+      // Some targets reset their debug port too. Try to reconnect in the next iteration.
+      try
+      {
+        JtagDap_Connect();
+      }
+      catch ( const std::exception & )
+      {
+      }
+    }
+
+    latencyTickCount = GetDwtElapsedCycleCount( releaseTime );
+
+    if ( isHalted )
+      break;
+
+    if ( latencyTickCount >= timeoutTickCount )
+      throw std::runtime_error( "Timeout waiting for the target to halt after reset." );
+  }
+
+  // Leave the vector catch the way we found it.
+  JtagDap_WriteMem32( ARMV7M_DEMCR, prevDemcr );
+
+  return DwtCycleCountToUs( latencyTickCount );
+}
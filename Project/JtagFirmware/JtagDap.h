@@ -0,0 +1,43 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef JTAG_DAP_H_INCLUDED
+#define JTAG_DAP_H_INCLUDED
+
+#include <stdint.h>
+
+// Minimal ARM ADIv5 debug port support over JTAG (JTAG-DP), enough to access
+// the target's memory through MEM-AP 0. This is what a Cortex-M3 target like
+// a second Arduino Due offers. All errors throw a std::runtime_error.
+
+void JtagDap_Connect ( void );
+
+uint32_t JtagDap_ReadIdCode ( void );
+
+uint32_t JtagDap_ReadMem32  ( uint32_t addr );
+void     JtagDap_WriteMem32 ( uint32_t addr, uint32_t data );
+
+// Resets the target with the SRST line while the Cortex-M core reset vector catch is active,
+// so that the CPU halts before executing the first instruction. Returns the time in microseconds
+// between the SRST release and the moment the halted state was confirmed.
+uint32_t JtagDap_ResetAndHalt ( uint32_t srstPulseWidthUs, uint32_t haltTimeoutUs );
+
+#define JTAG_DAP_MAX_SRST_PULSE_WIDTH_US  100000
+#define JTAG_DAP_MAX_HALT_TIMEOUT_US      200000
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,452 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "JtagTap.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stdexcept>
+
+#include <BareMetalSupport/Miscellaneous.h>
+
+#include "BusPirateOpenOcdMode.h"
+
+
+// By default, there is a single TAP in the chain. Its IR length does not matter then,
+// because no padding is needed.
+static uint8_t s_chainDeviceCount = 1;
+static uint8_t s_chainIrLengths[ JTAG_TAP_MAX_CHAIN_DEVICE_COUNT ] = { 0 };
+static uint8_t s_selectedTap = 0;
+
+// Whether all TAPs other than the selected one have the BYPASS instruction loaded.
+static bool s_otherTapsInBypass = true;
+
+static bool     s_isScanInProgress = false;
+static bool     s_isIrScan;
+static uint32_t s_remainingScanDataBitCount;
+static uint32_t s_scanSuffixBitCount;
+
+// The maximum IR length we consider during chain discovery.
+static const uint32_t MAX_IR_LEN = 32;
+static const uint32_t MAX_TOTAL_IR_LEN = MAX_IR_LEN * JTAG_TAP_MAX_CHAIN_DEVICE_COUNT;
+
+
+// Walks the TAP from Run-Test/Idle to Shift-IR or Shift-DR.
+
+static void GoFromIdleToShift ( const bool isIr )
+{
+  // Run-Test/Idle -> Select-DR-Scan.
+  ShiftSingleJtagBit( false, true );
+
+  // Select-DR-Scan -> Select-IR-Scan.
+  if ( isIr )
+    ShiftSingleJtagBit( false, true );
+
+  // -> Capture-xR -> Shift-xR.
+  ShiftSingleJtagBit( false, false );
+  ShiftSingleJtagBit( false, false );
+}
+
+
+// The last bit shifted has moved us to Exit1-xR.
+
+static void GoFromExit1ToIdle ( void )
+{
+  // Exit1-xR -> Update-xR -> Run-Test/Idle.
+  ShiftSingleJtagBit( false, true );
+  ShiftSingleJtagBit( false, false );
+}
+
+
+// Shifts the bits in chunks of up to 8 bits, which is much faster than one bit at a time.
+// If isLastChunk is true, TMS goes high on the last bit, which moves us to Exit1-xR.
+
+static uint8_t ShiftChunk ( const uint8_t tdi8, const uint8_t bitCount, const bool isLastChunk )
+{
+  const uint8_t tms8 = isLastChunk ? uint8_t( 1 << ( bitCount - 1 ) ) : 0;
+
+  return ShiftJtagBits( tdi8, tms8, bitCount );
+}
+
+
+static void ShiftPadding ( const uint32_t bitCount, const bool isLastPadding )
+{
+  // BYPASS is the all-ones instruction. The DR padding goes to the 1-bit bypass registers,
+  // and its value does not matter.
+  const uint8_t paddingByte = s_isIrScan ? 0xFF : 0x00;
+
+  for ( uint32_t bitPos = 0; bitPos < bitCount; bitPos += 8 )
+  {
+    const uint8_t chunkBitCount = uint8_t( MinFrom( bitCount - bitPos, uint32_t( 8 ) ) );
+
+    ShiftChunk( paddingByte, chunkBitCount, isLastPadding && bitPos + chunkBitCount == bitCount );
+  }
+}
+
+
+static void CheckChainDescription ( const uint8_t deviceCount,
+                                    const uint8_t * const irLengths,
+                                    const uint8_t selectedTap )
+{
+  if ( deviceCount == 0 || deviceCount > JTAG_TAP_MAX_CHAIN_DEVICE_COUNT )
+    throw std::runtime_error( "Invalid JTAG chain device count." );
+
+  if ( selectedTap >= deviceCount )
+    throw std::runtime_error( "Invalid JTAG TAP index." );
+
+  if ( deviceCount == 1 )
+    return;
+
+  for ( unsigned i = 0; i < deviceCount; ++i )
+  {
+    // The IEEE 1149.1 standard mandates at least 2 bits.
+    if ( irLengths[ i ] < 2 || irLengths[ i ] > MAX_IR_LEN )
+      throw std::runtime_error( "Invalid JTAG IR length." );
+  }
+}
+
+
+void JtagTap_SetChain ( const uint8_t deviceCount,
+                        const uint8_t * const irLengths,
+                        const uint8_t selectedTap )
+{
+  assert( !s_isScanInProgress );
+
+  CheckChainDescription( deviceCount, irLengths, selectedTap );
+
+  s_chainDeviceCount = deviceCount;
+
+  for ( unsigned i = 0; i < JTAG_TAP_MAX_CHAIN_DEVICE_COUNT; ++i )
+    s_chainIrLengths[ i ] = ( i < deviceCount ) ? irLengths[ i ] : 0;
+
+  s_selectedTap = selectedTap;
+
+  // We do not know which instructions the TAPs have loaded now.
+  s_otherTapsInBypass = ( deviceCount == 1 );
+}
+
+
+void JtagTap_SelectTap ( const uint8_t selectedTap )
+{
+  assert( !s_isScanInProgress );
+
+  if ( selectedTap >= s_chainDeviceCount )
+    throw std::runtime_error( "Invalid JTAG TAP index." );
+
+  if ( selectedTap == s_selectedTap )
+    return;
+
+  s_selectedTap = selectedTap;
+
+  // The previously-selected TAP has probably some other instruction than BYPASS loaded.
+  s_otherTapsInBypass = ( s_chainDeviceCount == 1 );
+}
+
+
+uint8_t JtagTap_GetChainDeviceCount ( void )
+{
+  return s_chainDeviceCount;
+}
+
+
+uint8_t JtagTap_GetChainIrLength ( const uint8_t tapIndex )
+{
+  assert( tapIndex < s_chainDeviceCount );
+  return s_chainIrLengths[ tapIndex ];
+}
+
+
+uint8_t JtagTap_GetSelectedTap ( void )
+{
+  return s_selectedTap;
+}
+
+
+void JtagTap_ForgetBypassState ( void )
+{
+  assert( !s_isScanInProgress );
+
+  s_otherTapsInBypass = ( s_chainDeviceCount == 1 );
+}
+
+
+// Shifts ones in until a one comes out, and then goes back to Run-Test/Idle.
+// Returns the number of zeros that came out, or maxCount + 1 if there were too many.
+
+static uint32_t CountZerosUntilFirstOne ( const uint32_t maxCount )
+{
+  uint32_t count = 0;
+
+  while ( count <= maxCount && !ShiftSingleJtagBit( true, false ) )
+    ++count;
+
+  // Go to Exit1-xR. One more '1' bit does not hurt.
+  ShiftSingleJtagBit( true, true );
+
+  GoFromExit1ToIdle();
+
+  return count;
+}
+
+
+// The chain description stores the IR lengths as bytes.
+
+static uint8_t CheckDiscoveredIrLength ( const uint32_t irLength )
+{
+  if ( irLength > MAX_IR_LEN )
+    throw std::runtime_error( "The discovered JTAG IR length is too long, please set the chain description manually." );
+
+  return uint8_t( irLength );
+}
+
+
+// The chain discovery relies on the IEEE 1149.1 rules: the IR capture value of each TAP ends
+// with binary "01", BYPASS is the all-ones instruction, and the bypass register captures a 0.
+// The IR capture value is ambiguous for some devices, in which case the host must
+// set the chain description manually.
+
+void JtagTap_DiscoverChain ( void )
+{
+  assert( !s_isScanInProgress );
+
+  JtagTap_ResetToIdle();
+
+
+  // Shift zeros through the whole IR chain in order to get the IR capture values out,
+  // and then ones until the first one appears. The number of zeros is the total IR length.
+  // This leaves all TAPs with the BYPASS instruction.
+
+  uint8_t irCapture[ MAX_TOTAL_IR_LEN / 8 ];
+
+  GoFromIdleToShift( true );
+
+  for ( uint32_t i = 0; i < MAX_TOTAL_IR_LEN; ++i )
+  {
+    const uint32_t byteIndex = i / 8;
+    const uint8_t  bitMask   = uint8_t( 1 << ( i % 8 ) );
+
+    if ( bitMask == 1 )
+      irCapture[ byteIndex ] = 0;
+
+    if ( ShiftSingleJtagBit( false, false ) )
+      irCapture[ byteIndex ] |= bitMask;
+  }
+
+  const uint32_t totalIrLen = CountZerosUntilFirstOne( MAX_TOTAL_IR_LEN );
+
+  if ( totalIrLen == 0 || totalIrLen > MAX_TOTAL_IR_LEN )
+    throw std::runtime_error( "Cannot determine the total JTAG IR length, is there a JTAG device connected?" );
+
+
+  // Now all TAPs are in BYPASS. Flush the bypass registers with zeros,
+  // and then count how many ones it takes for the first one to appear.
+
+  GoFromIdleToShift( false );
+
+  for ( uint32_t i = 0; i < JTAG_TAP_MAX_CHAIN_DEVICE_COUNT; ++i )
+    ShiftSingleJtagBit( false, false );
+
+  const uint32_t deviceCount = CountZerosUntilFirstOne( JTAG_TAP_MAX_CHAIN_DEVICE_COUNT );
+
+  if ( deviceCount == 0 || deviceCount > JTAG_TAP_MAX_CHAIN_DEVICE_COUNT )
+    throw std::runtime_error( "Cannot determine the number of devices on the JTAG chain." );
+
+
+  // Split the total IR length by looking for the "01" capture pattern. The first bit out
+  // comes from position 0, which is the TAP nearest to TDO.
+
+  uint8_t irLengths[ JTAG_TAP_MAX_CHAIN_DEVICE_COUNT ];
+
+  if ( deviceCount == 1 )
+  {
+    irLengths[ 0 ] = CheckDiscoveredIrLength( totalIrLen );
+  }
+  else
+  {
+    if ( 0 == ( irCapture[ 0 ] & 1 ) || 0 != ( irCapture[ 0 ] & 2 ) )
+      throw std::runtime_error( "Invalid JTAG IR capture value." );
+
+    uint32_t foundCount = 0;
+    uint32_t lastStart  = 0;
+
+    for ( uint32_t i = 1; i + 1 < totalIrLen; ++i )
+    {
+      const bool bit0 = 0 != ( irCapture[ i       / 8 ] & ( 1 << ( i       % 8 ) ) );
+      const bool bit1 = 0 != ( irCapture[ (i + 1) / 8 ] & ( 1 << ( (i + 1) % 8 ) ) );
+
+      if ( !bit0 || bit1 )
+        continue;
+
+      if ( foundCount == deviceCount - 1 )
+        throw std::runtime_error( "Ambiguous JTAG IR capture values, please set the chain description manually." );
+
+      irLengths[ foundCount++ ] = CheckDiscoveredIrLength( i - lastStart );
+      lastStart = i;
+    }
+
+    if ( foundCount != deviceCount - 1 )
+      throw std::runtime_error( "Ambiguous JTAG IR capture values, please set the chain description manually." );
+
+    irLengths[ foundCount ] = CheckDiscoveredIrLength( totalIrLen - lastStart );
+  }
+
+  JtagTap_SetChain( uint8_t( deviceCount ), irLengths, 0 );
+
+  // The scans above have left all TAPs in BYPASS.
+  s_otherTapsInBypass = true;
+}
+
+
+void JtagTap_ResetToIdle ( void )
+{
+  assert( !s_isScanInProgress );
+
+  // 5 clock cycles with TMS high reach Test-Logic-Reset from any state.
+  for ( unsigned i = 0; i < 5; ++i )
+    ShiftSingleJtagBit( false, true );
+
+  ShiftSingleJtagBit( false, false );
+
+  // After a reset, the TAPs have the IDCODE or the BYPASS instruction loaded.
+  s_otherTapsInBypass = ( s_chainDeviceCount == 1 );
+}
+
+
+void JtagTap_BeginScan ( const bool isIr, const uint32_t totalBitCount )
+{
+  assert( !s_isScanInProgress );
+  assert( totalBitCount > 0 );
+
+  if ( !isIr && !s_otherTapsInBypass )
+    throw std::runtime_error( "The other TAPs on the JTAG chain are not in BYPASS, an IR scan is needed first." );
+
+  uint32_t prefixBitCount = 0;
+  uint32_t suffixBitCount = 0;
+
+  for ( unsigned i = 0; i < s_chainDeviceCount; ++i )
+  {
+    if ( i == s_selectedTap )
+      continue;
+
+    const uint32_t paddingLen = isIr ? s_chainIrLengths[ i ] : 1;
+
+    if ( i < s_selectedTap )
+      prefixBitCount += paddingLen;
+    else
+      suffixBitCount += paddingLen;
+  }
+
+  s_isIrScan = isIr;
+  s_remainingScanDataBitCount = totalBitCount;
+  s_scanSuffixBitCount = suffixBitCount;
+  s_isScanInProgress = true;
+
+  GoFromIdleToShift( isIr );
+
+  // The first bits shifted in end up in the TAPs nearest to TDO.
+  ShiftPadding( prefixBitCount, false );
+}
+
+
+void JtagTap_ScanBits ( const uint8_t * const tdi, uint8_t * const tdo, const uint16_t bitCount )
+{
+  assert( s_isScanInProgress );
+  assert( bitCount <= s_remainingScanDataBitCount );
+
+  for ( uint32_t bitPos = 0; bitPos < bitCount; bitPos += 8 )
+  {
+    const uint32_t byteIndex     = bitPos / 8;
+    const uint8_t  chunkBitCount = uint8_t( MinFrom( bitCount - bitPos, uint32_t( 8 ) ) );
+
+    s_remainingScanDataBitCount -= chunkBitCount;
+
+    const bool isLastChunk = s_remainingScanDataBitCount == 0 && s_scanSuffixBitCount == 0;
+
+    const uint8_t tdo8 = ShiftChunk( tdi == NULL ? 0 : tdi[ byteIndex ], chunkBitCount, isLastChunk );
+
+    if ( tdo != NULL )
+      tdo[ byteIndex ] = tdo8;
+  }
+}
+
+
+void JtagTap_EndScan ( void )
+{
+  assert( s_isScanInProgress );
+  assert( s_remainingScanDataBitCount == 0 );
+
+  ShiftPadding( s_scanSuffixBitCount, true );
+
+  GoFromExit1ToIdle();
+
+  if ( s_isIrScan )
+    s_otherTapsInBypass = true;
+
+  s_isScanInProgress = false;
+}
+
+
+static void ShiftData ( const bool isIr,
+                        const uint8_t * const tdi,
+                        uint8_t * const tdo,
+                        const uint16_t bitCount )
+{
+  JtagTap_BeginScan( isIr, bitCount );
+  JtagTap_ScanBits( tdi, tdo, bitCount );
+  JtagTap_EndScan();
+}
+
+
+void JtagTap_ShiftIr ( const uint8_t * const tdi, uint8_t * const tdo, const uint16_t bitCount )
+{
+  ShiftData( true, tdi, tdo, bitCount );
+}
+
+
+void JtagTap_ShiftDr ( const uint8_t * const tdi, uint8_t * const tdo, const uint16_t bitCount )
+{
+  ShiftData( false, tdi, tdo, bitCount );
+}
+
+
+uint64_t JtagTap_ShiftDr64 ( const uint64_t tdi, const uint8_t bitCount )
+{
+  assert( bitCount <= 64 );
+
+  uint8_t tdiBytes[ 8 ];
+  uint8_t tdoBytes[ 8 ];
+
+  for ( unsigned i = 0; i < sizeof( tdiBytes ); ++i )
+    tdiBytes[ i ] = uint8_t( tdi >> ( i * 8 ) );
+
+  JtagTap_ShiftDr( tdiBytes, tdoBytes, bitCount );
+
+  uint64_t tdoVal = 0;
+
+  for ( unsigned i = 0; i < ( bitCount + 7u ) / 8; ++i )
+    tdoVal |= uint64_t( tdoBytes[ i ] ) << ( i * 8 );
+
+  if ( bitCount < 64 )
+    tdoVal &= ( uint64_t( 1 ) << bitCount ) - 1;
+
+  return tdoVal;
+}
+
+
+void JtagTap_RunIdleClocks ( const uint32_t clockCount )
+{
+  for ( uint32_t i = 0; i < clockCount; i += 8 )
+    ShiftChunk( 0, uint8_t( MinFrom( clockCount - i, uint32_t( 8 ) ) ), false );
+}
@@ -0,0 +1,67 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef JTAG_TAP_H_INCLUDED
+#define JTAG_TAP_H_INCLUDED
+
+#include <stdint.h>
+
+// These routines drive the TAP state machine on the device itself, without any help from the host.
+// They are meant for sequences where the USB round trips would be too slow or the timing too loose,
+// like the reset-and-halt sequence.
+//
+// All routines start and end in the Run-Test/Idle state. The bit arrays are LSB first,
+// like in the Bus Pirate protocol. The TDO array pointer can be NULL if the data is not needed.
+//
+// The scans are addressed to the selected TAP in the chain. The other TAPs get BYPASS instructions
+// during IR scans and a single padding bit each during DR scans, so that the caller only deals
+// with the data for the selected TAP. After a TAP reset, the other TAPs are no longer in BYPASS,
+// so you need to do an IR scan before the next DR scan.
+//
+// The chain positions are numbered like OpenOCD does: position 0 is the TAP nearest to TDO.
+
+#define JTAG_TAP_MAX_CHAIN_DEVICE_COUNT  16
+
+void JtagTap_SetChain ( uint8_t deviceCount, const uint8_t * irLengths, uint8_t selectedTap );
+void JtagTap_SelectTap ( uint8_t selectedTap );
+void JtagTap_DiscoverChain ( void );
+
+uint8_t JtagTap_GetChainDeviceCount ( void );
+uint8_t JtagTap_GetChainIrLength ( uint8_t tapIndex );
+uint8_t JtagTap_GetSelectedTap ( void );
+
+// Call this routine after shifting raw JTAG data without the help of this module, like with CMD_TAP_SHIFT,
+// because the other TAPs may have some instruction other than BYPASS loaded afterwards.
+void JtagTap_ForgetBypassState ( void );
+
+void JtagTap_ResetToIdle ( void );
+
+void JtagTap_ShiftIr ( const uint8_t * tdi, uint8_t * tdo, uint16_t bitCount );
+void JtagTap_ShiftDr ( const uint8_t * tdi, uint8_t * tdo, uint16_t bitCount );
+
+uint64_t JtagTap_ShiftDr64 ( uint64_t tdi, uint8_t bitCount );
+
+void JtagTap_RunIdleClocks ( uint32_t clockCount );
+
+// Use these routines if the data does not fit in a single array,
+// like when streaming from the USB buffers. The total bit count must be known in advance.
+void JtagTap_BeginScan ( bool isIr, uint32_t totalBitCount );
+void JtagTap_ScanBits  ( const uint8_t * tdi, uint8_t * tdo, uint16_t bitCount );
+void JtagTap_EndScan   ( void );
+
+
+#endif  // Include this header file only once.
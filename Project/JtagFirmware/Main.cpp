@@ -28,22 +28,24 @@
 #include <BareMetalSupport/SerialPortAsyncTx.h>
 #include <BareMetalSupport/SerialPrint.h>
 #include <BareMetalSupport/MainLoopSleep.h>
+#include <BareMetalSupport/DwtUtils.h>
 
 #include "Globals.h"
 #include "UsbConnection.h"
 #include "UsbSupport.h"
 #include "Led.h"
 #include "SerialPortConsole.h"
+#include "UsbDiagnosticPort.h"
 #include "BusPirateOpenOcdMode.h"
+#include "WorkBudget.h"
+#include "MainLoopStats.h"
+#include "Profiler.h"
 
 #include <sam3xa.h>  // All interrupt handlers must probably be extern "C", so include their declarations here.
 #include <pio.h>
 #include <pmc.h>
 #include <wdt.h>
 
-
-const uint32_t WATCHDOG_PERIOD_MS = 1000;
-
 #ifndef NDEBUG
   static const size_t MIN_UNUSED_STACK_SIZE = MaxFrom( MaxFrom( ASSERT_MSG_BUFSIZE, MAX_SERIAL_PRINT_LEN ), MAX_USB_PRINT_LEN ) + 200;
 #endif
@@ -98,6 +100,13 @@ static void Configure ( void )
   ConfigureLedPort();
 
 
+  // ------- Configure the DWT cycle counter -------
+
+  // Used for accurate timing in the microsecond range.
+  // The profiler uses it in the SysTick interrupt handler, so enable it first.
+  EnableDwtCycleCounter();
+
+
   // ------- Configure the Systick -------
 
   assert( SystemCoreClock == CPU_CLOCK );
@@ -117,6 +126,10 @@ static void Configure ( void )
                          PIO_DEFAULT ) );
   InitUsb();
 
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    InitUsbDiagnosticPort();
+  #endif
+
 
   // ------- Setup the stack size and canary check -------
 
@@ -270,8 +283,6 @@ void StartOfUserCode ( void )
 
     InitSerialPortConsole();  // Call this after the last message printed to the serial port.
 
-    uint64_t longestIterationTime = 0;
-
     uint64_t lastReferenceTimeForPeriodicAction = 0;
 
     for (;;)
@@ -281,9 +292,27 @@ void StartOfUserCode ( void )
 
       const uint64_t currentTime = GetUptime();
 
+      const uint32_t iterationStartCycleCount = GetDwtCycleCount();
+      uint32_t phaseStartCycleCount = iterationStartCycleCount;
+
+      WorkBudget_BeginPass();
+
+      WorkBudget_BeginService( wbsUsbConnection );
       ServiceUsbConnection( currentTime );
+      WorkBudget_EndService();
+      phaseStartCycleCount = MainLoopStats_EndPhase( mlpUsbConnection, phaseStartCycleCount );
 
+      WorkBudget_BeginService( wbsSerialPortConsole );
       ServiceSerialPortConsole( currentTime );
+      WorkBudget_EndService();
+      phaseStartCycleCount = MainLoopStats_EndPhase( mlpSerialPortConsole, phaseStartCycleCount );
+
+      #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+        WorkBudget_BeginService( wbsUsbDiagnosticPort );
+        ServiceUsbDiagnosticPort( currentTime );
+        WorkBudget_EndService();
+        phaseStartCycleCount = MainLoopStats_EndPhase( mlpUsbDiagnosticPort, phaseStartCycleCount );
+      #endif
 
       if ( HasUptimeElapsedMs( currentTime, lastReferenceTimeForPeriodicAction, 500 ) )
       {
@@ -291,32 +320,37 @@ void StartOfUserCode ( void )
         PeriodicAction();
 
         assert( CheckStackCanary( MIN_UNUSED_STACK_SIZE ) );
+
+        phaseStartCycleCount = MainLoopStats_EndPhase( mlpPeriodicAction, phaseStartCycleCount );
       }
 
       // If somebody forgets to re-enable the interrupts after disabling them, detect it as soon as possible.
       assert( AreInterruptsEnabled() );
 
       UpdateCpuLoadStats();
+      MainLoopStats_EndPhase( mlpCpuLoadStats, phaseStartCycleCount );
 
 
       const bool PRINT_LONGEST_ITERATION_TIME = false;
 
-      const uint64_t currentIterationTime = GetUptime() - currentTime;
+      const uint32_t prevLongestIterationCycleCount = MainLoopStats_GetHistogram( mlpBusy )->maxCycleCount;
 
-      if ( ENABLE_WDT )
-        assert( currentIterationTime < WATCHDOG_PERIOD_MS / 3 );  // Otherwise you are getting too close to the limit.
+      const uint32_t sleepStartCycleCount = MainLoopStats_EndPhase( mlpBusy, iterationStartCycleCount );
 
-      const uint64_t prevLongestInterationTime = longestIterationTime;
+      const uint32_t longestIterationCycleCount = MainLoopStats_GetHistogram( mlpBusy )->maxCycleCount;
 
-      longestIterationTime = MaxFrom( longestIterationTime, currentIterationTime );
+      if ( ENABLE_WDT )
+        assert( DwtCycleCountToUs( sleepStartCycleCount - iterationStartCycleCount ) < WATCHDOG_PERIOD_MS * 1000 / 3 );  // Otherwise you are getting too close to the limit.
 
       if ( PRINT_LONGEST_ITERATION_TIME &&
-           longestIterationTime != prevLongestInterationTime )
+           longestIterationCycleCount != prevLongestIterationCycleCount )
       {
-          SerialPrintf( "%u" EOL, unsigned( longestIterationTime ) );
+          SerialPrintf( "%u us" EOL, unsigned( DwtCycleCountToUs( longestIterationCycleCount ) ) );
       }
 
       MainLoopSleep();
+
+      MainLoopStats_EndPhase( mlpSleep, sleepStartCycleCount );
     }
 }
 
@@ -336,6 +370,8 @@ static uint32_t s_mainLoopWakeUpCounterCpuLoad  = 0;
 
 void SysTick_Handler ( void )
 {
+  PROFILE_ZONE( pzSysTickInterrupt );
+
   if ( false )
     SerialPrintStr( "." );
 
@@ -344,7 +380,7 @@ void SysTick_Handler ( void )
 
   // Wake the main loop up at regular intervals, in case the user code wants to trigger actions based on time-outs.
 
-  if ( true ) // Sometimes it is desirable for test or CPU load calibration purposes to disable this wake-up logic.
+  if ( true ) // Sometimes it is desirable for test purposes to disable this wake-up logic.
   {
     const uint32_t MAINLOOP_WAKE_UP_TIMEOUTS_MS = 250;
     const uint32_t MAINLOOP_WAKE_UP_TIMEOUTS_TICK_COUNT = MAINLOOP_WAKE_UP_TIMEOUTS_MS / SYSTEM_TICK_PERIOD_MS;
@@ -363,21 +399,18 @@ void SysTick_Handler ( void )
 
   // Wake the main loop up at regular intervals for the purposes of CPU load calculations.
 
-  if ( !ENABLE_CPU_SLEEP )
-  {
-    const uint32_t MAINLOOP_WAKE_UP_CPU_LOAD_MS = 1000 / CPU_LOAD_SHORT_PERIOD_SLOT_COUNT;
-    STATIC_ASSERT( 0 == ( 1000 % CPU_LOAD_SHORT_PERIOD_SLOT_COUNT ), "Cannot accurately calculate CPU load." );
-    const uint32_t MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT = MAINLOOP_WAKE_UP_CPU_LOAD_MS / SYSTEM_TICK_PERIOD_MS;
-    STATIC_ASSERT( 0 == ( MAINLOOP_WAKE_UP_CPU_LOAD_MS % SYSTEM_TICK_PERIOD_MS ), "The CPU load statistics will jitter." );
+  const uint32_t MAINLOOP_WAKE_UP_CPU_LOAD_MS = 1000 / CPU_LOAD_SHORT_PERIOD_SLOT_COUNT;
+  STATIC_ASSERT( 0 == ( 1000 % CPU_LOAD_SHORT_PERIOD_SLOT_COUNT ), "Cannot accurately calculate CPU load." );
+  const uint32_t MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT = MAINLOOP_WAKE_UP_CPU_LOAD_MS / SYSTEM_TICK_PERIOD_MS;
+  STATIC_ASSERT( 0 == ( MAINLOOP_WAKE_UP_CPU_LOAD_MS % SYSTEM_TICK_PERIOD_MS ), "The CPU load statistics will jitter." );
 
-    assert( s_mainLoopWakeUpCounterCpuLoad < MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT );
-    ++s_mainLoopWakeUpCounterCpuLoad;
+  assert( s_mainLoopWakeUpCounterCpuLoad < MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT );
+  ++s_mainLoopWakeUpCounterCpuLoad;
 
-    if ( s_mainLoopWakeUpCounterCpuLoad == MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT )
-    {
-      s_mainLoopWakeUpCounterCpuLoad = 0;
-      CpuLoadStatsTick();
-      WakeFromMainLoopSleep();
-    }
+  if ( s_mainLoopWakeUpCounterCpuLoad == MAINLOOP_WAKE_UP_CPU_LOAD_TICK_COUNT )
+  {
+    s_mainLoopWakeUpCounterCpuLoad = 0;
+    CpuLoadStatsTick();
+    WakeFromMainLoopSleep();
   }
 }
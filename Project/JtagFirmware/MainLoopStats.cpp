@@ -0,0 +1,82 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+#include "MainLoopStats.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+
+#include <BareMetalSupport/DwtUtils.h>
+#include <BareMetalSupport/Miscellaneous.h>
+
+
+static MainLoopHistogram s_histograms[ MAIN_LOOP_PHASE_COUNT ];
+
+
+uint32_t MainLoopStats_EndPhase ( const MainLoopPhaseEnum phase, const uint32_t startCycleCount )
+{
+  assert( phase < MAIN_LOOP_PHASE_COUNT );
+
+  const uint32_t now = GetDwtCycleCount();
+  const uint32_t cycleCount = now - startCycleCount;
+
+  unsigned binIndex = 0;
+
+  while ( binIndex < MAIN_LOOP_BIN_COUNT - 1 && ( cycleCount >> ( binIndex + MAIN_LOOP_FIRST_BIN_SHIFT ) ) != 0 )
+    ++binIndex;
+
+  MainLoopHistogram * const histogram = &s_histograms[ phase ];
+
+  ++histogram->binCounts[ binIndex ];
+  histogram->totalCycleCount += cycleCount;
+  histogram->maxCycleCount = MaxFrom( histogram->maxCycleCount, cycleCount );
+  ++histogram->sampleCount;
+
+  return now;
+}
+
+
+const char * MainLoopStats_GetPhaseName ( const MainLoopPhaseEnum phase )
+{
+  switch ( phase )
+  {
+  case mlpUsbConnection:     return "USB connection";
+  case mlpSerialPortConsole: return "Serial port console";
+  case mlpUsbDiagnosticPort: return "USB diagnostic port";
+  case mlpPeriodicAction:    return "Periodic action";
+  case mlpCpuLoadStats:      return "CPU load stats";
+  case mlpBusy:              return "Busy";
+  case mlpSleep:             return "Sleep";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+const MainLoopHistogram * MainLoopStats_GetHistogram ( const MainLoopPhaseEnum phase )
+{
+  assert( phase < MAIN_LOOP_PHASE_COUNT );
+  return &s_histograms[ phase ];
+}
+
+
+void MainLoopStats_Reset ( void )
+{
+  memset( s_histograms, 0, sizeof( s_histograms ) );
+}
@@ -0,0 +1,64 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef MAIN_LOOP_STATS_H_INCLUDED
+#define MAIN_LOOP_STATS_H_INCLUDED
+
+#include <stdint.h>
+
+// These histograms show how long the main loop iterations take, split by phase, see console command "MainLoopStats".
+// The tail of the "busy" histogram determines how quickly the firmware reacts to USB data,
+// and how close it gets to the watchdog limit. The durations are measured with the DWT cycle counter.
+
+enum MainLoopPhaseEnum
+{
+  mlpUsbConnection = 0,
+  mlpSerialPortConsole,
+  mlpUsbDiagnosticPort,
+  mlpPeriodicAction,
+  mlpCpuLoadStats,
+  mlpBusy,   // The whole iteration apart from the sleep time.
+  mlpSleep,
+
+  MAIN_LOOP_PHASE_COUNT
+};
+
+// Bin 0 counts the durations under 2^MAIN_LOOP_FIRST_BIN_SHIFT cycles, bin n counts those
+// under 2^(n + MAIN_LOOP_FIRST_BIN_SHIFT) cycles, and the last bin counts all longer durations.
+// At 84 MHz, the first bin is under 1 us and the last one starts at around 400 ms.
+#define MAIN_LOOP_FIRST_BIN_SHIFT  6
+#define MAIN_LOOP_BIN_COUNT        20
+
+struct MainLoopHistogram
+{
+  uint32_t binCounts[ MAIN_LOOP_BIN_COUNT ];
+  uint64_t totalCycleCount;
+  uint32_t maxCycleCount;
+  uint32_t sampleCount;
+};
+
+// Records the time elapsed since startCycleCount and returns the current cycle count,
+// so that the next phase can start where this one ended.
+uint32_t MainLoopStats_EndPhase ( MainLoopPhaseEnum phase, uint32_t startCycleCount );
+
+const char * MainLoopStats_GetPhaseName ( MainLoopPhaseEnum phase );
+const MainLoopHistogram * MainLoopStats_GetHistogram ( MainLoopPhaseEnum phase );
+void MainLoopStats_Reset ( void );
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,102 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+#include "Profiler.h"  // The include file for this module should come first.
+
+#include <assert.h>
+
+#include <BareMetalSupport/Miscellaneous.h>
+
+
+#ifndef ENABLE_PROFILER
+  #error "This module should only be compiled if the profiler is enabled."
+#endif
+
+
+static ProfileZoneStats s_zoneStats[ PROFILE_ZONE_COUNT ];
+
+
+// This routine can be called in interrupt context. Each zone has a single writer
+// (see the restriction in the header file), so there is no need to disable interrupts here.
+
+void Profiler_RecordZone ( const ProfileZoneEnum zone, const uint32_t cycleCount ) throw()
+{
+  assert( zone < PROFILE_ZONE_COUNT );
+
+  ProfileZoneStats * const stats = &s_zoneStats[ zone ];
+
+  if ( stats->callCount == 0 )
+  {
+    stats->minCycleCount = cycleCount;
+    stats->maxCycleCount = cycleCount;
+  }
+  else
+  {
+    stats->minCycleCount = MinFrom( stats->minCycleCount, cycleCount );
+    stats->maxCycleCount = MaxFrom( stats->maxCycleCount, cycleCount );
+  }
+
+  ++stats->callCount;
+  stats->totalCycleCount += cycleCount;
+}
+
+
+const char * Profiler_GetZoneName ( const ProfileZoneEnum zone )
+{
+  switch ( zone )
+  {
+  case pzServiceUsbConnection:       return "ServiceUsbConnection";
+  case pzUsbReceiveData:             return "USB ReceiveData";
+  case pzUsbSendData:                return "USB SendData";
+  case pzOpenOcdProcessReceivedData: return "OpenOCD ProcessReceivedData";
+  case pzSwdProcessReceivedData:     return "SWD ProcessReceivedData";
+  case pzShiftJtagData:              return "ShiftJtagData";
+  case pzSysTickInterrupt:           return "SysTick ISR";
+  case pzUsbRxNotifyInterrupt:       return "USB Rx notify ISR";
+  case pzSerialPortRxInterrupt:      return "Serial Rx ISR";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+// The interrupt handlers may be updating their zones at the same time, so
+// the following routines must disable interrupts in order to get consistent values.
+
+void Profiler_GetZoneStats ( const ProfileZoneEnum zone, ProfileZoneStats * const stats )
+{
+  assert( zone < PROFILE_ZONE_COUNT );
+
+  CAutoDisableInterrupts autoDisableInterrupts;
+  *stats = s_zoneStats[ zone ];
+}
+
+
+void Profiler_Reset ( void )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+
+  for ( unsigned i = 0; i < PROFILE_ZONE_COUNT; ++i )
+  {
+    s_zoneStats[ i ].callCount       = 0;
+    s_zoneStats[ i ].totalCycleCount = 0;
+    s_zoneStats[ i ].minCycleCount   = 0;
+    s_zoneStats[ i ].maxCycleCount   = 0;
+  }
+}
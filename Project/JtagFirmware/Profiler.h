@@ -0,0 +1,98 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+#include <stdint.h>
+
+// The profiler measures the time spent in a number of code zones with the DWT cycle counter.
+// Place a PROFILE_ZONE() marker at the beginning of a code block, and the time until the end
+// of the block is recorded for that zone. See console command "Profile".
+//
+// The times are inclusive: a zone in the main loop also counts the time spent in nested zones
+// and in any interrupts that happen to trigger in the meantime. A single zone must not be
+// used from both the main loop and an interrupt handler.
+//
+// Unless ENABLE_PROFILER is defined (see configure option --enable-profiler),
+// the markers compile to nothing.
+
+enum ProfileZoneEnum
+{
+  pzServiceUsbConnection = 0,
+  pzUsbReceiveData,
+  pzUsbSendData,
+  pzOpenOcdProcessReceivedData,
+  pzSwdProcessReceivedData,
+  pzShiftJtagData,
+  pzSysTickInterrupt,
+  pzUsbRxNotifyInterrupt,
+  pzSerialPortRxInterrupt,
+
+  PROFILE_ZONE_COUNT
+};
+
+
+#ifdef ENABLE_PROFILER
+
+  #include <BareMetalSupport/DwtUtils.h>
+
+  struct ProfileZoneStats
+  {
+    uint32_t callCount;
+    uint64_t totalCycleCount;
+    uint32_t minCycleCount;
+    uint32_t maxCycleCount;
+  };
+
+  void Profiler_RecordZone ( ProfileZoneEnum zone, uint32_t cycleCount ) throw();
+
+  const char * Profiler_GetZoneName ( ProfileZoneEnum zone );
+  void Profiler_GetZoneStats ( ProfileZoneEnum zone, ProfileZoneStats * stats );
+  void Profiler_Reset ( void );
+
+
+  class CProfileZoneScope
+  {
+  private:
+    const ProfileZoneEnum m_zone;
+    const uint32_t m_startCycleCount;
+
+  public:
+    explicit CProfileZoneScope ( const ProfileZoneEnum zone ) throw()
+      : m_zone( zone )
+      , m_startCycleCount( GetDwtCycleCount() )
+    {
+    }
+
+    ~CProfileZoneScope ( void ) throw()
+    {
+      Profiler_RecordZone( m_zone, GetDwtElapsedCycleCount( m_startCycleCount ) );
+    }
+  };
+
+  #define PROFILE_ZONE( zone )  CProfileZoneScope profileZoneScope( zone )
+
+#else
+
+  #define PROFILE_ZONE( zone )  do { } while ( false )
+
+#endif
+
+
+#endif  // Include this header file only once.
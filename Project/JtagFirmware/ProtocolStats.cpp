@@ -0,0 +1,47 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+#include "ProtocolStats.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+
+
+ProtocolStats g_protocolStats;
+
+
+const char * ProtocolStats_GetStallReasonName ( const ProtocolStallReasonEnum reason )
+{
+  switch ( reason )
+  {
+  case psrIncompleteCommand:       return "Incomplete command";
+  case psrTxBufferFull:            return "Not enough Tx Buffer room";
+  case psrTxNotEmptyForModeChange: return "Tx Buffer not empty for mode change";
+  case psrShiftWaitingForRxData:   return "Streamed shift waiting for Rx data";
+  case psrShiftWaitingForTxRoom:   return "Streamed shift waiting for Tx room";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+void ProtocolStats_Reset ( void )
+{
+  memset( &g_protocolStats, 0, sizeof( g_protocolStats ) );
+}
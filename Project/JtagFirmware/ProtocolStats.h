@@ -0,0 +1,73 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef PROTOCOL_STATS_H_INCLUDED
+#define PROTOCOL_STATS_H_INCLUDED
+
+#include <stdint.h>
+
+// These counters are always enabled, see console command "Stats". They help find out why the throughput drops:
+// whether the host is not sending data fast enough, the Tx Buffer is full, or the commands
+// are waiting incomplete in the Rx Buffer.
+//
+// The stall counters count how many times a command could not make progress, so a single command
+// that waits for data during several main loop iterations counts several times.
+
+enum ProtocolStallReasonEnum
+{
+  psrIncompleteCommand = 0,    // The rest of the command has not arrived yet.
+  psrTxBufferFull,             // There is not enough room in the Tx Buffer for the reply.
+  psrTxNotEmptyForModeChange,  // Changing modes or printing a welcome message waits for the Tx Buffer to empty.
+  psrShiftWaitingForRxData,    // A streamed CMD_TAP_SHIFT is waiting for more data.
+  psrShiftWaitingForTxRoom,    // A streamed CMD_TAP_SHIFT is waiting for room in the Tx Buffer.
+
+  PROTOCOL_STALL_REASON_COUNT
+};
+
+// The OpenOCD command codes are counted individually up to this value. The last entry counts all others.
+#define PROTOCOL_STATS_CMD_CODE_COUNT  0x30
+
+struct ProtocolStats
+{
+  uint32_t openOcdCommandCounts[ PROTOCOL_STATS_CMD_CODE_COUNT ];
+  uint32_t swdCommandCount;
+  uint64_t shiftedBitCount;
+  uint64_t usbReceivedByteCount;
+  uint64_t usbSentByteCount;
+  uint32_t stallCounts[ PROTOCOL_STALL_REASON_COUNT ];
+};
+
+extern ProtocolStats g_protocolStats;
+
+
+inline void ProtocolStats_CountOpenOcdCommand ( const uint8_t cmdCode )
+{
+  ++g_protocolStats.openOcdCommandCounts[ cmdCode < PROTOCOL_STATS_CMD_CODE_COUNT - 1 ? cmdCode : PROTOCOL_STATS_CMD_CODE_COUNT - 1 ];
+}
+
+inline void ProtocolStats_CountStall ( const ProtocolStallReasonEnum reason )
+{
+  ++g_protocolStats.stallCounts[ reason ];
+}
+
+const char * ProtocolStats_GetStallReasonName ( ProtocolStallReasonEnum reason );
+
+void ProtocolStats_Reset ( void );
+
+
+#endif  // Include this header file only once.
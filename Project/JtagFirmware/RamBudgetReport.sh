@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# Prints how the SRAM is distributed between static data, heap and stack,
+# together with the biggest statically-allocated objects.
+#
+# Usage: RamBudgetReport.sh <nm tool> <elf file> <stack size>
+
+set -o errexit
+set -o pipefail
+set -o nounset
+
+if (( $# != 3 )); then
+  echo "Invalid number of command-line arguments." >&2
+  exit 1
+fi
+
+NM_TOOL="$1"
+ELF_FILENAME="$2"
+STACK_SIZE="$3"
+
+NM_OUTPUT="$("$NM_TOOL" "$ELF_FILENAME")"
+
+get_symbol_value ()
+{
+  local SYMBOL_NAME="$1"
+  local VALUE_HEX
+
+  VALUE_HEX="$(awk -v name="$SYMBOL_NAME" '$3 == name { print $1 }' <<< "$NM_OUTPUT")"
+
+  if [[ -z "$VALUE_HEX" ]]; then
+    echo "Symbol \"$SYMBOL_NAME\" not found in \"$ELF_FILENAME\"." >&2
+    exit 1
+  fi
+
+  echo "$(( 16#$VALUE_HEX ))"
+}
+
+RAM_BEGIN="$(get_symbol_value "_srelocate")"
+DATA_END="$(get_symbol_value "_erelocate")"
+BSS_BEGIN="$(get_symbol_value "_sbss")"
+BSS_END="$(get_symbol_value "_ebss")"
+HEAP_BEGIN="$(get_symbol_value "_end")"
+RAM_END="$(get_symbol_value "__StackTop")"
+
+RAM_SIZE=$(( RAM_END - RAM_BEGIN ))
+DATA_SIZE=$(( DATA_END - RAM_BEGIN ))
+BSS_SIZE=$(( BSS_END - BSS_BEGIN ))
+HEAP_SIZE=$(( RAM_END - HEAP_BEGIN - STACK_SIZE ))
+
+printf "RAM budget:\n"
+printf "  %-22s %7d bytes\n" "Total RAM:"             "$RAM_SIZE"
+printf "  %-22s %7d bytes\n" "Initialised data:"      "$DATA_SIZE"
+printf "  %-22s %7d bytes\n" "Zero-initialised data:" "$BSS_SIZE"
+printf "  %-22s %7d bytes\n" "Stack:"                 "$STACK_SIZE"
+printf "  %-22s %7d bytes\n" "Left for the heap:"     "$HEAP_SIZE"
+
+printf "\nBiggest objects in RAM:\n"
+
+"$NM_TOOL" --size-sort --reverse-sort --radix=d --demangle "$ELF_FILENAME" | \
+  awk '$2 ~ /^[bBdD]$/ && ++count <= 15 { printf "  %7d  %s\n", $1, substr( $0, index( $0, $3 ) ) }'
+
+if (( HEAP_SIZE < 0 )); then
+  echo "Error: The static data and the stack do not fit in RAM." >&2
+  exit 1
+fi
@@ -21,7 +21,7 @@
 #include <BareMetalSupport/GenericSerialConsole.h>
 #include <BareMetalSupport/SerialPortAsyncTx.h>
 #include <BareMetalSupport/SerialPrint.h>
-#include <BareMetalSupport/CircularBuffer.h>
+#include <BareMetalSupport/SpscCircularBuffer.h>
 #include <BareMetalSupport/MainLoopSleep.h>
 #include <BareMetalSupport/Miscellaneous.h>
 
@@ -30,15 +30,16 @@
 #include <Globals.h>
 
 #include "CommandProcessor.h"
+#include "WorkBudget.h"
+#include "Profiler.h"
 
 
 #define SERIAL_PORT_RX_BUFFER_SIZE   32
 
-typedef CCircularBuffer< uint8_t, uint32_t, SERIAL_PORT_RX_BUFFER_SIZE > CSerialPortRxBuffer;
+// The Rx interrupt handler is the only producer and the main loop the only consumer,
+// so this buffer needs no interrupt masking.
+typedef CSpscCircularBuffer< uint8_t, uint32_t, SERIAL_PORT_RX_BUFFER_SIZE > CSerialPortRxBuffer;
 
-
-// This instance should be "volatile", but then I get difficult compilation errors,
-// more investigation is needed. In the mean time, see the AssumeMemoryHasChanged() calls below.
 static CSerialPortRxBuffer s_serialPortRxBuffer;
 
 
@@ -129,18 +130,10 @@ static void ServiceSerialPortRx ( const uint64_t currentTime )
 
   for ( ; ; )
   {
-    char c;
-
-    { // Scope for autoDisableInterrupts.
-      CAutoDisableInterrupts autoDisableInterrupts;
-
-      AssumeMemoryHasChanged();  // Because s_serialPortRxBuffer should be volatile.
+    uint8_t c;
 
-      if ( s_serialPortRxBuffer.IsEmpty() )
-        break;
-
-      c = s_serialPortRxBuffer.ReadElement();
-    }
+    if ( !s_serialPortRxBuffer.TryReadElement( &c ) )
+      break;
 
     if ( HasSerialPortDataBeenSentSinceLastCall() )
     {
@@ -167,6 +160,9 @@ static void ServiceSerialPortRx ( const uint64_t currentTime )
     }
 
     HasSerialPortDataBeenSentSinceLastCall();  // Reset the flag.
+
+    if ( WorkBudget_IsSpent() )
+      break;
   }
 }
 
@@ -198,6 +194,8 @@ void ServiceSerialPortConsole ( const uint64_t currentTime )
 
 void SerialPortRxInterruptHandler ( void )
 {
+  PROFILE_ZONE( pzSerialPortRxInterrupt );
+
   // There is no FIFO in our UART, so we process just 1 character every time this interrupt is triggered.
 
   // POSSIBLE OPTIMISATION: Use the DMA channels to transfer data.
@@ -209,22 +207,11 @@ void SerialPortRxInterruptHandler ( void )
     // We must always read the available character, otherwise the interrupt will trigger again.
     const char c = UART->UART_RHR;
 
-    { // Scope for autoDisableInterrupts.
-
-      CAutoDisableInterrupts autoDisableInterrupts;
-
-      AssumeMemoryHasChanged();  // Because s_serialPortRxBuffer should be volatile.
-
-      if ( s_serialPortRxBuffer.IsFull() )
-      {
-        s_rxBufferOverrun = true;
-      }
-      else
-      {
-        s_serialPortRxBuffer.WriteElem( c );
-      }
-
-    }  // Scope for autoDisableInterrupts.
+    if ( !s_serialPortRxBuffer.TryWriteElem( c ) )
+    {
+      s_serialPortRxBuffer.NoteOverflow( 1 );
+      s_rxBufferOverrun = true;
+    }
 
     WakeFromMainLoopSleep();
   }
@@ -257,3 +244,19 @@ void InitSerialPortConsole ( void )
 {
     HasSerialPortDataBeenSentSinceLastCall();  // Reset the flag.
 }
+
+
+// The statistics are updated from both the Rx interrupt handler and the main loop.
+
+void GetSerialPortRxBufferStats ( CircularBufferStats * const stats )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+  s_serialPortRxBuffer.GetStats( stats );
+}
+
+
+void ResetSerialPortRxBufferStats ( void )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+  s_serialPortRxBuffer.ResetStats();
+}
@@ -4,8 +4,13 @@
 
 #include <stdint.h>
 
+#include <BareMetalSupport/CircularBufferStats.h>
+
 void InitSerialPortConsole ( void );
 void ServiceSerialPortConsole ( uint64_t currentTime );
 
+void GetSerialPortRxBufferStats ( CircularBufferStats * stats );
+void ResetSerialPortRxBufferStats ( void );
+
 
 #endif  // Include this header file only once.
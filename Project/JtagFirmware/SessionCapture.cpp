@@ -0,0 +1,358 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "SessionCapture.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <BareMetalSupport/DwtUtils.h>
+#include <BareMetalSupport/IntegerPrintUtils.h>
+#include <BareMetalSupport/Miscellaneous.h>
+#include <BareMetalSupport/AssertionUtils.h>
+
+#include "Globals.h"
+
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+  #include "UsbDiagnosticPort.h"
+  #include "WorkBudget.h"
+#endif
+
+
+// The records are stored back to back in a byte ring. The positions and record indexes are free running,
+// they are allowed to wrap around.
+
+static uint8_t s_buffer[ SESSION_CAPTURE_BUFFER_SIZE ];
+
+static uint32_t s_writePos          = 0;
+static uint32_t s_oldestPos         = 0;
+static uint32_t s_writeRecordIndex  = 0;
+static uint32_t s_oldestRecordIndex = 0;
+static uint32_t s_overwrittenCount  = 0;
+
+static bool s_isActive = false;
+
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+  static bool s_isStreaming = false;
+  static SessionCaptureCursor s_streamCursor;
+#endif
+
+
+static void WriteBytes ( const uint32_t pos, const uint8_t * const data, const uint32_t dataLen )
+{
+  for ( uint32_t i = 0; i < dataLen; ++i )
+    s_buffer[ ( pos + i ) & ( SESSION_CAPTURE_BUFFER_SIZE - 1 ) ] = data[ i ];
+}
+
+
+static void ReadBytes ( const uint32_t pos, uint8_t * const data, const uint32_t dataLen )
+{
+  for ( uint32_t i = 0; i < dataLen; ++i )
+    data[ i ] = s_buffer[ ( pos + i ) & ( SESSION_CAPTURE_BUFFER_SIZE - 1 ) ];
+}
+
+
+static void FillRecordHeader ( uint8_t * const header,
+                               const SessionCaptureRecordTypeEnum recordType,
+                               const uint32_t cycleCount,
+                               const uint32_t payloadLen )
+{
+  assert( payloadLen <= SESSION_CAPTURE_MAX_PAYLOAD_LEN );
+
+  header[ 0 ] = uint8_t( recordType );
+  header[ 1 ] = uint8_t( cycleCount       );
+  header[ 2 ] = uint8_t( cycleCount >>  8 );
+  header[ 3 ] = uint8_t( cycleCount >> 16 );
+  header[ 4 ] = uint8_t( cycleCount >> 24 );
+  header[ 5 ] = uint8_t( payloadLen      );
+  header[ 6 ] = uint8_t( payloadLen >> 8 );
+}
+
+
+static uint32_t GetPayloadLen ( const uint8_t * const header )
+{
+  return uint32_t( header[ 5 ] ) | ( uint32_t( header[ 6 ] ) << 8 );
+}
+
+
+static void DropOldestRecord ( void )
+{
+  assert( s_oldestRecordIndex != s_writeRecordIndex );
+
+  uint8_t header[ SESSION_CAPTURE_RECORD_HEADER_LEN ];
+  ReadBytes( s_oldestPos, header, sizeof( header ) );
+
+  s_oldestPos += SESSION_CAPTURE_RECORD_HEADER_LEN + GetPayloadLen( header );
+  ++s_oldestRecordIndex;
+  ++s_overwrittenCount;
+}
+
+
+static void RecordSingle ( const SessionCaptureRecordTypeEnum recordType,
+                           const uint32_t cycleCount,
+                           const uint8_t * const payload,
+                           const uint32_t payloadLen )
+{
+  const uint32_t recordLen = SESSION_CAPTURE_RECORD_HEADER_LEN + payloadLen;
+
+  while ( s_writePos - s_oldestPos + recordLen > SESSION_CAPTURE_BUFFER_SIZE )
+    DropOldestRecord();
+
+  uint8_t header[ SESSION_CAPTURE_RECORD_HEADER_LEN ];
+  FillRecordHeader( header, recordType, cycleCount, payloadLen );
+
+  WriteBytes( s_writePos, header, sizeof( header ) );
+  WriteBytes( s_writePos + SESSION_CAPTURE_RECORD_HEADER_LEN, payload, payloadLen );
+
+  s_writePos += recordLen;
+  ++s_writeRecordIndex;
+}
+
+
+void SessionCapture_RecordData ( const SessionCaptureRecordTypeEnum recordType,
+                                 const uint8_t * const data,
+                                 const uint32_t dataLen )
+{
+  STATIC_ASSERT( ( SESSION_CAPTURE_BUFFER_SIZE & ( SESSION_CAPTURE_BUFFER_SIZE - 1 ) ) == 0, "The buffer size must be a power of two." );
+  STATIC_ASSERT( SESSION_CAPTURE_BUFFER_SIZE >= SESSION_CAPTURE_MAX_RECORD_LEN, "The buffer is too small." );
+
+  if ( !s_isActive )
+    return;
+
+  // All records for the same data block get the same timestamp.
+  const uint32_t cycleCount = GetDwtCycleCount();
+
+  uint32_t offset = 0;
+
+  do
+  {
+    const uint32_t payloadLen = MinFrom( dataLen - offset, uint32_t( SESSION_CAPTURE_MAX_PAYLOAD_LEN ) );
+
+    RecordSingle( recordType, cycleCount, data + offset, payloadLen );
+
+    offset += payloadLen;
+  }
+  while ( offset < dataLen );
+}
+
+
+bool SessionCapture_IsActive ( void )
+{
+  return s_isActive;
+}
+
+
+void SessionCapture_SetActive ( const bool active )
+{
+  s_isActive = active;
+}
+
+
+void SessionCapture_Clear ( void )
+{
+  s_oldestPos         = s_writePos;
+  s_oldestRecordIndex = s_writeRecordIndex;
+  s_overwrittenCount  = 0;
+
+  // Otherwise, the stream would report the cleared records as lost.
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    SessionCapture_GetOldestCursor( &s_streamCursor );
+  #endif
+}
+
+
+uint32_t SessionCapture_GetRecordCount ( void )
+{
+  return s_writeRecordIndex - s_oldestRecordIndex;
+}
+
+
+uint32_t SessionCapture_GetByteCount ( void )
+{
+  return s_writePos - s_oldestPos;
+}
+
+
+uint32_t SessionCapture_GetOverwrittenCount ( void )
+{
+  return s_overwrittenCount;
+}
+
+
+void SessionCapture_GetOldestCursor ( SessionCaptureCursor * const cursor )
+{
+  cursor->bytePos     = s_oldestPos;
+  cursor->recordIndex = s_oldestRecordIndex;
+}
+
+
+void SessionCapture_GetNewestCursor ( SessionCaptureCursor * const cursor )
+{
+  cursor->bytePos     = s_writePos;
+  cursor->recordIndex = s_writeRecordIndex;
+}
+
+
+uint32_t SessionCapture_ReadRecord ( SessionCaptureCursor * const cursor, uint8_t * const record )
+{
+  const uint32_t lostCount = s_oldestRecordIndex - cursor->recordIndex;
+
+  // The record indexes are free running, so compare them with a signed difference.
+  if ( int32_t( lostCount ) > 0 )
+  {
+    SessionCapture_GetOldestCursor( cursor );
+
+    const uint8_t payload[ 4 ] = { uint8_t( lostCount       ),
+                                   uint8_t( lostCount >>  8 ),
+                                   uint8_t( lostCount >> 16 ),
+                                   uint8_t( lostCount >> 24 ) };
+
+    FillRecordHeader( record, scrRecordsLost, GetDwtCycleCount(), sizeof( payload ) );
+    memcpy( record + SESSION_CAPTURE_RECORD_HEADER_LEN, payload, sizeof( payload ) );
+
+    return SESSION_CAPTURE_RECORD_HEADER_LEN + sizeof( payload );
+  }
+
+  if ( cursor->recordIndex == s_writeRecordIndex )
+    return 0;
+
+  ReadBytes( cursor->bytePos, record, SESSION_CAPTURE_RECORD_HEADER_LEN );
+
+  const uint32_t recordLen = SESSION_CAPTURE_RECORD_HEADER_LEN + GetPayloadLen( record );
+  assert( recordLen <= SESSION_CAPTURE_MAX_RECORD_LEN );
+
+  ReadBytes( cursor->bytePos + SESSION_CAPTURE_RECORD_HEADER_LEN,
+             record + SESSION_CAPTURE_RECORD_HEADER_LEN,
+             recordLen - SESSION_CAPTURE_RECORD_HEADER_LEN );
+
+  cursor->bytePos += recordLen;
+  ++cursor->recordIndex;
+
+  return recordLen;
+}
+
+
+uint32_t SessionCapture_MakeHeaderRecord ( uint8_t * const record )
+{
+  const uint32_t cpuClock = CPU_CLOCK;
+
+  const uint8_t payload[ 9 ] = { 'J', 'D', 'S', 'C',
+                                 SESSION_CAPTURE_FORMAT_VERSION,
+                                 uint8_t( cpuClock       ),
+                                 uint8_t( cpuClock >>  8 ),
+                                 uint8_t( cpuClock >> 16 ),
+                                 uint8_t( cpuClock >> 24 ) };
+
+  FillRecordHeader( record, scrCaptureHeader, GetDwtCycleCount(), sizeof( payload ) );
+  memcpy( record + SESSION_CAPTURE_RECORD_HEADER_LEN, payload, sizeof( payload ) );
+
+  return SESSION_CAPTURE_RECORD_HEADER_LEN + sizeof( payload );
+}
+
+
+void SessionCapture_FormatRecordLine ( const uint8_t * const record, const uint32_t recordLen, char * const line )
+{
+  assert( recordLen <= SESSION_CAPTURE_MAX_RECORD_LEN );
+
+  static const char PREFIX[] = "CAPTURE-RECORD ";
+  STATIC_ASSERT( sizeof( PREFIX ) - 1 == 15, "The line buffer size does not match the prefix." );
+
+  memcpy( line, PREFIX, sizeof( PREFIX ) - 1 );
+
+  char * p = line + sizeof( PREFIX ) - 1;
+
+  for ( uint32_t i = 0; i < recordLen; ++i )
+  {
+    *p++ = ConvertDigitToHex( record[ i ] >> 4, false );
+    *p++ = ConvertDigitToHex( record[ i ] & 0x0F, false );
+  }
+
+  strcpy( p, EOL );
+
+  assert( size_t( p - line ) + strlen( EOL ) < SESSION_CAPTURE_LINE_BUFFER_SIZE );
+}
+
+
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+
+static void StreamStr ( const char * const str )
+{
+  UsbDiagnosticPort_Write( str, strlen( str ) );
+}
+
+
+void SessionCapture_SetStreaming ( const bool enable )
+{
+  if ( enable == s_isStreaming )
+    return;
+
+  s_isStreaming = enable;
+
+  if ( !enable )
+  {
+    StreamStr( "CAPTURE-END" EOL );
+    return;
+  }
+
+  char line[ SESSION_CAPTURE_LINE_BUFFER_SIZE ];
+
+  snprintf( line, sizeof( line ), "CAPTURE-BEGIN cpu-clock=%u stream" EOL, unsigned( CPU_CLOCK ) );
+  StreamStr( line );
+
+  uint8_t record[ SESSION_CAPTURE_MAX_RECORD_LEN ];
+  const uint32_t recordLen = SessionCapture_MakeHeaderRecord( record );
+
+  SessionCapture_FormatRecordLine( record, recordLen, line );
+  StreamStr( line );
+
+  // Only stream the records captured from now on.
+  SessionCapture_GetNewestCursor( &s_streamCursor );
+}
+
+
+bool SessionCapture_IsStreaming ( void )
+{
+  return s_isStreaming;
+}
+
+
+void SessionCapture_ServiceStream ( void )
+{
+  if ( !s_isStreaming )
+    return;
+
+  // Stop before the diagnostic port has to drop a line. If it cannot keep up for long,
+  // the capture buffer overwrites the records first, and the stream reports them as lost.
+
+  while ( UsbDiagnosticPort_GetFreeTxCount() >= SESSION_CAPTURE_LINE_BUFFER_SIZE )
+  {
+    uint8_t record[ SESSION_CAPTURE_MAX_RECORD_LEN ];
+    const uint32_t recordLen = SessionCapture_ReadRecord( &s_streamCursor, record );
+
+    if ( recordLen == 0 )
+      break;
+
+    char line[ SESSION_CAPTURE_LINE_BUFFER_SIZE ];
+    SessionCapture_FormatRecordLine( record, recordLen, line );
+    StreamStr( line );
+
+    if ( WorkBudget_IsSpent() )
+      break;
+  }
+}
+
+#endif  // #ifdef ENABLE_USB_DIAGNOSTIC_PORT
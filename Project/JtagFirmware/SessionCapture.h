@@ -0,0 +1,146 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef SESSION_CAPTURE_H_INCLUDED
+#define SESSION_CAPTURE_H_INCLUDED
+
+#include <stdint.h>
+
+// The session capture records all data received and sent over the native USB port, with timestamps,
+// so that an intermittent failure in an OpenOCD session can be analysed and replayed afterwards.
+// It is only available if ENABLE_SESSION_CAPTURE is defined, see --enable-session-capture in configure.ac .
+//
+// The records land in a RAM buffer. When the buffer is full, the oldest records get overwritten,
+// so the capture always holds the most recent traffic. Recording is a plain memory copy,
+// so it costs just a few percent of throughput.
+//
+// Console command "Capture" controls the capture and dumps it as text. With the USB diagnostic port,
+// the records can also be streamed continuously as they are captured. Host tool
+// JtagTroubleshooting/ConvertSessionCapture.c turns the text output into a binary capture file
+// or into separate files with the host and device byte streams, which can be replayed.
+//
+// Record format, all integers are little endian:
+//   1 byte : record type, see SessionCaptureRecordTypeEnum.
+//   4 bytes: DWT cycle count when the record was captured. It wraps around every 51 seconds at 84 MHz.
+//   2 bytes: payload length.
+//   n bytes: payload.
+//
+// A capture file starts with a scrCaptureHeader record, whose payload is the "JDSC" signature,
+// a format version byte and the CPU clock in Hz as a 4-byte integer.
+
+#define SESSION_CAPTURE_RECORD_HEADER_LEN  7
+
+// Bigger data blocks are split into several records, so that each record fits in one text line.
+#define SESSION_CAPTURE_MAX_PAYLOAD_LEN  256
+
+#define SESSION_CAPTURE_MAX_RECORD_LEN  ( SESSION_CAPTURE_RECORD_HEADER_LEN + SESSION_CAPTURE_MAX_PAYLOAD_LEN )
+
+#define SESSION_CAPTURE_FORMAT_VERSION  1
+
+enum SessionCaptureRecordTypeEnum
+{
+  scrCaptureHeader = 1,
+  scrConnectionOpened,  // The payload is the channel number, 1 byte.
+  scrConnectionLost,
+  scrRxData,            // Data received from the host.
+  scrTxData,            // Data sent to the host.
+  scrRecordsLost        // The payload is the number of records lost at this point, 4 bytes.
+};
+
+
+#ifdef ENABLE_SESSION_CAPTURE
+
+  // Must be a power of two.
+  #ifndef SESSION_CAPTURE_BUFFER_SIZE
+    #define SESSION_CAPTURE_BUFFER_SIZE  16384
+  #endif
+
+  // A cursor walks the records in the capture buffer. If the records under the cursor get overwritten,
+  // the cursor reports how many were lost.
+  struct SessionCaptureCursor
+  {
+    uint32_t bytePos;
+    uint32_t recordIndex;
+  };
+
+  // These routines must only be called from the main loop, never in interrupt context.
+
+  bool SessionCapture_IsActive ( void );
+  void SessionCapture_SetActive ( bool active );
+  void SessionCapture_Clear ( void );
+
+  // Stops the capture while dumping it, so that the dump does not capture itself,
+  // and restores the previous state afterwards, even if the dump fails.
+  class CAutoDisableSessionCapture
+  {
+    const bool m_wasActive;
+  public:
+
+    CAutoDisableSessionCapture ( void )
+      : m_wasActive( SessionCapture_IsActive() )
+    {
+      SessionCapture_SetActive( false );
+    }
+
+    ~CAutoDisableSessionCapture ()
+    {
+      SessionCapture_SetActive( m_wasActive );
+    }
+  };
+
+  // Splits the data into several records if necessary.
+  void SessionCapture_RecordData ( SessionCaptureRecordTypeEnum recordType, const uint8_t * data, uint32_t dataLen );
+
+  uint32_t SessionCapture_GetRecordCount ( void );
+  uint32_t SessionCapture_GetByteCount ( void );
+  uint32_t SessionCapture_GetOverwrittenCount ( void );
+
+  void SessionCapture_GetOldestCursor ( SessionCaptureCursor * cursor );
+  void SessionCapture_GetNewestCursor ( SessionCaptureCursor * cursor );  // Points just after the newest record.
+
+  // The record buffer must have room for SESSION_CAPTURE_MAX_RECORD_LEN bytes.
+  // Returns 0 if there are no more records. If records were lost under the cursor, it returns
+  // a scrRecordsLost record that does not exist in the capture buffer.
+  uint32_t SessionCapture_ReadRecord ( SessionCaptureCursor * cursor, uint8_t * record );
+
+  // Fills in a scrCaptureHeader record with the current timestamp.
+  uint32_t SessionCapture_MakeHeaderRecord ( uint8_t * record );
+
+  // The text form of a record is "CAPTURE-RECORD <hex bytes>" EOL, and the line buffer must have
+  // room for SESSION_CAPTURE_LINE_BUFFER_SIZE characters, including the null terminator.
+  #define SESSION_CAPTURE_LINE_BUFFER_SIZE  ( 15 + SESSION_CAPTURE_MAX_RECORD_LEN * 2 + 2 + 1 )
+
+  void SessionCapture_FormatRecordLine ( const uint8_t * record, uint32_t recordLen, char * line );
+
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    void SessionCapture_SetStreaming ( bool enable );
+    bool SessionCapture_IsStreaming ( void );
+
+    // The diagnostic port calls this routine in order to send the newly captured records.
+    void SessionCapture_ServiceStream ( void );
+  #endif
+
+#else
+
+  inline bool SessionCapture_IsActive ( void ) { return false; }
+
+  inline void SessionCapture_RecordData ( SessionCaptureRecordTypeEnum, const uint8_t *, uint32_t ) {}
+
+#endif
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,326 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "SwdDap.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stdexcept>
+
+#include <BareMetalSupport/IoUtils.h>
+
+#include "JtagPins.h"
+#include "DapRegisters.h"
+#include "BusPirateOpenOcdMode.h"
+
+
+#define SWCLK_PIO  JTAG_TCK_PIO
+#define SWCLK_PIN  JTAG_TCK_PIN
+#define SWDIO_PIO  JTAG_TMS_PIO
+#define SWDIO_PIN  JTAG_TMS_PIN
+
+// The ACK bits are sent LSB first.
+#define SWD_ACK_OK     0x1
+#define SWD_ACK_WAIT   0x2
+#define SWD_ACK_FAULT  0x4
+
+// The JTAG-to-SWD switch sequence, sent LSB first.
+static const uint16_t JTAG_TO_SWD_SEQUENCE = 0xE79E;
+
+// A line reset needs at least 50 clock cycles with SWDIO high.
+static const unsigned LINE_RESET_CLOCK_COUNT = 56;
+
+static const unsigned MAX_WAIT_RETRY_COUNT = 100;
+static const unsigned MAX_POWER_UP_POLL_COUNT = 100;
+
+static uint32_t s_currentSelect;
+
+
+// The target samples SWDIO on the rising edge of SWCLK. Like in JTAG mode, SWCLK rests high.
+
+static void WriteBit ( const bool bit )
+{
+  assert( GetOutputDataDrivenOnPin( SWCLK_PIO, SWCLK_PIN ) );
+
+  SetOutputDataDrivenOnPinToLow( SWCLK_PIO, SWCLK_PIN );
+  SetOutputDataDrivenOnPin( SWDIO_PIO, SWDIO_PIN, bit );
+  SetOutputDataDrivenOnPinToHigh( SWCLK_PIO, SWCLK_PIN );
+}
+
+
+// The target drives SWDIO after the rising edge, so we sample it while SWCLK is low.
+
+static bool ReadBit ( void )
+{
+  assert( GetOutputDataDrivenOnPin( SWCLK_PIO, SWCLK_PIN ) );
+
+  SetOutputDataDrivenOnPinToLow( SWCLK_PIO, SWCLK_PIN );
+  const bool bit = IsInputPinHigh( SWDIO_PIO, SWDIO_PIN );
+  SetOutputDataDrivenOnPinToHigh( SWCLK_PIO, SWCLK_PIN );
+
+  return bit;
+}
+
+
+static void WriteBits ( const uint32_t data, const unsigned bitCount )
+{
+  for ( unsigned i = 0; i < bitCount; ++i )
+    WriteBit( 0 != ( data & ( 1UL << i ) ) );
+}
+
+
+static uint32_t ReadBits ( const unsigned bitCount )
+{
+  uint32_t data = 0;
+
+  for ( unsigned i = 0; i < bitCount; ++i )
+  {
+    if ( ReadBit() )
+      data |= 1UL << i;
+  }
+
+  return data;
+}
+
+
+// During the turnaround cycle nobody drives SWDIO. We use the default turnaround period of 1 clock cycle.
+
+static void TurnaroundToInput ( void )
+{
+  SetPinOutputEnabled( SWDIO_PIO, SWDIO_PIN, false );
+  ReadBit();
+}
+
+
+static void TurnaroundToOutput ( void )
+{
+  ReadBit();
+  SetPinOutputEnabled( SWDIO_PIO, SWDIO_PIN, true );
+}
+
+
+static bool CalculateParity ( uint32_t data )
+{
+  data ^= data >> 16;
+  data ^= data >> 8;
+  data ^= data >> 4;
+  data ^= data >> 2;
+  data ^= data >> 1;
+
+  return 0 != ( data & 1 );
+}
+
+
+static void ClearStickyErrors ( void );
+
+
+// Performs a single SWD transaction and retries it if the target answers with WAIT.
+// Returns the data read, or 0 for writes. AP reads are posted, so the data is then
+// the result of the previous AP read.
+
+static uint32_t Transfer ( const bool isAp,
+                           const bool isRead,
+                           const uint8_t regAddr,
+                           const uint32_t dataToWrite )
+{
+  assert( ( regAddr & ~0xC ) == 0 );
+  assert( IsPinOutputEnabled( SWDIO_PIO, SWDIO_PIN ) );
+
+  // Start, APnDP, RnW, A[2:3], parity, stop, park.
+  const uint32_t requestBits = ( isAp   ? 1 : 0 ) |
+                               ( isRead ? 2 : 0 ) |
+                               ( ( regAddr >> 2 ) << 2 );
+
+  const uint32_t request = 1 |
+                           ( requestBits << 1 ) |
+                           ( ( CalculateParity( requestBits ) ? 1 : 0 ) << 5 ) |
+                           ( 0 << 6 ) |
+                           ( 1 << 7 );
+
+  for ( unsigned retry = 0; retry < MAX_WAIT_RETRY_COUNT; ++retry )
+  {
+    WriteBits( request, 8 );
+
+    TurnaroundToInput();
+
+    const uint32_t ack = ReadBits( 3 );
+
+    if ( ack == SWD_ACK_OK )
+    {
+      uint32_t data = 0;
+
+      if ( isRead )
+      {
+        data = ReadBits( 32 );
+        const bool parity = ReadBit();
+
+        TurnaroundToOutput();
+
+        if ( parity != CalculateParity( data ) )
+          throw std::runtime_error( "SWD read parity error." );
+      }
+      else
+      {
+        TurnaroundToOutput();
+
+        WriteBits( dataToWrite, 32 );
+        WriteBit( CalculateParity( dataToWrite ) );
+      }
+
+      // A few idle cycles let the target finish the transaction.
+      WriteBits( 0, 2 );
+
+      return data;
+    }
+
+    // With the default settings (overrun detection disabled), there is no data phase
+    // after a WAIT or FAULT response.
+    TurnaroundToOutput();
+
+    if ( ack == SWD_ACK_WAIT )
+      continue;
+
+    if ( ack == SWD_ACK_FAULT )
+    {
+      ClearStickyErrors();
+      throw std::runtime_error( "SWD FAULT response." );
+    }
+
+    // Nobody answered, or the target lost synchronisation.
+    // A line reset is needed before the next transaction.
+    throw std::runtime_error( "SWD protocol error, no valid ACK." );
+  }
+
+  // Cancel the pending transaction on the target.
+  Transfer( false, false, DP_ABORT, DP_ABORT_DAPABORT );
+
+  throw std::runtime_error( "Too many SWD WAIT responses." );
+}
+
+
+static void ClearStickyErrors ( void )
+{
+  // Writes to the ABORT register are always accepted, even after a FAULT.
+  Transfer( false, false, DP_ABORT, DP_ABORT_STKCMPCLR |
+                                    DP_ABORT_STKERRCLR |
+                                    DP_ABORT_WDERRCLR  |
+                                    DP_ABORT_ORUNERRCLR );
+}
+
+
+void SwdDap_LineReset ( void )
+{
+  SetPinOutputEnabled( SWDIO_PIO, SWDIO_PIN, true );
+
+  for ( unsigned i = 0; i < LINE_RESET_CLOCK_COUNT; ++i )
+    WriteBit( true );
+
+  // At least 2 idle cycles are needed after a line reset.
+  WriteBits( 0, 8 );
+}
+
+
+static void SelectApBank ( const uint8_t apRegAddr )
+{
+  // Always AP number 0.
+  const uint32_t select = apRegAddr & 0xF0;
+
+  if ( select == s_currentSelect )
+    return;
+
+  Transfer( false, false, DP_SELECT, select );
+  s_currentSelect = select;
+}
+
+
+uint32_t SwdDap_ReadReg ( const bool isAp, const uint8_t regAddr )
+{
+  if ( !isAp )
+    return Transfer( false, true, regAddr & 0xC, 0 );
+
+  SelectApBank( regAddr );
+  Transfer( true, true, regAddr & 0xC, 0 );
+  return Transfer( false, true, DP_RDBUFF, 0 );
+}
+
+
+void SwdDap_WriteReg ( const bool isAp, const uint8_t regAddr, const uint32_t data )
+{
+  if ( isAp )
+    SelectApBank( regAddr );
+
+  Transfer( isAp, false, regAddr & 0xC, data );
+}
+
+
+uint32_t SwdDap_Connect ( void )
+{
+  if ( GetJtagPinMode() == MODE_HIZ )
+    throw std::runtime_error( "The JTAG pins are in high-impedance mode." );
+
+  // The target may be in JTAG mode, so send the JTAG-to-SWD sequence surrounded by line resets.
+  SetPinOutputEnabled( SWDIO_PIO, SWDIO_PIN, true );
+
+  for ( unsigned i = 0; i < LINE_RESET_CLOCK_COUNT; ++i )
+    WriteBit( true );
+
+  WriteBits( JTAG_TO_SWD_SEQUENCE, 16 );
+
+  SwdDap_LineReset();
+
+  // Reading the IDCODE is mandatory after a line reset.
+  const uint32_t idCode = Transfer( false, true, DP_IDCODE, 0 );
+
+  ClearStickyErrors();
+
+  // We do not know what the SELECT register contains, so force the next access to write it.
+  s_currentSelect = UINT32_MAX;
+  Transfer( false, false, DP_SELECT, 0 );
+  s_currentSelect = 0;
+
+  Transfer( false, false, DP_CTRL_STAT, DP_CTRL_STAT_CDBGPWRUPREQ | DP_CTRL_STAT_CSYSPWRUPREQ );
+
+  const uint32_t ackMask = DP_CTRL_STAT_CDBGPWRUPACK | DP_CTRL_STAT_CSYSPWRUPACK;
+
+  for ( unsigned i = 0; ; ++i )
+  {
+    if ( ( Transfer( false, true, DP_CTRL_STAT, 0 ) & ackMask ) == ackMask )
+      break;
+
+    if ( i == MAX_POWER_UP_POLL_COUNT )
+      throw std::runtime_error( "The debug port did not power up." );
+  }
+
+  SwdDap_WriteReg( true, AP_CSW, AP_CSW_VALUE );
+
+  return idCode;
+}
+
+
+uint32_t SwdDap_ReadMem32 ( const uint32_t addr )
+{
+  SwdDap_WriteReg( true, AP_TAR, addr );
+  return SwdDap_ReadReg( true, AP_DRW );
+}
+
+
+void SwdDap_WriteMem32 ( const uint32_t addr, const uint32_t data )
+{
+  SwdDap_WriteReg( true, AP_TAR, addr );
+  SwdDap_WriteReg( true, AP_DRW, data );
+
+  // Make sure that the posted write has completed and reported any errors.
+  Transfer( false, true, DP_RDBUFF, 0 );
+}
@@ -0,0 +1,44 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef SWD_DAP_H_INCLUDED
+#define SWD_DAP_H_INCLUDED
+
+#include <stdint.h>
+
+// ARM Serial Wire Debug (SWD) support on the JTAG pins: TCK is SWCLK and TMS is SWDIO.
+// The SWDIO pin switches direction for the target's answers. This module offers the same
+// memory access services as JtagDap.h . All errors throw a std::runtime_error.
+//
+// The JTAG pins must not be in high-impedance mode.
+
+// Switches the target from JTAG to SWD, performs a line reset and reads the IDCODE,
+// which is returned. Then powers up the debug domain and prepares MEM-AP 0.
+uint32_t SwdDap_Connect ( void );
+
+void SwdDap_LineReset ( void );
+
+// The register address is A[3:2] in bits 3 and 2, like in the ARM documentation.
+// AP register reads are posted, but these routines return the real value.
+uint32_t SwdDap_ReadReg  ( bool isAp, uint8_t regAddr );
+void     SwdDap_WriteReg ( bool isAp, uint8_t regAddr, uint32_t data );
+
+uint32_t SwdDap_ReadMem32  ( uint32_t addr );
+void     SwdDap_WriteMem32 ( uint32_t addr, uint32_t data );
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,268 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// SWD mode is a JtagDue extension, the Bus Pirate does not have it. You enter it from the
+// binary mode with SWD_MODE_CHAR, and you go back with BIN_MODE_CHAR, like in OpenOCD mode.
+//
+// All numbers are sent in big endian. Every reply starts with the command code and a status byte
+// (0 = success, 1 = error). The error message, if any, goes to the serial port console.
+//
+//  Command            Request data                     Reply data after the status byte
+//  SWD_CMD_CONNECT    -                                IDCODE (4 bytes)
+//  SWD_CMD_LINE_RESET -                                -
+//  SWD_CMD_READ_REG   APnDP (1 byte), address (1 byte) value (4 bytes)
+//  SWD_CMD_WRITE_REG  APnDP, address, value (4 bytes)  -
+//  SWD_CMD_READ_MEM   address (4 bytes)                value (4 bytes)
+//  SWD_CMD_WRITE_MEM  address, value (4 bytes each)    -
+//
+// The AP register address includes the bank number in its upper 4 bits, and AP 0 is always used.
+
+#include "SwdMode.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stdexcept>
+
+#include <BareMetalSupport/SerialPrint.h>
+#include <BareMetalSupport/AssertionUtils.h>
+
+#include "BusPirateConnection.h"
+#include "BusPirateBinaryMode.h"
+#include "BusPirateOpenOcdMode.h"
+#include "SwdDap.h"
+#include "Globals.h"
+#include "WorkBudget.h"
+#include "Profiler.h"
+#include "ProtocolStats.h"
+
+
+#define SWD_CMD_CONNECT     0x01
+#define SWD_CMD_LINE_RESET  0x02
+#define SWD_CMD_READ_REG    0x03
+#define SWD_CMD_WRITE_REG   0x04
+#define SWD_CMD_READ_MEM    0x05
+#define SWD_CMD_WRITE_MEM   0x06
+
+#define SWD_CMD_CODE_LEN    1
+#define SWD_REPLY_HDR_LEN   2
+#define MAX_SWD_CMD_LEN     ( SWD_CMD_CODE_LEN + 8 )
+
+
+#ifndef NDEBUG
+  static bool s_wasInitialised = false;
+#endif
+
+
+static void SendSwdModeWelcome ( CUsbTxBuffer * const txBuffer )
+{
+  UsbPrintStr( txBuffer, "SWD1" );
+}
+
+
+static uint32_t GetUint32 ( const uint8_t * const data )
+{
+  return ( uint32_t( data[0] ) << 24 ) |
+         ( uint32_t( data[1] ) << 16 ) |
+         ( uint32_t( data[2] ) <<  8 ) |
+           uint32_t( data[3] );
+}
+
+
+static void WriteUint32 ( CUsbTxBuffer * const txBuffer, const uint32_t val )
+{
+  txBuffer->WriteElem( uint8_t( val >> 24 ) );
+  txBuffer->WriteElem( uint8_t( val >> 16 ) );
+  txBuffer->WriteElem( uint8_t( val >>  8 ) );
+  txBuffer->WriteElem( uint8_t( val       ) );
+}
+
+
+static bool ProcessReceivedData ( CUsbRxBuffer * const rxBuffer,
+                                  CUsbTxBuffer * const txBuffer )
+{
+  PROFILE_ZONE( pzSwdProcessReceivedData );
+
+  if ( rxBuffer->IsEmpty() )
+    return false;
+
+  const uint8_t cmdCode = *rxBuffer->PeekElement();
+
+  switch ( cmdCode )
+  {
+  case BIN_MODE_CHAR:
+    if ( txBuffer->IsEmpty() )
+    {
+      rxBuffer->ConsumeReadElements( SWD_CMD_CODE_LEN );
+      ChangeBusPirateMode( bpBinMode, txBuffer );
+    }
+    else
+    {
+      ProtocolStats_CountStall( psrTxNotEmptyForModeChange );
+    }
+    return false;
+
+  case SWD_MODE_CHAR:
+    // We are already in SWD mode, just print the welcome message again.
+    if ( !txBuffer->IsEmpty() )
+    {
+      ProtocolStats_CountStall( psrTxNotEmptyForModeChange );
+      return false;
+    }
+
+    rxBuffer->ConsumeReadElements( SWD_CMD_CODE_LEN );
+    SendSwdModeWelcome( txBuffer );
+    return true;
+
+  default:
+    break;
+  }
+
+  uint32_t cmdLen;
+  uint32_t replyDataLen;
+
+  switch ( cmdCode )
+  {
+  case SWD_CMD_CONNECT:     cmdLen = 0; replyDataLen = 4; break;
+  case SWD_CMD_LINE_RESET:  cmdLen = 0; replyDataLen = 0; break;
+  case SWD_CMD_READ_REG:    cmdLen = 2; replyDataLen = 4; break;
+  case SWD_CMD_WRITE_REG:   cmdLen = 6; replyDataLen = 0; break;
+  case SWD_CMD_READ_MEM:    cmdLen = 4; replyDataLen = 4; break;
+  case SWD_CMD_WRITE_MEM:   cmdLen = 8; replyDataLen = 0; break;
+
+  default:
+    throw std::runtime_error( "Unknown SWD mode command." );
+  }
+
+  cmdLen += SWD_CMD_CODE_LEN;
+  assert( cmdLen <= MAX_SWD_CMD_LEN );
+
+  if ( rxBuffer->GetElemCount() < cmdLen )
+  {
+    ProtocolStats_CountStall( psrIncompleteCommand );
+    return false;
+  }
+
+  if ( txBuffer->GetFreeCount() < SWD_REPLY_HDR_LEN + replyDataLen )
+  {
+    ProtocolStats_CountStall( psrTxBufferFull );
+    return false;
+  }
+
+  ++g_protocolStats.swdCommandCount;
+
+  uint8_t cmdData[ MAX_SWD_CMD_LEN ];
+  rxBuffer->PeekMultipleElements( cmdLen, cmdData );
+  rxBuffer->ConsumeReadElements( cmdLen );
+
+  const uint8_t * const params = &cmdData[ SWD_CMD_CODE_LEN ];
+
+  uint8_t  status = 0;
+  uint32_t replyData = 0;
+
+  // Errors talking to the target are reported to the host, they do not reset the connection.
+  try
+  {
+    switch ( cmdCode )
+    {
+    case SWD_CMD_CONNECT:
+      replyData = SwdDap_Connect();
+      break;
+
+    case SWD_CMD_LINE_RESET:
+      SwdDap_LineReset();
+      break;
+
+    case SWD_CMD_READ_REG:
+      replyData = SwdDap_ReadReg( params[0] != 0, params[1] );
+      break;
+
+    case SWD_CMD_WRITE_REG:
+      SwdDap_WriteReg( params[0] != 0, params[1], GetUint32( &params[2] ) );
+      break;
+
+    case SWD_CMD_READ_MEM:
+      replyData = SwdDap_ReadMem32( GetUint32( &params[0] ) );
+      break;
+
+    case SWD_CMD_WRITE_MEM:
+      SwdDap_WriteMem32( GetUint32( &params[0] ), GetUint32( &params[4] ) );
+      break;
+
+    default:
+      assert( false );
+      break;
+    }
+  }
+  catch ( const std::exception & e )
+  {
+    SerialPrintf( "Error in SWD mode command 0x%02X: %s" EOL, cmdCode, e.what() );
+    status = 1;
+    replyData = 0;
+  }
+
+  txBuffer->WriteElem( cmdCode );
+  txBuffer->WriteElem( status );
+
+  if ( replyDataLen != 0 )
+  {
+    assert( replyDataLen == 4 );
+    WriteUint32( txBuffer, replyData );
+  }
+
+  return true;
+}
+
+
+void SwdMode_ProcessData ( CUsbRxBuffer * const rxBuffer, CUsbTxBuffer * const txBuffer )
+{
+  assert( s_wasInitialised );
+
+  // In order to prevent starving the main loop, we stop when this pass' work budget is spent,
+  // like in OpenOCD mode.
+
+  for ( ; ; )
+  {
+    if ( !ProcessReceivedData( rxBuffer, txBuffer ) || WorkBudget_IsSpent() )
+      break;
+  }
+}
+
+
+void SwdMode_Init ( CUsbTxBuffer * const txBuffer )
+{
+  assert( !s_wasInitialised );
+
+  #ifndef NDEBUG
+    s_wasInitialised = true;
+  #endif
+
+  // SWD needs the SWCLK and SWDIO pins driven.
+  SetJtagPinMode( MODE_JTAG );
+
+  // There is an error-handling path that might get us here with a non-empty Tx Buffer.
+  SendSwdModeWelcome( txBuffer );
+}
+
+
+void SwdMode_Terminate ( void )
+{
+  assert( s_wasInitialised );
+
+  InitJtagPins();
+
+  #ifndef NDEBUG
+   s_wasInitialised = false;
+  #endif
+}
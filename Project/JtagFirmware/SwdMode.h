@@ -0,0 +1,29 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef SWD_MODE_H_INCLUDED
+#define SWD_MODE_H_INCLUDED
+
+#include "UsbBuffers.h"
+
+void SwdMode_Init ( CUsbTxBuffer * txBuffer );
+void SwdMode_Terminate ( void );
+
+void SwdMode_ProcessData ( CUsbRxBuffer * rxBuffer, CUsbTxBuffer * txBuffer );
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,150 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+#include "TckTiming.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+
+#include <BareMetalSupport/Miscellaneous.h>
+
+
+static const uint32_t EDGES_PER_BIT  = 2;
+static const uint32_t EDGES_PER_BYTE = 8 * EDGES_PER_BIT;
+
+
+static TckTimingMetricEnum ClassifySample ( const uint32_t edgeIndex )
+{
+  const uint32_t edgeInByte = edgeIndex % EDGES_PER_BYTE;
+
+  if ( edgeInByte % EDGES_PER_BIT == 0 )
+    return ttmLowTime;
+
+  return edgeInByte == EDGES_PER_BYTE - 1 ? ttmByteGap : ttmHighTime;
+}
+
+
+static void AccumulateSample ( TckTimingMetric * const metric, const uint32_t sample )
+{
+  ++metric->sampleCount;
+  metric->totalCycleCount += sample;
+  metric->minCycleCount = MinFrom( metric->minCycleCount, sample );
+  metric->maxCycleCount = MaxFrom( metric->maxCycleCount, sample );
+}
+
+
+static void AddSampleToHistogram ( TckTimingMetric * const metric, const uint32_t sample )
+{
+  const uint32_t binIndex = ( sample - metric->minCycleCount ) / TCK_TIMING_BIN_WIDTH;
+
+  ++metric->binCounts[ MinFrom( binIndex, uint32_t( TCK_TIMING_BIN_COUNT - 1 ) ) ];
+}
+
+
+// The histograms are relative to the minimum, so the analysis needs two passes.
+
+void TckTiming_Analyse ( const uint32_t * const edgeCycleCounts,
+                         const uint32_t edgeCount,
+                         TckTimingMetric metrics[ TCK_TIMING_METRIC_COUNT ] )
+{
+  memset( metrics, 0, sizeof( TckTimingMetric ) * TCK_TIMING_METRIC_COUNT );
+
+  for ( unsigned m = 0; m < TCK_TIMING_METRIC_COUNT; ++m )
+    metrics[ m ].minCycleCount = UINT32_MAX;
+
+  for ( unsigned pass = 0; pass < 2; ++pass )
+  {
+    void (* const addSample )( TckTimingMetric *, uint32_t ) = pass == 0 ? AccumulateSample : AddSampleToHistogram;
+
+    for ( uint32_t i = 0; i + 1 < edgeCount; ++i )
+    {
+      // The unsigned subtraction takes care of the cycle counter wrapping around.
+      const uint32_t sample = edgeCycleCounts[ i + 1 ] - edgeCycleCounts[ i ];
+      const TckTimingMetricEnum metric = ClassifySample( i );
+
+      addSample( &metrics[ metric ], sample );
+
+      // The period goes from a falling edge to the next one inside the same byte.
+      if ( metric == ttmLowTime &&
+           i % EDGES_PER_BYTE < EDGES_PER_BYTE - EDGES_PER_BIT &&
+           i + 2 < edgeCount )
+      {
+        addSample( &metrics[ ttmPeriod ], edgeCycleCounts[ i + 2 ] - edgeCycleCounts[ i ] );
+      }
+    }
+  }
+
+  for ( unsigned m = 0; m < TCK_TIMING_METRIC_COUNT; ++m )
+  {
+    if ( metrics[ m ].sampleCount == 0 )
+      metrics[ m ].minCycleCount = 0;
+  }
+}
+
+
+const char * TckTiming_GetMetricName ( const TckTimingMetricEnum metric )
+{
+  switch ( metric )
+  {
+  case ttmLowTime:  return "TCK low";
+  case ttmHighTime: return "TCK high";
+  case ttmPeriod:   return "TCK period";
+  case ttmByteGap:  return "Byte gap";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+#ifdef ENABLE_TCK_TIMING
+
+uint32_t g_tckTimingEdgeCycleCounts[ TCK_TIMING_MAX_EDGE_COUNT ];
+uint32_t g_tckTimingEdgeCount = 0;
+uint32_t g_tckTimingEdgeLimit = 0;
+
+
+void TckTiming_Measure ( const JtagShiftKernelEnum kernel, TckTimingMetric metrics[ TCK_TIMING_METRIC_COUNT ] )
+{
+  const uint32_t BYTE_COUNT = TCK_TIMING_MAX_EDGE_COUNT / EDGES_PER_BYTE;
+
+  // The data pattern does not affect the timing much, but use a varying one anyway,
+  // so that the TDI and TMS pins toggle like in a real transfer.
+  uint8_t tdiTms[ BYTE_COUNT * 2 ];
+  uint8_t tdo   [ BYTE_COUNT ];
+
+  for ( uint32_t i = 0; i < BYTE_COUNT * 2; ++i )
+    tdiTms[ i ] = uint8_t( i * 37 + 11 );
+
+  { // Scope for interrupts disabled. Otherwise, the interrupt handlers would show up as jitter.
+    CAutoDisableInterrupts autoDisableInterrupts;
+
+    g_tckTimingEdgeCount = 0;
+    g_tckTimingEdgeLimit = TCK_TIMING_MAX_EDGE_COUNT;
+
+    RunJtagShiftKernel( kernel, tdiTms, tdo, BYTE_COUNT );
+
+    g_tckTimingEdgeLimit = 0;
+  }
+
+  assert( g_tckTimingEdgeCount == TCK_TIMING_MAX_EDGE_COUNT );
+
+  TckTiming_Analyse( g_tckTimingEdgeCycleCounts, g_tckTimingEdgeCount, metrics );
+}
+
+#endif  // #ifdef ENABLE_TCK_TIMING
@@ -0,0 +1,105 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef TCK_TIMING_H_INCLUDED
+#define TCK_TIMING_H_INCLUDED
+
+#include <stdint.h>
+
+// This module measures the TCK waveform that the JTAG shift kernels generate, without an oscilloscope,
+// see console command "TckTiming". It is only available if ENABLE_TCK_TIMING is defined,
+// see --enable-tck-timing in configure.ac .
+//
+// The shift kernels call TckTiming_RecordEdge() right after each TCK edge. While a measurement is running,
+// that routine stores a DWT cycle counter snapshot in a RAM buffer, and the snapshots get analysed afterwards.
+// Taking a snapshot costs a few cycles, so the measured waveform is slightly slower than the one
+// generated by a build without ENABLE_TCK_TIMING. The figures are meant to catch regressions
+// between builds with the same settings.
+//
+// TckTiming_Analyse() does not access any hardware, so that it can also run in a host build
+// against a mocked PIO and cycle counter.
+
+enum TckTimingMetricEnum
+{
+  ttmLowTime = 0,  // From a falling edge to the next rising edge.
+  ttmHighTime,     // From a rising edge to the next falling edge inside the same byte.
+  ttmPeriod,       // From a falling edge to the next falling edge inside the same byte.
+  ttmByteGap,      // From the last rising edge of a byte to the first falling edge of the next byte.
+
+  TCK_TIMING_METRIC_COUNT
+};
+
+// The histograms show the jitter: bin 0 counts the samples less than TCK_TIMING_BIN_WIDTH cycles
+// above the minimum, bin 1 the next TCK_TIMING_BIN_WIDTH cycles, and so on.
+// The last bin counts all longer samples.
+#define TCK_TIMING_BIN_COUNT  16
+#define TCK_TIMING_BIN_WIDTH  2
+
+struct TckTimingMetric
+{
+  uint32_t sampleCount;
+  uint32_t minCycleCount;
+  uint32_t maxCycleCount;
+  uint64_t totalCycleCount;
+  uint32_t binCounts[ TCK_TIMING_BIN_COUNT ];
+};
+
+// The edges are expected in the order the shift kernels generate them: for each bit,
+// first the falling edge and then the rising edge, LSB first, 8 bits per byte.
+void TckTiming_Analyse ( const uint32_t * edgeCycleCounts,
+                         uint32_t edgeCount,
+                         TckTimingMetric metrics[ TCK_TIMING_METRIC_COUNT ] );
+
+const char * TckTiming_GetMetricName ( TckTimingMetricEnum metric );
+
+
+#ifdef ENABLE_TCK_TIMING
+
+  #include <BareMetalSupport/DwtUtils.h>
+
+  #include "BusPirateOpenOcdMode.h"
+
+  // 64 bytes worth of edges.
+  #define TCK_TIMING_MAX_EDGE_COUNT  ( 64 * 8 * 2 )
+
+  extern uint32_t g_tckTimingEdgeCycleCounts[ TCK_TIMING_MAX_EDGE_COUNT ];
+  extern uint32_t g_tckTimingEdgeCount;
+  extern uint32_t g_tckTimingEdgeLimit;  // 0 when no measurement is running.
+
+  inline void TckTiming_RecordEdge ( void )
+  {
+    if ( g_tckTimingEdgeCount < g_tckTimingEdgeLimit )
+    {
+      g_tckTimingEdgeCycleCounts[ g_tckTimingEdgeCount ] = GetDwtCycleCount();
+      ++g_tckTimingEdgeCount;
+    }
+  }
+
+  // Runs the given shift kernel over some test data with interrupts disabled,
+  // and analyses the TCK edges. The JTAG pins must already be configured.
+  // WARNING: Do NOT connect any JTAG device, as the test data is shifted into it.
+  void TckTiming_Measure ( JtagShiftKernelEnum kernel, TckTimingMetric metrics[ TCK_TIMING_METRIC_COUNT ] );
+
+#else
+
+  inline void TckTiming_RecordEdge ( void ) {}
+
+#endif
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,163 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+#include "TraceRing.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <BareMetalSupport/DwtUtils.h>
+#include <BareMetalSupport/Miscellaneous.h>
+#include <BareMetalSupport/AssertionUtils.h>
+
+
+static TraceRecord s_records[ TRACE_RING_RECORD_COUNT ];
+
+static uint32_t s_writeCount = 0;  // Free running, it is allowed to wrap around.
+static volatile bool s_isEnabled = true;
+
+
+struct EventInfo
+{
+  TraceEventEnum eventId;
+  const char * name;
+  const char * arg1Name;  // An empty name means that the argument is not used.
+  const char * arg2Name;
+};
+
+static const EventInfo s_eventInfo[] =
+{
+  { teUsbResume,           "UsbResume",           "",          ""           },
+  { teUsbSuspend,          "UsbSuspend",          "",          ""           },
+  { teCdcEnable,           "CdcEnable",           "port",      ""           },
+  { teCdcDisable,          "CdcDisable",          "port",      ""           },
+  { teCdcSetDtr,           "CdcSetDtr",           "port",      "enable"     },
+  { teVendorEnable,        "VendorEnable",        "",          ""           },
+  { teVendorDisable,       "VendorDisable",       "",          ""           },
+  { teUsbConnectionOpened, "UsbConnectionOpened", "channel",   ""           },
+  { teUsbConnectionLost,   "UsbConnectionLost",   "",          ""           },
+  { teUsbDataReceived,     "UsbDataReceived",     "byteCount", "firstBytes" },
+  { teUsbDataSent,         "UsbDataSent",         "byteCount", "firstBytes" },
+  { teJtagShiftBegin,      "JtagShiftBegin",      "bitCount",  ""           },
+  { teJtagShiftEnd,        "JtagShiftEnd",        "",          ""           },
+  { teJtagShiftBits,       "JtagShiftBits",       "tms8tdi8",  "tdo8"       },
+};
+
+
+static const EventInfo * GetEventInfo ( const uint32_t eventId )
+{
+  STATIC_ASSERT( sizeof( s_eventInfo ) / sizeof( s_eventInfo[0] ) == TRACE_EVENT_COUNT - 1, "Event table mismatch." );
+
+  if ( eventId < 1 || eventId >= TRACE_EVENT_COUNT )
+    return NULL;
+
+  const EventInfo * const info = &s_eventInfo[ eventId - 1 ];
+  assert( uint32_t( info->eventId ) == eventId );
+
+  return info;
+}
+
+
+void TraceRing_Record ( const TraceEventEnum eventId, const uint32_t arg1, const uint32_t arg2 ) throw()
+{
+  STATIC_ASSERT( ( TRACE_RING_RECORD_COUNT & ( TRACE_RING_RECORD_COUNT - 1 ) ) == 0, "The record count must be a power of two." );
+
+  if ( !s_isEnabled )
+    return;
+
+  CAutoDisableInterrupts autoDisableInterrupts;
+
+  TraceRecord * const record = &s_records[ s_writeCount & ( TRACE_RING_RECORD_COUNT - 1 ) ];
+
+  record->cycleCount = GetDwtCycleCount();
+  record->eventId    = eventId;
+  record->arg1       = arg1;
+  record->arg2       = arg2;
+
+  ++s_writeCount;
+}
+
+
+uint32_t TraceRing_PackData ( const uint8_t * const data, const uint32_t dataLen ) throw()
+{
+  uint32_t packed = 0;
+
+  for ( uint32_t i = 0; i < 4; ++i )
+  {
+    packed <<= 8;
+
+    if ( i < dataLen )
+      packed |= data[ i ];
+  }
+
+  return packed;
+}
+
+
+bool TraceRing_SetEnabled ( const bool enable )
+{
+  const bool prevState = s_isEnabled;
+  s_isEnabled = enable;
+  return prevState;
+}
+
+
+void TraceRing_Clear ( void )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+  s_writeCount = 0;
+}
+
+
+uint32_t TraceRing_GetRecordCount ( void )
+{
+  return MinFrom( s_writeCount, uint32_t( TRACE_RING_RECORD_COUNT ) );
+}
+
+
+uint32_t TraceRing_GetOverwrittenCount ( void )
+{
+  return s_writeCount - TraceRing_GetRecordCount();
+}
+
+
+void TraceRing_GetRecord ( const uint32_t index, TraceRecord * const record )
+{
+  assert( index < TraceRing_GetRecordCount() );
+
+  CAutoDisableInterrupts autoDisableInterrupts;
+
+  const uint32_t oldestIndex = s_writeCount - TraceRing_GetRecordCount();
+
+  *record = s_records[ ( oldestIndex + index ) & ( TRACE_RING_RECORD_COUNT - 1 ) ];
+}
+
+
+const char * TraceRing_GetEventName ( const uint32_t eventId )
+{
+  const EventInfo * const info = GetEventInfo( eventId );
+  return info == NULL ? "<unknown>" : info->name;
+}
+
+
+void TraceRing_GetEventArgNames ( const uint32_t eventId, const char ** const arg1Name, const char ** const arg2Name )
+{
+  const EventInfo * const info = GetEventInfo( eventId );
+
+  *arg1Name = info == NULL ? "" : info->arg1Name;
+  *arg2Name = info == NULL ? "" : info->arg2Name;
+}
@@ -0,0 +1,104 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef TRACE_RING_H_INCLUDED
+#define TRACE_RING_H_INCLUDED
+
+#include <stdint.h>
+
+// The trace ring is a small flight recorder in RAM. Each record holds a DWT cycle count timestamp,
+// an event ID and 2 arguments. Recording an event takes just a few dozen clock cycles and never
+// prints anything, so tracing can stay enabled in release builds and under full load.
+// When the ring is full, the oldest records get overwritten.
+//
+// Console command "Trace" dumps the records as text, and script JtagTroubleshooting/DecodeTraceDump.sh
+// turns the dump into readable text on the host. The dump describes the events itself,
+// so the script does not need to know them in advance.
+//
+// The timestamps wrap around every 51 seconds at 84 MHz, so the time between 2 consecutive records
+// is only right if it is shorter than that.
+
+#define TRACE_RING_RECORD_COUNT  256  // Must be a power of two. Each record takes 16 bytes.
+
+enum TraceEventEnum
+{
+  teUsbResume = 1,
+  teUsbSuspend,
+  teCdcEnable,
+  teCdcDisable,
+  teCdcSetDtr,
+  teVendorEnable,
+  teVendorDisable,
+  teUsbConnectionOpened,
+  teUsbConnectionLost,
+  teUsbDataReceived,
+  teUsbDataSent,
+  teJtagShiftBegin,
+  teJtagShiftEnd,
+  teJtagShiftBits,
+
+  TRACE_EVENT_COUNT
+};
+
+struct TraceRecord
+{
+  uint32_t cycleCount;
+  uint32_t eventId;
+  uint32_t arg1;
+  uint32_t arg2;
+};
+
+// This routine can be called in interrupt context.
+void TraceRing_Record ( TraceEventEnum eventId, uint32_t arg1, uint32_t arg2 ) throw();
+
+// Packs the first bytes of a data block into a trace argument, the first byte in the most significant position.
+uint32_t TraceRing_PackData ( const uint8_t * data, uint32_t dataLen ) throw();
+
+// Returns the previous state. Disable tracing while dumping the records, so that the events
+// generated by the dump itself, like sending the text over USB, do not overwrite them.
+bool TraceRing_SetEnabled ( bool enable );
+
+// Disables tracing for the lifetime of the object, and then restores the previous state,
+// even if an exception is thrown in the meantime.
+class CAutoDisableTraceRing
+{
+  const bool m_wasEnabled;
+public:
+
+  CAutoDisableTraceRing ( void )
+    : m_wasEnabled( TraceRing_SetEnabled( false ) )
+  {
+  }
+
+  ~CAutoDisableTraceRing ()
+  {
+    TraceRing_SetEnabled( m_wasEnabled );
+  }
+};
+
+void TraceRing_Clear ( void );
+
+uint32_t TraceRing_GetRecordCount ( void );
+uint32_t TraceRing_GetOverwrittenCount ( void );
+void TraceRing_GetRecord ( uint32_t index, TraceRecord * record );  // Index 0 is the oldest record.
+
+const char * TraceRing_GetEventName ( uint32_t eventId );
+void TraceRing_GetEventArgNames ( uint32_t eventId, const char ** arg1Name, const char ** arg2Name );
+
+
+#endif  // Include this header file only once.
@@ -19,11 +19,34 @@
 #include <stdio.h>
 #include <stdexcept>
 
+#include <BareMetalSupport/Uptime.h>
+#include <BareMetalSupport/Miscellaneous.h>
+
 #include "Globals.h"
 
 
-static void SendData ( CUsbTxBuffer * const txBuffer, const uint8_t * data, const size_t dataLen )
+static UsbTxDrainRoutine s_drainRoutine = NULL;
+
+// How long a single console print may take in total when the Tx Buffer is full and we have
+// to wait for the USB host to read some data. The time counts from the beginning of the print,
+// and must stay well below the main loop's busy time limit, see the assert about
+// WATCHDOG_PERIOD_MS in Main.cpp .
+static const uint16_t DRAIN_TIMEOUT_MS = WATCHDOG_PERIOD_MS / 5;
+
+
+void SetUsbTxDrainRoutine ( const UsbTxDrainRoutine drainRoutine )
+{
+  s_drainRoutine = drainRoutine;
+}
+
+
+static void SendData ( CUsbTxBuffer * const txBuffer,
+                       const uint8_t * data,
+                       const size_t dataLen,
+                       const uint64_t printStartTime )
 {
+  STATIC_ASSERT( DRAIN_TIMEOUT_MS < WATCHDOG_PERIOD_MS / 3, "The drain time-out is too close to the watchdog period." );
+
   if ( dataLen == 0 )
   {
     // This could happen, but is unusual.
@@ -31,26 +54,43 @@ static void SendData ( CUsbTxBuffer * const txBuffer, const uint8_t * data, cons
     return;
   }
 
-  if ( dataLen > txBuffer->GetFreeCount() )
-  {
-    // The caller should always make sure that there is enough space in the Tx Buffer
-    // before calling this routine. Otherwise, all or part of the outgoing text
-    // will be dropped, and the user may get no hint whatsoever about what just happened.
-    //
-    // However, there are some situations where this is hard to implement, or where
-    // the risk of data loss is acceptable for performance reasons.
-    //
-    // I have left an assert in place because data truncation should be rare and
-    // you should strive to avoid it.
-    //
-    // Remember that, with the current implementation, data does not just get truncated
-    // at this point, but the whole connection gets reset.
-    assert( false );
+  size_t remainingLen = dataLen;
 
-    throw std::runtime_error( "Tx Buffer overflow." );
+  for ( ; ; )
+  {
+    const size_t writeCount = MinFrom( remainingLen, size_t( txBuffer->GetFreeCount() ) );
+
+    if ( writeCount != 0 )
+    {
+      txBuffer->WriteElemArray( data, writeCount );
+      data         += writeCount;
+      remainingLen -= writeCount;
+
+      if ( remainingLen == 0 )
+        break;
+    }
+
+    if ( s_drainRoutine == NULL )
+    {
+      // The caller should always make sure that there is enough space in the Tx Buffer
+      // before calling this routine. Otherwise, the rest of the outgoing text
+      // will be dropped, and the user may get no hint whatsoever about what just happened.
+      //
+      // I have left an assert in place because data truncation should be rare and
+      // you should strive to avoid it.
+      //
+      // Remember that, with the current implementation, data does not just get truncated
+      // at this point, but the whole connection gets reset.
+      assert( false );
+
+      throw std::runtime_error( "Tx Buffer overflow." );
+    }
+
+    if ( HasUptimeElapsedMs( GetUptime(), printStartTime, DRAIN_TIMEOUT_MS ) )
+      throw std::runtime_error( "Tx Buffer overflow, the USB host is not reading the data fast enough." );
+
+    s_drainRoutine( txBuffer );
   }
-
-  txBuffer->WriteElemArray( data, dataLen );
 }
 
 
@@ -66,6 +106,8 @@ void UsbPrintV ( CUsbTxBuffer * const txBuffer, const char * const formatStr, va
   // in the Tx Buffer. Or maybe there is a variant of vsnprintf() which does not take
   // a buffer to write to, but a call-back routine instead.
 
+  const uint64_t printStartTime = GetUptime();
+
   char buffer[ MAX_USB_PRINT_LEN + 1 ];
 
   const int len = vsnprintf( buffer, MAX_USB_PRINT_LEN + 1, formatStr, argList );
@@ -77,12 +119,12 @@ void UsbPrintV ( CUsbTxBuffer * const txBuffer, const char * const formatStr, va
     // We don't actually need to assert on this, but I just want to be sure I know what happens in this case.
     assert( buffer[ MAX_USB_PRINT_LEN ] == 0 );
 
-    SendData( txBuffer, (const uint8_t *)buffer, MAX_USB_PRINT_LEN );
-    SendData( txBuffer, (const uint8_t *)TRUNCATION_SUFFIX, TRUNCATION_SUFFIX_LEN );
+    SendData( txBuffer, (const uint8_t *)buffer, MAX_USB_PRINT_LEN, printStartTime );
+    SendData( txBuffer, (const uint8_t *)TRUNCATION_SUFFIX, TRUNCATION_SUFFIX_LEN, printStartTime );
   }
   else
   {
-    SendData( txBuffer, (const uint8_t *)buffer, len );
+    SendData( txBuffer, (const uint8_t *)buffer, len, printStartTime );
   }
 }
 
@@ -100,10 +142,10 @@ void UsbPrintf ( CUsbTxBuffer * const txBuffer, const char * formatStr, ... )
 
 void UsbPrintStr ( CUsbTxBuffer * const txBuffer, const char * str )
 {
-  SendData( txBuffer, (const uint8_t *)str, strlen( str ) );
+  SendData( txBuffer, (const uint8_t *)str, strlen( str ), GetUptime() );
 }
 
 void UsbPrintChar ( CUsbTxBuffer * const txBuffer, const char c )
 {
-  SendData( txBuffer, (const uint8_t *)&c, sizeof(c) );
+  SendData( txBuffer, (const uint8_t *)&c, sizeof(c), GetUptime() );
 }
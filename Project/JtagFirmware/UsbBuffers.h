@@ -40,33 +40,55 @@
 // especially when processing binary mode commands. When performance matters, the transmission buffer
 // is mostly filled in place, in order to avoid copying the data around.
 //
-// With the current implementation, the next received command cannot be processed until
-// the transmission buffer has enough room left for its response. This means that, if the previous
-// reponse has not been transmitted yet, processing of the next command may be delayed.
+// Most binary commands are only processed when the transmission buffer has enough room left
+// for their response. The exception is the biggest one, OpenOCD's CMD_TAP_SHIFT, which streams
+// its reply: it shifts as many bits as the data available in the reception buffer and the room
+// left in the transmission buffer allow, and resumes on the next call where it left off.
+//
+// The console printing routines below produce their output incrementally too. If the transmission
+// buffer fills up, they call the drain routine registered with SetUsbTxDrainRoutine(), which sends
+// data to the USB host in order to make room, and then they carry on printing. If a single print
+// spends too long waiting for the host, it throws, in order to keep well clear of the watchdog.
 //
 // Routine BusPirateConnection_ProcessData() gets also called a periodic intervals, so that it can
 // time-out a command whenever necessary.
 //
 // The current circular buffer is a generic implementation that should work on other platforms
 // or environments where data is transmitted perhaps over different interfaces.
-// The Atmel Software Framework library uses its own buffers, probably the same USB hardware buffers
-// that the ATSAM3X8 has. It may be possible to optimise the code to use these hardware buffers directly
-// so that it does not need the extra circular buffers any more. However, such an
-// optimised implementation would probably be tied to the USB buffer architecture of that
-// particular Atmel chip's. I do not have enough experience to tell whether that architecture
-// is also popular across the USB chip industry.
-
-// These buffers can hold the biggest possible command and its reponse, although commands are normally
-// much smaller than the maximum size.
-#define USB_RX_BUFFER_SIZE 4096  // This size matches the buffer size used in OpenOCD's routine buspirate_tap_execute(),
-                                 // but it is probably never used to its maximum capacity.
-#define USB_TX_BUFFER_SIZE 4096  // The Tx Buffer must accomodate the largest possible command reply.
-                                 // The biggest OpenOCD command is CMD_TAP_SHIFT, which needs twice as much
-                                 // Rx Buffer as Tx Buffer. Another source of large data in a single block
-                                 // is the text of the 'help' console command.
-
-typedef CCircularBuffer< uint8_t, uint32_t, USB_TX_BUFFER_SIZE > CUsbTxBuffer;
-typedef CCircularBuffer< uint8_t, uint32_t, USB_RX_BUFFER_SIZE > CUsbRxBuffer;
+// The Atmel Software Framework library uses its own buffers for the CDC interface, so the data gets copied
+// between those buffers and the circular buffers. The optional vendor-specific interface has no such buffers,
+// and module UsbZeroCopy.cpp lets the USB driver transfer its data directly into and out of the circular buffers.
+//
+// It may be possible to parse the CDC data straight from the ASF buffers too, but ASF's udi_cdc.c keeps them
+// private, and its start-of-frame interrupt may send the Tx buffer at any time, so the shift engine
+// could not fill it in place. Such an optimisation would need a modified copy of udi_cdc.c .
+// If you need the extra speed, use the vendor-specific interface instead, see --enable-usb-vendor-interface .
+
+// The build normally sets the buffer size, see --with-usb-buffer-size in configure.ac .
+// Bigger buffers allow longer CMD_TAP_SHIFT commands, see MAX_JTAG_TAP_SHIFT_BIT_COUNT,
+// and let the host queue more commands while the previous replies are being sent.
+#ifndef USB_BUFFER_SIZE
+  #define USB_BUFFER_SIZE 4096
+#endif
+
+#define USB_RX_BUFFER_SIZE USB_BUFFER_SIZE  // The default size matches the buffer size used in OpenOCD's routine
+                                            // buspirate_tap_execute(), but it is probably never used to its maximum capacity.
+#define USB_TX_BUFFER_SIZE USB_BUFFER_SIZE  // CMD_TAP_SHIFT needs twice as much Rx Buffer as Tx Buffer,
+                                            // but the Tx Buffer also holds the console output.
+
+// Both buffers have a mirrored region after their end, see MIRROR_ELEM_COUNT in CircularBuffer.h .
+// This way, the JTAG shift routines always get contiguous TDI/TMS byte pairs and do not need
+// to split their blocks at the wrap-around point. A full USB packet also fits contiguously,
+// so the zero-copy transfers for the vendor interface never need their bounce buffer.
+#define USB_BUFFER_MIRROR_SIZE 512
+
+// The vendor interface only starts receiving when a whole packet fits in the Rx Buffer, see StartRxTransfer()
+// in UsbZeroCopy.cpp . Therefore, a command that must be completely in the Rx Buffer before it can run
+// must leave room for the biggest packet, or its last bytes would never arrive.
+#define USB_RX_PACKET_MARGIN 512
+
+typedef CCircularBuffer< uint8_t, uint32_t, USB_TX_BUFFER_SIZE, USB_BUFFER_MIRROR_SIZE > CUsbTxBuffer;
+typedef CCircularBuffer< uint8_t, uint32_t, USB_RX_BUFFER_SIZE, USB_BUFFER_MIRROR_SIZE > CUsbRxBuffer;
 
 // The maximum print length below determines how much stack space routine UsbPrintf() needs.
 #define MAX_USB_PRINT_LEN 256
@@ -76,5 +98,11 @@ void UsbPrintV ( CUsbTxBuffer * const txBuffer, const char * const formatStr, va
 void UsbPrintChar ( CUsbTxBuffer * txBuffer, const char c );
 void UsbPrintStr ( CUsbTxBuffer * txBuffer, const char * str );
 
+// The drain routine should try to send data out of the Tx Buffer. The printing routines keep calling it
+// while the Tx Buffer is full, and give up with an error if the host does not read any data for too long.
+// If there is no drain routine, printing more text than fits in the Tx Buffer is an error.
+typedef void (* UsbTxDrainRoutine )( CUsbTxBuffer * txBuffer );
+void SetUsbTxDrainRoutine ( UsbTxDrainRoutine drainRoutine );
+
 
 #endif  // Include this header file only once.
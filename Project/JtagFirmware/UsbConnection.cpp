@@ -27,10 +27,18 @@
 #include <BareMetalSupport/SerialPrint.h>
 #include <BareMetalSupport/AssertionUtils.h>
 #include <BareMetalSupport/MainLoopSleep.h>
+#include <BareMetalSupport/DwtUtils.h>
 
 #include "UsbSupport.h"
 #include "Globals.h"
 #include "BusPirateConnection.h"
+#include "UsbZeroCopy.h"
+#include "UsbRxRing.h"
+#include "Profiler.h"
+#include "CommandLatency.h"
+#include "TraceRing.h"
+#include "ProtocolStats.h"
+#include "SessionCapture.h"
 
 #include <udi_cdc.h>
 
@@ -46,33 +54,171 @@ enum ConnectionStatusEnum
 
 static ConnectionStatusEnum s_connectionStatus = csNoConnection;
 
+// With the optional vendor-specific interface, there are 2 channels on the USB port, but only one
+// protocol session at a time. The first channel to open wins, the other one is ignored until
+// the active one closes.
+
+enum UsbChannelEnum
+{
+  ucCdc = 1,
+  ucVendor
+};
+
+static UsbChannelEnum s_activeChannel = ucCdc;
+
+#ifdef ENABLE_USB_VENDOR_INTERFACE
+  static uint32_t s_vendorSessionNumber = 0;
+#endif
+
 static CUsbTxBuffer s_usbTxBuffer;
 static CUsbRxBuffer s_usbRxBuffer;
 
+// The interrupt-driven reception moves the data out of the ASF CDC buffers as soon as it arrives,
+// see UsbRxRing.h . Otherwise, the data is only collected once per main loop iteration.
+// This option has no effect on the vendor interface, which always uses the zero-copy transfers.
+static const bool USE_INTERRUPT_DRIVEN_USB_RX = true;
 
-static void ResetBuffers ( void )
+
+// Reply coalescing: while more commands are waiting in the Rx Buffer, hold the replies back
+// until there is at least a full USB packet's worth of data. Otherwise, a burst of small commands,
+// like OpenOCD's CMD_TAP_SHIFT during a "load", generates a short USB packet per command,
+// and each one costs a wake-up on the host side. The data gets sent straight away when
+// the Rx Buffer runs empty, or when the oldest data has been waiting for longer than
+// the deadline below. The deadline matters when the next command in the Rx Buffer is not complete yet.
+static const bool     ENABLE_REPLY_COALESCING      = true;
+static const uint32_t REPLY_COALESCING_DEADLINE_US = 200;
+
+static bool     s_isReplyCoalescingEnabled = ENABLE_REPLY_COALESCING;
+static bool     s_isTxDataWaiting          = false;
+static uint32_t s_txDataWaitingSince;  // DWT cycle count.
+
+static UsbTxStats s_txStats;
+static volatile uint32_t s_txTransferCount = 0;  // Incremented in interrupt context.
+
+// The session capture records the Tx data when it is first handed over to the USB driver.
+// This is how many bytes at the beginning of the Tx Buffer have already been captured.
+static uint32_t s_txCapturedCount = 0;
+
+
+// The vendor interface has no ASF buffers, so its data goes directly between the USB driver
+// and the circular buffers, see UsbZeroCopy.h .
+
+static bool IsZeroCopyActive ( void )
+{
+  return s_activeChannel == ucVendor;
+}
+
+
+static bool IsChannelOpen ( const UsbChannelEnum channel )
+{
+  switch ( channel )
+  {
+  case ucCdc:
+    return IsUsbConnectionOpen();
+
+  #ifdef ENABLE_USB_VENDOR_INTERFACE
+  case ucVendor:
+    {
+      uint32_t sessionNumber;
+      const bool isOpen = IsUsbVendorChannelOpen( &sessionNumber );
+      return isOpen && sessionNumber == s_vendorSessionNumber;
+    }
+  #endif
+
+  default:
+    assert( false );
+    return false;
+  }
+}
+
+
+// Returns whether any channel has been opened, and if so, makes it the active one.
+
+static bool CheckForNewChannel ( void )
+{
+  if ( IsUsbConnectionOpen() )
+  {
+    s_activeChannel = ucCdc;
+    return true;
+  }
+
+  #ifdef ENABLE_USB_VENDOR_INTERFACE
+    if ( IsUsbVendorChannelOpen( &s_vendorSessionNumber ) )
+    {
+      s_activeChannel = ucVendor;
+      return true;
+    }
+  #endif
+
+  return false;
+}
+
+
+static void DiscardTxData ( void )
 {
   s_usbTxBuffer.Reset();
+  s_txCapturedCount = 0;
+}
+
+
+static void ResetBuffers ( void )
+{
+  DiscardTxData();
   s_usbRxBuffer.Reset();
+  s_isTxDataWaiting = false;
 }
 
 
+static void DrainTxBuffer ( CUsbTxBuffer * txBuffer );
+
+
 static void UsbConnectionEstablished ( void )
 {
-  SerialPrintStr( "Connection opened on the native USB port." EOL );
+  TraceRing_Record( teUsbConnectionOpened, s_activeChannel, 0 );
+
+  const uint8_t channel = uint8_t( s_activeChannel );
+  SessionCapture_RecordData( scrConnectionOpened, &channel, sizeof( channel ) );
+
+  SerialPrintStr( s_activeChannel == ucVendor ? "Connection opened on the native USB port (vendor interface)." EOL
+                                               : "Connection opened on the native USB port." EOL );
 
   // SerialPrint( "Rx buffer size: %u, Tx buffer size: %u" EOL, unsigned(USB_RX_BUFFER_SIZE), unsigned(USB_TX_BUFFER_SIZE) );
 
+  // configure.ac checks the same minimum, see --with-usb-buffer-size . This assert catches
+  // a USB_BUFFER_SIZE passed to the compiler by other means.
+  STATIC_ASSERT( USB_BUFFER_SIZE >= 4096, "The USB buffers must be able to hold OpenOCD's longest commands." );
+
   ResetBuffers();
+
+  if ( IsZeroCopyActive() )
+    UsbZeroCopy_Start();
+  else if ( USE_INTERRUPT_DRIVEN_USB_RX )
+    UsbRxRing_Enable();
+
+  CommandLatency_ConnectionStarted( s_usbRxBuffer.GetElemCount() );
+
+  SetUsbTxDrainRoutine( DrainTxBuffer );
+
   BusPirateConnection_Init( &s_usbTxBuffer );
 }
 
 
 static void UsbConnectionLost ( void )
 {
+  TraceRing_Record( teUsbConnectionLost, 0, 0 );
+  SessionCapture_RecordData( scrConnectionLost, NULL, 0 );
+
   SerialPrintStr( "Connection lost on the native USB port." EOL );
 
   BusPirateConnection_Terminate();
+
+  if ( IsZeroCopyActive() )
+    UsbZeroCopy_Stop();
+  else if ( USE_INTERRUPT_DRIVEN_USB_RX )
+    UsbRxRing_Disable();
+
+  SetUsbTxDrainRoutine( NULL );
+
   ResetBuffers();
 
   // Note that at this point there may still be outgoing data in the USB buffer inside the Atmel Software Framework
@@ -123,7 +269,32 @@ static const uint32_t USB_CONNECTION_STABLE_DELAY = 50;  // In milliseconds.
 static uint64_t s_lastReferenceTimeForUsbOpen = 0;
 
 
-static bool SendData ( void )
+// The session capture splits the data at the wrap-around point, which does not matter,
+// because the records are meant to be concatenated again.
+
+template < typename BufferType >
+static void CaptureBufferData ( const SessionCaptureRecordTypeEnum recordType,
+                                const BufferType * const buffer,
+                                const uint32_t beginOffset,
+                                const uint32_t endOffset )
+{
+  uint32_t offset = beginOffset;
+
+  while ( offset < endOffset )
+  {
+    uint32_t chunkLen;
+    const uint8_t * const chunk = buffer->GetReadPtrAt( offset, &chunkLen );
+
+    chunkLen = MinFrom( chunkLen, endOffset - offset );
+
+    SessionCapture_RecordData( recordType, chunk, chunkLen );
+
+    offset += chunkLen;
+  }
+}
+
+
+static bool SendDataOverCdc ( void )
 {
   bool wasAtLeastOneByteTransferred = false;
 
@@ -146,12 +317,6 @@ static bool SendData ( void )
       break;
     }
 
-    if ( false )
-    {
-      SerialPrintStr( "Data sent:" EOL );
-      SerialPrintHexDump( readPtr, writtenCount, EOL );
-    }
-
     s_usbTxBuffer.ConsumeReadElements( writtenCount );
     wasAtLeastOneByteTransferred = true;
   }
@@ -160,8 +325,63 @@ static bool SendData ( void )
 }
 
 
+static bool SendData ( void )
+{
+  PROFILE_ZONE( pzUsbSendData );
 
-static bool ReceiveData ( void )
+  const uint32_t pendingCountBefore = s_usbTxBuffer.GetElemCount();
+
+  // Some console commands, like the speed tests, reset the Tx Buffer behind our back.
+  s_txCapturedCount = MinFrom( s_txCapturedCount, pendingCountBefore );
+
+  if ( SessionCapture_IsActive() )
+  {
+    CaptureBufferData( scrTxData, &s_usbTxBuffer, s_txCapturedCount, pendingCountBefore );
+    s_txCapturedCount = pendingCountBefore;
+  }
+
+  // The data stays in place after being consumed, so we can look at it afterwards for tracing purposes.
+  uint32_t firstChunkCount;
+  const uint8_t * const firstChunk = s_usbTxBuffer.GetReadPtr( &firstChunkCount );
+
+  const bool wasAtLeastOneByteTransferred = IsZeroCopyActive() ? UsbZeroCopy_SendData( &s_usbTxBuffer )
+                                                               : SendDataOverCdc();
+
+  const uint32_t sentCount = pendingCountBefore - s_usbTxBuffer.GetElemCount();
+
+  s_txCapturedCount -= MinFrom( s_txCapturedCount, sentCount );
+
+  if ( sentCount != 0 )
+  {
+    TraceRing_Record( teUsbDataSent, sentCount, TraceRing_PackData( firstChunk, MinFrom( sentCount, firstChunkCount ) ) );
+    g_protocolStats.usbSentByteCount += sentCount;
+    CommandLatency_DataSent( sentCount );
+  }
+
+  return wasAtLeastOneByteTransferred;
+}
+
+
+// The console printing routines call this when the Tx Buffer is full, see SetUsbTxDrainRoutine().
+
+static void DrainTxBuffer ( CUsbTxBuffer * const txBuffer )
+{
+  assert( txBuffer == &s_usbTxBuffer );
+  UNUSED_IN_RELEASE( txBuffer );
+
+  if ( s_connectionStatus == csLastRxDataAfterConnectionLost )
+  {
+    // Nobody is listening anymore, just drop the data, like ServiceUsbConnectionData() does.
+    DiscardTxData();
+    return;
+  }
+
+  SendData();
+}
+
+
+
+static bool ReceiveDataOverCdc ( void )
 {
   bool wasAtLeastOneByteTransferred = false;
 
@@ -192,32 +412,104 @@ static bool ReceiveData ( void )
       break;
     }
 
+    s_usbRxBuffer.CommitWrittenElements( readCount );
+    wasAtLeastOneByteTransferred = true;
+  }
 
-    // Trace the full data received.
+  return wasAtLeastOneByteTransferred;
+}
 
-    if ( false )
-    {
-      SerialPrintStr( "Data received:" EOL );
-      SerialPrintHexDump( writePtr, readCount, EOL );
-    }
 
+static bool ReceiveData ( void )
+{
+  PROFILE_ZONE( pzUsbReceiveData );
 
-    // Trace only the packet length.
+  const uint32_t elemCountBefore = s_usbRxBuffer.GetElemCount();
 
-    if ( false )
-    {
-      SerialPrintf( "%u" EOL, unsigned( readCount ) );
-    }
+  // Remember where the new data will land, for tracing purposes.
+  uint32_t firstChunkCount;
+  const uint8_t * const firstChunk = s_usbRxBuffer.GetWritePtr( &firstChunkCount );
 
+  bool wasAtLeastOneByteTransferred;
 
-    s_usbRxBuffer.CommitWrittenElements( readCount );
-    wasAtLeastOneByteTransferred = true;
+  if ( IsZeroCopyActive() )
+    wasAtLeastOneByteTransferred = UsbZeroCopy_ReceiveData( &s_usbRxBuffer );
+  else if ( USE_INTERRUPT_DRIVEN_USB_RX )
+    wasAtLeastOneByteTransferred = UsbRxRing_ReceiveData( &s_usbRxBuffer );
+  else
+    wasAtLeastOneByteTransferred = ReceiveDataOverCdc();
+
+  const uint32_t receivedCount = s_usbRxBuffer.GetElemCount() - elemCountBefore;
+
+  if ( receivedCount != 0 )
+  {
+    if ( SessionCapture_IsActive() )
+      CaptureBufferData( scrRxData, &s_usbRxBuffer, elemCountBefore, elemCountBefore + receivedCount );
+
+    TraceRing_Record( teUsbDataReceived, receivedCount, TraceRing_PackData( firstChunk, MinFrom( receivedCount, firstChunkCount ) ) );
+    g_protocolStats.usbReceivedByteCount += receivedCount;
+    CommandLatency_DataReceived( receivedCount );
   }
 
   return wasAtLeastOneByteTransferred;
 }
 
 
+static bool ShouldFlushTxData ( void )
+{
+  const uint32_t pendingCount = s_usbTxBuffer.GetElemCount();
+
+  if ( pendingCount == 0 )
+  {
+    s_isTxDataWaiting = false;
+    return false;
+  }
+
+  if ( !s_isReplyCoalescingEnabled ||
+       s_usbRxBuffer.IsEmpty()     ||
+       pendingCount >= GetUsbDataPacketSize() )
+  {
+    return true;
+  }
+
+  const uint32_t currentCycleCount = GetDwtCycleCount();
+
+  if ( !s_isTxDataWaiting )
+  {
+    s_isTxDataWaiting    = true;
+    s_txDataWaitingSince = currentCycleCount;
+  }
+  else if ( DwtCycleCountToUs( currentCycleCount - s_txDataWaitingSince ) >= REPLY_COALESCING_DEADLINE_US )
+  {
+    return true;
+  }
+
+  // Come back soon in order to check the deadline again.
+  WakeFromMainLoopSleep();
+  return false;
+}
+
+
+static bool FlushTxData ( void )
+{
+  const uint32_t pendingCountBefore = s_usbTxBuffer.GetElemCount();
+
+  const bool atLeastOneByteSent = SendData();
+
+  if ( atLeastOneByteSent )
+  {
+    s_isTxDataWaiting = false;
+
+    const uint32_t sentCount = pendingCountBefore - s_usbTxBuffer.GetElemCount();
+
+    ++s_txStats.flushCount;
+    s_txStats.byteCount += sentCount;
+  }
+
+  return atLeastOneByteSent;
+}
+
+
 static void ServiceUsbConnectionData ( const uint64_t currentTime )
 {
   // We could write here a loop in order to process as much data as we can,
@@ -240,14 +532,14 @@ static void ServiceUsbConnectionData ( const uint64_t currentTime )
   if ( s_connectionStatus == csLastRxDataAfterConnectionLost )
   {
     // The connection is not there any more, drop all eventual data to send.
-    s_usbTxBuffer.Reset();
+    DiscardTxData();
 
     // Continue reading until the end of data, when we will declare the connection as lost.
     WakeFromMainLoopSleep();
   }
   else
   {
-    const bool atLeastOneByteSent = SendData();
+    const bool atLeastOneByteSent = ShouldFlushTxData() && FlushTxData();
 
     // If we have sent at least one byte of data, then there is more space available in the tx buffer,
     // which means that perhaps the next command already waiting in the rx buffer could be processed
@@ -287,12 +579,14 @@ static void HandleError ( const char * const errMsg )
 
 void ServiceUsbConnection ( const uint64_t currentTime )
 {
+  PROFILE_ZONE( pzServiceUsbConnection );
+
   try
   {
     switch ( s_connectionStatus )
     {
     case csNoConnection:
-      if ( IsUsbConnectionOpen() )
+      if ( CheckForNewChannel() )
       {
         s_lastReferenceTimeForUsbOpen = currentTime;
         s_connectionStatus = csInitialDelay;
@@ -302,7 +596,7 @@ void ServiceUsbConnection ( const uint64_t currentTime )
       break;
 
     case csInitialDelay:
-      if ( !IsUsbConnectionOpen() )
+      if ( !IsChannelOpen( s_activeChannel ) )
       {
         s_connectionStatus = csNoConnection;
       }
@@ -314,7 +608,7 @@ void ServiceUsbConnection ( const uint64_t currentTime )
       break;
 
     case csStable:
-      if ( !IsUsbConnectionOpen() )
+      if ( !IsChannelOpen( s_activeChannel ) )
       {
         s_connectionStatus = csLastRxDataAfterConnectionLost;
       }
@@ -339,3 +633,51 @@ void ServiceUsbConnection ( const uint64_t currentTime )
     HandleError( "Unexpected C++ exception." );
   }
 }
+
+
+void NoteUsbTxTransferComplete ( void )
+{
+  // There is only one interrupt that calls this routine, so there is no need to disable interrupts.
+  s_txTransferCount = s_txTransferCount + 1;
+}
+
+
+void GetUsbTxStats ( UsbTxStats * const stats )
+{
+  *stats = s_txStats;
+  stats->transferCount = s_txTransferCount;
+}
+
+
+void ResetUsbTxStats ( void )
+{
+  s_txStats.flushCount  = 0;
+  s_txStats.byteCount   = 0;
+  s_txTransferCount     = 0;
+}
+
+
+void SetUsbReplyCoalescing ( const bool enable )
+{
+  s_isReplyCoalescingEnabled = enable;
+}
+
+
+bool IsUsbReplyCoalescingEnabled ( void )
+{
+  return s_isReplyCoalescingEnabled;
+}
+
+
+void GetUsbBufferStats ( CircularBufferStats * const rxStats, CircularBufferStats * const txStats )
+{
+  s_usbRxBuffer.GetStats( rxStats );
+  s_usbTxBuffer.GetStats( txStats );
+}
+
+
+void ResetUsbBufferStats ( void )
+{
+  s_usbRxBuffer.ResetStats();
+  s_usbTxBuffer.ResetStats();
+}
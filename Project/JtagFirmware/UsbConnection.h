@@ -4,6 +4,33 @@
 
 #include <stdint.h>
 
+#include <BareMetalSupport/CircularBufferStats.h>
+
 void ServiceUsbConnection ( uint64_t currentTime );
 
+// These statistics help tune the reply coalescing, see ENABLE_REPLY_COALESCING.
+struct UsbTxStats
+{
+  uint32_t flushCount;     // How many times some data was passed to the USB driver.
+  uint32_t transferCount;  // How many USB transfers the driver has completed, see NoteUsbTxTransferComplete().
+  uint32_t byteCount;
+};
+
+// The USB driver calls this in interrupt context each time it finishes sending a transfer
+// on the native USB port. ASF's CDC interface merges all writes that arrive before the next
+// start-of-frame into one transfer, and at high speed each such transfer is a single USB packet.
+// The vendor-specific interface sends all contiguous data in the Tx Buffer as one transfer,
+// which may need several packets.
+void NoteUsbTxTransferComplete ( void );
+
+void GetUsbTxStats ( UsbTxStats * stats );
+void ResetUsbTxStats ( void );
+
+void SetUsbReplyCoalescing ( bool enable );
+bool IsUsbReplyCoalescingEnabled ( void );
+
+// Occupancy statistics for the native USB port's Rx and Tx Buffers, see ENABLE_CIRCULAR_BUFFER_STATS.
+void GetUsbBufferStats ( CircularBufferStats * rxStats, CircularBufferStats * txStats );
+void ResetUsbBufferStats ( void );
+
 #endif  // Include this header file only once.
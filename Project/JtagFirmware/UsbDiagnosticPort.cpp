@@ -0,0 +1,403 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "UsbDiagnosticPort.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+#include <BareMetalSupport/PowerOfTwoCircularBuffer.h>
+#include <BareMetalSupport/GenericSerialConsole.h>
+#include <BareMetalSupport/SerialPrint.h>
+#include <BareMetalSupport/Miscellaneous.h>
+#include <BareMetalSupport/AssertionUtils.h>
+#include <BareMetalSupport/Uptime.h>
+
+#include <udi_cdc.h>
+
+#include "Globals.h"
+#include "UsbSupport.h"
+#include "UsbConnection.h"
+#include "BusPirateOpenOcdMode.h"
+#include "CommandProcessor.h"
+#include "WorkBudget.h"
+#include "SessionCapture.h"
+
+
+#define USB_DIAG_TX_BUFFER_SIZE 4096
+
+// How long a single print from a console command may wait in total for the USB host
+// to read the previous output. This must stay well below the main loop's busy time limit,
+// see the assert about WATCHDOG_PERIOD_MS in Main.cpp .
+static const uint16_t CMD_OUTPUT_TIMEOUT_MS = WATCHDOG_PERIOD_MS / 5;
+
+// There may be several producers, like the main loop and the interrupt handlers that trace something,
+// so the Tx Buffer is protected by disabling interrupts.
+typedef CPowerOfTwoCircularBuffer< uint8_t, uint32_t, USB_DIAG_TX_BUFFER_SIZE > CUsbDiagTxBuffer;
+
+static CUsbDiagTxBuffer s_txBuffer;
+static uint32_t s_droppedByteCount = 0;
+
+// Only the main loop changes this flag, but the producers look at it too.
+static volatile bool s_isOpen = false;
+
+static uint32_t s_liveStatsPeriodMs = 0;
+static uint64_t s_lastLiveStatsTime = 0;
+static uint32_t s_lastStatsCommandCount;
+static UsbTxStats s_lastStatsUsbTx;
+
+
+bool UsbDiagnosticPort_Write ( const void * const data, const size_t dataLen )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+
+  if ( !s_isOpen )
+    return false;
+
+  if ( dataLen > s_txBuffer.GetFreeCount() )
+  {
+    // Drop the whole block, a partial text line or binary record would only confuse the reader.
+    s_droppedByteCount += dataLen;
+  }
+  else
+  {
+    s_txBuffer.WriteElemArray( static_cast< const uint8_t * >( data ), dataLen );
+  }
+
+  return true;
+}
+
+
+size_t UsbDiagnosticPort_GetFreeTxCount ( void )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+  return s_txBuffer.GetFreeCount();
+}
+
+
+static void ServiceTx ( void )
+{
+  for ( ; ; )
+  {
+    uint32_t availableCount;
+    const uint8_t * readPtr;
+
+    {
+      CAutoDisableInterrupts autoDisableInterrupts;
+      readPtr = s_txBuffer.GetReadPtr( &availableCount );
+    }
+
+    if ( availableCount == 0 )
+      break;
+
+    // Never write more than the ASF CDC buffer can take, because udi_cdc_multi_write_buf()
+    // would then wait for the host to read the data.
+    const uint32_t freeCount = udi_cdc_multi_get_free_tx_buffer( USB_DIAGNOSTIC_PORT_NUMBER );
+
+    const uint32_t toWriteCount = MinFrom( availableCount, freeCount );
+
+    if ( toWriteCount == 0 )
+      break;
+
+    const uint32_t remainingCount = udi_cdc_multi_write_buf( USB_DIAGNOSTIC_PORT_NUMBER, readPtr, toWriteCount );
+    assert( remainingCount <= toWriteCount );
+
+    const uint32_t writtenCount = toWriteCount - remainingCount;
+
+    if ( writtenCount == 0 )
+      break;
+
+    // The producers never touch the data we have just read, so it is safe to copy it
+    // with interrupts enabled, but consuming it must be protected.
+    CAutoDisableInterrupts autoDisableInterrupts;
+    s_txBuffer.ConsumeReadElements( writtenCount );
+  }
+}
+
+
+// The console commands can print much more than the Tx Buffer holds, like the trace dump does,
+// so their output waits for the USB host to read the data. All other producers never wait,
+// see UsbDiagnosticPort_Write().
+
+static void WaitForTxRoom ( const size_t dataLen )
+{
+  STATIC_ASSERT( CMD_OUTPUT_TIMEOUT_MS < WATCHDOG_PERIOD_MS / 3, "The time-out is too close to the watchdog period." );
+
+  assert( dataLen <= USB_DIAG_TX_BUFFER_SIZE );
+
+  const uint64_t startTime = GetUptime();
+
+  for ( ; ; )
+  {
+    if ( UsbDiagnosticPort_GetFreeTxCount() >= dataLen )
+      return;
+
+    // If the host closes the port in the meantime, the data gets discarded anyway.
+    if ( !IsUsbDiagnosticPortOpen() )
+      return;
+
+    if ( HasUptimeElapsedMs( GetUptime(), startTime, CMD_OUTPUT_TIMEOUT_MS ) )
+      throw std::runtime_error( "The USB host is not reading the diagnostic port output fast enough." );
+
+    // This only does something once the USB driver has sent its buffer.
+    ServiceTx();
+  }
+}
+
+
+static void PrintV ( const bool waitForRoom, const char * const formatStr, va_list argList )
+{
+  char buffer[ MAX_SERIAL_PRINT_LEN + 1 ];
+
+  const int len = vsnprintf( buffer, sizeof( buffer ), formatStr, argList );
+
+  // The text could be truncated, but the commands should strive to avoid that.
+  assert( len <= MAX_SERIAL_PRINT_LEN );
+
+  const size_t dataLen = MinFrom( size_t( len ), size_t( MAX_SERIAL_PRINT_LEN ) );
+
+  if ( waitForRoom )
+    WaitForTxRoom( dataLen );
+
+  UsbDiagnosticPort_Write( buffer, dataLen );
+}
+
+
+static void Printf ( const char * const formatStr, ... ) __attribute__ ((format(printf, 1, 2)));
+
+static void Printf ( const char * const formatStr, ... )
+{
+  va_list argList;
+  va_start( argList, formatStr );
+
+  PrintV( false, formatStr, argList );
+
+  va_end( argList );
+}
+
+
+static void PrintStr ( const char * const str )
+{
+  UsbDiagnosticPort_Write( str, strlen( str ) );
+}
+
+
+class CUsbDiagnosticPortConsole : public CGenericSerialConsole
+{
+private:
+  virtual void Printf ( const char * formatStr, ... ) const __attribute__ ((format(printf, 2, 3)));
+};
+
+
+void CUsbDiagnosticPortConsole::Printf ( const char * const formatStr, ... ) const
+{
+  va_list argList;
+  va_start( argList, formatStr );
+
+  PrintV( false, formatStr, argList );
+
+  va_end( argList );
+}
+
+
+class CUsbDiagnosticPortCommandProcessor : public CCommandProcessor
+{
+private:
+  virtual void Printf ( const char * formatStr, ... ) __attribute__ ((format(printf, 2, 3)));
+  virtual void PrintStr ( const char * str );
+
+public:
+  CUsbDiagnosticPortCommandProcessor ( void )
+    : CCommandProcessor( NULL, NULL )
+  {
+  }
+};
+
+
+void CUsbDiagnosticPortCommandProcessor::Printf ( const char * const formatStr, ... )
+{
+  va_list argList;
+  va_start( argList, formatStr );
+
+  PrintV( true, formatStr, argList );
+
+  va_end( argList );
+}
+
+
+void CUsbDiagnosticPortCommandProcessor::PrintStr ( const char * const str )
+{
+  const size_t len = strlen( str );
+
+  WaitForTxRoom( len );
+  UsbDiagnosticPort_Write( str, len );
+}
+
+
+static CUsbDiagnosticPortConsole s_console;
+
+
+static bool RedirectSerialPrint ( const char * const data, const size_t dataLen )
+{
+  return UsbDiagnosticPort_Write( data, dataLen );
+}
+
+
+static void ServiceRx ( const uint64_t currentTime )
+{
+  // Process at most one command per main loop iteration, and stop early if this pass' work budget
+  // is spent, so that the JTAG channel gets its turn.
+
+  while ( udi_cdc_multi_is_rx_ready( USB_DIAGNOSTIC_PORT_NUMBER ) )
+  {
+    const uint8_t c = uint8_t( udi_cdc_multi_getc( USB_DIAGNOSTIC_PORT_NUMBER ) );
+
+    uint32_t cmdLen;
+    const char * const cmd = s_console.AddChar( c, &cmdLen );
+
+    if ( cmd != NULL )
+    {
+      PrintStr( EOL );
+
+      CUsbDiagnosticPortCommandProcessor cmdProcessor;
+
+      cmdProcessor.ProcessCommand( cmd, currentTime );
+
+      PrintStr( BUS_PIRATE_CONSOLE_PROMPT );
+      break;
+    }
+
+    if ( WorkBudget_IsSpent() )
+      break;
+  }
+}
+
+
+static void PrintLiveStats ( const uint64_t currentTime )
+{
+  if ( s_liveStatsPeriodMs == 0 ||
+       currentTime < s_lastLiveStatsTime + s_liveStatsPeriodMs )
+  {
+    return;
+  }
+
+  s_lastLiveStatsTime = currentTime;
+
+  const uint32_t commandCount = GetOpenOcdCommandCount();
+
+  UsbTxStats usbTxStats;
+  GetUsbTxStats( &usbTxStats );
+
+  // The counters may have been reset in the meantime, in which case the deltas are meaningless,
+  // but the next line will be right again.
+  Printf( "[Stats] OpenOCD commands: %u, USB transfers: %u, USB bytes: %u" EOL,
+          unsigned( commandCount             - s_lastStatsCommandCount        ),
+          unsigned( usbTxStats.transferCount - s_lastStatsUsbTx.transferCount ),
+          unsigned( usbTxStats.byteCount     - s_lastStatsUsbTx.byteCount     ) );
+
+  s_lastStatsCommandCount = commandCount;
+  s_lastStatsUsbTx        = usbTxStats;
+}
+
+
+static void ReportDroppedData ( void )
+{
+  uint32_t droppedByteCount;
+
+  {
+    CAutoDisableInterrupts autoDisableInterrupts;
+    droppedByteCount = s_droppedByteCount;
+    s_droppedByteCount = 0;
+  }
+
+  if ( droppedByteCount != 0 )
+    Printf( EOL "[%u bytes of diagnostic output lost]" EOL, unsigned( droppedByteCount ) );
+}
+
+
+static void HandleError ( const char * const errMsg )
+{
+  Printf( EOL "Error servicing the USB diagnostic port: %s" EOL, errMsg );
+}
+
+
+void ServiceUsbDiagnosticPort ( const uint64_t currentTime )
+{
+  const bool isOpen = IsUsbDiagnosticPortOpen();
+
+  if ( isOpen != s_isOpen )
+  {
+    {
+      CAutoDisableInterrupts autoDisableInterrupts;
+      s_txBuffer.Reset();
+      s_droppedByteCount = 0;
+      s_isOpen = isOpen;
+    }
+
+    #ifdef ENABLE_SESSION_CAPTURE
+      SessionCapture_SetStreaming( false );
+    #endif
+
+    if ( isOpen )
+    {
+      s_console.Reset();
+      s_liveStatsPeriodMs = 0;
+      PrintStr( "Welcome to the JtagDue diagnostic port." EOL BUS_PIRATE_CONSOLE_PROMPT );
+    }
+  }
+
+  if ( !isOpen )
+    return;
+
+  try
+  {
+    ServiceRx( currentTime );
+  }
+  catch ( const std::exception & e )
+  {
+    HandleError( e.what() );
+  }
+  catch ( ... )
+  {
+    HandleError( "Unexpected C++ exception." );
+  }
+
+  PrintLiveStats( currentTime );
+
+  #ifdef ENABLE_SESSION_CAPTURE
+    SessionCapture_ServiceStream();
+  #endif
+
+  ReportDroppedData();
+  ServiceTx();
+}
+
+
+void UsbDiagnosticPort_SetLiveStatsPeriod ( const uint32_t periodMs )
+{
+  s_liveStatsPeriodMs     = periodMs;
+  s_lastLiveStatsTime     = 0;
+  s_lastStatsCommandCount = GetOpenOcdCommandCount();
+  GetUsbTxStats( &s_lastStatsUsbTx );
+}
+
+
+void InitUsbDiagnosticPort ( void )
+{
+  SetSerialPrintRedirection( RedirectSerialPrint );
+}
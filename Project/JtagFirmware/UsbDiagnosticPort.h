@@ -0,0 +1,55 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef USB_DIAGNOSTIC_PORT_H_INCLUDED
+#define USB_DIAGNOSTIC_PORT_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The diagnostic port is the second virtual serial port on the composite USB device,
+// see ENABLE_USB_DIAGNOSTIC_PORT in configure.ac. It offers the same console as
+// the 'Programming' USB port, but at USB speed.
+//
+// While a host has the diagnostic port open, all SerialPrint output goes there instead of
+// to the UART, so that tracing does not have to wait for the slow serial port.
+// Note that this includes the output of the serial port console too.
+//
+// Writing to the diagnostic port never blocks. If the host does not read the data fast enough,
+// the data gets dropped, and the user gets a hint about how much data was lost.
+// This way, the diagnostic port never holds up the JTAG channel.
+// The only exception is the output of the console commands, which waits a limited time
+// for the host to read the data, because commands like the trace dump print much more
+// than the Tx Buffer can hold.
+
+void InitUsbDiagnosticPort ( void );
+
+void ServiceUsbDiagnosticPort ( uint64_t currentTime );
+
+// This routine can be called in interrupt context. The data can be text or binary.
+// Returns 'false' if the diagnostic port is not open.
+bool UsbDiagnosticPort_Write ( const void * data, size_t dataLen );
+
+// Producers that can wait, like the session capture stream, can check beforehand
+// whether their data would fit, so that it does not get dropped.
+size_t UsbDiagnosticPort_GetFreeTxCount ( void );
+
+// A period of 0 stops printing the live statistics.
+void UsbDiagnosticPort_SetLiveStatsPeriod ( uint32_t periodMs );
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,147 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "UsbRxRing.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+
+#include <interrupt.h>
+
+#include <BareMetalSupport/SpscCircularBuffer.h>
+#include <BareMetalSupport/Miscellaneous.h>
+
+#include <udi_cdc.h>
+
+
+// The ring adds to the 2 packet buffers inside the ASF CDC layer.
+#define USB_RX_RING_SIZE 1024
+
+typedef CSpscCircularBuffer< uint8_t, uint32_t, USB_RX_RING_SIZE > CUsbRxRing;
+
+static CUsbRxRing s_usbRxRing;
+
+static volatile bool s_isEnabled = false;
+
+// udi_cdc_read_buf() may restart the reception, which calls MyUsbCallback_cdc_rx_notify() again
+// from within FillRingFromCdc(). The nested call must not write to the ring, the outer loop
+// will collect any new data anyway.
+static bool s_isFilling = false;
+
+
+// Must be called with interrupts disabled, or from the USB interrupt handler.
+
+static void FillRingFromCdc ( void )
+{
+  if ( !s_isEnabled || s_isFilling )
+    return;
+
+  s_isFilling = true;
+
+  for ( ; ; )
+  {
+    uint32_t byteCountToWrite;
+    uint8_t * const writePtr = s_usbRxRing.GetWritePtr( &byteCountToWrite );
+
+    const uint32_t toReceiveCount = MinFrom( uint32_t( udi_cdc_get_nb_received_data() ), byteCountToWrite );
+
+    if ( toReceiveCount == 0 )
+      break;
+
+    const uint32_t remainingCount = udi_cdc_read_buf( writePtr, toReceiveCount );
+
+    assert( remainingCount <= toReceiveCount );
+
+    const uint32_t readCount = toReceiveCount - remainingCount;
+
+    if ( readCount == 0 )
+    {
+      assert( false );
+      break;
+    }
+
+    s_usbRxRing.CommitWrittenElements( readCount );
+  }
+
+  s_isFilling = false;
+}
+
+
+void UsbRxRing_NotifyDataReceived ( void )
+{
+  FillRingFromCdc();
+}
+
+
+void UsbRxRing_Enable ( void )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+
+  assert( !s_isEnabled );
+
+  s_usbRxRing.Reset();
+  s_isEnabled = true;
+
+  // The notification for any data already waiting in the ASF buffers may have come before.
+  FillRingFromCdc();
+}
+
+
+void UsbRxRing_Disable ( void )
+{
+  CAutoDisableInterrupts autoDisableInterrupts;
+
+  s_isEnabled = false;
+  s_usbRxRing.Reset();
+}
+
+
+bool UsbRxRing_ReceiveData ( CUsbRxBuffer * const rxBuffer )
+{
+  bool wasAtLeastOneByteTransferred = false;
+
+  // The second iteration collects any data that did not fit in the ring when the interrupt came.
+
+  for ( unsigned i = 0; i < 2; ++i )
+  {
+    for ( ; ; )
+    {
+      uint32_t availableCount;
+      const uint8_t * const readPtr = s_usbRxRing.GetReadPtr( &availableCount );
+
+      uint32_t freeCount;
+      uint8_t * const writePtr = rxBuffer->GetWritePtr( &freeCount );
+
+      const uint32_t count = MinFrom( availableCount, freeCount );
+
+      if ( count == 0 )
+        break;
+
+      memcpy( writePtr, readPtr, count );
+      rxBuffer->CommitWrittenElements( count );
+      s_usbRxRing.ConsumeReadElements( count );
+      wasAtLeastOneByteTransferred = true;
+    }
+
+    if ( i == 0 )
+    {
+      CAutoDisableInterrupts autoDisableInterrupts;
+      FillRingFromCdc();
+    }
+  }
+
+  return wasAtLeastOneByteTransferred;
+}
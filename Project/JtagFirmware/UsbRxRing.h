@@ -0,0 +1,42 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef USB_RX_RING_H_INCLUDED
+#define USB_RX_RING_H_INCLUDED
+
+#include "UsbBuffers.h"
+
+// Interrupt-driven USB reception. When the ASF CDC layer notifies that new data has arrived,
+// the interrupt handler moves it straight away into a lock-free ring, so that the ASF buffers
+// are free again and the host can keep sending while the main loop is busy with a long command,
+// like a big JTAG shift. The main loop then only moves the data from the ring to the Rx Buffer.
+//
+// The ring is only filled while it is enabled, that is, while a connection is established.
+// Both the interrupt handler and the main loop can fill the ring, but the main loop does it
+// with interrupts disabled, so that there is only one producer at a time.
+
+void UsbRxRing_Enable  ( void );
+void UsbRxRing_Disable ( void );
+
+// Called from MyUsbCallback_cdc_rx_notify() in interrupt context.
+void UsbRxRing_NotifyDataReceived ( void );
+
+// Main loop only. Returns whether at least one byte was moved to the Rx Buffer.
+bool UsbRxRing_ReceiveData ( CUsbRxBuffer * rxBuffer );
+
+
+#endif  // Include this header file only once.
@@ -23,6 +23,10 @@
 #include <udd.h>
 #include <udi_cdc.h>
 
+#ifdef ENABLE_USB_VENDOR_INTERFACE
+  #include <udi_vendor.h>
+#endif
+
 #include <BareMetalSupport/AssertionUtils.h>
 #include <BareMetalSupport/MainLoopSleep.h>
 #include <BareMetalSupport/SerialPrint.h>
@@ -30,6 +34,10 @@
 #include "my_usb_callbacks.h"
 
 #include "Globals.h"
+#include "UsbRxRing.h"
+#include "Profiler.h"
+#include "TraceRing.h"
+#include "UsbConnection.h"
 
 
 void InitUsb ( void )
@@ -37,7 +45,17 @@ void InitUsb ( void )
   udc_start();
 }
 
-static const bool TRACE_USB_CONNECTION_NOTIFICATIONS = false;
+
+uint32_t GetUsbDataPacketSize ( void )
+{
+  #ifdef ENABLE_USB_VENDOR_INTERFACE
+    STATIC_ASSERT( UDI_VENDOR_EPS_SIZE_BULK_HS == UDI_CDC_DATA_EPS_HS_SIZE &&
+                   UDI_VENDOR_EPS_SIZE_BULK_FS == UDI_CDC_DATA_EPS_FS_SIZE,
+                   "Both interfaces should have the same endpoint sizes." );
+  #endif
+
+  return udd_is_high_speed() ? UDI_CDC_DATA_EPS_HS_SIZE : UDI_CDC_DATA_EPS_FS_SIZE;
+}
 
 static const uint8_t USB_CALLBACK_PORT_NUMBER = 0;
 
@@ -46,14 +64,18 @@ static volatile bool s_isUsbCableConnected   = false;
 static volatile bool s_isCdcInterfaceEnabled = false;  // Note that this interface remains enabled even if the cable is pulled.
 static volatile bool s_isChannelOpen         = false;
 
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+  static volatile bool s_isDiagInterfaceEnabled = false;
+  static volatile bool s_isDiagChannelOpen      = false;
+#endif
+
 
 void MyUsbCallback_udc_resume ( void )
 {
   // Sometimes, when you connect the cable, you get a first resume/suspend notification pair,
   // and then a second, stable resume notification.
 
-  if ( TRACE_USB_CONNECTION_NOTIFICATIONS )
-    SerialPrintStr( "MyUsbCallback_udc_resume()" EOL );
+  TraceRing_Record( teUsbResume, 0, 0 );
 
   assert( !s_isUsbCableConnected );
   s_isUsbCableConnected = true;
@@ -62,8 +84,7 @@ void MyUsbCallback_udc_resume ( void )
 
 void MyUsbCallback_udc_suspend ( void )
 {
-  if ( TRACE_USB_CONNECTION_NOTIFICATIONS )
-    SerialPrintStr( "MyUsbCallback_udc_suspend()" EOL );
+  TraceRing_Record( teUsbSuspend, 0, 0 );
 
   // This routine is always called once at the beginning, therefore we cannot assert this here:
   //   ASSERT( s_isUsbCableConnected );
@@ -78,8 +99,16 @@ void MyUsbCallback_udc_suspend ( void )
 
 bool MyUsbCallback_cdc_enable ( const uint8_t port )
 {
-  if ( TRACE_USB_CONNECTION_NOTIFICATIONS )
-    SerialPrintStr( "MyUsbCallback_cdc_enable()" EOL );
+  TraceRing_Record( teCdcEnable, port, 0 );
+
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    if ( port == USB_DIAGNOSTIC_PORT_NUMBER )
+    {
+      assert( !s_isDiagInterfaceEnabled );
+      s_isDiagInterfaceEnabled = true;
+      return true;
+    }
+  #endif
 
   assert( port == USB_CALLBACK_PORT_NUMBER );
   UNUSED_IN_RELEASE( port );
@@ -94,8 +123,17 @@ bool MyUsbCallback_cdc_enable ( const uint8_t port )
 
 void MyUsbCallback_cdc_disable ( const uint8_t port )
 {
-  if ( TRACE_USB_CONNECTION_NOTIFICATIONS )
-    SerialPrintStr( "MyUsbCallback_cdc_disable()" EOL );
+  TraceRing_Record( teCdcDisable, port, 0 );
+
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    if ( port == USB_DIAGNOSTIC_PORT_NUMBER )
+    {
+      assert( s_isDiagInterfaceEnabled );
+      s_isDiagInterfaceEnabled = false;
+      WakeFromMainLoopSleep();
+      return;
+    }
+  #endif
 
   assert( port == USB_CALLBACK_PORT_NUMBER );
   UNUSED_IN_RELEASE( port );
@@ -110,11 +148,16 @@ void MyUsbCallback_cdc_disable ( const uint8_t port )
 
 void MyUsbCallback_cdc_set_dtr ( const uint8_t port, const bool enable )
 {
-  if ( TRACE_USB_CONNECTION_NOTIFICATIONS )
-  {
-    SerialPrintf( "MyUsbCallback_cdc_set_dtr( %s )" EOL,
-                  enable ? "enable" : "disable" );
-  }
+  TraceRing_Record( teCdcSetDtr, port, enable ? 1 : 0 );
+
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    if ( port == USB_DIAGNOSTIC_PORT_NUMBER )
+    {
+      s_isDiagChannelOpen = enable;
+      WakeFromMainLoopSleep();
+      return;
+    }
+  #endif
 
   assert( port == USB_CALLBACK_PORT_NUMBER );
   UNUSED_IN_RELEASE( port );
@@ -137,6 +180,8 @@ void MyUsbCallback_cdc_set_dtr ( const uint8_t port, const bool enable )
 
 void MyUsbCallback_cdc_rx_notify ( const uint8_t port )
 {
+  PROFILE_ZONE( pzUsbRxNotifyInterrupt );
+
   if ( false )
     SerialPrintStr( "MyUsbCallback_cdc_rx_notify()" EOL );
 
@@ -146,12 +191,22 @@ void MyUsbCallback_cdc_rx_notify ( const uint8_t port )
     SerialPrintf( "%u" EOL, unsigned( udi_cdc_get_nb_received_data() ) );
   }
 
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    if ( port == USB_DIAGNOSTIC_PORT_NUMBER )
+    {
+      WakeFromMainLoopSleep();
+      return;
+    }
+  #endif
+
   assert( port == USB_CALLBACK_PORT_NUMBER );
   UNUSED_IN_RELEASE( port );
 
   // This can trigger if the caller closes the connection quickly.
   //   ASSERT( IsUsbConnectionOpen() );
 
+  UsbRxRing_NotifyDataReceived();
+
   WakeFromMainLoopSleep();
 }
 
@@ -161,8 +216,14 @@ void MyUsbCallback_cdc_tx_empty_notify ( const uint8_t port )
   if ( false )
     SerialPrintStr( "MyUsbCallback_cdc_tx_empty_notify()" EOL );
 
-  assert( port == USB_CALLBACK_PORT_NUMBER );
-  UNUSED_IN_RELEASE( port );
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    assert( port == USB_CALLBACK_PORT_NUMBER || port == USB_DIAGNOSTIC_PORT_NUMBER );
+  #else
+    assert( port == USB_CALLBACK_PORT_NUMBER );
+  #endif
+
+  if ( port == USB_CALLBACK_PORT_NUMBER )
+    NoteUsbTxTransferComplete();
 
   // This can trigger if the caller closes the connection quickly.
   //   ASSERT( IsUsbConnectionOpen() );
@@ -176,7 +237,12 @@ void MyUsbCallback_cdc_set_coding ( const uint8_t port, usb_cdc_line_coding_t *
   if ( false )
     SerialPrintStr( "MyUsbCallback_cdc_set_coding()" EOL );
 
-  assert( port == USB_CALLBACK_PORT_NUMBER );
+  #ifdef ENABLE_USB_DIAGNOSTIC_PORT
+    assert( port == USB_CALLBACK_PORT_NUMBER || port == USB_DIAGNOSTIC_PORT_NUMBER );
+  #else
+    assert( port == USB_CALLBACK_PORT_NUMBER );
+  #endif
+
   UNUSED_IN_RELEASE( port );
 
   assert( s_isUsbCableConnected );
@@ -198,6 +264,69 @@ bool IsUsbConnectionOpen ( void )
 }
 
 
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+
+bool IsUsbDiagnosticPortOpen ( void )
+{
+  return s_isUsbCableConnected &&
+         s_isDiagInterfaceEnabled &&
+         s_isDiagChannelOpen;
+}
+
+#endif
+
+
+#ifdef ENABLE_USB_VENDOR_INTERFACE
+
+// The vendor interface has no DTR signal. Instead, the host opens the channel by selecting
+// alternate setting 1, and closes it by selecting alternate setting 0 again. Selecting
+// alternate setting 1 twice in a row yields a disable/enable pair of notifications,
+// which the main loop might miss, hence the session number.
+
+static volatile bool     s_isVendorInterfaceEnabled = false;
+static volatile uint32_t s_vendorSessionNumber      = 0;
+
+
+bool MyUsbCallback_vendor_enable ( void )
+{
+  TraceRing_Record( teVendorEnable, 0, 0 );
+
+  assert( !s_isVendorInterfaceEnabled );
+
+  ++s_vendorSessionNumber;
+  s_isVendorInterfaceEnabled = true;
+
+  WakeFromMainLoopSleep();
+
+  return true;  // Indicate success.
+}
+
+
+void MyUsbCallback_vendor_disable ( void )
+{
+  TraceRing_Record( teVendorDisable, 0, 0 );
+
+  assert( s_isVendorInterfaceEnabled );
+
+  s_isVendorInterfaceEnabled = false;
+
+  WakeFromMainLoopSleep();  // Notify the main loop if we loose the USB connection.
+}
+
+
+bool IsUsbVendorChannelOpen ( uint32_t * const sessionNumber )
+{
+  // Read the session number first, so that a disable/enable pair in between
+  // makes the caller see a different session number the next time around.
+  *sessionNumber = s_vendorSessionNumber;
+
+  return s_isUsbCableConnected &&
+         s_isVendorInterfaceEnabled;
+}
+
+#endif  // #ifdef ENABLE_USB_VENDOR_INTERFACE
+
+
 static void UsbWriteLoop ( const void * const buf, const size_t byteCount )
 {
   STATIC_ASSERT( sizeof( iram_size_t ) == sizeof( byteCount ), "Size mismatch." );
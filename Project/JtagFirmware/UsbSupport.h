@@ -19,11 +19,26 @@
 #define USB_SUPPORT_H_INCLUDED
 
 #include <stddef.h>
+#include <stdint.h>
 
 void InitUsb ( void );
 
+// The size of the data endpoints depends on the negotiated USB speed.
+uint32_t GetUsbDataPacketSize ( void );
+
 bool IsUsbConnectionOpen ( void );
 
+#ifdef ENABLE_USB_DIAGNOSTIC_PORT
+  // The second CDC port on the composite device, see UsbDiagnosticPort.h .
+  #define USB_DIAGNOSTIC_PORT_NUMBER 1
+
+  bool IsUsbDiagnosticPortOpen ( void );
+#endif
+
+#ifdef ENABLE_USB_VENDOR_INTERFACE
+  bool IsUsbVendorChannelOpen ( uint32_t * sessionNumber );
+#endif
+
 void UsbWriteData ( const void * data, size_t dataLen );
 void UsbWriteStr ( const char * str );
 
@@ -0,0 +1,229 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+#include "UsbZeroCopy.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+
+#include <BareMetalSupport/Miscellaneous.h>
+#include <BareMetalSupport/AssertionUtils.h>
+#include <BareMetalSupport/MainLoopSleep.h>
+
+#include <udd.h>
+#include <udi_vendor.h>
+
+#include "UsbSupport.h"
+#include "UsbConnection.h"
+
+
+static const udd_ep_id_t DATA_EP_IN  = UDI_VENDOR_EP_BULK_IN;
+static const udd_ep_id_t DATA_EP_OUT = UDI_VENDOR_EP_BULK_OUT;
+
+
+// The USB driver cannot receive a packet into a buffer smaller than the endpoint size.
+// If the contiguous free space at the end of the Rx Buffer is not enough, we receive
+// one packet into this bounce buffer and copy it afterwards. This is the only copy left.
+static uint8_t s_rxBounceBuffer[ UDI_VENDOR_EPS_SIZE_BULK_HS ];
+
+static volatile bool     s_isRxTransferInProgress = false;
+static volatile bool     s_isRxTransferComplete;
+static volatile uint32_t s_rxTransferredCount;
+static uint8_t *         s_rxTransferPtr;
+
+static volatile bool     s_isTxTransferInProgress = false;
+static volatile bool     s_isTxTransferComplete;
+static volatile uint32_t s_txTransferredCount;
+static const uint8_t *   s_txTransferPtr;
+
+
+// Called in interrupt context.
+
+static void RxTransferCallback ( const udd_ep_status_t status,
+                                 const iram_size_t transferredCount,
+                                 const udd_ep_id_t ep )
+{
+  assert( ep == DATA_EP_OUT );
+  UNUSED_IN_RELEASE( ep );
+
+  // On abort, the caller forgets about the transfer.
+  if ( status == UDD_EP_TRANSFER_ABORT )
+    return;
+
+  s_rxTransferredCount = ( status == UDD_EP_TRANSFER_OK ) ? transferredCount : 0;
+  s_isRxTransferComplete = true;
+
+  WakeFromMainLoopSleep();
+}
+
+
+// Called in interrupt context.
+
+static void TxTransferCallback ( const udd_ep_status_t status,
+                                 const iram_size_t transferredCount,
+                                 const udd_ep_id_t ep )
+{
+  assert( ep == DATA_EP_IN );
+  UNUSED_IN_RELEASE( ep );
+
+  if ( status == UDD_EP_TRANSFER_ABORT )
+    return;
+
+  s_txTransferredCount = ( status == UDD_EP_TRANSFER_OK ) ? transferredCount : 0;
+  s_isTxTransferComplete = true;
+
+  if ( s_txTransferredCount != 0 )
+    NoteUsbTxTransferComplete();
+
+  WakeFromMainLoopSleep();
+}
+
+
+void UsbZeroCopy_Start ( void )
+{
+  // Nobody else uses the vendor endpoints, so there is nothing to take over.
+  assert( !s_isRxTransferInProgress );
+  assert( !s_isTxTransferInProgress );
+}
+
+
+void UsbZeroCopy_Stop ( void )
+{
+  // Aborting calls the callbacks synchronously.
+  if ( s_isRxTransferInProgress )
+    udd_ep_abort( DATA_EP_OUT );
+
+  if ( s_isTxTransferInProgress )
+    udd_ep_abort( DATA_EP_IN );
+
+  s_isRxTransferInProgress = false;
+  s_isTxTransferInProgress = false;
+}
+
+
+static bool StartRxTransfer ( CUsbRxBuffer * const rxBuffer )
+{
+  STATIC_ASSERT( USB_RX_PACKET_MARGIN >= UDI_VENDOR_EPS_SIZE_BULK_HS, "See USB_RX_PACKET_MARGIN." );
+
+  const uint32_t packetSize = GetUsbDataPacketSize();
+
+  if ( rxBuffer->GetFreeCount() < packetSize )
+    return false;
+
+  uint32_t contiguousFreeCount;
+  uint8_t * const writePtr = rxBuffer->GetWritePtr( &contiguousFreeCount );
+
+  uint8_t * transferPtr;
+  uint32_t  transferSize;
+
+  if ( contiguousFreeCount >= packetSize )
+  {
+    transferPtr  = writePtr;
+    transferSize = contiguousFreeCount - contiguousFreeCount % packetSize;
+  }
+  else
+  {
+    transferPtr  = s_rxBounceBuffer;
+    transferSize = packetSize;
+  }
+
+  s_rxTransferPtr = transferPtr;
+  s_isRxTransferComplete = false;
+  s_isRxTransferInProgress = true;
+
+  // A short packet ends the transfer, so we get the data as soon as the host stops sending.
+  if ( !udd_ep_run( DATA_EP_OUT, true, transferPtr, transferSize, RxTransferCallback ) )
+  {
+    s_isRxTransferInProgress = false;
+    return false;
+  }
+
+  return true;
+}
+
+
+bool UsbZeroCopy_ReceiveData ( CUsbRxBuffer * const rxBuffer )
+{
+  bool wasAtLeastOneByteTransferred = false;
+
+  if ( s_isRxTransferInProgress && s_isRxTransferComplete )
+  {
+    const uint32_t count = s_rxTransferredCount;
+
+    uint32_t contiguousFreeCount;
+    uint8_t * const writePtr = rxBuffer->GetWritePtr( &contiguousFreeCount );
+
+    if ( s_rxTransferPtr == writePtr )
+    {
+      // This is the normal, zero-copy case.
+      assert( count <= contiguousFreeCount );
+      rxBuffer->CommitWrittenElements( count );
+    }
+    else
+    {
+      // Either the data landed in the bounce buffer, or somebody has reset the Rx Buffer
+      // in the meantime. The data is still valid, but it needs copying.
+      assert( count <= rxBuffer->GetFreeCount() );
+      rxBuffer->WriteElemArray( s_rxTransferPtr, count );
+    }
+
+    s_isRxTransferInProgress = false;
+    wasAtLeastOneByteTransferred = count > 0;
+  }
+
+  if ( !s_isRxTransferInProgress )
+    StartRxTransfer( rxBuffer );
+
+  return wasAtLeastOneByteTransferred;
+}
+
+
+bool UsbZeroCopy_SendData ( CUsbTxBuffer * const txBuffer )
+{
+  bool wasAtLeastOneByteTransferred = false;
+
+  if ( s_isTxTransferInProgress && s_isTxTransferComplete )
+  {
+    uint32_t availableCount;
+    const uint8_t * const readPtr = txBuffer->GetReadPtr( &availableCount );
+
+    // If somebody has reset the Tx Buffer in the meantime, the data sent is gone anyway.
+    if ( s_txTransferPtr == readPtr && s_txTransferredCount <= availableCount )
+      txBuffer->ConsumeReadElements( s_txTransferredCount );
+
+    s_isTxTransferInProgress = false;
+    wasAtLeastOneByteTransferred = s_txTransferredCount > 0;
+  }
+
+  if ( !s_isTxTransferInProgress )
+  {
+    uint32_t availableCount;
+    const uint8_t * const readPtr = txBuffer->GetReadPtr( &availableCount );
+
+    if ( availableCount != 0 )
+    {
+      s_txTransferPtr = readPtr;
+      s_isTxTransferComplete = false;
+      s_isTxTransferInProgress = true;
+
+      // If the endpoint is busy for some reason, we just try again later.
+      if ( !udd_ep_run( DATA_EP_IN, true, const_cast< uint8_t * >( readPtr ), availableCount, TxTransferCallback ) )
+        s_isTxTransferInProgress = false;
+    }
+  }
+
+  return wasAtLeastOneByteTransferred;
+}
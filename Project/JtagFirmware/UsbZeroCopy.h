@@ -0,0 +1,55 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+// Include this header file only once.
+#ifndef USB_ZERO_COPY_H_INCLUDED
+#define USB_ZERO_COPY_H_INCLUDED
+
+#include "UsbBuffers.h"
+
+// Data path for the optional vendor-specific interface, see --enable-usb-vendor-interface in configure.ac .
+// That interface has no ASF buffers of its own, so this module lets the USB driver transfer the data
+// straight into the free space of the Rx Buffer and out of the Tx Buffer.
+// The CDC interface always copies the data through the ASF CDC buffers.
+//
+// The USB driver invokes its completion callbacks in interrupt context, but all buffer updates
+// happen in the main loop, inside the ReceiveData and SendData routines below.
+//
+// More data can only be received if there is room for a whole USB packet in the Rx Buffer,
+// so commands must be at least 512 bytes shorter than the Rx Buffer. That is the case
+// for all commands OpenOCD sends.
+
+#ifdef ENABLE_USB_VENDOR_INTERFACE
+
+  void UsbZeroCopy_Start ( void );
+  void UsbZeroCopy_Stop  ( void );
+
+  bool UsbZeroCopy_ReceiveData ( CUsbRxBuffer * rxBuffer );
+  bool UsbZeroCopy_SendData    ( CUsbTxBuffer * txBuffer );
+
+#else
+
+  // Without the vendor interface, UsbConnection.cpp never calls these routines.
+  inline void UsbZeroCopy_Start ( void ) {}
+  inline void UsbZeroCopy_Stop  ( void ) {}
+
+  inline bool UsbZeroCopy_ReceiveData ( CUsbRxBuffer * ) { return false; }
+  inline bool UsbZeroCopy_SendData    ( CUsbTxBuffer * ) { return false; }
+
+#endif
+
+
+#endif  // Include this header file only once.
@@ -0,0 +1,145 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+#include "WorkBudget.h"  // The include file for this module should come first.
+
+#include <assert.h>
+#include <string.h>
+#include <stdexcept>
+
+#include <BareMetalSupport/DwtUtils.h>
+#include <BareMetalSupport/MainLoopSleep.h>
+#include <BareMetalSupport/Miscellaneous.h>
+
+
+// The budget is short enough to keep the serial console responsive while OpenOCD is busy,
+// and long enough to amortise the main loop overhead over many small JTAG commands.
+static const uint32_t DEFAULT_PASS_BUDGET_US = 2000;
+
+static uint32_t s_passBudgetCycleCount = DEFAULT_PASS_BUDGET_US * ( CPU_CLOCK / 1000000 );
+
+static uint32_t s_passStartCycleCount;
+static uint32_t s_serviceStartCycleCount;
+static WorkBudgetServiceEnum s_currentService = WORK_BUDGET_SERVICE_COUNT;
+static bool s_hasCurrentServiceSpentBudget;
+
+static uint32_t s_passCount = 0;
+static WorkBudgetServiceStats s_serviceStats[ WORK_BUDGET_SERVICE_COUNT ];
+
+
+void WorkBudget_BeginPass ( void )
+{
+  assert( s_currentService == WORK_BUDGET_SERVICE_COUNT );
+
+  s_passStartCycleCount = GetDwtCycleCount();
+  ++s_passCount;
+}
+
+
+void WorkBudget_BeginService ( const WorkBudgetServiceEnum service )
+{
+  assert( service < WORK_BUDGET_SERVICE_COUNT );
+  assert( s_currentService == WORK_BUDGET_SERVICE_COUNT );
+
+  s_currentService = service;
+  s_hasCurrentServiceSpentBudget = false;
+  s_serviceStartCycleCount = GetDwtCycleCount();
+}
+
+
+void WorkBudget_EndService ( void )
+{
+  assert( s_currentService < WORK_BUDGET_SERVICE_COUNT );
+
+  const uint32_t elapsedCycleCount = GetDwtElapsedCycleCount( s_serviceStartCycleCount );
+
+  WorkBudgetServiceStats * const stats = &s_serviceStats[ s_currentService ];
+
+  stats->totalCycleCount += elapsedCycleCount;
+  stats->maxCycleCount = MaxFrom( stats->maxCycleCount, elapsedCycleCount );
+  ++stats->passCount;
+
+  if ( s_hasCurrentServiceSpentBudget )
+    ++stats->spentCount;
+
+  s_currentService = WORK_BUDGET_SERVICE_COUNT;
+}
+
+
+bool WorkBudget_IsSpent ( void )
+{
+  if ( GetDwtElapsedCycleCount( s_passStartCycleCount ) < s_passBudgetCycleCount )
+    return false;
+
+  // Some work is probably still pending, so come back straight away.
+  WakeFromMainLoopSleep();
+
+  s_hasCurrentServiceSpentBudget = true;
+  return true;
+}
+
+
+void WorkBudget_SetPassBudgetUs ( const uint32_t budgetUs )
+{
+  if ( budgetUs == 0 || budgetUs > WORK_BUDGET_MAX_PASS_BUDGET_US )
+    throw std::runtime_error( "Invalid work budget." );
+
+  s_passBudgetCycleCount = budgetUs * ( CPU_CLOCK / 1000000 );
+}
+
+
+uint32_t WorkBudget_GetPassBudgetUs ( void )
+{
+  return DwtCycleCountToUs( s_passBudgetCycleCount );
+}
+
+
+const char * WorkBudget_GetServiceName ( const WorkBudgetServiceEnum service )
+{
+  switch ( service )
+  {
+  case wbsUsbConnection:     return "USB connection";
+  case wbsSerialPortConsole: return "Serial port console";
+  case wbsUsbDiagnosticPort: return "USB diagnostic port";
+
+  default:
+    assert( false );
+    return "<unknown>";
+  }
+}
+
+
+void WorkBudget_GetServiceStats ( const WorkBudgetServiceEnum service, WorkBudgetServiceStats * const stats )
+{
+  assert( service < WORK_BUDGET_SERVICE_COUNT );
+  *stats = s_serviceStats[ service ];
+}
+
+
+uint32_t WorkBudget_GetPassCount ( void )
+{
+  return s_passCount;
+}
+
+
+void WorkBudget_ResetStats ( void )
+{
+  // The console command that calls this routine runs inside a service, which will
+  // add its own time at the end, but that is harmless.
+  memset( s_serviceStats, 0, sizeof( s_serviceStats ) );
+  s_passCount = 0;
+}
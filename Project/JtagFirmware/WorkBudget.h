@@ -0,0 +1,71 @@
+
+// Copyright (C) 2014 R. Diez
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Affero GNU General Public License version 3
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Affero GNU General Public License version 3 for more details.
+//
+// You should have received a copy of the Affero GNU General Public License version 3
+// along with this program. If not, see http://www.gnu.org/licenses/ .
+
+
+
+// Include this header file only once.
+#ifndef WORK_BUDGET_H_INCLUDED
+#define WORK_BUDGET_H_INCLUDED
+
+#include <stdint.h>
+
+// Each main loop pass has a work budget measured in CPU cycles with the DWT cycle counter.
+// All services share the same budget: a service keeps processing data until the budget is spent,
+// and the services called later in the same pass only get the rest.
+//
+// A service always gets to do at least one unit of work (a command, a character) per pass,
+// even if the budget is already spent, so that no service can starve completely.
+// Keep the budget well below the watchdog period, because a single unit of work
+// can overrun it.
+
+enum WorkBudgetServiceEnum
+{
+  wbsUsbConnection = 0,
+  wbsSerialPortConsole,
+  wbsUsbDiagnosticPort,
+
+  WORK_BUDGET_SERVICE_COUNT
+};
+
+struct WorkBudgetServiceStats
+{
+  uint64_t totalCycleCount;
+  uint32_t maxCycleCount;   // The longest time spent in a single pass.
+  uint32_t passCount;
+  uint32_t spentCount;      // How many times the service stopped early because the budget was spent.
+};
+
+void WorkBudget_BeginPass ( void );
+
+void WorkBudget_BeginService ( WorkBudgetServiceEnum service );
+void WorkBudget_EndService ( void );
+
+// Call this routine after each unit of work. If it returns 'true', return to the main loop.
+// This routine then makes sure that the main loop does not go to sleep, so that
+// the pending work is resumed on the next pass.
+bool WorkBudget_IsSpent ( void );
+
+void WorkBudget_SetPassBudgetUs ( uint32_t budgetUs );
+uint32_t WorkBudget_GetPassBudgetUs ( void );
+
+#define WORK_BUDGET_MAX_PASS_BUDGET_US  100000
+
+const char * WorkBudget_GetServiceName ( WorkBudgetServiceEnum service );
+void WorkBudget_GetServiceStats ( WorkBudgetServiceEnum service, WorkBudgetServiceStats * stats );
+uint32_t WorkBudget_GetPassCount ( void );
+void WorkBudget_ResetStats ( void );
+
+
+#endif  // Include this header file only once.